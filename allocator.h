@@ -17,7 +17,7 @@ typedef void* (*Allocator)(void* alloc, int mode, int64_t new_size, void* old_pt
 
 typedef enum Allocator_Mode {
     ALLOCATOR_MODE_ALLOC = 0,
-    ALLOCATOR_MODE_GET_STATS = 0,
+    ALLOCATOR_MODE_GET_STATS = 1,
 } Allocator_Mode;
 
 typedef enum Allocator_Error_Type {
@@ -51,6 +51,7 @@ typedef struct Allocator_Stats {
 
     bool _[4];
     isize fixed_memory_pool_size;
+    isize bytes_committed;  //The number of bytes of physical memory currently committed (for allocators working with virtual memory). 0 if not tracked.
 
     //The number of bytes given out to the program by this allocator. (does NOT include book keeping bytes).
     //Might not be totally accurate but is required to be locally stable - if we allocate 100B and then deallocate 100B this should not change.
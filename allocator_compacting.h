@@ -0,0 +1,585 @@
+#ifndef MODULE_ALLOCATOR_COMPACTING
+#define MODULE_ALLOCATOR_COMPACTING
+
+// A compacting allocator which hands out handles instead of pointers. Because all accesses go through
+// the handle the allocator is free to move the data around. It uses this to get rid of fragmentation.
+//
+// Memory is obtained from the parent allocator in blocks (COMPACT_DEF_BLOCK_SIZE by default, bigger for
+// allocations that do not fit). Allocation simply bumps the end of the current block. Deallocation only
+// updates the bookkeeping and leaves a hole behind (unless it was the last allocation of the block in which
+// case the end is moved back). Holes are only ever reclaimed by compaction. This makes both operations
+// very cheap and the memory layout of live allocations is kept in allocation order.
+//
+// Compaction evacuates the most fragmented block - its live allocations are moved (in memory order) to the
+// end of other blocks after which it becomes empty and is reused or returned to the parent. The work is
+// done incrementally by compact_incremental which stops once the time budget is exceeded. Calling it once
+// per frame/tick with a small budget keeps the fragmentation bounded without any pauses.
+//
+// Handles are resolved to pointers through compact_get. These pointers are only valid until the next call to
+// compact_incremental/compact_all. If a pointer needs to stay valid for longer (for example while
+// some other thread reads the data or while it is stored inside a temporary structure) the handle
+// can be pinned by compact_pin. Pinned allocations are never moved. Blocks whose all live allocations are
+// pinned are skipped by compaction.
+//
+// Handles are 64 bit: the low 32 bits are the slot index + 1 and the high 32 bits the generation of
+// the slot. The generation is incremented on each deallocation thus stale handles are detected and
+// resolve to NULL. 0 is never a valid handle.
+//
+// Compacting_Allocator is single threaded.
+
+#include "allocator.h"
+#include "platform.h"
+#include <math.h>
+
+#ifdef MODULE_ALL_COUPLED
+    #include "defines.h"
+    #include "assert.h"
+#endif
+
+#define COMPACT_DEF_BLOCK_SIZE      (1024*1024)
+#define COMPACT_MAX_ALIGN           4096
+#define COMPACT_DEF_FRAGMENTATION   0.25 //Blocks with at least this fraction of their used memory in holes get compacted
+
+typedef uint64_t Compacted;
+
+typedef struct Compact_Block {
+    uint8_t* data;      //NULL if this block entry is not used
+    isize size;
+    isize used_to;      //end of the last allocation in this block
+    isize live_bytes;
+    isize padding_bytes; //alignment padding before the live allocations. Not counted as fragmentation.
+    isize live_count;
+    isize pinned_count;
+
+    uint32_t slot_first; //slots of allocations in memory order. 1 based, 0 means none
+    uint32_t slot_last;
+} Compact_Block;
+
+typedef struct Compacted_Slot {
+    uint8_t* data;      //NULL if the slot is free
+    isize size;
+    uint32_t block;
+    uint32_t gen;
+    uint32_t next;      //next in memory order within the block or next free slot. 1 based, 0 means none
+    uint32_t prev;
+    uint32_t pin_count;
+    uint32_t align;
+    uint32_t padding;   //alignment padding before data at the time it was placed
+    uint32_t _;
+} Compacted_Slot;
+
+typedef struct Compact_Stats {
+    isize block_count;
+    isize bytes_reserved;   //total size of all blocks
+    isize bytes_used;       //sum of the used parts of all blocks
+    isize bytes_live;       //sum of the sizes of all live allocations
+    isize bytes_padding;    //alignment padding in front of live allocations
+    isize bytes_holes;      //memory within the used parts left behind by deallocations. This is what compaction reclaims.
+    isize bytes_tail_free;  //memory after the used parts of blocks. This is where new allocations go.
+    isize largest_tail_free;//the biggest allocation that fits without obtaining a new block
+    isize live_count;
+    isize pinned_count;
+    double fragmentation;   //bytes_holes/bytes_used
+
+    isize bytes_moved;      //bytes moved by compaction so far
+    isize moved_count;
+    isize evacuated_count;  //number of blocks fully processed by compaction
+} Compact_Stats;
+
+typedef struct Compacting_Allocator {
+    Allocator* parent;
+    const char* name;
+    isize block_size;
+    double fragmentation_threshold;
+
+    Compacted_Slot* slots;
+    uint32_t slot_count;
+    uint32_t slot_capacity;
+    uint32_t slot_first_free; //1 based
+    uint32_t block_current;
+
+    Compact_Block* blocks;
+    uint32_t block_count;   //number of used entries in blocks. Some might be released (data == NULL).
+    uint32_t block_capacity;
+    uint32_t block_evacuating; //block being currently compacted. 1 based, 0 means none.
+    uint32_t _;
+
+    isize bytes_live;
+    isize live_count;
+    isize bytes_moved;
+    isize moved_count;
+    isize evacuated_count;
+} Compacting_Allocator;
+
+EXTERNAL void compact_init(Compacting_Allocator* self, Allocator* parent_or_null, isize block_size_or_zero, const char* name);
+//Frees all blocks. All handles become invalid.
+EXTERNAL void compact_deinit(Compacting_Allocator* self);
+
+//Allocates size bytes aligned to align (at most COMPACT_MAX_ALIGN). Returns 0 if size is 0.
+EXTERNAL Compacted compact_alloc(Compacting_Allocator* self, isize size, isize align);
+//Deallocates the handle. Stale handles and 0 are ignored. The allocation must not be pinned.
+EXTERNAL void compact_dealloc(Compacting_Allocator* self, Compacted handle);
+
+//Returns the current pointer to the data of the handle or NULL if the handle is stale or 0.
+// The pointer is valid until the next compaction unless the handle is pinned.
+EXTERNAL void* compact_get(const Compacting_Allocator* self, Compacted handle);
+//Returns the size of the allocation or 0 if the handle is stale or 0.
+EXTERNAL isize compact_size(const Compacting_Allocator* self, Compacted handle);
+//Prevents the allocation from being moved until the matching compact_unpin. Pins nest. Returns the pointer to the data.
+EXTERNAL void* compact_pin(Compacting_Allocator* self, Compacted handle);
+EXTERNAL void compact_unpin(Compacting_Allocator* self, Compacted handle);
+
+//Compacts the most fragmented blocks until the time budget is exceeded or nothing is left to compact.
+// Always moves at least one allocation if there is something to compact. Returns the number of bytes moved.
+EXTERNAL isize compact_incremental(Compacting_Allocator* self, double max_seconds);
+//Compacts all blocks above the fragmentation threshold. Returns the number of bytes moved.
+EXTERNAL isize compact_all(Compacting_Allocator* self);
+
+EXTERNAL Compact_Stats compact_get_stats(const Compacting_Allocator* self);
+EXTERNAL void compact_test_consistency(const Compacting_Allocator* self);
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_ALLOCATOR_COMPACTING)) && !defined(MODULE_HAS_IMPL_ALLOCATOR_COMPACTING)
+#define MODULE_HAS_IMPL_ALLOCATOR_COMPACTING
+
+#ifndef INTERNAL
+    #define INTERNAL inline static
+#endif
+
+#define _COMPACT_NONE ((uint32_t) -1)
+
+INTERNAL Compacted _compact_pack(uint32_t slot_i, uint32_t gen)
+{
+    return (Compacted) (slot_i + 1) | (Compacted) gen << 32;
+}
+
+INTERNAL Compacted_Slot* _compact_find_slot(const Compacting_Allocator* self, Compacted handle)
+{
+    uint32_t id = (uint32_t) handle;
+    uint32_t gen = (uint32_t) (handle >> 32);
+    if(0 < id && id <= self->slot_count)
+    {
+        Compacted_Slot* slot = &self->slots[id - 1];
+        if(slot->gen == gen && slot->data != NULL)
+            return slot;
+    }
+    return NULL;
+}
+
+EXTERNAL void compact_init(Compacting_Allocator* self, Allocator* parent_or_null, isize block_size_or_zero, const char* name)
+{
+    compact_deinit(self);
+    self->parent = parent_or_null ? parent_or_null : allocator_get_default();
+    self->name = name;
+    self->block_size = block_size_or_zero > 0 ? block_size_or_zero : COMPACT_DEF_BLOCK_SIZE;
+    self->fragmentation_threshold = COMPACT_DEF_FRAGMENTATION;
+    self->block_current = _COMPACT_NONE;
+}
+
+EXTERNAL void compact_deinit(Compacting_Allocator* self)
+{
+    if(self->parent)
+    {
+        for(uint32_t i = 0; i < self->block_count; i++)
+            if(self->blocks[i].data)
+                allocator_deallocate(self->parent, self->blocks[i].data, self->blocks[i].size, COMPACT_MAX_ALIGN);
+
+        allocator_deallocate(self->parent, self->blocks, self->block_capacity*(isize) sizeof(Compact_Block), __alignof(Compact_Block));
+        allocator_deallocate(self->parent, self->slots, self->slot_capacity*(isize) sizeof(Compacted_Slot), __alignof(Compacted_Slot));
+    }
+    memset(self, 0, sizeof *self);
+}
+
+INTERNAL isize _compact_block_tail_offset(const Compact_Block* block, isize size, isize align)
+{
+    isize offset = (uint8_t*) align_forward(block->data + block->used_to, align) - block->data;
+    return offset + size <= block->size ? offset : -1;
+}
+
+INTERNAL double _compact_block_fragmentation(const Compact_Block* block)
+{
+    if(block->used_to == 0)
+        return 0;
+    return 1.0 - (double) (block->live_bytes + block->padding_bytes)/(double) block->used_to;
+}
+
+//Only appends to blocks which are not candidates for evacuation. Appending only lowers fragmentation so the
+// set of fragmented blocks shrinks with every evacuation and compaction cannot bounce allocations between them.
+INTERNAL bool _compact_block_accepts(const Compacting_Allocator* self, uint32_t block_i, isize size, isize align)
+{
+    const Compact_Block* block = &self->blocks[block_i];
+    return block->data != NULL
+        && block_i != self->block_evacuating - 1
+        && _compact_block_fragmentation(block) < self->fragmentation_threshold
+        && _compact_block_tail_offset(block, size, align) != -1;
+}
+
+//Finds a block with enough space at its end. Never returns the block being evacuated.
+INTERNAL uint32_t _compact_find_block(Compacting_Allocator* self, isize size, isize align)
+{
+    if(self->block_current != _COMPACT_NONE && _compact_block_accepts(self, self->block_current, size, align))
+        return self->block_current;
+
+    uint32_t free_entry = _COMPACT_NONE;
+    for(uint32_t i = 0; i < self->block_count; i++)
+    {
+        if(self->blocks[i].data == NULL)
+            free_entry = i;
+        else if(_compact_block_accepts(self, i, size, align))
+            return self->block_current = i;
+    }
+
+    if(free_entry == _COMPACT_NONE)
+    {
+        if(self->block_count >= self->block_capacity)
+        {
+            uint32_t new_capacity = self->block_capacity*2 + 8;
+            self->blocks = (Compact_Block*) allocator_reallocate(self->parent, new_capacity*(isize) sizeof(Compact_Block),
+                self->blocks, self->block_capacity*(isize) sizeof(Compact_Block), __alignof(Compact_Block));
+            self->block_capacity = new_capacity;
+        }
+        free_entry = self->block_count++;
+    }
+
+    Compact_Block* block = &self->blocks[free_entry];
+    memset(block, 0, sizeof *block);
+    block->size = MAX(self->block_size, size);
+    block->data = (uint8_t*) allocator_allocate(self->parent, block->size, COMPACT_MAX_ALIGN);
+    return self->block_current = free_entry;
+}
+
+//Places the slot at the end of the block
+INTERNAL void _compact_link(Compacting_Allocator* self, uint32_t slot_i, uint32_t block_i)
+{
+    Compacted_Slot* slot = &self->slots[slot_i];
+    Compact_Block* block = &self->blocks[block_i];
+    isize offset = _compact_block_tail_offset(block, slot->size, slot->align);
+    ASSERT(offset != -1);
+
+    slot->data = block->data + offset;
+    slot->padding = (uint32_t) (offset - block->used_to);
+    slot->block = block_i;
+    slot->next = 0;
+    slot->prev = block->slot_last;
+    if(block->slot_last)
+        self->slots[block->slot_last - 1].next = slot_i + 1;
+    else
+        block->slot_first = slot_i + 1;
+    block->slot_last = slot_i + 1;
+
+    block->used_to = offset + slot->size;
+    block->live_bytes += slot->size;
+    block->padding_bytes += slot->padding;
+    block->live_count += 1;
+    block->pinned_count += slot->pin_count > 0;
+}
+
+//Removes the slot from its block. Releases the block if it became empty and there already is an empty block.
+INTERNAL void _compact_unlink(Compacting_Allocator* self, uint32_t slot_i)
+{
+    Compacted_Slot* slot = &self->slots[slot_i];
+    Compact_Block* block = &self->blocks[slot->block];
+    if(slot->next)
+        self->slots[slot->next - 1].prev = slot->prev;
+    else
+        block->slot_last = slot->prev;
+
+    if(slot->prev)
+        self->slots[slot->prev - 1].next = slot->next;
+    else
+        block->slot_first = slot->next;
+
+    //if was last move used_to back
+    if(block->slot_last == 0)
+        block->used_to = 0;
+    else if(slot->next == 0)
+    {
+        Compacted_Slot* last = &self->slots[block->slot_last - 1];
+        block->used_to = last->data + last->size - block->data;
+    }
+
+    ASSERT(block->live_count >= 1 && block->live_bytes >= slot->size);
+    block->live_bytes -= slot->size;
+    block->padding_bytes -= slot->padding;
+    block->live_count -= 1;
+    block->pinned_count -= slot->pin_count > 0;
+
+    //A block emptied by evacuation is where the slots of the next evacuated block would go, so one empty
+    // block is kept to let compaction proceed without going to the parent. Any further empty blocks and
+    // oversized blocks (made for a single big allocation) are returned.
+    if(block->live_count == 0)
+    {
+        uint32_t block_i = slot->block;
+        bool has_other_empty = false;
+        for(uint32_t i = 0; i < self->block_count; i++)
+            if(i != block_i && self->blocks[i].data && self->blocks[i].live_count == 0)
+                has_other_empty = true;
+
+        if(has_other_empty || block->size > self->block_size)
+        {
+            allocator_deallocate(self->parent, block->data, block->size, COMPACT_MAX_ALIGN);
+            memset(block, 0, sizeof *block);
+            if(self->block_current == block_i)
+                self->block_current = _COMPACT_NONE;
+        }
+    }
+}
+
+EXTERNAL Compacted compact_alloc(Compacting_Allocator* self, isize size, isize align)
+{
+    REQUIRE(size >= 0 && is_power_of_two(align) && align <= COMPACT_MAX_ALIGN);
+    if(size == 0)
+        return 0;
+
+    //grab a free slot
+    if(self->slot_first_free == 0)
+    {
+        if(self->slot_count >= self->slot_capacity)
+        {
+            uint32_t new_capacity = self->slot_capacity ? self->slot_capacity*2 : 64;
+            self->slots = (Compacted_Slot*) allocator_reallocate(self->parent, new_capacity*(isize) sizeof(Compacted_Slot),
+                self->slots, self->slot_capacity*(isize) sizeof(Compacted_Slot), __alignof(Compacted_Slot));
+            memset(self->slots + self->slot_capacity, 0, (new_capacity - self->slot_capacity)*sizeof(Compacted_Slot));
+            self->slot_capacity = new_capacity;
+        }
+        self->slots[self->slot_count].gen = 1;
+        self->slot_first_free = ++self->slot_count;
+        self->slots[self->slot_first_free - 1].next = 0;
+    }
+
+    uint32_t slot_i = self->slot_first_free - 1;
+    Compacted_Slot* slot = &self->slots[slot_i];
+    self->slot_first_free = slot->next;
+    slot->size = size;
+    slot->align = (uint32_t) align;
+    slot->pin_count = 0;
+
+    uint32_t block_i = _compact_find_block(self, size, align);
+    _compact_link(self, slot_i, block_i);
+
+    self->bytes_live += size;
+    self->live_count += 1;
+    return _compact_pack(slot_i, slot->gen);
+}
+
+EXTERNAL void compact_dealloc(Compacting_Allocator* self, Compacted handle)
+{
+    Compacted_Slot* slot = _compact_find_slot(self, handle);
+    if(slot == NULL)
+        return;
+
+    ASSERT(slot->pin_count == 0, "deallocating pinned allocation");
+    uint32_t slot_i = (uint32_t) (slot - self->slots);
+    _compact_unlink(self, slot_i);
+
+    self->bytes_live -= slot->size;
+    self->live_count -= 1;
+
+    slot->data = NULL;
+    slot->size = 0;
+    slot->pin_count = 0;
+    slot->gen += 1;
+    slot->next = self->slot_first_free;
+    slot->prev = 0;
+    self->slot_first_free = slot_i + 1;
+}
+
+EXTERNAL void* compact_get(const Compacting_Allocator* self, Compacted handle)
+{
+    Compacted_Slot* slot = _compact_find_slot(self, handle);
+    return slot ? slot->data : NULL;
+}
+
+EXTERNAL isize compact_size(const Compacting_Allocator* self, Compacted handle)
+{
+    Compacted_Slot* slot = _compact_find_slot(self, handle);
+    return slot ? slot->size : 0;
+}
+
+EXTERNAL void* compact_pin(Compacting_Allocator* self, Compacted handle)
+{
+    Compacted_Slot* slot = _compact_find_slot(self, handle);
+    if(slot == NULL)
+        return NULL;
+
+    if(slot->pin_count++ == 0)
+        self->blocks[slot->block].pinned_count += 1;
+    return slot->data;
+}
+
+EXTERNAL void compact_unpin(Compacting_Allocator* self, Compacted handle)
+{
+    Compacted_Slot* slot = _compact_find_slot(self, handle);
+    if(slot == NULL)
+        return;
+
+    ASSERT(slot->pin_count > 0, "unpinning allocation which is not pinned");
+    if(--slot->pin_count == 0)
+        self->blocks[slot->block].pinned_count -= 1;
+}
+
+//Returns the most fragmented block above the threshold which has something to move or _COMPACT_NONE
+INTERNAL uint32_t _compact_pick_block(const Compacting_Allocator* self)
+{
+    uint32_t best = _COMPACT_NONE;
+    double best_fragmentation = 0;
+    for(uint32_t i = 0; i < self->block_count; i++)
+    {
+        const Compact_Block* block = &self->blocks[i];
+        if(block->data == NULL || block->used_to == 0 || block->live_count == block->pinned_count)
+            continue;
+
+        double fragmentation = _compact_block_fragmentation(block);
+        if(fragmentation >= self->fragmentation_threshold && fragmentation > best_fragmentation)
+        {
+            best = i;
+            best_fragmentation = fragmentation;
+        }
+    }
+    return best;
+}
+
+EXTERNAL isize compact_incremental(Compacting_Allocator* self, double max_seconds)
+{
+    int64_t start = platform_perf_counter();
+    double budget = max_seconds*(double) platform_perf_counter_frequency();
+    isize moved = 0;
+    for(;;)
+    {
+        if(self->block_evacuating == 0)
+        {
+            uint32_t picked = _compact_pick_block(self);
+            if(picked == _COMPACT_NONE)
+                break;
+            self->block_evacuating = picked + 1;
+        }
+
+        //Find the first allocation we can move. The ones before it are pinned.
+        uint32_t evacuating = self->block_evacuating - 1;
+        uint32_t slot_id = self->blocks[evacuating].slot_first;
+        while(slot_id && self->slots[slot_id - 1].pin_count > 0)
+            slot_id = self->slots[slot_id - 1].next;
+
+        if(slot_id == 0)
+        {
+            self->block_evacuating = 0;
+            self->evacuated_count += 1;
+            continue;
+        }
+
+        //Move it to the end of some other block. Copy first since unlinking might release the evacuated block.
+        uint32_t slot_i = slot_id - 1;
+        isize size = self->slots[slot_i].size;
+        isize align = self->slots[slot_i].align;
+        uint32_t block_i = _compact_find_block(self, size, align);
+        Compact_Block* block = &self->blocks[block_i];
+        memcpy(block->data + _compact_block_tail_offset(block, size, align), self->slots[slot_i].data, (size_t) size);
+        _compact_unlink(self, slot_i);
+        _compact_link(self, slot_i, block_i);
+
+        if(self->blocks[evacuating].data == NULL)
+        {
+            self->block_evacuating = 0;
+            self->evacuated_count += 1;
+        }
+
+        moved += size;
+        self->bytes_moved += size;
+        self->moved_count += 1;
+        if((double) (platform_perf_counter() - start) >= budget)
+            break;
+    }
+
+    return moved;
+}
+
+EXTERNAL isize compact_all(Compacting_Allocator* self)
+{
+    return compact_incremental(self, INFINITY);
+}
+
+EXTERNAL Compact_Stats compact_get_stats(const Compacting_Allocator* self)
+{
+    Compact_Stats stats = {0};
+    for(uint32_t i = 0; i < self->block_count; i++)
+    {
+        const Compact_Block* block = &self->blocks[i];
+        if(block->data == NULL)
+            continue;
+
+        stats.block_count += 1;
+        stats.bytes_reserved += block->size;
+        stats.bytes_used += block->used_to;
+        stats.bytes_live += block->live_bytes;
+        stats.bytes_padding += block->padding_bytes;
+        stats.pinned_count += block->pinned_count;
+        stats.largest_tail_free = MAX(stats.largest_tail_free, block->size - block->used_to);
+    }
+
+    stats.bytes_holes = stats.bytes_used - stats.bytes_live - stats.bytes_padding;
+    stats.bytes_tail_free = stats.bytes_reserved - stats.bytes_used;
+    stats.live_count = self->live_count;
+    stats.fragmentation = stats.bytes_used > 0 ? (double) stats.bytes_holes/(double) stats.bytes_used : 0;
+    stats.bytes_moved = self->bytes_moved;
+    stats.moved_count = self->moved_count;
+    stats.evacuated_count = self->evacuated_count;
+    return stats;
+}
+
+EXTERNAL void compact_test_consistency(const Compacting_Allocator* self)
+{
+    TEST(self->slot_count <= self->slot_capacity);
+    TEST(self->block_count <= self->block_capacity);
+    TEST(self->block_evacuating <= self->block_count);
+
+    isize total_bytes = 0;
+    isize total_count = 0;
+    for(uint32_t i = 0; i < self->block_count; i++)
+    {
+        const Compact_Block* block = &self->blocks[i];
+        if(block->data == NULL)
+        {
+            TEST(block->slot_first == 0 && block->slot_last == 0 && block->live_count == 0);
+            continue;
+        }
+
+        isize bytes = 0;
+        isize padding = 0;
+        isize count = 0;
+        isize pinned = 0;
+        const uint8_t* prev_end = block->data;
+        uint32_t prev = 0;
+        for(uint32_t id = block->slot_first; id; id = self->slots[id - 1].next)
+        {
+            const Compacted_Slot* slot = &self->slots[id - 1];
+            TEST(slot->block == i && slot->prev == prev);
+            TEST(slot->data >= prev_end && slot->data + slot->size <= block->data + block->size);
+            TEST((uintptr_t) slot->data % slot->align == 0);
+            prev_end = slot->data + slot->size;
+            prev = id;
+
+            bytes += slot->size;
+            padding += slot->padding;
+            count += 1;
+            pinned += slot->pin_count > 0;
+        }
+
+        TEST(block->slot_last == prev);
+        TEST(block->used_to == prev_end - block->data);
+        TEST(block->live_bytes == bytes && block->padding_bytes == padding);
+        TEST(block->live_count == count && block->pinned_count == pinned);
+        total_bytes += bytes;
+        total_count += count;
+    }
+
+    TEST(total_bytes == self->bytes_live && total_count == self->live_count);
+
+    isize free_count = 0;
+    for(uint32_t id = self->slot_first_free; id; id = self->slots[id - 1].next)
+    {
+        TEST(self->slots[id - 1].data == NULL);
+        free_count += 1;
+    }
+    TEST(free_count + total_count == self->slot_count);
+}
+#endif
@@ -26,6 +26,21 @@
 //  +-----------------------------------------------+       L 8 aligned              L aligned to user specified align
 //
 // (*) Dead zones might be larger then specified by options to account for overaligned allocations.
+//
+// Dead zones are only checked on deallocation or on explicit/continual checks. To catch overruns at the faulting
+// instruction the allocator can also place allocations against a guard page (electric fence style). Such allocation
+// gets its own virtual memory region from platform_virtual_reallocate with the user data ending right before an
+// inaccessible page:
+//
+//  +------------------------------------------------------------------------------+
+//  | unused | call stack | dead zone | USER DATA | dead (< align) | GUARD PAGE     |
+//  +------------------------------------------------------------------------------+
+//  L page aligned                                                 L page aligned, no access
+//
+// On deallocation the region is decommitted (made inaccessible) and kept in a quarantine ring of
+// guard_quarantine_count entries before being released, so use after free faults as well.
+// Since each guarded allocation costs at least two pages, guard_page_sample_rate can be used to guard
+// only roughly every N-th allocation which keeps the overhead acceptable under load.
 
 #include "platform.h"
 #include "assert.h"
@@ -46,15 +61,21 @@ typedef struct Debug_Allocation {
     uint16_t pre_dead_zone;
     uint16_t post_dead_zone;
     uint16_t call_stack_count;
+    uint32_t flags;             //DEBUG_ALLOCATION_GUARDED
+    uint32_t guarded_pages;     //number of committed pages in front of the guard page. 0 if not guarded
     uint64_t time;
     uint64_t id;
 } Debug_Allocation;
 
+#define DEBUG_ALLOCATION_GUARDED 1 //the allocation was placed against a guard page
+
 typedef struct Debug_Allocator_Options {
     const char* name;                 //Optional name of this allocator for printing and debugging. 
     isize pre_dead_zone_size;         //size in bytes of overwrite prevention dead zone. 
     isize post_dead_zone_size;        //size in bytes of overwrite prevention dead zone. 
     isize capture_stack_frames_count; //number of stack frames to capture on each allocation. 
+    isize guard_page_sample_rate;     //0 disables guard pages. Otherwise roughly every N-th allocation is placed against a guard page.
+    isize guard_quarantine_count;     //number of freed guarded allocations kept inaccessible to catch use after free. Fixed at init.
     bool do_printing;                 //prints all allocations/deallocation
     bool do_continual_checks;         //continually checks all allocations for overwrites
     bool do_deinit_leak_check;        //If the memory use on initialization and deinitialization does not match panics.
@@ -62,10 +83,15 @@ typedef struct Debug_Allocator_Options {
     bool _[4];
 } Debug_Allocator_Options;
 
+typedef struct Debug_Guarded_Region {
+    void* address;
+    isize size;
+} Debug_Guarded_Region;
+
 //roughly one page big
 typedef struct Debug_Allocation_Block {
     struct Debug_Allocation_Block* next;
-    Debug_Allocation allocations[72];
+    Debug_Allocation allocations[63];
 } Debug_Allocation_Block;
 
 typedef struct Debug_Allocator {
@@ -88,8 +114,14 @@ typedef struct Debug_Allocator {
     isize deallocation_count;
     isize reallocation_count;
 
+    isize guarded_count;            //number of allocations ever placed against a guard page
+
     uint64_t last_id;
     Allocator_Set allocator_backup;
+
+    Debug_Guarded_Region* quarantine; //ring of freed guarded regions
+    isize quarantine_capacity;
+    isize quarantine_pushed;
 } Debug_Allocator;
 
 #define DEBUG_ALLOC_LARGE_DEAD_ZONE     1  // dead_zone_size = 64 
@@ -99,6 +131,7 @@ typedef struct Debug_Allocator {
 #define DEBUG_ALLOC_CONTINUOUS          16 // do_continual_checks = true 
 #define DEBUG_ALLOC_PRINT               32 // do_printing = true 
 #define DEBUG_ALLOC_USE                 64 // do_set_as_default = true
+#define DEBUG_ALLOC_GUARD_PAGES         128 // guard_page_sample_rate = 1, guard_quarantine_count = 256
 
 //TODO: thread local list of debug allocators!
 
@@ -117,6 +150,12 @@ EXTERNAL void debug_allocator_test_consistency(const Debug_Allocator* self);
 EXTERNAL void debug_allocator_print_alive_allocations(const char* name, Log_Type log_type, const Debug_Allocator* allocator, isize print_max, uint32_t flags);
 
 EXTERNAL void* debug_allocator_func(void* self, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest);
+
+//Fills/tests the dead zones around [user_ptr, user_ptr + size) the same way Debug_Allocator does. 
+//Lets other allocators add overwrite checks to their own block layout. pre_dead_zone_size must be a multiple of 8 
+// and user_ptr - pre_dead_zone_size 8 aligned. Panics with a view of the overwritten bytes on failure.
+EXTERNAL void debug_dead_zones_fill(void* user_ptr, isize size, isize pre_dead_zone_size, isize post_dead_zone_size);
+EXTERNAL void debug_dead_zones_test(const char* name_or_null, void* user_ptr, isize size, isize pre_dead_zone_size, isize post_dead_zone_size);
 #endif
 
 #if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_DEBUG_ALLOCATOR)) && !defined(MODULE_HAS_IMPL_DEBUG_ALLOCATOR)
@@ -136,9 +175,11 @@ INTERNAL Debug_Allocation* _debug_allocator_find_allocation(const Debug_Allocato
 INTERNAL void _debug_allocator_insert_allocation(Debug_Allocator* debug, Debug_Allocation* allocation);
 INTERNAL void _debug_allocator_remove_allocation(Debug_Allocator* self, Debug_Allocation* allocation);
 INTERNAL void _debug_allocator_deallocate_allocation(Debug_Allocator* self, Debug_Allocation* allocation);
+INTERNAL void _debug_allocator_release_quarantine(Debug_Allocator* self);
+INTERNAL uint64_t _debug_alloc_ptr_hash(void* ptr);
 INTERNAL void _debug_allocator_check_consistency(const Debug_Allocator* self);
-INTERNAL void _debug_allocator_panic(const Debug_Allocator* self, void* user_ptr, const Debug_Allocation* allocation, isize dist, const char* panic_reason);
-INTERNAL void _debug_allocation_test_dead_zones(const Debug_Allocator* self, const Debug_Allocation* allocation);
+INTERNAL void _debug_allocator_panic(const char* name, void* user_ptr, const Debug_Allocation* allocation, isize dist, const char* panic_reason);
+INTERNAL void _debug_allocation_test_dead_zones(const char* name, const Debug_Allocation* allocation);
 INTERNAL Debug_Allocation* _debug_allocation_get_closest(const Debug_Allocator* self, void* ptr, isize* dist_or_null);
 
 EXTERNAL void debug_allocator_init(Debug_Allocator* self, Allocator* parent, Allocator* internal, Debug_Allocator_Options options)
@@ -156,6 +197,10 @@ EXTERNAL void debug_allocator_init(Debug_Allocator* self, Allocator* parent, All
     self->allocation_hash = ALLOCATE(self->internal_alloc, _DEBUG_ALLOC_HASH_SIZE, Debug_Allocation*);
     memset(self->allocation_hash, 0, sizeof(Debug_Allocation*)*_DEBUG_ALLOC_HASH_SIZE);
 
+    self->quarantine_capacity = MAX(options.guard_quarantine_count, 0);
+    if(self->quarantine_capacity > 0)
+        self->quarantine = ALLOCATE(self->internal_alloc, self->quarantine_capacity, Debug_Guarded_Region);
+
     if(options.do_set_as_default)
         self->allocator_backup = allocator_set_default(self->alloc);
         
@@ -178,7 +223,7 @@ EXTERNAL void debug_allocator_deinit(Debug_Allocator* self)
             for(Debug_Allocation* curr = self->allocation_hash[i]; curr; ) {
                 ASSERT(curr->size != -1);
                 Debug_Allocation* next = curr->next;
-                _debug_allocation_test_dead_zones(self, curr);
+                _debug_allocation_test_dead_zones(self->options.name, curr);
                 _debug_allocator_deallocate_allocation(self, curr);
                 curr = next;
             }
@@ -187,6 +232,11 @@ EXTERNAL void debug_allocator_deinit(Debug_Allocator* self)
         DEALLOCATE(self->internal_alloc, self->allocation_hash, _DEBUG_ALLOC_HASH_SIZE, Debug_Allocation*);
     }
 
+    if(self->quarantine) {
+        _debug_allocator_release_quarantine(self);
+        DEALLOCATE(self->internal_alloc, self->quarantine, self->quarantine_capacity, Debug_Guarded_Region);
+    }
+
     for(Debug_Allocation_Block* curr = self->allocation_blocks; curr; ) {
         Debug_Allocation_Block* next = curr->next;
         DEALLOCATE(self->internal_alloc, curr, 1, Debug_Allocation_Block);
@@ -221,6 +271,10 @@ EXTERNAL Debug_Allocator debug_allocator_make(Allocator* parent, uint64_t flags)
     }
     if(flags & DEBUG_ALLOC_CAPTURE_CALLSTACK)
         options.capture_stack_frames_count = 16;
+    if(flags & DEBUG_ALLOC_GUARD_PAGES) {
+        options.guard_page_sample_rate = 1;
+        options.guard_quarantine_count = 256;
+    }
     
     Debug_Allocator allocator = {0};
     debug_allocator_init(&allocator, parent, parent, options);
@@ -259,21 +313,21 @@ EXTERNAL void* debug_allocator_func(void* self_void, int mode, isize new_size, v
 
                 isize closest_dist = 0;
                 Debug_Allocation* closest = _debug_allocation_get_closest(self, old_ptr, &closest_dist);
-                _debug_allocator_panic(self, old_ptr, closest, closest_dist, "invalid pointer");
+                _debug_allocator_panic(self->options.name, old_ptr, closest, closest_dist, "invalid pointer");
             }
 
             if(old_alloc->size != old_size) {
                 LOG_FATAL("DEBUG", "debug allocator%s%s size does not match for allocation 0x%016llx: given:%lli actual:%lli", 
                     name ? "name: " : "", name, (llu) old_ptr, (lli) old_size, (lli) old_alloc->size);
-                _debug_allocator_panic(self, old_ptr, old_alloc, 0, "invalid size parameter");
+                _debug_allocator_panic(self->options.name, old_ptr, old_alloc, 0, "invalid size parameter");
             }
                 
             if(old_alloc->align != align) {
                 LOG_FATAL("DEBUG", "debug allocator%s%s align does not match for allocation 0x%016llx: given:%lli actual:%lli", 
                     name ? "name: " : "", name, (llu) old_ptr, (lli) align, (lli) old_alloc->align);
-                _debug_allocator_panic(self, old_ptr, old_alloc, 0, "invalid align parameter");
+                _debug_allocator_panic(self->options.name, old_ptr, old_alloc, 0, "invalid align parameter");
             }
-            _debug_allocation_test_dead_zones(self, old_alloc);
+            _debug_allocation_test_dead_zones(self->options.name, old_alloc);
         }
         else
         {
@@ -289,36 +343,81 @@ EXTERNAL void* debug_allocator_func(void* self_void, int mode, isize new_size, v
         uint8_t* out_ptr = NULL;
         if(new_size > 0)
         {
-            isize preamble_size = self->options.pre_dead_zone_size + self->options.capture_stack_frames_count*sizeof(void*);
-            isize postamble_size = self->options.post_dead_zone_size;
-            isize new_total_size = preamble_size + postamble_size + align + new_size;
-            uint8_t* new_block_ptr = (uint8_t*) allocator_try_reallocate(self->parent_alloc, new_total_size, NULL, 0, DEF_ALIGN, (Allocator_Error*) rest);
-            if(new_block_ptr == NULL)
+            uint8_t* new_block_ptr = NULL;
+            uint8_t* new_block_end = NULL;
+            void**   callstack = NULL;
+            uint8_t* pre_dead_zone = NULL;
+            uint8_t* post_dead_zone = NULL;
+            isize guarded_pages = 0;
+            
+            isize sample_rate = self->options.guard_page_sample_rate;
+            bool is_guarded = sample_rate > 0 && _debug_alloc_ptr_hash((void*) self->last_id) % (uint64_t) sample_rate == 0;
+            if(is_guarded)
             {
-                PROFILE_STOP();
-                return NULL;
+                //Reserve the whole region (inaccessible) then commit everything except the last page
+                isize page_size = platform_page_size();
+                isize preamble_size = self->options.pre_dead_zone_size + self->options.capture_stack_frames_count*sizeof(void*) + sizeof(uint64_t);
+                isize data_size = DIV_CEIL(preamble_size + align + new_size, page_size)*page_size;
+                void* region = NULL;
+                Platform_Error error = platform_virtual_reallocate(&region, NULL, data_size + page_size, PLATFORM_VIRTUAL_ALLOC_RESERVE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+                if(error == 0)
+                    error = platform_virtual_reallocate(NULL, region, data_size, PLATFORM_VIRTUAL_ALLOC_COMMIT, PLATFORM_MEMORY_PROT_READ_WRITE);
+                if(error != 0)
+                {
+                    if(region)
+                        platform_virtual_reallocate(NULL, region, data_size + page_size, PLATFORM_VIRTUAL_ALLOC_RELEASE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+                    allocator_error((Allocator_Error*) rest, ALLOCATOR_ERROR_OUT_OF_MEM, self->alloc, new_size, old_ptr, old_size, align, 
+                        "failed to map guarded allocation of %lli bytes (error %lli)", (lli) data_size, (lli) error);
+                    PROFILE_STOP();
+                    return NULL;
+                }
+
+                //Place the data so that it ends as close to the guard page as the alignment allows
+                new_block_end = (uint8_t*) region + data_size;
+                out_ptr = (uint8_t*) align_backward(new_block_end - new_size, align);
+                pre_dead_zone = (uint8_t*) align_backward(out_ptr - self->options.pre_dead_zone_size, sizeof(uint64_t));
+                callstack = (void**) (void*) pre_dead_zone - self->options.capture_stack_frames_count;
+                post_dead_zone = out_ptr + new_size;
+                new_block_ptr = (uint8_t*) (void*) callstack;
+                guarded_pages = data_size/page_size;
+                self->guarded_count += 1;
             }
+            else
+            {
+                isize preamble_size = self->options.pre_dead_zone_size + self->options.capture_stack_frames_count*sizeof(void*);
+                isize postamble_size = self->options.post_dead_zone_size;
+                isize new_total_size = preamble_size + postamble_size + align + new_size;
+                new_block_ptr = (uint8_t*) allocator_try_reallocate(self->parent_alloc, new_total_size, NULL, 0, DEF_ALIGN, (Allocator_Error*) rest);
+                if(new_block_ptr == NULL)
+                {
+                    PROFILE_STOP();
+                    return NULL;
+                }
 
-            out_ptr = (uint8_t*) align_forward(new_block_ptr + preamble_size, align);
-            void**   callstack = (void**) (void*) new_block_ptr;
-            uint8_t* pre_dead_zone = (uint8_t*) (void*) (callstack + self->options.capture_stack_frames_count); 
-            uint8_t* post_dead_zone = out_ptr + new_size;
+                new_block_end = new_block_ptr + new_total_size;
+                out_ptr = (uint8_t*) align_forward(new_block_ptr + preamble_size, align);
+                callstack = (void**) (void*) new_block_ptr;
+                pre_dead_zone = (uint8_t*) (void*) (callstack + self->options.capture_stack_frames_count); 
+                post_dead_zone = out_ptr + new_size;
+            }
              
             new_alloc = _debug_allocator_get_new_allocation(self);
+            new_alloc->flags = is_guarded ? DEBUG_ALLOCATION_GUARDED : 0;
+            new_alloc->guarded_pages = (uint32_t) guarded_pages;
             new_alloc->ptr = out_ptr;
             new_alloc->align = (uint16_t) align;
             new_alloc->size = new_size;
             new_alloc->call_stack_count = (uint16_t) self->options.capture_stack_frames_count;
             new_alloc->id = self->last_id++;
             new_alloc->pre_dead_zone = (uint16_t) (out_ptr - pre_dead_zone);
-            new_alloc->post_dead_zone = (uint16_t) (new_block_ptr + new_total_size - post_dead_zone);
+            new_alloc->post_dead_zone = (uint16_t) (new_block_end - post_dead_zone);
             new_alloc->time = platform_epoch_time();
 
             if(new_alloc->call_stack_count > 0)
                 platform_capture_call_stack(callstack, new_alloc->call_stack_count, 1);
 
             ASSERT(new_block_ptr <= pre_dead_zone && pre_dead_zone + new_alloc->pre_dead_zone <= out_ptr);
-            ASSERT(out_ptr + new_size <= post_dead_zone && post_dead_zone + new_alloc->post_dead_zone <= new_block_ptr + new_total_size);
+            ASSERT(out_ptr + new_size <= post_dead_zone && post_dead_zone + new_alloc->post_dead_zone <= new_block_end);
 
             isize min_size = new_size < old_size ? new_size : old_size;
             memset(pre_dead_zone,  _DEBUG_ALLOCATOR_MAGIC_NUM8, (size_t) new_alloc->pre_dead_zone);
@@ -481,11 +580,45 @@ INTERNAL void _debug_allocator_deallocate_allocation(Debug_Allocator* self, Debu
 {
     void* block = debug_allocation_get_callstack(allocation);
     isize total_size = sizeof(void*)*allocation->call_stack_count + allocation->pre_dead_zone + allocation->size + allocation->post_dead_zone;
-    allocator_deallocate(self->parent_alloc, block, total_size, DEF_ALIGN);
+    if(allocation->flags & DEBUG_ALLOCATION_GUARDED)
+    {
+        //The region spans from its start up to and including the guard page. The start is not necessarily
+        // the page containing the call stack as alignment slack can push the block into later pages.
+        isize page_size = platform_page_size();
+        uint8_t* guard_page = (uint8_t*) block + total_size;
+        Debug_Guarded_Region region = {0};
+        region.address = guard_page - (isize) allocation->guarded_pages*page_size;
+        region.size = ((isize) allocation->guarded_pages + 1)*page_size;
+        ASSERT((uintptr_t) guard_page % (uintptr_t) page_size == 0);
+        ASSERT((uint8_t*) region.address <= (uint8_t*) block);
+
+        //Make the whole region inaccessible. It stays reserved while in quarantine so nothing else gets placed there.
+        if(self->quarantine_capacity > 0)
+        {
+            platform_virtual_reallocate(NULL, region.address, region.size - page_size, PLATFORM_VIRTUAL_ALLOC_DECOMMIT, PLATFORM_MEMORY_PROT_NO_ACCESS);
+            Debug_Guarded_Region* slot = &self->quarantine[self->quarantine_pushed % self->quarantine_capacity];
+            if(self->quarantine_pushed >= self->quarantine_capacity)
+                platform_virtual_reallocate(NULL, slot->address, slot->size, PLATFORM_VIRTUAL_ALLOC_RELEASE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+            *slot = region;
+            self->quarantine_pushed += 1;
+        }
+        else
+            platform_virtual_reallocate(NULL, region.address, region.size, PLATFORM_VIRTUAL_ALLOC_RELEASE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+    }
+    else
+        allocator_deallocate(self->parent_alloc, block, total_size, DEF_ALIGN);
+}
+
+INTERNAL void _debug_allocator_release_quarantine(Debug_Allocator* self)
+{
+    isize count = MIN(self->quarantine_pushed, self->quarantine_capacity);
+    for(isize i = 0; i < count; i++)
+        platform_virtual_reallocate(NULL, self->quarantine[i].address, self->quarantine[i].size, PLATFORM_VIRTUAL_ALLOC_RELEASE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+    self->quarantine_pushed = 0;
 }
 
 #include <time.h>
-INTERNAL void _debug_allocator_panic(const Debug_Allocator* self, void* user_ptr, const Debug_Allocation* allocation, isize dist, const char* panic_reason)
+INTERNAL void _debug_allocator_panic(const char* name, void* user_ptr, const Debug_Allocation* allocation, isize dist, const char* panic_reason)
 {
     if(allocation) {
         if(dist == 0)
@@ -506,10 +639,10 @@ INTERNAL void _debug_allocator_panic(const Debug_Allocator* self, void* user_ptr
         }
     }
 
-    PANIC("debug allocator%s%s reported failure '%s'", self->options.name ? "name: " : "", self->options.name, panic_reason);
+    PANIC("debug allocator%s%s reported failure '%s'", name ? "name: " : "", name, panic_reason);
 }
 
-INTERNAL void _debug_allocation_test_dead_zones(const Debug_Allocator* self, const Debug_Allocation* allocation)
+INTERNAL void _debug_allocation_test_dead_zones(const char* name, const Debug_Allocation* allocation)
 {
     uint8_t* pre_dead_zone = (uint8_t*) allocation->ptr - allocation->pre_dead_zone;
     uint8_t* post_dead_zone = (uint8_t*) allocation->ptr + allocation->size;
@@ -593,7 +726,6 @@ INTERNAL void _debug_allocation_test_dead_zones(const Debug_Allocator* self, con
             ASSERT(wh < text_cap && wa < text_cap);
         
             //print out the 
-            const char* name = self->options.name;
             if(zone_i) {
                 LOG_FATAL("DEBUG", "debug allocator%s%s found write %lliB before the beginning of allocation 0x%016llx. Printing view of dead zone:", 
                     name ? "name: " : "", name, (lli) (zone_size - override_pos), (llu) allocation->ptr);
@@ -609,11 +741,29 @@ INTERNAL void _debug_allocation_test_dead_zones(const Debug_Allocator* self, con
             free(text_hex);
             free(text_ascii);
             
-            _debug_allocator_panic(self, allocation->ptr, allocation, 0, zone_i ? "overwrite before block" : "overwrite after block");
+            _debug_allocator_panic(name, allocation->ptr, allocation, 0, zone_i ? "overwrite before block" : "overwrite after block");
         }
     }
 }
 
+EXTERNAL void debug_dead_zones_fill(void* user_ptr, isize size, isize pre_dead_zone_size, isize post_dead_zone_size)
+{
+    memset((uint8_t*) user_ptr - pre_dead_zone_size, _DEBUG_ALLOCATOR_MAGIC_NUM8, (size_t) pre_dead_zone_size);
+    memset((uint8_t*) user_ptr + size, _DEBUG_ALLOCATOR_MAGIC_NUM8, (size_t) post_dead_zone_size);
+}
+
+EXTERNAL void debug_dead_zones_test(const char* name_or_null, void* user_ptr, isize size, isize pre_dead_zone_size, isize post_dead_zone_size)
+{
+    Debug_Allocation allocation = {0};
+    allocation.ptr = user_ptr;
+    allocation.size = size;
+    allocation.align = 1;
+    allocation.pre_dead_zone = (uint16_t) pre_dead_zone_size;
+    allocation.post_dead_zone = (uint16_t) post_dead_zone_size;
+    ASSERT(allocation.pre_dead_zone == pre_dead_zone_size && allocation.post_dead_zone == post_dead_zone_size);
+    _debug_allocation_test_dead_zones(name_or_null, &allocation);
+}
+
 INTERNAL Debug_Allocation* _debug_allocation_get_closest(const Debug_Allocator* self, void* ptr, isize* dist_or_null)
 {
     Debug_Allocation* closest = NULL;
@@ -648,7 +798,7 @@ EXTERNAL void debug_allocator_test_all_allocations(const Allocator* self_alloc)
     if(self->allocation_hash)
         for(isize i = 0; i < _DEBUG_ALLOC_HASH_SIZE; i++) {
             for(Debug_Allocation* curr = self->allocation_hash[i]; curr; curr = curr->next) {
-                _debug_allocation_test_dead_zones(self, curr);
+                _debug_allocation_test_dead_zones(self->options.name, curr);
                 size_sum += curr->size;
             }
         }
@@ -688,7 +838,7 @@ EXTERNAL void debug_allocator_test_allocation(const Allocator* self_alloc, void*
     const Debug_Allocator* self = (const Debug_Allocator*) (void*) self_alloc;
     const Debug_Allocation* found = debug_allocator_get_allocation(self, user_ptr);
     TEST(found != NULL);
-    _debug_allocation_test_dead_zones(self, found);
+    _debug_allocation_test_dead_zones(self->options.name, found);
 }
 
 INTERNAL int _debug_allocation_alloc_id_compare(const void* a_, const void* b_)
@@ -0,0 +1,536 @@
+#ifndef MODULE_ALLOCATOR_POOL
+#define MODULE_ALLOCATOR_POOL
+
+// A thread safe pool of fixed size items built on magazines.
+// See [Bonwick, Adams "Magazines and Vmem: Extending the Slab Allocator to Many CPUs and Arbitrary Resources"].
+//
+// A magazine is a small stack of up to POOL_MAGAZINE_SIZE free items. Each thread has a Pool_Cache
+// holding two magazines - the loaded one and the previous one. pool_get pops from the loaded magazine
+// and pool_put pushes into it, without any synchronization. When the loaded magazine is empty (on get)
+// or full (on put) the two are swapped. Only when both are empty/full the thread goes to the depot.
+// The depot is a pair of lock free stacks, one of full and one of empty magazines. A thread exchanges
+// a whole magazine with the depot at once so in the steady state each thread touches shared state
+// at most once per POOL_MAGAZINE_SIZE operations, no matter how the items travel between threads.
+//
+// Magazines live in one reserved virtual address range and are referred to by their index.
+// This lets us pack the index together with a modification counter into a single 64 bit word
+// which is then updated by a compare exchange. That makes the depot stacks immune to the ABA problem.
+//
+// New items are carved from POOL_CHUNK_SIZE chunks obtained from platform_virtual_reallocate
+// under a mutex. Chunks are only given back on pool_deinit.
+//
+// When initialized with POOL_DEBUG each item is surrounded by dead zones (see allocator_debug.h)
+// checked on every pool_put. While in the pool the whole item is filled with the dead zone pattern
+// which is checked on pool_get, so writes after pool_put are also detected.
+//
+// Threads are bound to their cache through Sync_Thread_Slots like in allocator_tlsf_mt.h. A thread which
+// will no longer use the pool should call pool_thread_detach so that its items return to the depot.
+
+#include "defines.h"
+#include "assert.h"
+#include "platform.h"
+#include "allocator.h"
+#include "allocator_debug.h"
+#include "sync.h"
+
+#define POOL_MAGAZINE_SIZE      64
+#define POOL_MAX_MAGAZINES      (1 << 20)
+#define POOL_CHUNK_SIZE         (1024*1024)
+#define POOL_DEAD_ZONE_SIZE     16
+
+#define POOL_DEBUG              1 //Adds dead zones around every item and checks for writes after put
+
+typedef struct Pool_Magazine {
+    CHAN_ATOMIC(uint32_t) next; //index + 1 of the next magazine in a depot stack. 0 if none
+    uint32_t count;
+    void* items[POOL_MAGAZINE_SIZE];
+} Pool_Magazine;
+
+typedef struct Pool_Cache {
+    uint32_t loaded;   //index of the loaded magazine
+    uint32_t previous; //index of the previous magazine
+    struct Pool_Cache* next; //protected by Pool.lock
+    bool is_detached;  //protected by Pool.lock
+
+    //Only written by the owning thread
+    CHAN_ATOMIC(isize) get_count;
+    CHAN_ATOMIC(isize) put_count;
+} Pool_Cache;
+
+typedef struct Pool {
+    Allocator alloc[1];
+    const char* name;
+    uint64_t flags;
+    uint64_t id;
+    isize item_size;
+    isize item_align;
+    isize slot_size;        //item_size including dead zones and alignment padding
+    isize pre_dead_zone;    //0 if not POOL_DEBUG
+
+    //Tagged stack heads: (modification count << 32) | (magazine index + 1)
+    ATTRIBUTE_ALIGNED(64) CHAN_ATOMIC(uint64_t) depot_full;
+    ATTRIBUTE_ALIGNED(64) CHAN_ATOMIC(uint64_t) depot_empty;
+
+    //Everything below is protected by lock
+    ATTRIBUTE_ALIGNED(64) Mutex lock;
+    Pool_Magazine* magazines;
+    uint32_t magazine_count;
+    uint32_t magazine_committed;
+    uint8_t* chunk_pos;
+    uint8_t* chunk_end;
+    void* chunks;           //linked list through the first word of each chunk
+    isize chunk_count;
+    isize chunk_bytes;
+    isize item_count;       //total number of items carved
+    void* overflow;         //items put when no magazine could be obtained. Linked through their first word.
+    Pool_Cache* caches;
+} Pool;
+
+//Initializes a pool of items of the given size and align. Flags can be POOL_DEBUG. Returns false if could not reserve memory.
+EXTERNAL bool pool_init(Pool* pool, isize item_size, isize item_align, const char* name_or_null, uint64_t flags);
+//Releases all memory. No thread can be using the pool at this point.
+EXTERNAL void pool_deinit(Pool* pool);
+//Returns a single item or NULL if out of memory.
+EXTERNAL void* pool_get(Pool* pool);
+//Returns item obtained through pool_get back to the pool. Item may be put from a different thread than it was gotten from.
+EXTERNAL void  pool_put(Pool* pool, void* item);
+//Returns the cached items of the calling thread to the depot and releases its cache so that other threads can adopt it.
+EXTERNAL void  pool_thread_detach(Pool* pool);
+
+//Serves allocations of at most item_size bytes aligned to at most item_align. Others fail with ALLOCATOR_ERROR_INVALID_PARAMS.
+EXTERNAL void* pool_allocator_func(void* self, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest);
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_ALLOCATOR_POOL)) && !defined(MODULE_HAS_IMPL_ALLOCATOR_POOL)
+#define MODULE_HAS_IMPL_ALLOCATOR_POOL
+
+static ATTRIBUTE_THREAD_LOCAL Sync_Thread_Slots _pool_slots;
+
+#define _POOL_NO_MAGAZINE 0xFFFFFFFF
+
+INTERNAL Pool_Magazine* _pool_magazine(Pool* pool, uint32_t index)
+{
+    ASSERT(index < POOL_MAX_MAGAZINES);
+    return &pool->magazines[index];
+}
+
+INTERNAL void _pool_depot_push(Pool* pool, CHAN_ATOMIC(uint64_t)* head, uint32_t index)
+{
+    Pool_Magazine* magazine = _pool_magazine(pool, index);
+    uint64_t old_head = atomic_load_explicit(head, memory_order_relaxed);
+    for(;;)
+    {
+        atomic_store_explicit(&magazine->next, (uint32_t) old_head, memory_order_relaxed);
+        uint64_t new_head = (((old_head >> 32) + 1) << 32) | (index + 1);
+        if(atomic_compare_exchange_weak_explicit(head, &old_head, new_head, memory_order_release, memory_order_relaxed))
+            break;
+    }
+}
+
+INTERNAL uint32_t _pool_depot_pop(Pool* pool, CHAN_ATOMIC(uint64_t)* head)
+{
+    uint64_t old_head = atomic_load_explicit(head, memory_order_acquire);
+    for(;;)
+    {
+        uint32_t top = (uint32_t) old_head;
+        if(top == 0)
+            return _POOL_NO_MAGAZINE;
+
+        //The magazine might get popped and pushed elsewhere in the meantime making next stale.
+        // The modification count in the head then makes the exchange fail. Magazines are never
+        // unmapped so reading next is always safe.
+        uint32_t next = atomic_load_explicit(&_pool_magazine(pool, top - 1)->next, memory_order_relaxed);
+        uint64_t new_head = (((old_head >> 32) + 1) << 32) | next;
+        if(atomic_compare_exchange_weak_explicit(head, &old_head, new_head, memory_order_acquire, memory_order_acquire))
+            return top - 1;
+    }
+}
+
+//Needs to hold the lock
+INTERNAL uint32_t _pool_new_magazine_locked(Pool* pool)
+{
+    if(pool->magazine_count >= pool->magazine_committed)
+    {
+        isize commit = 64*1024;
+        uint32_t add = (uint32_t) (commit/sizeof(Pool_Magazine));
+        if(pool->magazine_committed + add > POOL_MAX_MAGAZINES)
+            return _POOL_NO_MAGAZINE;
+
+        //Commit whole pages covering the new magazines
+        uint8_t* from = (uint8_t*) (pool->magazines + pool->magazine_committed);
+        uint8_t* to = (uint8_t*) (pool->magazines + pool->magazine_committed + add);
+        isize page = platform_page_size();
+        from = (uint8_t*) ((uintptr_t) from / (uintptr_t) page * (uintptr_t) page);
+        if(platform_virtual_reallocate(NULL, from, to - from, PLATFORM_VIRTUAL_ALLOC_COMMIT, PLATFORM_MEMORY_PROT_READ_WRITE) != 0)
+            return _POOL_NO_MAGAZINE;
+        pool->magazine_committed += add;
+    }
+
+    uint32_t index = pool->magazine_count++;
+    Pool_Magazine* magazine = _pool_magazine(pool, index);
+    magazine->count = 0;
+    atomic_store_explicit(&magazine->next, 0, memory_order_relaxed);
+    return index;
+}
+
+INTERNAL uint32_t _pool_get_empty_magazine(Pool* pool)
+{
+    uint32_t index = _pool_depot_pop(pool, &pool->depot_empty);
+    if(index == _POOL_NO_MAGAZINE)
+    {
+        mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+        index = _pool_new_magazine_locked(pool);
+        mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+    }
+    return index;
+}
+
+//Carves `size` bytes aligned to `align` from the current chunk. Needs to hold the lock.
+INTERNAL void* _pool_carve_locked(Pool* pool, isize size, isize align)
+{
+    uint8_t* ptr = (uint8_t*) align_forward(pool->chunk_pos, align);
+    if(pool->chunk_pos == NULL || ptr + size > pool->chunk_end)
+    {
+        isize page = platform_page_size();
+        isize chunk_size = MAX(POOL_CHUNK_SIZE, DIV_CEIL(pool->slot_size*POOL_MAGAZINE_SIZE + page, page)*page);
+        void* chunk = NULL;
+        if(platform_virtual_reallocate(&chunk, NULL, chunk_size, (Platform_Virtual_Allocation) (PLATFORM_VIRTUAL_ALLOC_RESERVE | PLATFORM_VIRTUAL_ALLOC_COMMIT), PLATFORM_MEMORY_PROT_READ_WRITE) != 0)
+            return NULL;
+
+        //The first two words hold the link and size of the chunk
+        void** header = (void**) chunk;
+        header[0] = pool->chunks;
+        header[1] = (void*) chunk_size;
+        pool->chunks = chunk;
+        pool->chunk_count += 1;
+        pool->chunk_bytes += chunk_size;
+        pool->chunk_pos = (uint8_t*) chunk + 2*sizeof(void*);
+        pool->chunk_end = (uint8_t*) chunk + chunk_size;
+        ptr = (uint8_t*) align_forward(pool->chunk_pos, align);
+    }
+
+    pool->chunk_pos = ptr + size;
+    return ptr;
+}
+
+INTERNAL void _pool_debug_fill(Pool* pool, void* item)
+{
+    //The whole slot becomes dead zone
+    debug_dead_zones_fill((uint8_t*) item - pool->pre_dead_zone, 0, 0, pool->slot_size);
+}
+
+INTERNAL void _pool_debug_test(Pool* pool, void* item, bool is_free)
+{
+    isize post_dead_zone = pool->slot_size - pool->pre_dead_zone - pool->item_size;
+    if(is_free)
+        debug_dead_zones_test(pool->name, (uint8_t*) item - pool->pre_dead_zone, 0, 0, pool->slot_size);
+    else
+        debug_dead_zones_test(pool->name, item, pool->item_size, pool->pre_dead_zone, post_dead_zone);
+}
+
+//Fills the magazine with new items. Needs to hold the lock.
+INTERNAL void _pool_refill_locked(Pool* pool, Pool_Magazine* magazine)
+{
+    while(pool->overflow && magazine->count < POOL_MAGAZINE_SIZE)
+    {
+        void* item = pool->overflow;
+        pool->overflow = *(void**) item;
+        if(pool->flags & POOL_DEBUG)
+            _pool_debug_fill(pool, item);
+        magazine->items[magazine->count++] = item;
+    }
+
+    isize slot_align = MAX(pool->item_align, DEF_ALIGN);
+    while(magazine->count < POOL_MAGAZINE_SIZE)
+    {
+        uint8_t* slot = (uint8_t*) _pool_carve_locked(pool, pool->slot_size, slot_align);
+        if(slot == NULL)
+            break;
+
+        void* item = slot + pool->pre_dead_zone;
+        if(pool->flags & POOL_DEBUG)
+            _pool_debug_fill(pool, item);
+        magazine->items[magazine->count++] = item;
+        pool->item_count += 1;
+    }
+}
+
+static ATTRIBUTE_INLINE_NEVER Pool_Cache* _pool_attach(Pool* pool)
+{
+    mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+    Pool_Cache* cache = NULL;
+    for(Pool_Cache* it = pool->caches; it; it = it->next)
+        if(it->is_detached)
+        {
+            cache = it;
+            cache->is_detached = false;
+            break;
+        }
+
+    if(cache == NULL)
+    {
+        cache = (Pool_Cache*) _pool_carve_locked(pool, sizeof(Pool_Cache), 64);
+        if(cache)
+        {
+            memset(cache, 0, sizeof *cache);
+            cache->loaded = _POOL_NO_MAGAZINE;
+            cache->previous = _POOL_NO_MAGAZINE;
+            cache->next = pool->caches;
+            pool->caches = cache;
+        }
+    }
+    mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+    if(cache == NULL)
+        return NULL;
+
+    //Detached caches hold no magazines. If we cannot get them keep the cache detached and fail.
+    if(cache->loaded == _POOL_NO_MAGAZINE)
+        cache->loaded = _pool_get_empty_magazine(pool);
+    if(cache->previous == _POOL_NO_MAGAZINE)
+        cache->previous = _pool_get_empty_magazine(pool);
+    if(cache->loaded == _POOL_NO_MAGAZINE || cache->previous == _POOL_NO_MAGAZINE)
+    {
+        mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+        cache->is_detached = true;
+        mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+        return NULL;
+    }
+
+    //If all slots are used the evicted cache keeps its items until deinit.
+    sync_thread_slots_set(&_pool_slots, pool->id, cache);
+    return cache;
+}
+
+INTERNAL Pool_Cache* _pool_get_cache(Pool* pool)
+{
+    Pool_Cache* cache = (Pool_Cache*) sync_thread_slots_get(&_pool_slots, pool->id);
+    return cache ? cache : _pool_attach(pool);
+}
+
+static ATTRIBUTE_INLINE_NEVER void* _pool_get_slow(Pool* pool, Pool_Cache* cache)
+{
+    Pool_Magazine* previous = _pool_magazine(pool, cache->previous);
+    if(previous->count == 0)
+    {
+        uint32_t full = _pool_depot_pop(pool, &pool->depot_full);
+        if(full != _POOL_NO_MAGAZINE)
+        {
+            _pool_depot_push(pool, &pool->depot_empty, cache->previous);
+            cache->previous = full;
+        }
+        else
+        {
+            mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+            _pool_refill_locked(pool, previous);
+            mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+        }
+    }
+
+    uint32_t empty = cache->loaded;
+    cache->loaded = cache->previous;
+    cache->previous = empty;
+
+    Pool_Magazine* loaded = _pool_magazine(pool, cache->loaded);
+    if(loaded->count == 0)
+        return NULL;
+    return loaded->items[--loaded->count];
+}
+
+static ATTRIBUTE_INLINE_NEVER void _pool_put_slow(Pool* pool, Pool_Cache* cache, void* item)
+{
+    Pool_Magazine* previous = _pool_magazine(pool, cache->previous);
+    if(previous->count == POOL_MAGAZINE_SIZE)
+    {
+        uint32_t empty = _pool_get_empty_magazine(pool);
+        if(empty == _POOL_NO_MAGAZINE)
+        {
+            mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+            *(void**) item = pool->overflow;
+            pool->overflow = item;
+            mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+            return;
+        }
+
+        _pool_depot_push(pool, &pool->depot_full, cache->previous);
+        cache->previous = empty;
+    }
+
+    uint32_t full = cache->loaded;
+    cache->loaded = cache->previous;
+    cache->previous = full;
+
+    Pool_Magazine* loaded = _pool_magazine(pool, cache->loaded);
+    loaded->items[loaded->count++] = item;
+}
+
+EXTERNAL void* pool_get(Pool* pool)
+{
+    Pool_Cache* cache = _pool_get_cache(pool);
+    if(cache == NULL)
+        return NULL;
+
+    void* item = NULL;
+    Pool_Magazine* loaded = _pool_magazine(pool, cache->loaded);
+    if(loaded->count > 0)
+        item = loaded->items[--loaded->count];
+    else
+        item = _pool_get_slow(pool, cache);
+
+    if(item)
+    {
+        if(pool->flags & POOL_DEBUG)
+        {
+            _pool_debug_test(pool, item, true);
+            debug_dead_zones_fill(item, pool->item_size, pool->pre_dead_zone, pool->slot_size - pool->pre_dead_zone - pool->item_size);
+        }
+        sync_single_writer_add(&cache->get_count, 1);
+    }
+    return item;
+}
+
+EXTERNAL void pool_put(Pool* pool, void* item)
+{
+    if(item == NULL)
+        return;
+
+    if(pool->flags & POOL_DEBUG)
+    {
+        _pool_debug_test(pool, item, false);
+        _pool_debug_fill(pool, item);
+    }
+
+    Pool_Cache* cache = _pool_get_cache(pool);
+    if(cache == NULL)
+    {
+        mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+        *(void**) item = pool->overflow;
+        pool->overflow = item;
+        mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+        return;
+    }
+
+    Pool_Magazine* loaded = _pool_magazine(pool, cache->loaded);
+    if(loaded->count < POOL_MAGAZINE_SIZE)
+        loaded->items[loaded->count++] = item;
+    else
+        _pool_put_slow(pool, cache, item);
+    sync_single_writer_add(&cache->put_count, 1);
+}
+
+EXTERNAL void pool_thread_detach(Pool* pool)
+{
+    Pool_Cache* cache = (Pool_Cache*) sync_thread_slots_remove(&_pool_slots, pool->id);
+    if(cache)
+    {
+        uint32_t magazines[2] = {cache->loaded, cache->previous};
+        for(isize k = 0; k < 2; k++)
+        {
+            bool has_items = _pool_magazine(pool, magazines[k])->count > 0;
+            _pool_depot_push(pool, has_items ? &pool->depot_full : &pool->depot_empty, magazines[k]);
+        }
+
+        cache->loaded = _POOL_NO_MAGAZINE;
+        cache->previous = _POOL_NO_MAGAZINE;
+        mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+        cache->is_detached = true;
+        mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+    }
+}
+
+EXTERNAL bool pool_init(Pool* pool, isize item_size, isize item_align, const char* name_or_null, uint64_t flags)
+{
+    REQUIRE(item_size > 0 && is_power_of_two(item_align) && item_align <= platform_page_size());
+    memset(pool, 0, sizeof *pool);
+
+    void* magazines = NULL;
+    isize reserve = (isize) sizeof(Pool_Magazine)*POOL_MAX_MAGAZINES;
+    if(platform_virtual_reallocate(&magazines, NULL, reserve, PLATFORM_VIRTUAL_ALLOC_RESERVE, PLATFORM_MEMORY_PROT_NO_ACCESS) != 0)
+        return false;
+
+    pool->alloc[0] = pool_allocator_func;
+    pool->name = name_or_null;
+    pool->flags = flags;
+    pool->id = sync_thread_slots_make_id();
+    pool->item_size = item_size;
+    pool->item_align = item_align;
+    pool->magazines = (Pool_Magazine*) magazines;
+
+    //Items need to be able to hold the overflow link
+    isize slot_align = MAX(item_align, DEF_ALIGN);
+    isize size = MAX(item_size, (isize) sizeof(void*));
+    if(flags & POOL_DEBUG)
+    {
+        pool->pre_dead_zone = MAX(POOL_DEAD_ZONE_SIZE, item_align);
+        size = pool->pre_dead_zone + size + POOL_DEAD_ZONE_SIZE;
+    }
+    pool->slot_size = DIV_CEIL(size, slot_align)*slot_align;
+    REQUIRE((flags & POOL_DEBUG) == 0 || pool->slot_size < UINT16_MAX, "Debug dead zones can only cover items smaller than 64KB");
+    return true;
+}
+
+EXTERNAL void pool_deinit(Pool* pool)
+{
+    for(void* chunk = pool->chunks; chunk; )
+    {
+        void** header = (void**) chunk;
+        void* next = header[0];
+        platform_virtual_reallocate(NULL, chunk, (isize) header[1], PLATFORM_VIRTUAL_ALLOC_RELEASE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+        chunk = next;
+    }
+
+    if(pool->magazines)
+        platform_virtual_reallocate(NULL, pool->magazines, (isize) sizeof(Pool_Magazine)*POOL_MAX_MAGAZINES, PLATFORM_VIRTUAL_ALLOC_RELEASE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+
+    //Stale thread local slots can never match as ids are unique
+    memset(pool, 0, sizeof *pool);
+}
+
+EXTERNAL void* pool_allocator_func(void* self, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest)
+{
+    Pool* pool = (Pool*) self;
+    if(mode == ALLOCATOR_MODE_ALLOC) {
+        if(new_size > pool->item_size || align > pool->item_align)
+        {
+            allocator_error((Allocator_Error*) rest, ALLOCATOR_ERROR_INVALID_PARAMS, (Allocator*) self, new_size, old_ptr, old_size, align,
+                "Pool of items of size %lli and align %lli cannot allocate %lli bytes aligned to %lli",
+                (long long) pool->item_size, (long long) pool->item_align, (long long) new_size, (long long) align);
+            return NULL;
+        }
+
+        //All items are the same size so resizing is free
+        if(old_size > 0 && new_size > 0)
+            return old_ptr;
+
+        void* new_ptr = NULL;
+        if(new_size > 0)
+        {
+            new_ptr = pool_get(pool);
+            if(new_ptr == NULL)
+                allocator_error((Allocator_Error*) rest, ALLOCATOR_ERROR_OUT_OF_MEM, (Allocator*) self, new_size, old_ptr, old_size, align, "Out of memory");
+        }
+        if(old_size > 0)
+            pool_put(pool, old_ptr);
+        return new_ptr;
+    }
+    if(mode == ALLOCATOR_MODE_GET_STATS) {
+        Allocator_Stats stats = {0};
+        stats.type_name = "Pool";
+        stats.name = pool->name;
+        stats.is_top_level = true;
+        stats.is_growing = true;
+        stats.is_capable_of_resize = true;
+
+        mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+        for(Pool_Cache* cache = pool->caches; cache; cache = cache->next)
+        {
+            stats.allocation_count += atomic_load_explicit(&cache->get_count, memory_order_relaxed);
+            stats.deallocation_count += atomic_load_explicit(&cache->put_count, memory_order_relaxed);
+        }
+        mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+
+        stats.bytes_allocated = (stats.allocation_count - stats.deallocation_count)*pool->item_size;
+        *(Allocator_Stats*) rest = stats;
+    }
+    return NULL;
+}
+#endif
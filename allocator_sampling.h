@@ -0,0 +1,329 @@
+#ifndef MODULE_ALLOCATOR_SAMPLING
+#define MODULE_ALLOCATOR_SAMPLING
+
+// A low overhead heap profiler in the form of an allocator wrapper.
+//
+// Unlike Debug_Allocator it does not record every allocation. Instead it samples on average one
+// allocation per sample_period bytes allocated. Sampling is modeled as a Poisson process over
+// the allocated bytes (same as tcmalloc) - after each sample the distance to the next one is drawn from
+// exponential distribution with mean sample_period. An allocation of size S is thus sampled with
+// probability 1 - exp(-S/sample_period) and when sampled represents S/(1 - exp(-S/sample_period)) bytes.
+// This gives us unbiased estimates of the live and total bytes for each call site while only paying
+// for a call stack capture once every sample_period bytes. Allocations which were not sampled only
+// decrement a counter and do a lookup into a (usually small) hash on deallocation.
+//
+// Per call site statistics are kept in a hash keyed by the hash of the captured call stack. They
+// can be exported on demand either in the folded stack format (for flamegraph.pl, speedscope...)
+// or in the legacy text heap profile format understood by pprof.
+//
+// Same as the other allocators here it is not thread safe.
+
+#include "allocator.h"
+#include "platform.h"
+#include "hash.h"
+#include "hash_func.h"
+#include "random.h"
+#include "string.h"
+#include <math.h>
+#include <stdio.h>
+
+#define SAMPLING_ALLOCATOR_DEF_PERIOD   (512*1024)
+#define SAMPLING_ALLOCATOR_MAX_FRAMES   32
+
+typedef struct Sampling_Site {
+    uint64_t hash;
+    int32_t frame_count;
+    int32_t _;
+    void* frames[SAMPLING_ALLOCATOR_MAX_FRAMES]; //frames[0] is the caller of the allocator
+
+    //Estimated (unsampled) values
+    isize live_bytes;
+    isize live_count;
+    isize total_bytes;
+    isize total_count;
+
+    //Raw values of the sampled allocations only
+    isize sampled_live_bytes;
+    isize sampled_live_count;
+    isize sampled_total_bytes;
+    isize sampled_total_count;
+} Sampling_Site;
+
+typedef struct Sampling_Allocator {
+    Allocator alloc[1];
+    Allocator* parent;
+    Allocator* internal;    //used for the bookkeeping
+    const char* name;
+
+    isize sample_period;    //Should not be changed after init
+    isize bytes_until_sample;
+    Random_State random;
+
+    Hash site_hash;         //call stack hash -> index into sites
+    Hash sample_hash;       //hashed sampled pointer -> index into sites
+    Sampling_Site* sites;
+    isize site_count;
+    isize site_capacity;
+
+    isize sample_count;
+    isize bytes_allocated;
+    isize max_bytes_allocated;
+    isize allocation_count;
+    isize deallocation_count;
+    isize reallocation_count;
+} Sampling_Allocator;
+
+typedef enum Sampling_Export_Format {
+    SAMPLING_EXPORT_FOLDED_LIVE = 0,    //"main;foo;bar 1234" lines with estimated live bytes
+    SAMPLING_EXPORT_FOLDED_TOTAL = 1,   //same as above but with estimated total allocated bytes
+    SAMPLING_EXPORT_PPROF = 2,          //legacy "heap profile: ... @ heap_v2/<period>" text format
+} Sampling_Export_Format;
+
+EXTERNAL void sampling_allocator_init(Sampling_Allocator* self, Allocator* parent_or_null, Allocator* internal_or_null, isize sample_period_or_zero, const char* name);
+EXTERNAL void sampling_allocator_deinit(Sampling_Allocator* self);
+EXTERNAL void* sampling_allocator_func(void* self, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest);
+
+//Appends the profile in the given format
+EXTERNAL void sampling_allocator_export(const Sampling_Allocator* self, String_Builder* append_to, Sampling_Export_Format format);
+EXTERNAL Platform_Error sampling_allocator_export_file(const Sampling_Allocator* self, Platform_String path, Sampling_Export_Format format);
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_ALLOCATOR_SAMPLING)) && !defined(MODULE_HAS_IMPL_ALLOCATOR_SAMPLING)
+#define MODULE_HAS_IMPL_ALLOCATOR_SAMPLING
+
+#define _SAMPLING_HASH_EMPTY ((uint64_t) -2)
+
+INTERNAL isize _sampling_allocator_next_interval(Sampling_Allocator* self)
+{
+    //Exponential distribution with mean sample_period. 1 - U is in (0, 1] so the log is finite.
+    double u = 1.0 - random_f64_from(&self->random);
+    return (isize) (-log(u)*(double) self->sample_period) + 1;
+}
+
+//Estimated number of allocations one sampled allocation of the given size represents
+INTERNAL double _sampling_allocator_weight(const Sampling_Allocator* self, isize size)
+{
+    double probability = 1.0 - exp(-(double) size/(double) self->sample_period);
+    return probability > 0 ? 1.0/probability : 1.0;
+}
+
+INTERNAL uint64_t _sampling_allocator_ptr_hash(void* ptr)
+{
+    return hash64_bijective((uint64_t) ptr);
+}
+
+INTERNAL isize _sampling_allocator_get_site(Sampling_Allocator* self, void** frames, int32_t frame_count)
+{
+    uint64_t hash = xxhash64(frames, frame_count*(isize) sizeof(void*), 0);
+    for(Hash_Iter it = {0}; hash_iterate(&self->site_hash, hash, &it); )
+    {
+        Sampling_Site* site = &self->sites[it.entry->value];
+        if(site->frame_count == frame_count && memcmp(site->frames, frames, frame_count*sizeof(void*)) == 0)
+            return (isize) it.entry->value;
+    }
+
+    if(self->site_count >= self->site_capacity)
+    {
+        isize new_capacity = MAX(self->site_capacity*2, 16);
+        self->sites = (Sampling_Site*) allocator_reallocate(self->internal, new_capacity*(isize) sizeof(Sampling_Site), self->sites, self->site_capacity*(isize) sizeof(Sampling_Site), __alignof(Sampling_Site));
+        self->site_capacity = new_capacity;
+    }
+
+    isize index = self->site_count++;
+    Sampling_Site* site = &self->sites[index];
+    memset(site, 0, sizeof *site);
+    site->hash = hash;
+    site->frame_count = frame_count;
+    memcpy(site->frames, frames, frame_count*sizeof(void*));
+    hash_insert(&self->site_hash, hash, (uint64_t) index);
+    return index;
+}
+
+static ATTRIBUTE_INLINE_NEVER void _sampling_allocator_sample(Sampling_Allocator* self, void* ptr, isize size)
+{
+    //Skip this function and sampling_allocator_func
+    void* frames[SAMPLING_ALLOCATOR_MAX_FRAMES] = {0};
+    int32_t frame_count = (int32_t) platform_capture_call_stack(frames, SAMPLING_ALLOCATOR_MAX_FRAMES, 2);
+
+    isize index = _sampling_allocator_get_site(self, frames, frame_count);
+    Sampling_Site* site = &self->sites[index];
+    double weight = _sampling_allocator_weight(self, size);
+    isize bytes = (isize) (weight*(double) size);
+    isize count = (isize) (weight + 0.5);
+
+    site->live_bytes += bytes;
+    site->live_count += count;
+    site->total_bytes += bytes;
+    site->total_count += count;
+    site->sampled_live_bytes += size;
+    site->sampled_live_count += 1;
+    site->sampled_total_bytes += size;
+    site->sampled_total_count += 1;
+
+    hash_insert(&self->sample_hash, _sampling_allocator_ptr_hash(ptr), (uint64_t) index);
+    self->sample_count += 1;
+    self->bytes_until_sample = _sampling_allocator_next_interval(self);
+}
+
+static ATTRIBUTE_INLINE_NEVER void _sampling_allocator_unsample(Sampling_Allocator* self, void* ptr, isize size)
+{
+    isize found = 0;
+    if(hash_find(&self->sample_hash, _sampling_allocator_ptr_hash(ptr), &found))
+    {
+        Sampling_Site* site = &self->sites[self->sample_hash.entries[found].value];
+        hash_remove(&self->sample_hash, found);
+
+        //Same computation as when sampled so the values cancel out exactly
+        double weight = _sampling_allocator_weight(self, size);
+        site->live_bytes -= (isize) (weight*(double) size);
+        site->live_count -= (isize) (weight + 0.5);
+        site->sampled_live_bytes -= size;
+        site->sampled_live_count -= 1;
+    }
+}
+
+EXTERNAL void sampling_allocator_init(Sampling_Allocator* self, Allocator* parent_or_null, Allocator* internal_or_null, isize sample_period_or_zero, const char* name)
+{
+    REQUIRE(sample_period_or_zero >= 0);
+    sampling_allocator_deinit(self);
+    self->alloc[0] = sampling_allocator_func;
+    self->parent = parent_or_null ? parent_or_null : allocator_get_default();
+    self->internal = internal_or_null ? internal_or_null : allocator_get_malloc();
+    self->name = name;
+    self->sample_period = sample_period_or_zero > 0 ? sample_period_or_zero : SAMPLING_ALLOCATOR_DEF_PERIOD;
+    self->random = random_state_make(random_seed() ^ (uint64_t) self);
+    self->bytes_until_sample = _sampling_allocator_next_interval(self);
+    hash_init(&self->site_hash, self->internal, _SAMPLING_HASH_EMPTY);
+    hash_init(&self->sample_hash, self->internal, _SAMPLING_HASH_EMPTY);
+}
+
+EXTERNAL void sampling_allocator_deinit(Sampling_Allocator* self)
+{
+    if(self->internal)
+    {
+        hash_deinit(&self->site_hash);
+        hash_deinit(&self->sample_hash);
+        allocator_deallocate(self->internal, self->sites, self->site_capacity*(isize) sizeof(Sampling_Site), __alignof(Sampling_Site));
+    }
+    memset(self, 0, sizeof *self);
+}
+
+EXTERNAL void* sampling_allocator_func(void* self_void, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest)
+{
+    Sampling_Allocator* self = (Sampling_Allocator*) self_void;
+    if(mode == ALLOCATOR_MODE_ALLOC) {
+        void* new_ptr = (*self->parent)(self->parent, ALLOCATOR_MODE_ALLOC, new_size, old_ptr, old_size, align, rest);
+        if(new_ptr == NULL && new_size > 0)
+            return NULL;
+
+        //A reallocation is treated as deallocation followed by allocation
+        if(old_ptr && self->sample_hash.count > 0)
+            _sampling_allocator_unsample(self, old_ptr, old_size);
+        if(new_size > 0)
+        {
+            self->bytes_until_sample -= new_size;
+            if(self->bytes_until_sample <= 0)
+                _sampling_allocator_sample(self, new_ptr, new_size);
+        }
+
+        if(old_ptr == NULL)
+            self->allocation_count += 1;
+        else if(new_size == 0)
+            self->deallocation_count += 1;
+        else
+            self->reallocation_count += 1;
+
+        self->bytes_allocated += new_size - old_size;
+        self->max_bytes_allocated = MAX(self->max_bytes_allocated, self->bytes_allocated);
+        return new_ptr;
+    }
+    if(mode == ALLOCATOR_MODE_GET_STATS) {
+        Allocator_Stats stats = {0};
+        stats.type_name = "Sampling_Allocator";
+        stats.name = self->name;
+        stats.parent = self->parent;
+        stats.is_growing = true;
+        stats.is_capable_of_resize = true;
+        stats.bytes_allocated = self->bytes_allocated;
+        stats.max_bytes_allocated = self->max_bytes_allocated;
+        stats.allocation_count = self->allocation_count;
+        stats.deallocation_count = self->deallocation_count;
+        stats.reallocation_count = self->reallocation_count;
+        *(Allocator_Stats*) rest = stats;
+    }
+    return NULL;
+}
+
+EXTERNAL void sampling_allocator_export(const Sampling_Allocator* self, String_Builder* append_to, Sampling_Export_Format format)
+{
+    if(format == SAMPLING_EXPORT_PPROF)
+    {
+        isize live_count = 0, live_bytes = 0, total_count = 0, total_bytes = 0;
+        for(isize i = 0; i < self->site_count; i++)
+        {
+            live_count += self->sites[i].sampled_live_count;
+            live_bytes += self->sites[i].sampled_live_bytes;
+            total_count += self->sites[i].sampled_total_count;
+            total_bytes += self->sites[i].sampled_total_bytes;
+        }
+
+        format_append_into(append_to, "heap profile: %lli: %lli [%lli: %lli] @ heap_v2/%lli\n",
+            (lli) live_count, (lli) live_bytes, (lli) total_count, (lli) total_bytes, (lli) self->sample_period);
+        for(isize i = 0; i < self->site_count; i++)
+        {
+            const Sampling_Site* site = &self->sites[i];
+            format_append_into(append_to, "%lli: %lli [%lli: %lli] @",
+                (lli) site->sampled_live_count, (lli) site->sampled_live_bytes, (lli) site->sampled_total_count, (lli) site->sampled_total_bytes);
+            for(int32_t k = 0; k < site->frame_count; k++)
+                format_append_into(append_to, " 0x%llx", (llu) site->frames[k]);
+            builder_push(append_to, '\n');
+        }
+
+        //pprof needs the mapping of the executable and shared libraries to symbolize the addresses.
+        // Only available on linux. Elsewhere the addresses are left for the user to symbolize.
+        //The file reports zero size and is generated as it is read so read it sequentially.
+        FILE* maps = fopen("/proc/self/maps", "rb");
+        if(maps)
+        {
+            format_append_into(append_to, "\nMAPPED_LIBRARIES:\n");
+            char buffer[4096];
+            for(size_t read = 0; (read = fread(buffer, 1, sizeof buffer, maps)) > 0; )
+                builder_append(append_to, SINIT(String){buffer, (isize) read});
+            fclose(maps);
+        }
+    }
+    else
+    {
+        for(isize i = 0; i < self->site_count; i++)
+        {
+            const Sampling_Site* site = &self->sites[i];
+            isize value = format == SAMPLING_EXPORT_FOLDED_LIVE ? site->live_bytes : site->total_bytes;
+            if(value <= 0)
+                continue;
+
+            Platform_Stack_Trace_Entry entries[SAMPLING_ALLOCATOR_MAX_FRAMES];
+            platform_translate_call_stack(entries, (void**) site->frames, site->frame_count);
+
+            //Folded stacks go from the root to the leaf
+            for(int32_t k = site->frame_count; k-- > 0; )
+            {
+                if(entries[k].function[0])
+                    format_append_into(append_to, "%s", entries[k].function);
+                else
+                    format_append_into(append_to, "0x%llx", (llu) site->frames[k]);
+                builder_push(append_to, k > 0 ? ';' : ' ');
+            }
+            format_append_into(append_to, "%lli\n", (lli) value);
+        }
+    }
+}
+
+EXTERNAL Platform_Error sampling_allocator_export_file(const Sampling_Allocator* self, Platform_String path, Sampling_Export_Format format)
+{
+    String_Builder builder = builder_make(self->internal, 0);
+    sampling_allocator_export(self, &builder, format);
+    Platform_Error error = platform_file_write_entire(path, builder.data, builder.count, false);
+    builder_deinit(&builder);
+    return error;
+}
+#endif
@@ -0,0 +1,378 @@
+#ifndef MODULE_ALLOCATOR_SLAB
+#define MODULE_ALLOCATOR_SLAB
+
+// A general purpose allocator for small objects built out of size class slabs.
+//
+// Each allocation size is rounded up to one of SLAB_SIZE_CLASSES size classes (16B to 2KB spaced
+// roughly by powers of two, with an extra class in between). Every size class owns a set of
+// slabs - SLAB_ALLOCATOR_SLAB_SIZE bytes big and equally aligned blocks obtained from the
+// parent allocator. A slab starts with the Slab header followed by an array of equally sized slots.
+// Because slabs are aligned to their size the header of any slot is found by just masking its
+// address thus small allocations carry no per allocation bookkeeping at all.
+//
+// Inside a slab:
+//  - A bitmap tracks which slots are used. This catches double frees and frees of foreign pointers.
+//  - Freed slots form a page local singly linked free list. Allocation takes from this list first.
+//  - Slots which were never used are handed out by bumping an index so a fresh slab is never
+//    touched ahead of time.
+//
+// Every size class keeps a list of partially used slabs from which it allocates, a list of full
+// slabs and at most one completely empty slab. When a slab becomes empty and there already is an
+// empty slab in its class it is returned to the parent. Keeping the one empty slab around prevents
+// allocating and freeing a slab over and over when a single object oscillates on the boundary.
+//
+// Allocations bigger than SLAB_MAX_SIZE or aligned to more than SLAB_MAX_ALIGN are passed to
+// the parent allocator directly. Slab_Allocator is single threaded.
+
+#include "allocator.h"
+
+#ifdef MODULE_ALL_COUPLED
+    #include "defines.h"
+    #include "assert.h"
+#endif
+
+#define SLAB_ALLOCATOR_SLAB_SIZE    (64*1024)
+#define SLAB_SIZE_CLASSES           14
+#define SLAB_MAX_SIZE               2048
+#define SLAB_MAX_ALIGN              64
+#define SLAB_MAX_SLOTS              (SLAB_ALLOCATOR_SLAB_SIZE/16)
+#define SLAB_MAGIC                  0x42414C53 //"SLAB" in ascii little endian
+
+typedef struct Slab {
+    struct Slab* next;  //next in the partial or full list of its class
+    struct Slab* prev;
+    void* free_list;    //freed slots
+    uint32_t magic;
+    uint32_t size_class;
+    uint32_t slot_size;
+    uint32_t slot_reciprocal; //(offset*slot_reciprocal) >> 32 == offset/slot_size for all offsets inside the slab
+    uint32_t slot_count;
+    uint32_t used_count;
+    uint32_t bump;      //slots from bump onwards were never used
+    uint32_t is_full;
+    uint64_t used_mask[SLAB_MAX_SLOTS/64];
+} Slab;
+
+typedef struct Slab_Class {
+    Slab* partial;
+    Slab* full;
+    Slab* empty;
+    isize slab_count;
+} Slab_Class;
+
+typedef struct Slab_Allocator {
+    Allocator alloc[1];
+    Allocator* parent;
+    const char* name;
+
+    Slab_Class classes[SLAB_SIZE_CLASSES];
+    isize slab_count;       //number of slabs currently obtained from parent
+    isize max_slab_count;
+
+    isize bytes_allocated;
+    isize max_bytes_allocated;
+    isize allocation_count;
+    isize deallocation_count;
+    isize reallocation_count;
+    isize live_allocations;
+    isize max_live_allocations;
+} Slab_Allocator;
+
+EXTERNAL void slab_allocator_init(Slab_Allocator* self, Allocator* parent_or_null, const char* name);
+//Returns all slabs to parent. Allocations which went directly to parent are not freed.
+EXTERNAL void slab_allocator_deinit(Slab_Allocator* self);
+//Returns the index of the size class of the given size and align or -1 if the allocation goes directly to parent.
+EXTERNAL int32_t slab_size_class(isize size, isize align);
+EXTERNAL isize slab_size_class_size(int32_t size_class);
+
+EXTERNAL void* slab_allocator_func(void* self, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest);
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_ALLOCATOR_SLAB)) && !defined(MODULE_HAS_IMPL_ALLOCATOR_SLAB)
+#define MODULE_HAS_IMPL_ALLOCATOR_SLAB
+
+#ifndef INTERNAL
+    #define INTERNAL inline static
+#endif
+
+static const uint32_t _slab_class_sizes[SLAB_SIZE_CLASSES] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048};
+
+//size class of sizes up to 256 indexed by (size + 15)/16
+static const uint8_t _slab_small_classes[17] = {0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7};
+
+//Slots start on a cache line boundary right after the header
+#define _SLAB_SLOTS_OFFSET (((isize) sizeof(Slab) + 63)/64*64)
+
+EXTERNAL int32_t slab_size_class(isize size, isize align)
+{
+    if(size <= 0 || size > SLAB_MAX_SIZE || align > SLAB_MAX_ALIGN)
+        return -1;
+
+    int32_t size_class = size <= 256 ? _slab_small_classes[(size + 15)/16] : 8;
+    for(; size_class < SLAB_SIZE_CLASSES; size_class++)
+    {
+        //slots are at least 16 aligned and for higher alignments we need a size which is its multiple
+        uint32_t slot_size = _slab_class_sizes[size_class];
+        if(slot_size >= size && (align <= 16 || slot_size % align == 0))
+            return size_class;
+    }
+    return -1;
+}
+
+EXTERNAL isize slab_size_class_size(int32_t size_class)
+{
+    ASSERT(0 <= size_class && size_class < SLAB_SIZE_CLASSES);
+    return _slab_class_sizes[size_class];
+}
+
+INTERNAL void _slab_link(Slab** head, Slab* slab)
+{
+    slab->prev = NULL;
+    slab->next = *head;
+    if(*head)
+        (*head)->prev = slab;
+    *head = slab;
+}
+
+INTERNAL void _slab_unlink(Slab** head, Slab* slab)
+{
+    if(slab->prev)
+        slab->prev->next = slab->next;
+    else
+        *head = slab->next;
+
+    if(slab->next)
+        slab->next->prev = slab->prev;
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+INTERNAL Slab* _slab_from_ptr(void* ptr)
+{
+    Slab* slab = (Slab*) ((uintptr_t) ptr & ~(uintptr_t) (SLAB_ALLOCATOR_SLAB_SIZE - 1));
+    ASSERT(slab->magic == SLAB_MAGIC, "Pointer was not allocated from Slab_Allocator or its slab is corrupted");
+    return slab;
+}
+
+INTERNAL void _slab_reset(Slab* slab, int32_t size_class)
+{
+    uint32_t slot_size = _slab_class_sizes[size_class];
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->free_list = NULL;
+    slab->magic = SLAB_MAGIC;
+    slab->size_class = (uint32_t) size_class;
+    slab->slot_size = slot_size;
+    slab->slot_reciprocal = (uint32_t) (((uint64_t) 1 << 32)/slot_size + 1);
+    slab->slot_count = (uint32_t) ((SLAB_ALLOCATOR_SLAB_SIZE - _SLAB_SLOTS_OFFSET)/slot_size);
+    slab->used_count = 0;
+    slab->bump = 0;
+    slab->is_full = false;
+    memset(slab->used_mask, 0, sizeof slab->used_mask);
+}
+
+INTERNAL void _slab_release(Slab_Allocator* self, Slab* slab)
+{
+    Slab_Class* c = &self->classes[slab->size_class];
+    slab->magic = 0;
+    c->slab_count -= 1;
+    self->slab_count -= 1;
+    allocator_deallocate(self->parent, slab, SLAB_ALLOCATOR_SLAB_SIZE, SLAB_ALLOCATOR_SLAB_SIZE);
+}
+
+INTERNAL Slab* _slab_acquire(Slab_Allocator* self, int32_t size_class, Allocator_Error* error)
+{
+    Slab_Class* c = &self->classes[size_class];
+    Slab* slab = c->empty;
+    if(slab)
+        c->empty = NULL;
+    else
+    {
+        slab = (Slab*) allocator_try_reallocate(self->parent, SLAB_ALLOCATOR_SLAB_SIZE, NULL, 0, SLAB_ALLOCATOR_SLAB_SIZE, error);
+        if(slab == NULL)
+            return NULL;
+
+        ASSERT(((uintptr_t) slab & (SLAB_ALLOCATOR_SLAB_SIZE - 1)) == 0, "parent allocator must respect the alignment");
+        _slab_reset(slab, size_class);
+        c->slab_count += 1;
+        self->slab_count += 1;
+        if(self->max_slab_count < self->slab_count)
+            self->max_slab_count = self->slab_count;
+    }
+
+    _slab_link(&c->partial, slab);
+    return slab;
+}
+
+INTERNAL void* _slab_allocate(Slab_Allocator* self, int32_t size_class, Allocator_Error* error)
+{
+    Slab_Class* c = &self->classes[size_class];
+    Slab* slab = c->partial;
+    if(slab == NULL)
+    {
+        slab = _slab_acquire(self, size_class, error);
+        if(slab == NULL)
+            return NULL;
+    }
+
+    uint8_t* slots = (uint8_t*) slab + _SLAB_SLOTS_OFFSET;
+    void* ptr = slab->free_list;
+    if(ptr)
+        slab->free_list = *(void**) ptr;
+    else
+    {
+        ASSERT(slab->bump < slab->slot_count);
+        ptr = slots + (isize) slab->bump*slab->slot_size;
+        slab->bump += 1;
+    }
+
+    uint32_t index = (uint32_t) (((uint64_t) ((uint8_t*) ptr - slots)*slab->slot_reciprocal) >> 32);
+    ASSERT((slab->used_mask[index/64] & ((uint64_t) 1 << index%64)) == 0);
+    slab->used_mask[index/64] |= (uint64_t) 1 << index%64;
+    slab->used_count += 1;
+
+    if(slab->used_count == slab->slot_count)
+    {
+        _slab_unlink(&c->partial, slab);
+        _slab_link(&c->full, slab);
+        slab->is_full = true;
+    }
+    return ptr;
+}
+
+INTERNAL void _slab_deallocate(Slab_Allocator* self, void* ptr, int32_t size_class)
+{
+    Slab* slab = _slab_from_ptr(ptr);
+    Slab_Class* c = &self->classes[size_class];
+    ASSERT(slab->size_class == (uint32_t) size_class, "Freed with a different size or align then allocated with");
+
+    uint8_t* slots = (uint8_t*) slab + _SLAB_SLOTS_OFFSET;
+    isize offset = (uint8_t*) ptr - slots;
+    uint32_t index = (uint32_t) (((uint64_t) offset*slab->slot_reciprocal) >> 32);
+    uint64_t bit = (uint64_t) 1 << index%64;
+    ASSERT(offset >= 0 && offset == (isize) index*slab->slot_size && index < slab->bump, "Pointer does not point to a slot");
+    ASSERT(slab->used_mask[index/64] & bit, "Double free");
+    slab->used_mask[index/64] &= ~bit;
+
+    *(void**) ptr = slab->free_list;
+    slab->free_list = ptr;
+    slab->used_count -= 1;
+
+    if(slab->is_full)
+    {
+        _slab_unlink(&c->full, slab);
+        _slab_link(&c->partial, slab);
+        slab->is_full = false;
+    }
+
+    if(slab->used_count == 0)
+    {
+        _slab_unlink(&c->partial, slab);
+        if(c->empty == NULL)
+        {
+            _slab_reset(slab, size_class);
+            c->empty = slab;
+        }
+        else
+            _slab_release(self, slab);
+    }
+}
+
+EXTERNAL void slab_allocator_init(Slab_Allocator* self, Allocator* parent_or_null, const char* name)
+{
+    memset(self, 0, sizeof *self);
+    self->alloc[0] = slab_allocator_func;
+    self->parent = parent_or_null ? parent_or_null : allocator_get_default();
+    self->name = name;
+}
+
+EXTERNAL void slab_allocator_deinit(Slab_Allocator* self)
+{
+    for(int32_t i = 0; i < SLAB_SIZE_CLASSES; i++)
+    {
+        Slab_Class* c = &self->classes[i];
+        Slab* lists[3] = {c->partial, c->full, c->empty};
+        for(isize l = 0; l < 3; l++)
+            for(Slab* slab = lists[l]; slab; )
+            {
+                Slab* next = slab->next;
+                _slab_release(self, slab);
+                slab = next;
+            }
+    }
+    ASSERT(self->slab_count == 0);
+    memset(self, 0, sizeof *self);
+}
+
+EXTERNAL void* slab_allocator_func(void* self_void, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest)
+{
+    Slab_Allocator* self = (Slab_Allocator*) self_void;
+    if(mode == ALLOCATOR_MODE_ALLOC) {
+        int32_t new_class = slab_size_class(new_size, align);
+        int32_t old_class = slab_size_class(old_size, align);
+        void* new_ptr = NULL;
+
+        //Resizing inside the same size class is free. Only the stats change.
+        if(old_size > 0 && new_size > 0 && new_class >= 0 && new_class == old_class)
+            new_ptr = old_ptr;
+        else
+        {
+            if(new_size > 0)
+            {
+                if(new_class >= 0)
+                    new_ptr = _slab_allocate(self, new_class, (Allocator_Error*) rest);
+                else
+                    new_ptr = allocator_try_reallocate(self->parent, new_size, NULL, 0, align, (Allocator_Error*) rest);
+
+                if(new_ptr == NULL)
+                    return NULL;
+            }
+
+            if(old_size > 0)
+            {
+                ASSERT(old_ptr);
+                if(new_ptr)
+                    memcpy(new_ptr, old_ptr, (size_t) (old_size < new_size ? old_size : new_size));
+
+                if(old_class >= 0)
+                    _slab_deallocate(self, old_ptr, old_class);
+                else
+                    allocator_deallocate(self->parent, old_ptr, old_size, align);
+            }
+        }
+
+        if(old_size == 0)
+            self->allocation_count += 1;
+        else if(new_size == 0)
+            self->deallocation_count += 1;
+        else
+            self->reallocation_count += 1;
+
+        self->live_allocations += (new_size > 0) - (old_size > 0);
+        if(self->max_live_allocations < self->live_allocations)
+            self->max_live_allocations = self->live_allocations;
+
+        self->bytes_allocated += new_size - old_size;
+        if(self->max_bytes_allocated < self->bytes_allocated)
+            self->max_bytes_allocated = self->bytes_allocated;
+        return new_ptr;
+    }
+    if(mode == ALLOCATOR_MODE_GET_STATS) {
+        Allocator_Stats stats = {0};
+        stats.type_name = "Slab_Allocator";
+        stats.name = self->name;
+        stats.parent = self->parent;
+        stats.is_top_level = false;
+        stats.is_growing = true;
+        stats.is_capable_of_resize = true;
+        stats.bytes_allocated = self->bytes_allocated;
+        stats.max_bytes_allocated = self->max_bytes_allocated;
+        stats.max_concurrent_allocations = self->max_live_allocations;
+        stats.allocation_count = self->allocation_count;
+        stats.deallocation_count = self->deallocation_count;
+        stats.reallocation_count = self->reallocation_count;
+        *(Allocator_Stats*) rest = stats;
+    }
+    return NULL;
+}
+#endif
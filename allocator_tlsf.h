@@ -42,6 +42,13 @@
 //     a different bin if the new free size does not match the bins range.
 //  8. Return the `node` and its offset 
 //
+// The resize algorithm:
+//  0. Obtain a `node` and the requested new size.
+//  1. Obtain `node`s next node `next` in memory order. The free memory right after `node` is owned by `next`.
+//  2. If the new size does not fit before `next->offset` fail. Nothing changes.
+//  3. Change the size of `node`. This changes the amount of free memory in `next` which might involve relinking 
+//     it to a different bin (same as step 7. of the allocation algorithm).
+//
 // The deallocation algorithm:
 //  0. Obtain a `node` (via its index in the nodes array)
 //  1. Obtains `node`s previous node `prev` and next node `next` in memory order.
@@ -292,6 +299,9 @@ EXTERNAL void     tlsf_grow_nodes(Tlsf_Allocator* allocator, void* new_node_memo
 EXTERNAL isize    tlsf_allocate(Tlsf_Allocator* allocator, uint32_t* node_output, isize size, isize align, isize align_offset);
 //Deallocates a node obtained from tlsf_allocate or tlsf_malloc. If node is 0 does not do anything.
 EXTERNAL void     tlsf_deallocate(Tlsf_Allocator* allocator, uint32_t node);
+//Changes the size of a node obtained from tlsf_allocate without moving it. Grows into the free memory directly
+// after the node or shrinks, returning the tail to a bin. If there is not enough free memory returns false and does nothing.
+EXTERNAL bool     tlsf_resize(Tlsf_Allocator* allocator, uint32_t node, isize new_size);
 
 //Allocates a `size` bytes in the local memory and returns a pointer to it. 
 //The returned pointer `ptr` is aligned such that `((uintptr_t) ptr + align_offset) % align == 0`. 
@@ -299,6 +309,9 @@ EXTERNAL void     tlsf_deallocate(Tlsf_Allocator* allocator, uint32_t node);
 EXTERNAL void*    tlsf_malloc(Tlsf_Allocator* allocator, isize size, isize align, isize align_offset);
 //Frees an allocation represented by a `ptr` obtained from tlsf_malloc. if `ptr` is NULL does not do anything.
 EXTERNAL void     tlsf_free(Tlsf_Allocator* allocator, void* ptr);
+//Resizes the allocation `ptr` obtained from tlsf_malloc to `new_size` > 0 bytes without moving it (see tlsf_resize). 
+//Returns true on success. On failure returns false and the allocation is left untouched.
+EXTERNAL bool     tlsf_realloc_in_place(Tlsf_Allocator* allocator, void* ptr, isize new_size);
 
 //Returns the size of the given node. If the `node_i` is invalid returns 0. If the `node_i` was freed returns 0xFFFFFFFF.
 EXTERNAL isize    tlsf_node_size(Tlsf_Allocator* allocator, uint32_t node_i);
@@ -581,6 +594,46 @@ EXTERNAL void tlsf_deallocate(Tlsf_Allocator* allocator, uint32_t node_i)
     _tlsf_check_consistency(allocator);
 }
 
+EXTERNAL bool tlsf_resize(Tlsf_Allocator* allocator, uint32_t node_i, isize new_size)
+{
+    ASSERT(allocator);
+    ASSERT(new_size > 0);
+    _tlsf_check_consistency(allocator);
+    _tlsf_check_node(allocator, node_i, TLSF_CHECK_USED);
+    ASSERT(node_i != TLSF_FIRST_NODE && node_i != TLSF_LAST_NODE);
+
+    Tlsf_Node* __restrict node = &allocator->nodes[node_i]; 
+    uint32_t next_i = node->next;
+    Tlsf_Node* __restrict next = &allocator->nodes[next_i];
+
+    //The free memory after node belongs to next
+    ASSERT(next->offset >= node->offset + node->size);
+    if(new_size > (isize) (next->offset - node->offset))
+        return false;
+    
+    Tlsf_Size old_next_unused = next->offset - (node->offset + node->size);
+    Tlsf_Size new_next_unused = next->offset - (node->offset + (Tlsf_Size) new_size);
+    int32_t old_next_bin = old_next_unused >= TLSF_MIN_SIZE ? tlsf_bin_index_from_size(old_next_unused, false) : -1;
+    int32_t new_next_bin = new_next_unused >= TLSF_MIN_SIZE ? tlsf_bin_index_from_size(new_next_unused, false) : -1;
+    if(old_next_bin != new_next_bin)
+    {
+        if(old_next_bin != -1)
+            _tlsf_unlink_node_in_bin(allocator, next_i, old_next_bin);
+        next->next_in_bin = TLSF_INVALID;
+        next->prev_in_bin = TLSF_INVALID;
+        if(new_next_bin != -1)
+            _tlsf_link_node_in_bin(allocator, next_i, new_next_bin);
+    }
+
+    allocator->bytes_allocated += new_size - (isize) node->size;
+    if(allocator->max_bytes_allocated < allocator->bytes_allocated)
+        allocator->max_bytes_allocated = allocator->bytes_allocated;
+    node->size = (Tlsf_Size) new_size;
+
+    _tlsf_check_consistency(allocator);
+    return true;
+}
+
 INTERNAL void _tlsf_unlink_node_in_bin(Tlsf_Allocator* allocator, uint32_t node_i, int32_t bin_i)
 {
     ASSERT(bin_i < TLSF_BINS);
@@ -700,6 +753,11 @@ INTERNAL void* _tlsf_allocator_func(void* self, int mode, int64_t new_size, void
     #ifdef MODULE_ALLOCATOR
         if(mode == ALLOCATOR_MODE_ALLOC) {
             Tlsf_Allocator* allocator = (Tlsf_Allocator*) self;
+            
+            //Try to resize without moving first. Alignment stays the same since the pointer does not change.
+            if(new_size > 0 && old_size > 0 && tlsf_realloc_in_place(allocator, old_ptr, new_size))
+                return old_ptr;
+
             void* new_ptr = NULL;
             if(new_size > 0)
             {
@@ -902,6 +960,32 @@ EXTERNAL void tlsf_free(Tlsf_Allocator* allocator, void* ptr)
     tlsf_deallocate(allocator, node);
 }
 
+EXTERNAL bool tlsf_realloc_in_place(Tlsf_Allocator* allocator, void* ptr, isize new_size)
+{
+    ASSERT(allocator && allocator->memory);
+    ASSERT(new_size > 0);
+    uint32_t node_i = tlsf_get_node(allocator, ptr);
+    if(node_i == 0)
+        return false;
+
+    //The node holds the header before ptr (and the magic after the data in debug)
+    Tlsf_Node* node = &allocator->nodes[node_i];
+    isize header_size = (uint8_t*) ptr - (allocator->memory + node->offset);
+    #ifdef TLSF_DEBUG
+        uint32_t magic = TLSF_MAGIC;
+        isize old_size = (isize) node->size - header_size - (isize) sizeof(uint32_t);
+        if(tlsf_resize(allocator, node_i, header_size + new_size + (isize) sizeof(uint32_t)) == false)
+            return false;
+
+        if(new_size > old_size)
+            memset((uint8_t*) ptr + old_size, 0x55, new_size - old_size);
+        memcpy((uint8_t*) ptr + new_size, &magic, sizeof(uint32_t));
+        return true;
+    #else
+        return tlsf_resize(allocator, node_i, header_size + new_size);
+    #endif
+}
+
 EXTERNAL isize tlsf_node_size(Tlsf_Allocator* allocator, uint32_t node_i)
 {
     if(TLSF_LAST_NODE < node_i && node_i < allocator->node_capacity)
@@ -1149,6 +1233,59 @@ void test_tlsf_alloc_unit()
     free(nodes);
 }
 
+bool memtest(const void* data, int val, isize size);
+
+void test_tlsf_realloc_in_place_unit()
+{
+    isize memory_size = 4096;
+    isize node_memory_size = 16*sizeof(Tlsf_Node);
+    void* nodes = malloc(node_memory_size);
+    void* memory = malloc(memory_size);
+
+    Tlsf_Allocator allocator = {0};
+    TEST(tlsf_init(&allocator, memory, memory_size, nodes, node_memory_size));
+
+    uint8_t* a = (uint8_t*) tlsf_malloc(&allocator, 100, 8, 0);
+    uint8_t* b = (uint8_t*) tlsf_malloc(&allocator, 100, 8, 0);
+    TEST(a && b && a < b);
+    memset(a, 1, 100);
+    memset(b, 2, 100);
+
+    //a is directly followed by b so it cannot grow much
+    TEST(tlsf_realloc_in_place(&allocator, a, 164) == false);
+    TEST(memtest(a, 1, 100) && memtest(b, 2, 100));
+
+    //shrinking returns the tail which can then be grown into again
+    TEST(tlsf_realloc_in_place(&allocator, a, 10));
+    tlsf_test_consistency(&allocator, TLSF_CHECK_DETAILED | TLSF_CHECK_ALL_NODES);
+    TEST(tlsf_realloc_in_place(&allocator, a, 100));
+    tlsf_test_consistency(&allocator, TLSF_CHECK_DETAILED | TLSF_CHECK_ALL_NODES);
+    TEST(memtest(a, 1, 10) && memtest(b, 2, 100));
+
+    //b is followed by all of the remaining memory
+    TEST(tlsf_realloc_in_place(&allocator, b, 3000));
+    tlsf_test_consistency(&allocator, TLSF_CHECK_DETAILED | TLSF_CHECK_ALL_NODES);
+    TEST(memtest(b, 2, 100));
+    memset(b, 2, 3000);
+    TEST(tlsf_realloc_in_place(&allocator, b, 8000) == false);
+    TEST(tlsf_get_node(&allocator, b) != 0 && memtest(b, 2, 3000));
+
+    //the freed space after shrinking is usable by other allocations
+    TEST(tlsf_realloc_in_place(&allocator, b, 100));
+    uint8_t* c = (uint8_t*) tlsf_malloc(&allocator, 2000, 8, 0);
+    TEST(c != NULL && c > b);
+    TEST(tlsf_realloc_in_place(&allocator, b, 3000) == false);
+
+    tlsf_free(&allocator, a);
+    tlsf_free(&allocator, b);
+    tlsf_free(&allocator, c);
+    TEST(allocator.bytes_allocated == 0);
+    tlsf_test_consistency(&allocator, TLSF_CHECK_DETAILED | TLSF_CHECK_ALL_NODES);
+
+    free(nodes);
+    free(memory);
+}
+
 //tests whether the data is equal to the specified bit pattern
 bool memtest(const void* data, int val, isize size)
 {
@@ -1259,6 +1396,15 @@ void test_allocator_tlsf_stress(double seconds, isize at_once)
             TEST(allocs[i].ptr != NULL);
         }
         
+        //Sometimes also resize in place
+        if(allocs[i].ptr && _tlsf_random_range(0, 4) == 0)
+        {
+            uint32_t new_size = (uint32_t) _tlsf_random_range(1, 2*allocs[i].size + 1);
+            if(tlsf_realloc_in_place(&allocator, allocs[i].ptr, new_size))
+                allocs[i].size = new_size;
+            tlsf_test_consistency(&allocator, TLSF_CHECK_DETAILED | TLSF_CHECK_ALL_NODES);
+        }
+
         allocs[i].node = tlsf_get_node(&allocator, allocs[i].ptr);
 
         TEST((uint64_t) allocs[i].ptr % allocs[i].align == 0);
@@ -1294,6 +1440,7 @@ void test_allocator_tlsf(double seconds)
     }
 
     test_tlsf_alloc_unit();
+    test_tlsf_realloc_in_place_unit();
     test_allocator_tlsf_stress(seconds/4, 1);
     test_allocator_tlsf_stress(seconds/4, 10);
     test_allocator_tlsf_stress(seconds/4, 100);
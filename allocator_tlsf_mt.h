@@ -0,0 +1,531 @@
+#ifndef MODULE_ALLOCATOR_TLSF_MT
+#define MODULE_ALLOCATOR_TLSF_MT
+
+// A thread safe front-end for Tlsf_Allocator with per thread caches of small blocks.
+//
+// Tlsf_Allocator itself is single threaded so sharing it between threads requires a lock around
+// every tlsf_malloc/tlsf_free. Tlsf_Mt_Allocator instead gives each thread its own Tlsf_Mt_Cache
+// holding free lists of a few small size classes (up to TLSF_MT_MAX_CACHED_SIZE bytes).
+// Allocations and frees of small blocks are served from the calling threads cache without any
+// synchronization. The shared Tlsf_Allocator (and its lock) is only touched when:
+//  1. A cache runs out of blocks of some size class. It then refills a whole batch at once.
+//  2. A cache holds too many free blocks of some size class. It then flushes a batch back.
+//  3. The allocation is too big or too aligned to be cached. These go directly to the TLSF.
+//
+// Each cached block is prefixed with a small header remembering the cache which carved it out.
+// Freeing a block allocated by a different thread (remote free) does not touch the other
+// threads free lists. Instead the freeing thread gathers the blocks into a local chain and
+// once the chain is long enough (or it starts freeing to a different owner) pushes the whole
+// chain onto the owners lock free remote list with a single sync_list_push_chain. The owner
+// takes all of them with sync_list_pop_all the next time it would have to refill.
+//
+// Threads are bound to their cache through a small thread local table keyed by the allocators
+// unique id (Sync_Thread_Slots). A thread which is done using the allocator should call tlsf_mt_thread_detach so that
+// its cached blocks are returned and the cache can be adopted by the next thread. Caches of threads
+// which exited without detaching keep their blocks until tlsf_mt_deinit. The same happens when
+// a thread uses more than SYNC_THREAD_SLOTS different Tlsf_Mt_Allocators at the same time.
+//
+// The Tlsf_Allocator is borrowed not owned. tlsf_mt_deinit returns all blocks back to it.
+
+#include "defines.h"
+#include "assert.h"
+#include "allocator_tlsf.h"
+#include "allocator.h"
+#include "sync.h"
+
+#define TLSF_MT_SIZE_CLASSES        14
+#define TLSF_MT_MAX_CACHED_SIZE     1024
+#define TLSF_MT_MAX_CACHED_ALIGN    16
+#define TLSF_MT_BATCH_BYTES         (8*1024) //roughly how many bytes get moved on each refill/flush
+#define TLSF_MT_REMOTE_BATCH        32 //how many remote frees get gathered before pushing them to the owner
+#define TLSF_MT_MAGIC               0x544D4654 //"TFMT" in ascii little endian
+
+typedef struct Tlsf_Mt_Cache Tlsf_Mt_Cache;
+
+//Placed in front of every cached block
+typedef struct Tlsf_Mt_Header {
+    Tlsf_Mt_Cache* owner;
+    uint32_t size_class;
+    uint32_t magic;
+} Tlsf_Mt_Header;
+
+//Occupies the user part of the block while it is free
+typedef struct Tlsf_Mt_Block {
+    struct Tlsf_Mt_Block* next;
+} Tlsf_Mt_Block;
+
+typedef struct Tlsf_Mt_Cache {
+    ATTRIBUTE_ALIGNED(64)
+    //Pushed to by other threads. Kept on its own cache line
+    CHAN_ATOMIC(Tlsf_Mt_Block*) remote_frees;
+
+    ATTRIBUTE_ALIGNED(64)
+    struct Tlsf_Mt_Allocator* allocator;
+    Tlsf_Mt_Cache* next; //next in Tlsf_Mt_Allocator.caches. Protected by the allocators lock
+    bool is_detached;    //Protected by the allocators lock
+
+    //Remote frees not yet pushed to their owner
+    Tlsf_Mt_Cache* pending_owner;
+    Tlsf_Mt_Block* pending_first;
+    Tlsf_Mt_Block* pending_last;
+    isize pending_count;
+
+    Tlsf_Mt_Block* free_lists[TLSF_MT_SIZE_CLASSES];
+    isize free_counts[TLSF_MT_SIZE_CLASSES];
+
+    //Only written by the thread owning the cache. Read when gathering stats.
+    CHAN_ATOMIC(isize) bytes_allocated;
+    CHAN_ATOMIC(isize) allocation_count;
+    CHAN_ATOMIC(isize) deallocation_count;
+    CHAN_ATOMIC(isize) reallocation_count;
+    CHAN_ATOMIC(isize) refill_count;
+    CHAN_ATOMIC(isize) flush_count;
+} Tlsf_Mt_Cache;
+
+typedef struct Tlsf_Mt_Allocator {
+    //Allocator "virtual" interface.
+    Allocator allocator;
+    const char* name;
+
+    Tlsf_Allocator* tlsf;
+    Mutex lock; //protects tlsf and the list of caches
+    uint64_t id;
+    Tlsf_Mt_Cache* caches;
+
+    //Stats of allocations which went directly to tlsf. Protected by lock
+    isize direct_bytes_allocated;
+    isize direct_allocation_count;
+    isize direct_deallocation_count;
+} Tlsf_Mt_Allocator;
+
+EXTERNAL void tlsf_mt_init(Tlsf_Mt_Allocator* allocator, Tlsf_Allocator* tlsf, const char* name_or_null);
+//Returns all memory back to the underlying Tlsf_Allocator. No thread can be using the allocator at this point.
+EXTERNAL void tlsf_mt_deinit(Tlsf_Mt_Allocator* allocator);
+//Returns cached blocks of the calling thread and releases its cache so that other threads can adopt it.
+EXTERNAL void tlsf_mt_thread_detach(Tlsf_Mt_Allocator* allocator);
+
+EXTERNAL void* tlsf_mt_malloc(Tlsf_Mt_Allocator* allocator, isize size, isize align);
+//Frees a block obtained from tlsf_mt_malloc. `size` and `align` must be the ones used to allocate it.
+EXTERNAL void  tlsf_mt_free(Tlsf_Mt_Allocator* allocator, void* ptr, isize size, isize align);
+
+//Returns the index of the size class `size` and `align` get cached in or -1 if they are not cached.
+EXTERNAL int32_t tlsf_mt_size_class(isize size, isize align);
+EXTERNAL isize   tlsf_mt_size_class_size(int32_t size_class);
+
+EXTERNAL void* tlsf_mt_allocator_func(void* self, int mode, int64_t new_size, void* old_ptr, int64_t old_size, int64_t align, void* other);
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_ALLOCATOR_TLSF_MT)) && !defined(MODULE_HAS_IMPL_ALLOCATOR_TLSF_MT)
+#define MODULE_HAS_IMPL_ALLOCATOR_TLSF_MT
+
+static ATTRIBUTE_THREAD_LOCAL Sync_Thread_Slots _tlsf_mt_slots;
+
+static const isize _tlsf_mt_class_sizes[TLSF_MT_SIZE_CLASSES] = {16, 32, 48, 64, 80, 96, 112, 128, 192, 256, 384, 512, 768, 1024};
+
+EXTERNAL int32_t tlsf_mt_size_class(isize size, isize align)
+{
+    if(size <= 0 || size > TLSF_MT_MAX_CACHED_SIZE || align > TLSF_MT_MAX_CACHED_ALIGN)
+        return -1;
+
+    if(size <= 128)
+        return (int32_t) ((size + 15)/16 - 1);
+
+    int32_t size_class = 8;
+    while(_tlsf_mt_class_sizes[size_class] < size)
+        size_class += 1;
+    return size_class;
+}
+
+EXTERNAL isize tlsf_mt_size_class_size(int32_t size_class)
+{
+    CHECK_BOUNDS(size_class, TLSF_MT_SIZE_CLASSES);
+    return _tlsf_mt_class_sizes[size_class];
+}
+
+INTERNAL isize _tlsf_mt_batch_size(int32_t size_class)
+{
+    isize batch = TLSF_MT_BATCH_BYTES/_tlsf_mt_class_sizes[size_class];
+    return MAX(4, MIN(batch, 64));
+}
+
+INTERNAL Tlsf_Mt_Header* _tlsf_mt_header(void* ptr)
+{
+    Tlsf_Mt_Header* header = (Tlsf_Mt_Header*) ptr - 1;
+    ASSERT(header->magic == TLSF_MT_MAGIC, "Corrupted or not Tlsf_Mt_Allocator block");
+    return header;
+}
+
+INTERNAL void* _tlsf_mt_direct_malloc(Tlsf_Mt_Allocator* allocator, isize size, isize align)
+{
+    mutex_lock(&allocator->lock, SYNC_WAIT_BLOCK);
+    void* ptr = tlsf_malloc(allocator->tlsf, size, align, 0);
+    if(ptr)
+    {
+        allocator->direct_bytes_allocated += size;
+        allocator->direct_allocation_count += 1;
+    }
+    mutex_unlock(&allocator->lock, SYNC_WAIT_BLOCK);
+    return ptr;
+}
+
+INTERNAL void _tlsf_mt_direct_free(Tlsf_Mt_Allocator* allocator, void* ptr, isize size)
+{
+    mutex_lock(&allocator->lock, SYNC_WAIT_BLOCK);
+    tlsf_free(allocator->tlsf, ptr);
+    allocator->direct_bytes_allocated -= size;
+    allocator->direct_deallocation_count += 1;
+    mutex_unlock(&allocator->lock, SYNC_WAIT_BLOCK);
+}
+
+//Frees a chain of blocks directly to tlsf. Needs to hold the lock.
+INTERNAL isize _tlsf_mt_free_chain_locked(Tlsf_Mt_Allocator* allocator, Tlsf_Mt_Block* first)
+{
+    isize count = 0;
+    for(Tlsf_Mt_Block* block = first; block; count++)
+    {
+        Tlsf_Mt_Block* next = block->next;
+        tlsf_free(allocator->tlsf, (Tlsf_Mt_Header*) (void*) block - 1);
+        block = next;
+    }
+    return count;
+}
+
+INTERNAL void _tlsf_mt_push_pending(Tlsf_Mt_Cache* cache)
+{
+    if(cache->pending_count > 0)
+    {
+        sync_list_push_chain(&cache->pending_owner->remote_frees, cache->pending_first, cache->pending_last);
+        cache->pending_owner = NULL;
+        cache->pending_first = NULL;
+        cache->pending_last = NULL;
+        cache->pending_count = 0;
+    }
+}
+
+//Moves all remotely freed blocks into the free lists. Returns the number of blocks taken.
+INTERNAL isize _tlsf_mt_drain_remote(Tlsf_Mt_Cache* cache)
+{
+    isize count = 0;
+    Tlsf_Mt_Block* block = (Tlsf_Mt_Block*) sync_list_pop_all(&cache->remote_frees);
+    for(; block; count++)
+    {
+        Tlsf_Mt_Block* next = block->next;
+        Tlsf_Mt_Header* header = _tlsf_mt_header(block);
+        ASSERT(header->owner == cache);
+        block->next = cache->free_lists[header->size_class];
+        cache->free_lists[header->size_class] = block;
+        cache->free_counts[header->size_class] += 1;
+        block = next;
+    }
+    return count;
+}
+
+//Returns every cached block back to tlsf. Needs to hold the lock.
+INTERNAL void _tlsf_mt_cache_release_locked(Tlsf_Mt_Cache* cache)
+{
+    Tlsf_Mt_Allocator* allocator = cache->allocator;
+    _tlsf_mt_drain_remote(cache);
+    for(int32_t i = 0; i < TLSF_MT_SIZE_CLASSES; i++)
+    {
+        _tlsf_mt_free_chain_locked(allocator, cache->free_lists[i]);
+        cache->free_lists[i] = NULL;
+        cache->free_counts[i] = 0;
+    }
+}
+
+static ATTRIBUTE_INLINE_NEVER Tlsf_Mt_Cache* _tlsf_mt_attach(Tlsf_Mt_Allocator* allocator)
+{
+    mutex_lock(&allocator->lock, SYNC_WAIT_BLOCK);
+    Tlsf_Mt_Cache* cache = NULL;
+    for(Tlsf_Mt_Cache* it = allocator->caches; it; it = it->next)
+        if(it->is_detached)
+        {
+            cache = it;
+            break;
+        }
+
+    if(cache == NULL)
+    {
+        cache = (Tlsf_Mt_Cache*) tlsf_malloc(allocator->tlsf, sizeof *cache, 64, 0);
+        if(cache)
+        {
+            memset(cache, 0, sizeof *cache);
+            cache->allocator = allocator;
+            cache->next = allocator->caches;
+            allocator->caches = cache;
+        }
+    }
+
+    if(cache)
+        cache->is_detached = false;
+    mutex_unlock(&allocator->lock, SYNC_WAIT_BLOCK);
+
+    //If we ran out of memory for the cache itself the caller falls back to the direct path.
+    // If all slots are used the evicted cache stays attached until deinit (see the top of the file).
+    if(cache)
+        sync_thread_slots_set(&_tlsf_mt_slots, allocator->id, cache);
+    return cache;
+}
+
+INTERNAL Tlsf_Mt_Cache* _tlsf_mt_get_cache(Tlsf_Mt_Allocator* allocator)
+{
+    Tlsf_Mt_Cache* cache = (Tlsf_Mt_Cache*) sync_thread_slots_get(&_tlsf_mt_slots, allocator->id);
+    return cache ? cache : _tlsf_mt_attach(allocator);
+}
+
+static ATTRIBUTE_INLINE_NEVER bool _tlsf_mt_refill(Tlsf_Mt_Cache* cache, int32_t size_class)
+{
+    //Remote frees are free refills
+    _tlsf_mt_push_pending(cache);
+    if(_tlsf_mt_drain_remote(cache) > 0 && cache->free_lists[size_class])
+        return true;
+
+    Tlsf_Mt_Allocator* allocator = cache->allocator;
+    isize batch = _tlsf_mt_batch_size(size_class);
+    isize block_size = _tlsf_mt_class_sizes[size_class] + (isize) sizeof(Tlsf_Mt_Header);
+
+    isize got = 0;
+    mutex_lock(&allocator->lock, SYNC_WAIT_BLOCK);
+    for(; got < batch; got++)
+    {
+        Tlsf_Mt_Header* header = (Tlsf_Mt_Header*) tlsf_malloc(allocator->tlsf, block_size, TLSF_MT_MAX_CACHED_ALIGN, 0);
+        if(header == NULL)
+            break;
+
+        header->owner = cache;
+        header->size_class = (uint32_t) size_class;
+        header->magic = TLSF_MT_MAGIC;
+
+        Tlsf_Mt_Block* block = (Tlsf_Mt_Block*) (void*) (header + 1);
+        block->next = cache->free_lists[size_class];
+        cache->free_lists[size_class] = block;
+    }
+    mutex_unlock(&allocator->lock, SYNC_WAIT_BLOCK);
+
+    cache->free_counts[size_class] += got;
+    sync_single_writer_add(&cache->refill_count, 1);
+    return got > 0;
+}
+
+static ATTRIBUTE_INLINE_NEVER void _tlsf_mt_flush(Tlsf_Mt_Cache* cache, int32_t size_class)
+{
+    Tlsf_Mt_Allocator* allocator = cache->allocator;
+    isize batch = _tlsf_mt_batch_size(size_class);
+
+    //Detach the first `batch` blocks. The ones we keep are the most recently freed thus the warmest.
+    Tlsf_Mt_Block* kept = cache->free_lists[size_class];
+    for(isize i = 0; i < cache->free_counts[size_class] - batch - 1; i++)
+        kept = kept->next;
+
+    Tlsf_Mt_Block* flushed = kept->next;
+    kept->next = NULL;
+    cache->free_counts[size_class] -= batch;
+
+    mutex_lock(&allocator->lock, SYNC_WAIT_BLOCK);
+    isize count = _tlsf_mt_free_chain_locked(allocator, flushed);
+    mutex_unlock(&allocator->lock, SYNC_WAIT_BLOCK);
+
+    ASSERT(count == batch);
+    sync_single_writer_add(&cache->flush_count, 1);
+}
+
+EXTERNAL void* tlsf_mt_malloc(Tlsf_Mt_Allocator* allocator, isize size, isize align)
+{
+    int32_t size_class = tlsf_mt_size_class(size, align);
+    if(size_class < 0)
+        return _tlsf_mt_direct_malloc(allocator, size, align);
+
+    //If we cannot get a cache (out of memory) the block goes directly to tlsf. It still needs a header
+    // because tlsf_mt_free only sees the size. The NULL owner marks it as direct.
+    Tlsf_Mt_Cache* cache = _tlsf_mt_get_cache(allocator);
+    if(cache == NULL)
+    {
+        isize block_size = _tlsf_mt_class_sizes[size_class] + (isize) sizeof(Tlsf_Mt_Header);
+        Tlsf_Mt_Header* header = (Tlsf_Mt_Header*) _tlsf_mt_direct_malloc(allocator, block_size, TLSF_MT_MAX_CACHED_ALIGN);
+        if(header == NULL)
+            return NULL;
+
+        header->owner = NULL;
+        header->size_class = (uint32_t) size_class;
+        header->magic = TLSF_MT_MAGIC;
+        return header + 1;
+    }
+
+    if(cache->free_lists[size_class] == NULL && _tlsf_mt_refill(cache, size_class) == false)
+        return NULL;
+
+    Tlsf_Mt_Block* block = cache->free_lists[size_class];
+    cache->free_lists[size_class] = block->next;
+    cache->free_counts[size_class] -= 1;
+
+    sync_single_writer_add(&cache->bytes_allocated, _tlsf_mt_class_sizes[size_class]);
+    sync_single_writer_add(&cache->allocation_count, 1);
+    return block;
+}
+
+EXTERNAL void tlsf_mt_free(Tlsf_Mt_Allocator* allocator, void* ptr, isize size, isize align)
+{
+    if(ptr == NULL)
+        return;
+
+    int32_t size_class = tlsf_mt_size_class(size, align);
+    if(size_class < 0)
+    {
+        _tlsf_mt_direct_free(allocator, ptr, size);
+        return;
+    }
+
+    Tlsf_Mt_Header* header = _tlsf_mt_header(ptr);
+    ASSERT(header->size_class == (uint32_t) size_class, "Block freed with a different size then it was allocated with");
+    if(header->owner == NULL)
+    {
+        _tlsf_mt_direct_free(allocator, header, _tlsf_mt_class_sizes[size_class] + (isize) sizeof(Tlsf_Mt_Header));
+        return;
+    }
+
+    ASSERT(header->owner->allocator == allocator);
+
+    //If we cannot get a cache (out of memory) send the block back to its owner directly
+    Tlsf_Mt_Cache* cache = _tlsf_mt_get_cache(allocator);
+    Tlsf_Mt_Block* block = (Tlsf_Mt_Block*) ptr;
+    if(cache == NULL)
+    {
+        sync_list_push(&header->owner->remote_frees, block);
+        return;
+    }
+
+    if(header->owner == cache)
+    {
+        block->next = cache->free_lists[size_class];
+        cache->free_lists[size_class] = block;
+        cache->free_counts[size_class] += 1;
+        if(cache->free_counts[size_class] > 2*_tlsf_mt_batch_size(size_class))
+            _tlsf_mt_flush(cache, size_class);
+    }
+    else
+    {
+        if(cache->pending_owner != header->owner)
+            _tlsf_mt_push_pending(cache);
+
+        block->next = cache->pending_first;
+        cache->pending_first = block;
+        if(cache->pending_count == 0)
+        {
+            cache->pending_last = block;
+            cache->pending_owner = header->owner;
+        }
+        cache->pending_count += 1;
+        if(cache->pending_count >= TLSF_MT_REMOTE_BATCH)
+            _tlsf_mt_push_pending(cache);
+    }
+
+    sync_single_writer_add(&cache->bytes_allocated, -_tlsf_mt_class_sizes[size_class]);
+    sync_single_writer_add(&cache->deallocation_count, 1);
+}
+
+EXTERNAL void tlsf_mt_thread_detach(Tlsf_Mt_Allocator* allocator)
+{
+    Tlsf_Mt_Cache* cache = (Tlsf_Mt_Cache*) sync_thread_slots_remove(&_tlsf_mt_slots, allocator->id);
+    if(cache)
+    {
+        _tlsf_mt_push_pending(cache);
+        mutex_lock(&allocator->lock, SYNC_WAIT_BLOCK);
+        _tlsf_mt_cache_release_locked(cache);
+        cache->is_detached = true;
+        mutex_unlock(&allocator->lock, SYNC_WAIT_BLOCK);
+    }
+}
+
+EXTERNAL void tlsf_mt_init(Tlsf_Mt_Allocator* allocator, Tlsf_Allocator* tlsf, const char* name_or_null)
+{
+    ASSERT(tlsf && tlsf->memory, "Tlsf_Mt_Allocator needs a Tlsf_Allocator with a memory block");
+    memset(allocator, 0, sizeof *allocator);
+    allocator->allocator = tlsf_mt_allocator_func;
+    allocator->name = name_or_null;
+    allocator->tlsf = tlsf;
+    allocator->id = sync_thread_slots_make_id();
+}
+
+EXTERNAL void tlsf_mt_deinit(Tlsf_Mt_Allocator* allocator)
+{
+    tlsf_mt_thread_detach(allocator);
+    mutex_lock(&allocator->lock, SYNC_WAIT_BLOCK);
+
+    //Pending chains hold blocks of other caches so free them first. Then each cache has all of its blocks.
+    for(Tlsf_Mt_Cache* cache = allocator->caches; cache; cache = cache->next)
+    {
+        _tlsf_mt_free_chain_locked(allocator, cache->pending_first);
+        cache->pending_count = 0;
+    }
+
+    for(Tlsf_Mt_Cache* cache = allocator->caches; cache; )
+    {
+        Tlsf_Mt_Cache* next = cache->next;
+        _tlsf_mt_cache_release_locked(cache);
+        tlsf_free(allocator->tlsf, cache);
+        cache = next;
+    }
+
+    mutex_unlock(&allocator->lock, SYNC_WAIT_BLOCK);
+    memset(allocator, 0, sizeof *allocator);
+}
+
+EXTERNAL void* tlsf_mt_allocator_func(void* self, int mode, int64_t new_size, void* old_ptr, int64_t old_size, int64_t align, void* other)
+{
+    Tlsf_Mt_Allocator* allocator = (Tlsf_Mt_Allocator*) self;
+    if(mode == ALLOCATOR_MODE_ALLOC) {
+        //Resizing within the same size class is free
+        int32_t new_class = tlsf_mt_size_class(new_size, align);
+        if(old_size > 0 && new_class >= 0 && new_class == tlsf_mt_size_class(old_size, align))
+            return old_ptr;
+
+        void* new_ptr = NULL;
+        if(new_size > 0)
+        {
+            new_ptr = tlsf_mt_malloc(allocator, new_size, align);
+            if(new_ptr == NULL)
+            {
+                allocator_error((Allocator_Error*) other, ALLOCATOR_ERROR_OUT_OF_MEM, (Allocator*) self, new_size, old_ptr, old_size, align, "Out of memory");
+                return NULL;
+            }
+        }
+
+        if(old_size > 0)
+        {
+            ASSERT(old_ptr);
+            if(new_ptr)
+            {
+                memcpy(new_ptr, old_ptr, (size_t) MIN(old_size, new_size));
+                Tlsf_Mt_Cache* cache = new_class >= 0 ? _tlsf_mt_get_cache(allocator) : NULL;
+                if(cache)
+                    sync_single_writer_add(&cache->reallocation_count, 1);
+            }
+            tlsf_mt_free(allocator, old_ptr, old_size, align);
+        }
+        return new_ptr;
+    }
+    if(mode == ALLOCATOR_MODE_GET_STATS) {
+        Allocator_Stats stats = {0};
+        stats.type_name = "Tlsf_Mt_Allocator";
+        stats.name = allocator->name;
+        stats.is_top_level = false;
+        stats.is_capable_of_resize = true;
+
+        mutex_lock(&allocator->lock, SYNC_WAIT_BLOCK);
+        stats.bytes_allocated = allocator->direct_bytes_allocated;
+        stats.allocation_count = allocator->direct_allocation_count;
+        stats.deallocation_count = allocator->direct_deallocation_count;
+        stats.max_bytes_allocated = allocator->tlsf->max_bytes_allocated;
+        for(Tlsf_Mt_Cache* cache = allocator->caches; cache; cache = cache->next)
+        {
+            stats.bytes_allocated += atomic_load_explicit(&cache->bytes_allocated, memory_order_relaxed);
+            stats.allocation_count += atomic_load_explicit(&cache->allocation_count, memory_order_relaxed);
+            stats.deallocation_count += atomic_load_explicit(&cache->deallocation_count, memory_order_relaxed);
+            stats.reallocation_count += atomic_load_explicit(&cache->reallocation_count, memory_order_relaxed);
+        }
+        mutex_unlock(&allocator->lock, SYNC_WAIT_BLOCK);
+        *(Allocator_Stats*) other = stats;
+    }
+    return NULL;
+}
+#endif
@@ -0,0 +1,480 @@
+#ifndef MODULE_ALLOCATOR_TRACE
+#define MODULE_ALLOCATOR_TRACE
+
+// Records every allocation, deallocation and resize going through an allocator into a binary trace file
+// and replays such traces against any other Allocator. The point is to choose and tune allocators against
+// real allocation patterns of the program instead of synthetic loops.
+//
+// Allocation_Trace_Recorder is an allocator wrapper. It forwards everything to its parent and appends one
+// 32B Allocation_Trace_Event per call into a buffer which gets written to the file once full. Pointers are
+// not stored directly. Instead each live allocation is given a small id which stays the same across
+// resizes and gets reused after it is freed. This keeps the replay bookkeeping a flat array.
+// The recorder is thread safe - it holds a mutex for the duration of the parent call so that the order of
+// events in the trace is the order in which they actually happened. The parent thus does not have to be thread safe
+// but the recording obviously serializes all allocations.
+//
+// allocation_trace_load memory maps the trace file and allocation_trace_replay drives the given Allocator with it.
+// The replay is single threaded in the recorded order, the thread index of each event is kept only for inspection.
+// It touches one byte of each page of every allocation so that the memory becomes resident and reports:
+//  - throughput: the time spent inside the replay loop (allocator calls + page touches).
+//  - peak RSS: the maximum increase in the process resident memory over the start of the replay. Sampled every
+//    ALLOCATION_REPLAY_RSS_PERIOD events and at the end. Only available on linux - is 0 elsewhere.
+//  - fragmentation: 1 - peak_live_bytes/peak_rss_bytes. That is the fraction of resident memory which at its
+//    peak did not hold live allocations. Allocators which reuse memory they held before the replay (malloc)
+//    can appear better than they are so its best to replay each allocator in a fresh process.
+//
+// Once the trace is replayed all allocations still alive are freed (outside of the timed section) so that
+// the allocator can be reused or deinited without leaks.
+//
+// The file consists of Allocation_Trace_Header followed by the events.
+
+#include "allocator.h"
+#include "platform.h"
+#include "sync.h"
+#include "hash.h"
+#include "hash_func.h"
+#include <stdio.h>
+
+#define ALLOCATION_TRACE_MAGIC          0x4352544F4C4C41ULL //"ALLOTRC" in little endian
+#define ALLOCATION_TRACE_VERSION        1
+#define ALLOCATION_TRACE_BUFFER_EVENTS  4096
+#define ALLOCATION_REPLAY_RSS_PERIOD    1024
+
+typedef enum Allocation_Trace_Kind {
+    ALLOCATION_TRACE_ALLOC = 1,
+    ALLOCATION_TRACE_FREE = 2,
+    ALLOCATION_TRACE_RESIZE = 3,
+    ALLOCATION_TRACE_FAILED = 16,       //flag: the parent allocator returned NULL. The allocation did not change.
+} Allocation_Trace_Kind;
+
+typedef struct Allocation_Trace_Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t event_size;
+    uint8_t _[16];
+} Allocation_Trace_Header;
+
+typedef struct Allocation_Trace_Event {
+    uint64_t time;              //nanoseconds since the start of the recording
+    uint64_t new_size   : 48;
+    uint64_t align_log2 : 8;
+    uint64_t kind       : 8;    //Allocation_Trace_Kind possibly with ALLOCATION_TRACE_FAILED
+    uint64_t old_size   : 48;
+    uint64_t thread     : 16;   //index of the calling thread in the order of first appearance
+    uint32_t id;                //id of the allocation. 1 based.
+    uint32_t _;
+} Allocation_Trace_Event;
+
+typedef struct Allocation_Trace_Recorder {
+    Allocator alloc[1];
+    Allocator* parent;
+    Allocator* internal;    //used for the bookkeeping
+    const char* name;
+
+    Platform_File file;
+    Platform_Error file_error; //first error encountered while writing
+    Mutex mutex;
+    int64_t start_counter;
+
+    Hash ptr_hash;          //hashed pointer -> id
+    Hash thread_hash;       //hashed thread id -> index
+    uint32_t* free_ids;
+    uint32_t free_id_count;
+    uint32_t free_id_capacity;
+    uint32_t id_count;      //ids ever handed out
+    uint32_t thread_count;
+
+    Allocation_Trace_Event* buffer;
+    isize buffer_count;
+    isize event_count;      //events recorded including the ones in buffer
+
+    isize bytes_allocated;
+    isize max_bytes_allocated;
+    isize allocation_count;
+    isize deallocation_count;
+    isize reallocation_count;
+} Allocation_Trace_Recorder;
+
+typedef struct Allocation_Trace {
+    Platform_Memory_Mapping mapping;
+    const Allocation_Trace_Event* events;
+    isize event_count;
+
+    //Computed on load
+    uint32_t max_id;
+    uint32_t thread_count;
+    isize peak_live_bytes;
+    isize peak_live_count;
+    double duration;        //seconds between the first and last event
+} Allocation_Trace;
+
+typedef struct Allocation_Replay_Stats {
+    isize event_count;
+    isize allocation_count;
+    isize deallocation_count;
+    isize reallocation_count;
+    isize failed_count;     //events which failed during replay (or depend on allocation which failed)
+
+    double seconds;
+    double events_per_second;
+
+    isize peak_live_bytes;
+    isize peak_rss_bytes;
+    double fragmentation;
+} Allocation_Replay_Stats;
+
+EXTERNAL Platform_Error allocation_trace_recorder_init(Allocation_Trace_Recorder* self, Allocator* parent_or_null, Allocator* internal_or_null, Platform_String path, const char* name);
+//Flushes the remaining events and closes the file. Returns the first error encountered while writing.
+EXTERNAL Platform_Error allocation_trace_recorder_deinit(Allocation_Trace_Recorder* self);
+EXTERNAL Platform_Error allocation_trace_recorder_flush(Allocation_Trace_Recorder* self);
+EXTERNAL void* allocation_trace_recorder_func(void* self, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest);
+
+EXTERNAL Platform_Error allocation_trace_load(Allocation_Trace* trace, Platform_String path);
+EXTERNAL void allocation_trace_unload(Allocation_Trace* trace);
+EXTERNAL Allocation_Replay_Stats allocation_trace_replay(const Allocation_Trace* trace, Allocator* alloc);
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_ALLOCATOR_TRACE)) && !defined(MODULE_HAS_IMPL_ALLOCATOR_TRACE)
+#define MODULE_HAS_IMPL_ALLOCATOR_TRACE
+
+#ifndef INTERNAL
+    #define INTERNAL inline static
+#endif
+
+#define _ALLOCATION_TRACE_HASH_EMPTY ((uint64_t) -2)
+
+typedef struct _Allocation_Replay_Slot {
+    void* ptr;
+    isize size;
+    isize align;
+} _Allocation_Replay_Slot;
+
+INTERNAL Platform_Error _allocation_trace_recorder_flush_locked(Allocation_Trace_Recorder* self)
+{
+    if(self->buffer_count > 0 && self->file_error == 0)
+    {
+        isize written_before = self->event_count - self->buffer_count;
+        isize offset = (isize) sizeof(Allocation_Trace_Header) + written_before*(isize) sizeof(Allocation_Trace_Event);
+        self->file_error = platform_file_write(&self->file, self->buffer, self->buffer_count*(isize) sizeof(Allocation_Trace_Event), offset);
+    }
+    self->buffer_count = 0;
+    return self->file_error;
+}
+
+INTERNAL uint32_t _allocation_trace_recorder_thread(Allocation_Trace_Recorder* self)
+{
+    uint64_t hash = hash64_bijective((uint64_t) platform_thread_id());
+    isize found = 0;
+    if(hash_find(&self->thread_hash, hash, &found))
+        return (uint32_t) self->thread_hash.entries[found].value;
+
+    uint32_t index = self->thread_count++;
+    hash_insert(&self->thread_hash, hash, index);
+    return index;
+}
+
+INTERNAL uint32_t _allocation_trace_recorder_take_id(Allocation_Trace_Recorder* self, void* ptr)
+{
+    uint32_t id = 0;
+    if(self->free_id_count > 0)
+        id = self->free_ids[--self->free_id_count];
+    else
+        id = ++self->id_count;
+
+    hash_insert(&self->ptr_hash, hash64_bijective((uint64_t) ptr), id);
+    return id;
+}
+
+INTERNAL uint32_t _allocation_trace_recorder_release_id(Allocation_Trace_Recorder* self, void* ptr)
+{
+    isize found = 0;
+    if(hash_find(&self->ptr_hash, hash64_bijective((uint64_t) ptr), &found) == false)
+        return 0;
+
+    uint32_t id = (uint32_t) self->ptr_hash.entries[found].value;
+    hash_remove(&self->ptr_hash, found);
+    if(self->free_id_count >= self->free_id_capacity)
+    {
+        uint32_t new_capacity = self->free_id_capacity*2 + 64;
+        self->free_ids = (uint32_t*) allocator_reallocate(self->internal, new_capacity*(isize) sizeof(uint32_t), self->free_ids, self->free_id_capacity*(isize) sizeof(uint32_t), __alignof(uint32_t));
+        self->free_id_capacity = new_capacity;
+    }
+    self->free_ids[self->free_id_count++] = id;
+    return id;
+}
+
+EXTERNAL Platform_Error allocation_trace_recorder_init(Allocation_Trace_Recorder* self, Allocator* parent_or_null, Allocator* internal_or_null, Platform_String path, const char* name)
+{
+    allocation_trace_recorder_deinit(self);
+    self->alloc[0] = allocation_trace_recorder_func;
+    self->parent = parent_or_null ? parent_or_null : allocator_get_default();
+    self->internal = internal_or_null ? internal_or_null : allocator_get_malloc();
+    self->name = name;
+    self->start_counter = platform_perf_counter();
+    self->buffer = (Allocation_Trace_Event*) allocator_allocate(self->internal, ALLOCATION_TRACE_BUFFER_EVENTS*(isize) sizeof(Allocation_Trace_Event), __alignof(Allocation_Trace_Event));
+    hash_init(&self->ptr_hash, self->internal, _ALLOCATION_TRACE_HASH_EMPTY);
+    hash_init(&self->thread_hash, self->internal, _ALLOCATION_TRACE_HASH_EMPTY);
+
+    Allocation_Trace_Header header = {0};
+    header.magic = ALLOCATION_TRACE_MAGIC;
+    header.version = ALLOCATION_TRACE_VERSION;
+    header.event_size = sizeof(Allocation_Trace_Event);
+    self->file_error = platform_file_open(&self->file, path, PLATFORM_FILE_OPEN_WRITE | PLATFORM_FILE_OPEN_CREATE | PLATFORM_FILE_OPEN_REMOVE_CONTENT);
+    if(self->file_error == 0)
+        self->file_error = platform_file_write(&self->file, &header, sizeof header, 0);
+    return self->file_error;
+}
+
+EXTERNAL Platform_Error allocation_trace_recorder_deinit(Allocation_Trace_Recorder* self)
+{
+    Platform_Error error = 0;
+    if(self->internal)
+    {
+        error = _allocation_trace_recorder_flush_locked(self);
+        platform_file_close(&self->file);
+        hash_deinit(&self->ptr_hash);
+        hash_deinit(&self->thread_hash);
+        allocator_deallocate(self->internal, self->free_ids, self->free_id_capacity*(isize) sizeof(uint32_t), __alignof(uint32_t));
+        allocator_deallocate(self->internal, self->buffer, ALLOCATION_TRACE_BUFFER_EVENTS*(isize) sizeof(Allocation_Trace_Event), __alignof(Allocation_Trace_Event));
+    }
+    memset(self, 0, sizeof *self);
+    return error;
+}
+
+EXTERNAL Platform_Error allocation_trace_recorder_flush(Allocation_Trace_Recorder* self)
+{
+    mutex_lock(&self->mutex, SYNC_WAIT_BLOCK);
+    Platform_Error error = _allocation_trace_recorder_flush_locked(self);
+    if(error == 0)
+        error = platform_file_flush(&self->file);
+    mutex_unlock(&self->mutex, SYNC_WAIT_BLOCK);
+    return error;
+}
+
+EXTERNAL void* allocation_trace_recorder_func(void* self_void, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest)
+{
+    Allocation_Trace_Recorder* self = (Allocation_Trace_Recorder*) self_void;
+    if(mode == ALLOCATOR_MODE_ALLOC) {
+        if(old_ptr == NULL && new_size == 0)
+            return NULL;
+
+        mutex_lock(&self->mutex, SYNC_WAIT_BLOCK);
+        void* new_ptr = (*self->parent)(self->parent, ALLOCATOR_MODE_ALLOC, new_size, old_ptr, old_size, align, rest);
+        bool failed = new_ptr == NULL && new_size > 0;
+
+        Allocation_Trace_Event event = {0};
+        event.time = (uint64_t) ((double) (platform_perf_counter() - self->start_counter)*1e9/(double) platform_perf_counter_frequency());
+        event.new_size = (uint64_t) new_size;
+        event.old_size = (uint64_t) old_size;
+        event.thread = _allocation_trace_recorder_thread(self);
+        for(isize a = align; a > 1; a /= 2)
+            event.align_log2 += 1;
+
+        if(old_ptr == NULL)
+        {
+            event.kind = ALLOCATION_TRACE_ALLOC;
+            if(failed == false)
+                event.id = _allocation_trace_recorder_take_id(self, new_ptr);
+            self->allocation_count += 1;
+        }
+        else if(new_size == 0)
+        {
+            event.kind = ALLOCATION_TRACE_FREE;
+            event.id = _allocation_trace_recorder_release_id(self, old_ptr);
+            self->deallocation_count += 1;
+        }
+        else
+        {
+            event.kind = ALLOCATION_TRACE_RESIZE;
+            if(failed == false)
+            {
+                event.id = _allocation_trace_recorder_release_id(self, old_ptr);
+                if(event.id != 0)
+                {
+                    self->free_id_count -= 1; //Take the same id back
+                    hash_insert(&self->ptr_hash, hash64_bijective((uint64_t) new_ptr), event.id);
+                }
+            }
+            self->reallocation_count += 1;
+        }
+
+        if(failed)
+            event.kind |= ALLOCATION_TRACE_FAILED;
+        else
+        {
+            self->bytes_allocated += new_size - old_size;
+            self->max_bytes_allocated = MAX(self->max_bytes_allocated, self->bytes_allocated);
+        }
+
+        self->buffer[self->buffer_count++] = event;
+        self->event_count += 1;
+        if(self->buffer_count >= ALLOCATION_TRACE_BUFFER_EVENTS)
+            _allocation_trace_recorder_flush_locked(self);
+
+        mutex_unlock(&self->mutex, SYNC_WAIT_BLOCK);
+        return new_ptr;
+    }
+    if(mode == ALLOCATOR_MODE_GET_STATS) {
+        Allocator_Stats stats = {0};
+        stats.type_name = "Allocation_Trace_Recorder";
+        stats.name = self->name;
+        stats.parent = self->parent;
+        stats.is_growing = true;
+        stats.is_capable_of_resize = true;
+        stats.bytes_allocated = self->bytes_allocated;
+        stats.max_bytes_allocated = self->max_bytes_allocated;
+        stats.allocation_count = self->allocation_count;
+        stats.deallocation_count = self->deallocation_count;
+        stats.reallocation_count = self->reallocation_count;
+        *(Allocator_Stats*) rest = stats;
+    }
+    return NULL;
+}
+
+EXTERNAL Platform_Error allocation_trace_load(Allocation_Trace* trace, Platform_String path)
+{
+    allocation_trace_unload(trace);
+
+    Platform_Memory_Mapping mapping = {0};
+    Platform_Error error = platform_file_memory_map(path, &mapping);
+    if(error == 0)
+    {
+        Allocation_Trace_Header header = {0};
+        if(mapping.size >= (isize) sizeof header)
+            memcpy(&header, mapping.address, sizeof header);
+
+        isize events_size = mapping.size - (isize) sizeof header;
+        if(header.magic != ALLOCATION_TRACE_MAGIC
+            || header.version != ALLOCATION_TRACE_VERSION
+            || header.event_size != sizeof(Allocation_Trace_Event)
+            || events_size % (isize) sizeof(Allocation_Trace_Event) != 0)
+            error = PLATFORM_ERROR_OTHER;
+
+        if(error == 0)
+        {
+            trace->mapping = mapping;
+            trace->events = (const Allocation_Trace_Event*) (void*) ((uint8_t*) mapping.address + sizeof header);
+            trace->event_count = events_size/(isize) sizeof(Allocation_Trace_Event);
+
+            isize live_bytes = 0;
+            isize live_count = 0;
+            for(isize i = 0; i < trace->event_count; i++)
+            {
+                Allocation_Trace_Event event = trace->events[i];
+                if(event.kind & ALLOCATION_TRACE_FAILED)
+                    continue;
+
+                live_bytes += (isize) event.new_size - (isize) event.old_size;
+                live_count += (event.kind == ALLOCATION_TRACE_ALLOC) - (event.kind == ALLOCATION_TRACE_FREE);
+                trace->max_id = MAX(trace->max_id, event.id);
+                trace->thread_count = MAX(trace->thread_count, (uint32_t) event.thread + 1);
+                trace->peak_live_bytes = MAX(trace->peak_live_bytes, live_bytes);
+                trace->peak_live_count = MAX(trace->peak_live_count, live_count);
+            }
+
+            if(trace->event_count > 0)
+                trace->duration = (double) (trace->events[trace->event_count - 1].time - trace->events[0].time)/1e9;
+        }
+        else
+            platform_file_memory_unmap(&mapping);
+    }
+
+    return error;
+}
+
+EXTERNAL void allocation_trace_unload(Allocation_Trace* trace)
+{
+    platform_file_memory_unmap(&trace->mapping);
+    memset(trace, 0, sizeof *trace);
+}
+
+//Resident memory of the whole process. The statm file is generated as it is read so read it through stdio.
+INTERNAL isize _allocation_trace_rss()
+{
+    isize rss = 0;
+    #ifdef __linux__
+    FILE* statm = fopen("/proc/self/statm", "rb");
+    if(statm)
+    {
+        long long size = 0, resident = 0;
+        if(fscanf(statm, "%lld %lld", &size, &resident) == 2)
+            rss = (isize) resident*platform_page_size();
+        fclose(statm);
+    }
+    #endif
+    return rss;
+}
+
+EXTERNAL Allocation_Replay_Stats allocation_trace_replay(const Allocation_Trace* trace, Allocator* alloc)
+{
+    Allocation_Replay_Stats stats = {0};
+    stats.peak_live_bytes = trace->peak_live_bytes;
+
+    //Indexed by id
+    Allocator* internal = allocator_get_malloc();
+    isize slot_count = (isize) trace->max_id + 1;
+    _Allocation_Replay_Slot* slots = (_Allocation_Replay_Slot*) allocator_allocate(internal, slot_count*(isize) sizeof *slots, __alignof(_Allocation_Replay_Slot));
+    memset(slots, 0, (size_t) slot_count*sizeof *slots);
+
+    isize page_size = platform_page_size();
+    isize baseline_rss = _allocation_trace_rss();
+    int64_t ticks = 0;
+    for(isize from = 0; from < trace->event_count; from += ALLOCATION_REPLAY_RSS_PERIOD)
+    {
+        isize to = MIN(from + ALLOCATION_REPLAY_RSS_PERIOD, trace->event_count);
+        int64_t before = platform_perf_counter();
+        for(isize i = from; i < to; i++)
+        {
+            Allocation_Trace_Event event = trace->events[i];
+            if(event.kind & ALLOCATION_TRACE_FAILED)
+                continue;
+
+            stats.event_count += 1;
+            _Allocation_Replay_Slot* slot = &slots[event.id];
+            if(event.kind == ALLOCATION_TRACE_ALLOC)
+                stats.allocation_count += 1;
+            else
+            {
+                stats.deallocation_count += event.kind == ALLOCATION_TRACE_FREE;
+                stats.reallocation_count += event.kind == ALLOCATION_TRACE_RESIZE;
+
+                //The allocation failed during replay (or was not known to the recorder)
+                if(slot->ptr == NULL)
+                {
+                    stats.failed_count += 1;
+                    continue;
+                }
+            }
+
+            isize new_size = (isize) event.new_size;
+            isize align = (isize) 1 << event.align_log2;
+            void* new_ptr = allocator_try_reallocate(alloc, new_size, slot->ptr, slot->size, align, NULL);
+            if(new_ptr == NULL && new_size > 0)
+            {
+                stats.failed_count += 1;
+                continue;
+            }
+
+            slot->ptr = new_ptr;
+            slot->size = new_size;
+            slot->align = align;
+            for(isize offset = 0; offset < new_size; offset += page_size)
+                ((volatile uint8_t*) new_ptr)[offset] = (uint8_t) i;
+        }
+        ticks += platform_perf_counter() - before;
+        stats.peak_rss_bytes = MAX(stats.peak_rss_bytes, _allocation_trace_rss() - baseline_rss);
+    }
+
+    for(isize id = 1; id < slot_count; id++)
+        if(slots[id].ptr)
+            allocator_try_reallocate(alloc, 0, slots[id].ptr, slots[id].size, slots[id].align, NULL);
+
+    stats.seconds = (double) ticks/(double) platform_perf_counter_frequency();
+    stats.events_per_second = stats.seconds > 0 ? (double) stats.event_count/stats.seconds : 0;
+    if(stats.peak_rss_bytes > stats.peak_live_bytes)
+        stats.fragmentation = 1.0 - (double) stats.peak_live_bytes/(double) stats.peak_rss_bytes;
+
+    allocator_deallocate(internal, slots, slot_count*(isize) sizeof *slots, __alignof(_Allocation_Replay_Slot));
+    return stats;
+}
+#endif
@@ -9,17 +9,40 @@
 // 
 // The main purpose of Tracking_Allocator is to be a quick substitute until more complex allocators are built.
 // Tracking_Allocator also exposes a malloc like interface for some basic control over allocations
+//
+// When initialized with TRACKING_ALLOCATOR_INIT_SITES it also attributes every allocation to a call site and keeps
+// live and total bytes per site. The site is either the caller supplied tag (see tracking_allocator_set_site_tag)
+// or the first TRACKING_ALLOCATOR_SITE_KEY_FRAMES return addresses above the allocator. Allocations made through
+// the allocator.h helpers (allocator_allocate -> allocator_try_reallocate -> allocator) are 3 frames deep so the
+// function calling the helper is part of the key (with one frame to spare for tail calls and unwinders which report
+// one frame more) and two functions using allocator_allocate are two different sites. Capturing the few frames is
+// a short stack unwind on every new allocation. Only when a new
+// site is seen the TRACKING_ALLOCATOR_SITE_FRAMES return addresses above the allocator are captured for
+// tracking_allocator_dump_sites.
+// The index of the site is kept in the spare bits of the header so the header stays 24B. Reallocations stay
+// attributed to the site which made the original allocation. Once TRACKING_ALLOCATOR_MAX_SITES distinct sites
+// were seen new sites are no longer attributed.
 
 #include <stdlib.h>
 #include "allocator.h"
+#include "platform.h"
+#include "hash.h"
+#include "hash_func.h"
+#include "string.h"
+#include "sort.h"
+
+#define TRACKING_ALLOCATOR_SITE_FRAMES      6
+#define TRACKING_ALLOCATOR_SITE_KEY_FRAMES  4
+#define TRACKING_ALLOCATOR_MAX_SITES        0xFFFF
 
 typedef struct Allocation_List_Block {
     struct Allocation_List_Block* next_block; 
     struct Allocation_List_Block* prev_block;
 
-    uint64_t align       : 16;
-    uint64_t size        : 47;
+    uint64_t size        : 41;
+    uint64_t align_log2  : 6;
     uint64_t is_offset   : 1;
+    uint64_t site        : 16; //index + 1 into Tracking_Allocator sites. 0 if not attributed
 
     #ifdef DO_ASSERTS
     char magic[8];
@@ -30,6 +53,21 @@ typedef struct Allocation_List {
     Allocation_List_Block* last_block;
 } Allocation_List;
 
+typedef struct Tracking_Site {
+    uint64_t hash;
+    const char* tag;        //caller supplied tag or NULL if identified by the key frames
+    void* key_frames[TRACKING_ALLOCATOR_SITE_KEY_FRAMES]; //return addresses identifying the site. NULL for tagged sites
+    void* frames[TRACKING_ALLOCATOR_SITE_FRAMES]; //call stack of the first allocation from this site
+    int32_t frame_count;
+    int32_t _;
+
+    isize live_bytes;
+    isize live_count;
+    isize max_live_bytes;
+    isize total_bytes;
+    isize total_count;
+} Tracking_Site;
+
 typedef struct Tracking_Allocator {
     Allocator alloc[1];
     Allocator* parent; //parent allocator. If parent is null uses malloc/free
@@ -45,6 +83,13 @@ typedef struct Tracking_Allocator {
 
     Allocator_Set allocator_backup;
     uint64_t flags;
+
+    //Per call site aggregation. Only used with TRACKING_ALLOCATOR_INIT_SITES
+    const char* site_tag;   //when not NULL new allocations are attributed to this tag instead of the call stack
+    Hash site_hash;         //hashed tag pointer or return address -> index into sites
+    Tracking_Site* sites;
+    isize site_count;
+    isize site_capacity;
 } Tracking_Allocator;
 
 EXTERNAL void  allocation_list_free_all(Allocation_List* self, Allocator* parent_or_null);
@@ -53,9 +98,15 @@ EXTERNAL void* allocation_list_allocate(Allocation_List* self, Allocator* parent
 EXTERNAL isize allocation_list_get_block_size(Allocation_List* self, void* old_ptr);
 EXTERNAL Allocation_List_Block* allocation_list_get_block_header(Allocation_List* self, void* old_ptr);
 
-#define TRACKING_ALLOCATOR_INIT_USE 1
+#define TRACKING_ALLOCATOR_INIT_USE   1
+#define TRACKING_ALLOCATOR_INIT_SITES 2
 EXTERNAL void tracking_allocator_init(Tracking_Allocator* self, const char* name, uint64_t flags);
 EXTERNAL void tracking_allocator_deinit(Tracking_Allocator* self);
+
+//Sets the tag subsequent allocations will be attributed to. NULL goes back to attributing by call stack. Returns the previous tag.
+EXTERNAL const char* tracking_allocator_set_site_tag(Tracking_Allocator* self, const char* tag_or_null);
+//Appends one line per site sorted by live bytes from the largest: "<live bytes> <live count> <total bytes> <total count> <site>"
+EXTERNAL void tracking_allocator_dump_sites(const Tracking_Allocator* self, String_Builder* append_to);
  
 EXTERNAL void* tracking_allocator_malloc(Tracking_Allocator* self, isize size);
 EXTERNAL void* tracking_allocator_realloc(Tracking_Allocator* self, void* old_ptr, isize new_size);
@@ -102,7 +153,7 @@ EXTERNAL void* tracking_allocator_func(void* self_void, int mode, isize new_size
             Allocation_List_Block* prev_block = block->prev_block;
             _allocation_list_assert_block_coherency(self, block);
             
-            allocation_list_allocate(self, parent_or_null, 0, block + 1, block->size, block->align, NULL);
+            allocation_list_allocate(self, parent_or_null, 0, block + 1, block->size, (isize) 1 << block->align_log2, NULL);
             block = prev_block;
         }
 
@@ -140,7 +191,7 @@ EXTERNAL void* tracking_allocator_func(void* self_void, int mode, isize new_size
             if(is_offset)
             {
                 uint64_t* offset = (uint64_t*) (void*) new_block_ptr - 1;
-                *offset = (uint64_t) new_allocation - (uint64_t) new_block_ptr;
+                *offset = (uint64_t) new_block_ptr - (uint64_t) new_allocation;
             }
 
             new_block_ptr->is_offset = is_offset; 
@@ -148,8 +199,12 @@ EXTERNAL void* tracking_allocator_func(void* self_void, int mode, isize new_size
                 #pragma GCC diagnostic push
                 #pragma GCC diagnostic ignored "-Wconversion"
             #endif
-            new_block_ptr->align = (uint64_t) align; 
+            new_block_ptr->align_log2 = 0;
+            for(isize a = align; a > 1; a /= 2)
+                new_block_ptr->align_log2 += 1;
+            ASSERT(new_size < (isize) 1 << 41, "size must fit into the header");
             new_block_ptr->size = (uint64_t) new_size; 
+            new_block_ptr->site = 0;
             #ifdef __GNUC__
                 #pragma GCC diagnostic pop
             #endif
@@ -175,7 +230,7 @@ EXTERNAL void* tracking_allocator_func(void* self_void, int mode, isize new_size
         {
             Allocation_List_Block* old_block_ptr = (Allocation_List_Block*) old_ptr - 1;
             _allocation_list_assert_block_coherency(self, old_block_ptr);
-            ASSERT((isize) old_block_ptr->size == old_size && (isize) old_block_ptr->align == align);
+            ASSERT((isize) old_block_ptr->size == old_size && (isize) 1 << old_block_ptr->align_log2 == align);
 
             //Unlink the block from the list
             if(old_block_ptr->next_block != NULL)
@@ -230,12 +285,92 @@ EXTERNAL void* tracking_allocator_func(void* self_void, int mode, isize new_size
         return block->size;
     }
     
+    #define _TRACKING_HASH_EMPTY ((uint64_t) -2)
+
+    static ATTRIBUTE_INLINE_NEVER uint32_t _tracking_allocator_find_site(Tracking_Allocator* self)
+    {
+        //Skip this function, _tracking_allocator_allocate and the public function which called it
+        const char* tag = self->site_tag;
+        void* key_frames[TRACKING_ALLOCATOR_SITE_KEY_FRAMES] = {0};
+        if(tag == NULL)
+            platform_capture_call_stack(key_frames, TRACKING_ALLOCATOR_SITE_KEY_FRAMES, 3);
+
+        uint64_t hash = tag ? hash64_bijective((uint64_t) tag) : xxhash64(key_frames, sizeof key_frames, 0);
+        for(Hash_Iter it = {0}; hash_iterate(&self->site_hash, hash, &it); )
+        {
+            Tracking_Site* site = &self->sites[it.entry->value];
+            if(site->tag == tag && memcmp(site->key_frames, key_frames, sizeof key_frames) == 0)
+                return (uint32_t) it.entry->value + 1;
+        }
+
+        if(self->site_count >= TRACKING_ALLOCATOR_MAX_SITES)
+            return 0;
+
+        if(self->site_count >= self->site_capacity)
+        {
+            isize new_capacity = self->site_capacity*2 + 16;
+            self->sites = (Tracking_Site*) allocator_reallocate(allocator_get_malloc(), new_capacity*(isize) sizeof(Tracking_Site), self->sites, self->site_capacity*(isize) sizeof(Tracking_Site), __alignof(Tracking_Site));
+            self->site_capacity = new_capacity;
+        }
+
+        isize index = self->site_count++;
+        Tracking_Site* site = &self->sites[index];
+        memset(site, 0, sizeof *site);
+        site->hash = hash;
+        site->tag = tag;
+        memcpy(site->key_frames, key_frames, sizeof key_frames);
+        if(tag == NULL)
+            site->frame_count = (int32_t) platform_capture_call_stack(site->frames, TRACKING_ALLOCATOR_SITE_FRAMES, 3);
+        hash_insert(&self->site_hash, hash, (uint64_t) index);
+        return (uint32_t) index + 1;
+    }
+
+    //All allocation entry points go through here so that the call site is always the same number of frames up
+    static ATTRIBUTE_INLINE_NEVER void* _tracking_allocator_allocate(Tracking_Allocator* self, isize new_size, void* old_ptr, isize old_size, isize align, Allocator_Error* error)
+    {
+        //Reallocations stay with the site of the original allocation
+        uint32_t site_i = 0;
+        if((self->flags & TRACKING_ALLOCATOR_INIT_SITES) && (old_ptr || new_size > 0))
+            site_i = old_ptr ? allocation_list_get_block_header(&self->list, old_ptr)->site : _tracking_allocator_find_site(self);
+
+        void* out = allocation_list_allocate(&self->list, self->parent, new_size, old_ptr, old_size, align, error);
+        if(out == NULL && new_size > 0)
+            return NULL;
+
+        if(old_size == 0)
+            self->allocation_count += 1;
+        if(new_size == 0)
+            self->deallocation_count += 1;
+        if(new_size != 0 && old_size != 0)
+            self->reallocation_count += 1;
+
+        self->bytes_allocated += new_size - old_size;
+        if(self->max_bytes_allocated < self->bytes_allocated)
+            self->max_bytes_allocated = self->bytes_allocated;
+
+        if(site_i)
+        {
+            Tracking_Site* site = &self->sites[site_i - 1];
+            site->live_bytes += new_size - old_size;
+            site->live_count += (old_ptr == NULL) - (new_size == 0);
+            site->total_bytes += MAX(new_size - old_size, 0);
+            site->total_count += old_ptr == NULL;
+            site->max_live_bytes = MAX(site->max_live_bytes, site->live_bytes);
+            if(out)
+                allocation_list_get_block_header(&self->list, out)->site = site_i;
+        }
+
+        return out;
+    }
+
     EXTERNAL void tracking_allocator_init(Tracking_Allocator* self, const char* name, uint64_t flags)
     {
         tracking_allocator_deinit(self);
         self->alloc[0] = tracking_allocator_func;
         self->name = name;
         self->flags = flags;
+        if(flags & TRACKING_ALLOCATOR_INIT_SITES)
+            hash_init(&self->site_hash, allocator_get_malloc(), _TRACKING_HASH_EMPTY);
         if(flags & TRACKING_ALLOCATOR_INIT_USE)
             self->allocator_backup = allocator_set_default(&self->alloc[0]);
     }
@@ -245,28 +380,66 @@ EXTERNAL void* tracking_allocator_func(void* self_void, int mode, isize new_size
         allocation_list_free_all(&self->list, self->parent);
         if(self->flags & TRACKING_ALLOCATOR_INIT_USE)
             allocators_set(self->allocator_backup);
+        if(self->flags & TRACKING_ALLOCATOR_INIT_SITES)
+        {
+            hash_deinit(&self->site_hash);
+            allocator_deallocate(allocator_get_malloc(), self->sites, self->site_capacity*(isize) sizeof(Tracking_Site), __alignof(Tracking_Site));
+        }
 
         memset(self, 0, sizeof *self);
     }
 
-    EXTERNAL void* tracking_allocator_func(void* self_void, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest)
+    EXTERNAL const char* tracking_allocator_set_site_tag(Tracking_Allocator* self, const char* tag_or_null)
     {
-        Tracking_Allocator* self = (Tracking_Allocator*) (void*) self_void;
-        if(mode == ALLOCATOR_MODE_ALLOC) {
-            void* out = allocation_list_allocate(&self->list, self->parent, new_size, old_ptr, old_size, align, (Allocator_Error*) rest);
+        const char* prev = self->site_tag;
+        self->site_tag = tag_or_null;
+        return prev;
+    }
+
+    INTERNAL bool _tracking_site_is_larger(const void* a, const void* b, void* context)
+    {
+        const Tracking_Site* sites = (const Tracking_Site*) context;
+        return sites[*(const isize*) a].live_bytes > sites[*(const isize*) b].live_bytes;
+    }
+
+    EXTERNAL void tracking_allocator_dump_sites(const Tracking_Allocator* self, String_Builder* append_to)
+    {
+        isize* order = (isize*) allocator_allocate(allocator_get_malloc(), self->site_count*(isize) sizeof(isize), __alignof(isize));
+        for(isize i = 0; i < self->site_count; i++)
+            order[i] = i;
+        hqsort(order, self->site_count, sizeof(isize), _tracking_site_is_larger, self->sites);
 
-            if(old_size == 0)
-                self->allocation_count += 1;
-            if(new_size == 0)
-                self->deallocation_count += 1;
-            if(new_size != 0 && old_size != 0)
-                self->reallocation_count += 1;
+        for(isize i = 0; i < self->site_count; i++)
+        {
+            const Tracking_Site* site = &self->sites[order[i]];
+            format_append_into(append_to, "%lli %lli %lli %lli ", (lli) site->live_bytes, (lli) site->live_count, (lli) site->total_bytes, (lli) site->total_count);
+            if(site->tag)
+                format_append_into(append_to, "%s", site->tag);
+            else
+            {
+                Platform_Stack_Trace_Entry entries[TRACKING_ALLOCATOR_SITE_FRAMES];
+                platform_translate_call_stack(entries, (void**) site->frames, site->frame_count);
+                for(int32_t k = 0; k < site->frame_count; k++)
+                {
+                    if(k > 0)
+                        format_append_into(append_to, " <- ");
+                    if(entries[k].function[0])
+                        format_append_into(append_to, "%s", entries[k].function);
+                    else
+                        format_append_into(append_to, "0x%llx", (llu) site->frames[k]);
+                }
+            }
+            builder_push(append_to, '\n');
+        }
 
-            self->bytes_allocated += new_size - old_size;
-            if(self->max_bytes_allocated < self->bytes_allocated)
-                self->max_bytes_allocated = self->bytes_allocated;
+        allocator_deallocate(allocator_get_malloc(), order, self->site_count*(isize) sizeof(isize), __alignof(isize));
+    }
 
-            return out;
+    EXTERNAL void* tracking_allocator_func(void* self_void, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest)
+    {
+        Tracking_Allocator* self = (Tracking_Allocator*) (void*) self_void;
+        if(mode == ALLOCATOR_MODE_ALLOC) {
+            return _tracking_allocator_allocate(self, new_size, old_ptr, old_size, align, (Allocator_Error*) rest);
         }
         if(mode) {
             Allocator_Stats out = {0};
@@ -289,14 +462,13 @@ EXTERNAL void* tracking_allocator_func(void* self_void, int mode, isize new_size
 
     EXTERNAL void* tracking_allocator_malloc(Tracking_Allocator* self, isize size)
     {
-        return allocation_list_allocate(&self->list, self->parent, size, NULL, 0, DEF_ALIGN, NULL);
+        return _tracking_allocator_allocate(self, size, NULL, 0, DEF_ALIGN, NULL);
     }
 
     EXTERNAL void* tracking_allocator_realloc(Tracking_Allocator* self, void* old_ptr, isize new_size)
     {
-        isize old_size = allocation_list_get_block_size(&self->list, old_ptr);
-        void* out = allocation_list_allocate(&self->list, self->parent, new_size, old_ptr, old_size, DEF_ALIGN, NULL);
-        return out;
+        isize old_size = old_ptr ? allocation_list_get_block_size(&self->list, old_ptr) : 0;
+        return _tracking_allocator_allocate(self, new_size, old_ptr, old_size, DEF_ALIGN, NULL);
     }
 
     EXTERNAL void tracking_allocator_free(Tracking_Allocator* self, void* old_ptr)
@@ -304,7 +476,7 @@ EXTERNAL void* tracking_allocator_func(void* self_void, int mode, isize new_size
         if(old_ptr != NULL)
         {
             isize old_size = allocation_list_get_block_size(&self->list, old_ptr);
-            allocation_list_allocate(&self->list, self->parent, 0, old_ptr, old_size, DEF_ALIGN, NULL);
+            _tracking_allocator_allocate(self, 0, old_ptr, old_size, DEF_ALIGN, NULL);
         }
     }
 #endif
@@ -11,6 +11,18 @@
 #define ARENA_DEF_RESERVE_SIZE (16*GB)
 #define ARENA_DEF_COMMIT_SIZE  ( 4*MB) 
 
+//Policy for giving back committed memory after a usage spike. Without it a single big push
+// keeps its memory committed for the entire lifetime of the arena.
+//If reset_count consecutive resets happen with peak usage at or below high_water_mark, all memory 
+// above high_water_mark is decommitted. Any reset above the mark starts the count over.
+// Only resets to the start count. Popping back to a position in the middle just contributes to the peak.
+// This gives us hysteresis - memory is only decommitted once it was not needed for a while 
+// and never below the mark so usage oscillating around small sizes does not cause repeated commits. 
+typedef struct Arena_Decommit_Policy {
+    isize high_water_mark;  //the committed bytes kept at all times
+    isize reset_count;      //number of resets below the mark before decommitting. 0 means never decommit (the default)
+} Arena_Decommit_Policy;
+
 //Contiguous chunk of virtual memory. 
 // This struct is combination of two separate concepts (for simplicity of implementation):
 //  1: Normal arena interface - push/pop/reset etc.
@@ -26,11 +38,20 @@ typedef struct Arena {
     uint8_t* commit_to;
     uint8_t* reserved_to;
     isize commit_granularity;
+    Platform_Virtual_Allocation memory_hints; //PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES, PLATFORM_VIRTUAL_ALLOC_NUMA_NODE(node) etc. passed on every reserve and commit
+
+    Arena_Decommit_Policy decommit_policy;
+    uint8_t* peak_used_to; //highest used_to since the last reset to the start
+    isize resets_below_mark;
+    isize decommit_count;
 
     const char* name;
 } Arena;
 
 EXTERNAL Platform_Error arena_init(Arena* arena, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero);
+//Same as arena_init but the memory is reserved and commited with the given hints (see Platform_Virtual_Allocation).
+// With huge pages the reserve size and commit granularity are rounded up to platform_huge_page_size().
+EXTERNAL Platform_Error arena_init_custom(Arena* arena, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero, Platform_Virtual_Allocation memory_hints);
 EXTERNAL void arena_deinit(Arena* arena);
 EXTERNAL void* arena_push_nonzero(Arena* arena, isize size, isize align, Allocator_Error* error_or_null);
 EXTERNAL void* arena_push(Arena* arena, isize size, isize align);
@@ -38,6 +59,9 @@ EXTERNAL void arena_reset_ptr(Arena* arena, const void* position);
 EXTERNAL void arena_commit_ptr(Arena* arena, const void* position, Allocator_Error* error_or_null);
 EXTERNAL void arena_reset(Arena* arena, isize to);
 EXTERNAL void arena_commit(Arena* arena, isize to);
+EXTERNAL void arena_set_decommit_policy(Arena* arena, Arena_Decommit_Policy policy);
+//Decommits all memory past MAX(used, keep_bytes) rounded up to the commit granularity.
+EXTERNAL void arena_decommit(Arena* arena, isize keep_bytes);
 
 
 EXTERNAL void* arena_allocator_func(void* self, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest);
@@ -48,10 +72,13 @@ EXTERNAL void* arena_allocator_func(void* self, int mode, isize new_size, void*
 #if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_ARENA)) && !defined(MODULE_HAS_IMPL_ARENA)
 #define MODULE_HAS_IMPL_ARENA
 
-EXTERNAL Platform_Error arena_init(Arena* arena, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero)
+EXTERNAL Platform_Error arena_init_custom(Arena* arena, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero, Platform_Virtual_Allocation memory_hints)
 {
     arena_deinit(arena);
     isize alloc_granularity = platform_allocation_granularity();
+    memory_hints = (Platform_Virtual_Allocation) (memory_hints & ~(PLATFORM_VIRTUAL_ALLOC_RESERVE | PLATFORM_VIRTUAL_ALLOC_COMMIT | PLATFORM_VIRTUAL_ALLOC_DECOMMIT | PLATFORM_VIRTUAL_ALLOC_RELEASE));
+    if(memory_hints & (PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES | PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES_EXPLICIT))
+        alloc_granularity = MAX(alloc_granularity, platform_huge_page_size());
     
     REQUIRE(reserve_size_or_zero >= 0);
     REQUIRE(commit_granularity_or_zero >= 0);
@@ -64,7 +91,7 @@ EXTERNAL Platform_Error arena_init(Arena* arena, const char* name, isize reserve
     commit_granularity = DIV_CEIL(commit_granularity, alloc_granularity)*alloc_granularity;
 
     uint8_t* data = NULL;
-    Platform_Error error = platform_virtual_reallocate((void**) &data, NULL, reserve_size, PLATFORM_VIRTUAL_ALLOC_RESERVE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+    Platform_Error error = platform_virtual_reallocate((void**) &data, NULL, reserve_size, (Platform_Virtual_Allocation) (PLATFORM_VIRTUAL_ALLOC_RESERVE | memory_hints), PLATFORM_MEMORY_PROT_NO_ACCESS);
     if(error == 0)
     {
         arena->alloc[0] = arena_allocator_func;
@@ -74,11 +101,17 @@ EXTERNAL Platform_Error arena_init(Arena* arena, const char* name, isize reserve
         arena->commit_to = data;
         arena->reserved_to = data + reserve_size;
         arena->commit_granularity = commit_granularity;
+        arena->memory_hints = memory_hints;
         arena->name = name;
     }
     return error;
 }
 
+EXTERNAL Platform_Error arena_init(Arena* arena, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero)
+{
+    return arena_init_custom(arena, name, reserve_size_or_zero, commit_granularity_or_zero, (Platform_Virtual_Allocation) 0);
+}
+
 EXTERNAL void arena_deinit(Arena* arena)
 {
     if(arena->data)
@@ -87,14 +120,14 @@ EXTERNAL void arena_deinit(Arena* arena)
     memset(arena, 0, sizeof *arena);
 }
 
-INTERNAL ATTRIBUTE_INLINE_NEVER void _arena_commit_no_inline(Arena* arena, const void* to, Allocator_Error* error_or_null)
+static ATTRIBUTE_INLINE_NEVER void _arena_commit_no_inline(Arena* arena, const void* to, Allocator_Error* error_or_null)
 {
     PROFILE_START();
     {
         isize size = (uint8_t*) to - arena->commit_to;
         isize commit = DIV_CEIL(size, arena->commit_granularity)*arena->commit_granularity;
 
-        uint8_t* new_commit_to = arena->used_to + commit;
+        uint8_t* new_commit_to = arena->commit_to + commit;
         if(new_commit_to > arena->reserved_to)
         {
             allocator_error(error_or_null, ALLOCATOR_ERROR_OUT_OF_MEM, arena->alloc, size, NULL, 0, 1, 
@@ -103,7 +136,7 @@ INTERNAL ATTRIBUTE_INLINE_NEVER void _arena_commit_no_inline(Arena* arena, const
             goto end;
         }
             
-        Platform_Error platform_error = platform_virtual_reallocate(NULL, arena->commit_to, new_commit_to - arena->commit_to, PLATFORM_VIRTUAL_ALLOC_COMMIT, PLATFORM_MEMORY_PROT_READ_WRITE);
+        Platform_Error platform_error = platform_virtual_reallocate(NULL, arena->commit_to, new_commit_to - arena->commit_to, (Platform_Virtual_Allocation) (PLATFORM_VIRTUAL_ALLOC_COMMIT | arena->memory_hints), PLATFORM_MEMORY_PROT_READ_WRITE);
         if(platform_error)
         {
             char buffer[4096];
@@ -142,8 +175,32 @@ EXTERNAL void* arena_push(Arena* arena, isize size, isize align)
     return out;
 }
 
+static ATTRIBUTE_INLINE_NEVER void _arena_decommit_policy_no_inline(Arena* arena)
+{
+    Arena_Decommit_Policy policy = arena->decommit_policy;
+    uint8_t* peak = arena->peak_used_to;
+    arena->peak_used_to = arena->data;
+    if(arena->commit_to - arena->data <= policy.high_water_mark)
+        return;
+
+    if(peak - arena->data > policy.high_water_mark)
+        arena->resets_below_mark = 0;
+    else if(++arena->resets_below_mark >= policy.reset_count)
+    {
+        arena->resets_below_mark = 0;
+        arena_decommit(arena, policy.high_water_mark);
+    }
+}
+
 EXTERNAL void arena_reset_ptr(Arena* arena, const void* position)
 {
+    //Only resets to the start count for the policy. Partial pops just remember the peak usage
+    if(arena->decommit_policy.reset_count > 0)
+    {
+        arena->peak_used_to = MAX(arena->peak_used_to, arena->used_to);
+        if((uint8_t*) position == arena->data)
+            _arena_decommit_policy_no_inline(arena);
+    }
     arena->used_to = (uint8_t*) position;
 }
 
@@ -157,16 +214,41 @@ EXTERNAL void arena_commit(Arena* arena, isize to)
     arena_commit_ptr(arena, arena->data + to, NULL);
 }
 
+EXTERNAL void arena_set_decommit_policy(Arena* arena, Arena_Decommit_Policy policy)
+{
+    REQUIRE(policy.high_water_mark >= 0 && policy.reset_count >= 0);
+    arena->decommit_policy = policy;
+    arena->peak_used_to = arena->used_to;
+    arena->resets_below_mark = 0;
+}
+
+EXTERNAL void arena_decommit(Arena* arena, isize keep_bytes)
+{
+    isize keep = MAX(keep_bytes, arena->used_to - arena->data);
+    keep = DIV_CEIL(keep, arena->commit_granularity)*arena->commit_granularity;
+    uint8_t* new_commit_to = arena->data + keep;
+    if(new_commit_to < arena->commit_to)
+    {
+        if(platform_virtual_reallocate(NULL, new_commit_to, arena->commit_to - new_commit_to, PLATFORM_VIRTUAL_ALLOC_DECOMMIT, PLATFORM_MEMORY_PROT_NO_ACCESS) == 0)
+        {
+            arena->commit_to = new_commit_to;
+            arena->decommit_count += 1;
+        }
+    }
+}
+
 EXTERNAL void* arena_allocator_func(void* self, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest)
 {
     if(mode == ALLOCATOR_MODE_ALLOC) {
         Arena* arena = (Arena*) (void*) self;
 
-        REQUIRE(old_ptr == arena->data);
+        //NULL stands for the (yet empty) allocation as well so that containers can start out empty
+        REQUIRE(old_ptr == arena->data || (old_ptr == NULL && old_size == 0));
         REQUIRE(old_size == arena->used_to - arena->data);
         REQUIRE(is_power_of_two(align));
 
-        arena_reset_ptr(arena, arena->data);
+        //Reallocation is not a reset so it does not go through the decommit policy
+        arena->used_to = arena->data;
         return arena_push_nonzero(arena, new_size, align, (Allocator_Error*) rest);
     }
     if(mode == ALLOCATOR_MODE_GET_STATS) {
@@ -177,6 +259,7 @@ EXTERNAL void* arena_allocator_func(void* self, int mode, isize new_size, void*
         stats.name = arena->name;
         stats.fixed_memory_pool_size = arena->reserved_to - arena->data; 
         stats.bytes_allocated = arena->used_to - arena->data;
+        stats.bytes_committed = arena->commit_to - arena->data;
         *(Allocator_Stats*) rest = stats;
     }
     return NULL;
@@ -0,0 +1,138 @@
+#ifndef MODULE_ARENA_SHARED
+#define MODULE_ARENA_SHARED
+
+// Arena into which many threads can push at once. Useful for parallel phases which write
+// their results contiguously (parsers, builders...) and would otherwise need per thread arenas and a merge step.
+//
+// Pushing is a compare exchange loop on the used position. The capacity is checked before the new position
+// is published so a push which does not fit leaves the arena untouched and later smaller pushes still succeed.
+// Only when the new position crosses the committed memory a thread needs to commit more. Commits are done
+// by a single thread through arena_commit_ptr while holding a try lock. Threads which fail to acquire it
+// wait until the memory they need becomes committed. Since commits are done in commit_granularity sized
+// steps this is rare.
+//
+// Note that the order of allocations between threads is not specified, only that the memory is contiguous.
+// arena_shared_reset can only be called at quiescent points, that is when no other thread is pushing.
+
+#include "arena.h"
+#include "sync.h"
+
+#define ARENA_SHARED_ALIGN DEF_ALIGN //All push sizes are rounded to it so pushes with at most this align need no padding.
+
+typedef struct Arena_Shared {
+    Arena arena; //used_to is unused. commit_to is only touched while holding commit_lock.
+
+    ATTRIBUTE_ALIGNED(64) CHAN_ATOMIC(uintptr_t) used_to;
+    ATTRIBUTE_ALIGNED(64) CHAN_ATOMIC(uintptr_t) commit_to;  //mirror of arena.commit_to readable without the lock
+    Mutex commit_lock;
+    CHAN_ATOMIC(isize) commit_count;
+} Arena_Shared;
+
+EXTERNAL Platform_Error arena_shared_init(Arena_Shared* shared, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero);
+EXTERNAL void arena_shared_deinit(Arena_Shared* shared);
+//Thread safe. Returns NULL and reports error if out of memory.
+EXTERNAL void* arena_shared_push_nonzero(Arena_Shared* shared, isize size, isize align, Allocator_Error* error_or_null);
+EXTERNAL void* arena_shared_push(Arena_Shared* shared, isize size, isize align);
+//Rewinds to the given offset. No other thread can be pushing at the same time!
+EXTERNAL void arena_shared_reset(Arena_Shared* shared, isize to);
+//Returns the number of bytes used so far. Includes padding due to alignment.
+EXTERNAL isize arena_shared_used(const Arena_Shared* shared);
+
+#define ARENA_SHARED_PUSH(shared_ptr, count, Type) ((Type*) arena_shared_push((shared_ptr), (count) * sizeof(Type), __alignof(Type)))
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_ARENA_SHARED)) && !defined(MODULE_HAS_IMPL_ARENA_SHARED)
+#define MODULE_HAS_IMPL_ARENA_SHARED
+
+EXTERNAL Platform_Error arena_shared_init(Arena_Shared* shared, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero)
+{
+    arena_shared_deinit(shared);
+    Platform_Error error = arena_init(&shared->arena, name, reserve_size_or_zero, commit_granularity_or_zero);
+    if(error == 0)
+    {
+        atomic_store(&shared->used_to, (uintptr_t) shared->arena.data);
+        atomic_store(&shared->commit_to, (uintptr_t) shared->arena.commit_to);
+    }
+    return error;
+}
+
+EXTERNAL void arena_shared_deinit(Arena_Shared* shared)
+{
+    arena_deinit(&shared->arena);
+    memset(shared, 0, sizeof *shared);
+}
+
+static ATTRIBUTE_INLINE_NEVER bool _arena_shared_commit(Arena_Shared* shared, uint8_t* to, Allocator_Error* error_or_null)
+{
+    for(;;)
+    {
+        if(mutex_try_lock(&shared->commit_lock))
+        {
+            if((uintptr_t) to > atomic_load(&shared->commit_to))
+            {
+                arena_commit_ptr(&shared->arena, to, error_or_null);
+                atomic_store_explicit(&shared->commit_to, (uintptr_t) shared->arena.commit_to, memory_order_release);
+                atomic_fetch_add_explicit(&shared->commit_count, 1, memory_order_relaxed);
+            }
+            bool state = to <= shared->arena.commit_to;
+            mutex_unlock(&shared->commit_lock, SYNC_WAIT_BLOCK);
+            return state;
+        }
+
+        //Someone else is committing. Their commit likely covers us as well.
+        while(mutex_is_locked(&shared->commit_lock))
+            chan_yield();
+        if((uintptr_t) to <= atomic_load_explicit(&shared->commit_to, memory_order_acquire))
+            return true;
+    }
+}
+
+EXTERNAL void* arena_shared_push_nonzero(Arena_Shared* shared, isize size, isize align, Allocator_Error* error_or_null)
+{
+    ASSERT(size >= 0 && is_power_of_two(align));
+    isize aligned_size = DIV_CEIL(size, ARENA_SHARED_ALIGN)*ARENA_SHARED_ALIGN;
+    uint8_t* out = NULL;
+    uint8_t* end = NULL;
+    uintptr_t used_to = atomic_load_explicit(&shared->used_to, memory_order_relaxed);
+    do {
+        out = (uint8_t*) align_forward((void*) used_to, align);
+        end = out + aligned_size;
+
+        //Checked before publishing. Were the position advanced first it would stay past the reserved
+        // memory and every following push would fail as well.
+        if(end > shared->arena.reserved_to)
+        {
+            allocator_error(error_or_null, ALLOCATOR_ERROR_OUT_OF_MEM, shared->arena.alloc, size, NULL, 0, align,
+                "More memory is needed then reserved! Reserved: %.2lf MB", (double) (shared->arena.reserved_to - shared->arena.data)/MB);
+            return NULL;
+        }
+    } while(!atomic_compare_exchange_weak_explicit(&shared->used_to, &used_to, (uintptr_t) end, memory_order_relaxed, memory_order_relaxed));
+
+    if((uintptr_t) end > atomic_load_explicit(&shared->commit_to, memory_order_acquire))
+        if(_arena_shared_commit(shared, end, error_or_null) == false)
+            return NULL;
+
+    return out;
+}
+
+EXTERNAL void* arena_shared_push(Arena_Shared* shared, isize size, isize align)
+{
+    void* out = arena_shared_push_nonzero(shared, size, align, NULL);
+    if(out)
+        memset(out, 0, size);
+    return out;
+}
+
+EXTERNAL void arena_shared_reset(Arena_Shared* shared, isize to)
+{
+    REQUIRE(0 <= to && to <= shared->arena.reserved_to - shared->arena.data);
+    to = DIV_CEIL(to, ARENA_SHARED_ALIGN)*ARENA_SHARED_ALIGN;
+    atomic_store(&shared->used_to, (uintptr_t) (shared->arena.data + to));
+}
+
+EXTERNAL isize arena_shared_used(const Arena_Shared* shared)
+{
+    uintptr_t used_to = atomic_load_explicit(&((Arena_Shared*) shared)->used_to, memory_order_relaxed);
+    return (isize) MIN(used_to - (uintptr_t) shared->arena.data, (uintptr_t) (shared->arena.reserved_to - shared->arena.data));
+}
+#endif
@@ -0,0 +1,151 @@
+#ifndef MODULE_ARENA_SNAPSHOT
+#define MODULE_ARENA_SNAPSHOT
+
+// Saves the used part of an Arena into a file which can be later memory mapped back read only.
+// Loading does no parsing at all - the pages are brought in lazily by the OS as they are touched.
+// This is meant for big precomputed structures such as lookup tables, frozen maps or string pools.
+//
+// Since the mapping can land at any address the saved structures cannot contain regular pointers.
+// Instead they should use relative pointers which store the offset from the pointer field itself
+// to the target (see REL_PTR). These stay valid as long as both the field and the target move
+// together, which is the case for anything inside a single arena.
+//
+// Example:
+//   typedef struct Node {
+//       REL_PTR(struct Node) next;
+//       REL_PTR(char) name;
+//   } Node;
+//
+//   Node* node = ARENA_PUSH(&arena, 1, Node);
+//   REL_PTR_SET(node->next, other_node);
+//   arena_snapshot_save(&arena, node, path);
+//   ...
+//   Arena_Snapshot snapshot = {0};
+//   arena_snapshot_load(&snapshot, path);
+//   const Node* root = (const Node*) snapshot.root;
+//   const Node* next = REL_PTR_GET(const Node, root->next);
+//
+// The file consists of ARENA_SNAPSHOT_HEADER_SIZE bytes of header followed by the data. The data thus
+// starts ARENA_SNAPSHOT_HEADER_SIZE aligned within the mapping so alignments up to that are preserved.
+
+#include "arena.h"
+#include "platform.h"
+
+#define ARENA_SNAPSHOT_MAGIC        0x504E53414E455241ULL //"ARENASNP" in little endian
+#define ARENA_SNAPSHOT_VERSION      1
+#define ARENA_SNAPSHOT_HEADER_SIZE  64
+
+//Relative pointer. Stores the offset from itself to the target. 0 is NULL. The Type is only for documentation.
+#define REL_PTR(Type) int64_t
+//Sets the relative pointer field rel_ptr to point to ptr. rel_ptr must be an lvalue residing at its final location.
+#define REL_PTR_SET(rel_ptr, ptr) rel_ptr_set(&(rel_ptr), (ptr))
+//Returns Type* pointed to by the relative pointer field rel_ptr
+#define REL_PTR_GET(Type, rel_ptr) ((Type*) rel_ptr_get(&(rel_ptr)))
+
+typedef struct Arena_Snapshot_Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    int64_t data_size;
+    int64_t root_offset;    //offset of the root from the start of data. -1 if none
+    uint8_t _[32];
+} Arena_Snapshot_Header;
+
+typedef struct Arena_Snapshot {
+    Platform_Memory_Mapping mapping;
+    const void* data;   //the start of the saved region
+    isize size;
+    const void* root;   //the root pointer passed to arena_snapshot_save (translated) or NULL
+} Arena_Snapshot;
+
+EXTERNAL void  rel_ptr_set(int64_t* rel_ptr, const void* ptr);
+EXTERNAL void* rel_ptr_get(const int64_t* rel_ptr);
+
+//Saves the region [arena->data, arena->used_to) into a file. Root is optional pointer into the region which can be retrieved on load.
+EXTERNAL Platform_Error arena_snapshot_save(const Arena* arena, const void* root_or_null, Platform_String path);
+EXTERNAL Platform_Error arena_snapshot_save_region(const void* data, isize size, const void* root_or_null, Platform_String path);
+//Maps a snapshot saved by arena_snapshot_save read only. Fails with PLATFORM_ERROR_OTHER if the file is not a valid snapshot.
+EXTERNAL Platform_Error arena_snapshot_load(Arena_Snapshot* snapshot, Platform_String path);
+EXTERNAL void arena_snapshot_unload(Arena_Snapshot* snapshot);
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_ARENA_SNAPSHOT)) && !defined(MODULE_HAS_IMPL_ARENA_SNAPSHOT)
+#define MODULE_HAS_IMPL_ARENA_SNAPSHOT
+
+EXTERNAL void rel_ptr_set(int64_t* rel_ptr, const void* ptr)
+{
+    *rel_ptr = ptr ? (int64_t) ((const uint8_t*) ptr - (const uint8_t*) rel_ptr) : 0;
+}
+
+EXTERNAL void* rel_ptr_get(const int64_t* rel_ptr)
+{
+    return *rel_ptr ? (void*) ((const uint8_t*) rel_ptr + *rel_ptr) : NULL;
+}
+
+EXTERNAL Platform_Error arena_snapshot_save_region(const void* data, isize size, const void* root_or_null, Platform_String path)
+{
+    REQUIRE(size >= 0 && (data != NULL || size == 0));
+    REQUIRE(root_or_null == NULL || ((const uint8_t*) data <= (const uint8_t*) root_or_null && (const uint8_t*) root_or_null < (const uint8_t*) data + size),
+        "root must point into the saved region");
+
+    Arena_Snapshot_Header header = {0};
+    header.magic = ARENA_SNAPSHOT_MAGIC;
+    header.version = ARENA_SNAPSHOT_VERSION;
+    header.header_size = ARENA_SNAPSHOT_HEADER_SIZE;
+    header.data_size = size;
+    header.root_offset = root_or_null ? (const uint8_t*) root_or_null - (const uint8_t*) data : -1;
+
+    Platform_File file = {0};
+    Platform_Error error = platform_file_open(&file, path, PLATFORM_FILE_OPEN_WRITE | PLATFORM_FILE_OPEN_CREATE | PLATFORM_FILE_OPEN_REMOVE_CONTENT);
+    if(error == 0)
+        error = platform_file_write(&file, &header, sizeof header, 0);
+    if(error == 0 && size > 0)
+        error = platform_file_write(&file, data, size, ARENA_SNAPSHOT_HEADER_SIZE);
+    platform_file_close(&file);
+    return error;
+}
+
+EXTERNAL Platform_Error arena_snapshot_save(const Arena* arena, const void* root_or_null, Platform_String path)
+{
+    return arena_snapshot_save_region(arena->data, arena->used_to - arena->data, root_or_null, path);
+}
+
+EXTERNAL Platform_Error arena_snapshot_load(Arena_Snapshot* snapshot, Platform_String path)
+{
+    arena_snapshot_unload(snapshot);
+
+    Platform_Memory_Mapping mapping = {0};
+    Platform_Error error = platform_file_memory_map(path, &mapping);
+    if(error == 0)
+    {
+        Arena_Snapshot_Header header = {0};
+        if(mapping.size >= ARENA_SNAPSHOT_HEADER_SIZE)
+            memcpy(&header, mapping.address, sizeof header);
+
+        if(header.magic != ARENA_SNAPSHOT_MAGIC
+            || header.version != ARENA_SNAPSHOT_VERSION
+            || header.header_size != ARENA_SNAPSHOT_HEADER_SIZE
+            || header.data_size != mapping.size - ARENA_SNAPSHOT_HEADER_SIZE
+            || header.root_offset < -1 || header.root_offset >= header.data_size)
+            error = PLATFORM_ERROR_OTHER;
+
+        if(error == 0)
+        {
+            snapshot->mapping = mapping;
+            snapshot->data = (const uint8_t*) mapping.address + ARENA_SNAPSHOT_HEADER_SIZE;
+            snapshot->size = header.data_size;
+            snapshot->root = header.root_offset >= 0 ? (const uint8_t*) snapshot->data + header.root_offset : NULL;
+        }
+        else
+            platform_file_memory_unmap(&mapping);
+    }
+
+    return error;
+}
+
+EXTERNAL void arena_snapshot_unload(Arena_Snapshot* snapshot)
+{
+    platform_file_memory_unmap(&snapshot->mapping);
+    memset(snapshot, 0, sizeof *snapshot);
+}
+#endif
@@ -198,6 +198,7 @@ CHANAPI Channel_Res channel_ticket_try_pop_weak(Channel* chan, void* item, uint6
 CHAN_INTRINSIC void chan_pause();
 
 CHAN_OS_API void chan_wake_block(volatile void* state);
+CHAN_OS_API void chan_wake_block_single(volatile void* state);
 CHAN_OS_API bool chan_wait_block(volatile void* state, uint32_t undesired, double timeout_or_negatove_if_infinite);
 CHAN_OS_API bool chan_wait_yield(volatile void* state, uint32_t undesired, double timeout_or_negatove_if_infinite);
 
@@ -225,8 +226,10 @@ CHAN_OS_API bool chan_start_thread(void (*func)(void* context), void* context);
 #endif
 
 #ifndef chan_debug_log
+    //only ever used inside sizeof so that the arguments are type checked but never evaluated
+    static int _chan_debug_log_unused(const char* msg, ...);
     //cheaply logs into memory msg static string followed by up to two uint64_t values
-    #define chan_debug_log(msg, ...) (void) sizeof((msg), ##__VA_ARGS__)   
+    #define chan_debug_log(msg, ...) (void) sizeof(_chan_debug_log_unused((msg), ##__VA_ARGS__))
     //performs n atomic additions on piece of global memory causing the caller to wait for a bit   
     // is used to make certain states more likely then others (increases the window between two instructions)
     #define chan_debug_wait(n)      (void) sizeof(n) 
@@ -1031,6 +1034,11 @@ CHANAPI void chan_wake_block(volatile void* state)
     chan_futex_wake_all((uint32_t*) state);
 }
 
+CHANAPI void chan_wake_block_single(volatile void* state)
+{
+    chan_futex_wake_single((uint32_t*) state);
+}
+
 //ARCH DETECTION
 #define CHAN_ARCH_UNKNOWN   0
 #define CHAN_ARCH_X86       1
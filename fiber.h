@@ -0,0 +1,773 @@
+#ifndef MODULE_FIBER
+#define MODULE_FIBER
+
+// Stackful fibers multiplexed over a small number of worker threads.
+// A fiber is a function with its own stack which can suspend itself at any point (not only on return)
+// and be resumed later, possibly on a different worker thread. This lets jobs wait on Wait_Group, Channel
+// or any other Sync_Wait based primitive, or on a blocking call such as a file read, without blocking
+// the worker thread running them. Meanwhile the worker runs other fibers.
+//
+// Waiting works through the Sync_Wait plug-in: SYNC_WAIT_FIBER (and fiber_sync_wait/fiber_sync_wake for
+// Channel_Info) parks the calling fiber in a small global address keyed wait table, a userspace futex. Called from a
+// regular thread it simply futex-waits. Waking wakes both parked fibers and sleeping threads. Thus all parties
+// using the primitive must use SYNC_WAIT_FIBER, else fibers would never get woken.
+// Waits with a timeout yield instead of parking (the caller rechecks the condition and the time after return).
+//
+// Blocking calls are run with fiber_blocking(func, context), which parks the fiber and runs func
+// on one of the scheduler's dedicated blocking threads. After func returns the fiber is made runnable again.
+//
+// The context switch is a few instructions of hand written assembly on x86-64 (System V) and aarch64
+// saving only callee saved registers. Elsewhere (or with FIBER_USE_UCONTEXT defined) ucontext is used
+// which is much slower as it also saves the signal mask through a syscall.
+//
+// Stacks are reserved with platform_virtual_reallocate with an inaccessible guard page below them so that
+// an overflow crashes instead of silently corrupting memory. Stacks of finished fibers are kept in a pool
+// and reused. The Fiber struct itself lives at the top of its stack so spawning does not allocate at all
+// once the pool is warm.
+//
+// Fibers must not hold a thread local pointer (or a lock) across a suspension as they can resume on
+// a different thread.
+
+#include "defines.h"
+#include "assert.h"
+#include "platform.h"
+#include "sync.h"
+#include <string.h>
+
+#if !defined(FIBER_USE_UCONTEXT) && !((defined(__x86_64__) || defined(__aarch64__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(_WIN32))
+    #define FIBER_USE_UCONTEXT
+#endif
+
+#ifdef FIBER_USE_UCONTEXT
+    #include <ucontext.h>
+    typedef struct Fiber_Context {
+        ucontext_t context;
+    } Fiber_Context;
+#else
+    typedef struct Fiber_Context {
+        void* stack_pointer;
+    } Fiber_Context;
+#endif
+
+#define FIBER_DEF_STACK_SIZE    (256*KB)
+#define FIBER_MAX_POOLED_STACKS 256
+#define FIBER_WAIT_BUCKETS      64
+
+typedef void (*Fiber_Func)(void* context);
+typedef struct Fiber_Scheduler Fiber_Scheduler;
+
+typedef enum Fiber_State {
+    FIBER_STATE_RUNNING = 0,
+    FIBER_STATE_PARKING,  //is about to be switched out. Whoever wakes it leaves pushing to the ready queue to the worker
+    FIBER_STATE_PARKED,   //is switched out and waiting for someone to wake it
+    FIBER_STATE_NOTIFIED, //was woken before it managed to park
+} Fiber_State;
+
+typedef struct Fiber {
+    Fiber_Context context;
+    Fiber_Scheduler* scheduler;
+    Fiber_Func func;
+    void* func_context;
+    Wait_Group* done;
+    struct Fiber* next; //in ready queue, wait bucket or blocking queue
+    CHAN_ATOMIC(uint32_t) state;
+    uint32_t _;
+
+    volatile void* wait_address;
+    Fiber_Func blocking_func;
+    void* blocking_context;
+
+    uint8_t* stack; //start of the whole reservation including the guard page
+    isize stack_reserved;
+} Fiber;
+
+typedef struct Fiber_Queue {
+    Fiber* first;
+    Fiber* last;
+} Fiber_Queue;
+
+typedef struct Fiber_Wait_Bucket {
+    Mutex lock;
+    CHAN_ATOMIC(uint32_t) waiters;
+    Fiber_Queue queue;
+} Fiber_Wait_Bucket;
+
+typedef struct Fiber_Scheduler {
+    Mutex lock; //protects ready and the stack pool
+    Fiber_Queue ready;
+    Event_Count ready_event;
+    isize free_stack_count;
+    Fiber* free_stacks[FIBER_MAX_POOLED_STACKS];
+
+    Mutex blocking_lock;
+    Fiber_Queue blocking;
+    Event_Count blocking_event;
+
+    CHAN_ATOMIC(uint32_t) is_closed;
+    CHAN_ATOMIC(uint32_t) threads_running;
+    CHAN_ATOMIC(uint32_t) fibers_alive;
+    uint32_t _;
+
+    isize thread_count;
+    isize blocking_thread_count;
+    isize stack_size;
+} Fiber_Scheduler;
+
+//Launches the worker and blocking threads. If thread_count is negative uses platform_thread_get_processor_count().
+// If blocking_thread_count is negative uses 4. stack_size_or_zero is the usable stack size of each fiber.
+EXTERNAL Platform_Error fiber_scheduler_init(Fiber_Scheduler* scheduler, isize thread_count_or_negative, isize blocking_thread_count_or_negative, isize stack_size_or_zero);
+//Waits for all fibers to finish, then stops all threads and releases the pooled stacks.
+EXTERNAL void fiber_scheduler_deinit(Fiber_Scheduler* scheduler);
+
+//Starts a new fiber running func(context). If done_or_null is given it is pushed here and popped once the fiber finishes.
+EXTERNAL Platform_Error fiber_spawn(Fiber_Scheduler* scheduler, Fiber_Func func, void* context, Wait_Group* done_or_null);
+EXTERNAL Fiber* fiber_current(); //returns the currently running fiber or NULL if not called from a fiber
+EXTERNAL void fiber_yield(); //lets other fibers run. Does nothing if not called from a fiber
+EXTERNAL void fiber_blocking(Fiber_Func func, void* context); //runs func on a blocking thread while the fiber is parked. If not called from a fiber just calls func
+EXTERNAL Platform_Error fiber_file_read(Platform_File* file, void* buffer, isize size, isize offset, isize* read_bytes_because_eof); //platform_file_read through fiber_blocking
+
+EXTERNAL bool fiber_sync_wait(volatile void* state, uint32_t undesired, double timeout_or_negative_if_infinite);
+EXTERNAL void fiber_sync_wake(volatile void* state);
+EXTERNAL void fiber_sync_wake_single(volatile void* state);
+
+#define SYNC_WAIT_FIBER SINIT(Sync_Wait){fiber_sync_wait, fiber_sync_wake, 0, 0, fiber_sync_wake_single}
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_FIBER)) && !defined(MODULE_HAS_IMPL_FIBER)
+#define MODULE_HAS_IMPL_FIBER
+
+//==========================================================================
+// Context switch
+//==========================================================================
+#ifdef FIBER_USE_UCONTEXT
+    INTERNAL void _fiber_main(Fiber* fiber);
+
+    static void _fiber_ucontext_entry(unsigned int low, unsigned int high)
+    {
+        Fiber* fiber = (Fiber*) (((uintptr_t) high << 16 << 16) | (uintptr_t) low);
+        _fiber_main(fiber);
+    }
+
+    INTERNAL void _fiber_context_make(Fiber_Context* context, uint8_t* stack_from, uint8_t* stack_to, Fiber* fiber)
+    {
+        getcontext(&context->context);
+        context->context.uc_stack.ss_sp = stack_from;
+        context->context.uc_stack.ss_size = (size_t) (stack_to - stack_from);
+        context->context.uc_link = NULL;
+
+        uintptr_t address = (uintptr_t) fiber;
+        makecontext(&context->context, (void (*)(void)) _fiber_ucontext_entry, 2, (unsigned int) address, (unsigned int) (address >> 16 >> 16));
+    }
+
+    INTERNAL void _fiber_context_switch(Fiber_Context* from, Fiber_Context* to)
+    {
+        swapcontext(&from->context, &to->context);
+    }
+#else
+    //Saves callee saved registers of the current context on its stack, stores the stack pointer into *from
+    // and restores the context saved on the to stack. Returns into the restored context.
+    void _fiber_switch_asm(void** from, void* to);
+    void _fiber_entry_asm();
+
+    #if defined(__x86_64__)
+    __asm__(
+        ".text\n"
+        ".globl _fiber_switch_asm\n"
+        ".type _fiber_switch_asm, @function\n"
+        "_fiber_switch_asm:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    subq $8, %rsp\n"
+        "    stmxcsr (%rsp)\n"
+        "    fnstcw 4(%rsp)\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    ldmxcsr (%rsp)\n"
+        "    fldcw 4(%rsp)\n"
+        "    addq $8, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size _fiber_switch_asm, .-_fiber_switch_asm\n"
+        "\n"
+        ".globl _fiber_entry_asm\n"
+        ".type _fiber_entry_asm, @function\n"
+        "_fiber_entry_asm:\n"
+        "    movq %r12, %rdi\n"
+        "    call _fiber_main_c\n"
+        "    ud2\n"
+        ".size _fiber_entry_asm, .-_fiber_entry_asm\n"
+    );
+
+    enum {_FIBER_INITIAL_FRAME = 8*8};
+    INTERNAL void _fiber_context_make(Fiber_Context* context, uint8_t* stack_from, uint8_t* stack_to, Fiber* fiber)
+    {
+        (void) stack_from;
+        //Layout from the top: return address, rbp, rbx, r12, r13, r14, r15, mxcsr + x87 control word.
+        // After the ret into _fiber_entry_asm the stack is 16 byte aligned as required before a call.
+        uint64_t* top = (uint64_t*) ((uintptr_t) stack_to & ~(uintptr_t) 15);
+        uint64_t* sp = top - 8;
+        memset(sp, 0, _FIBER_INITIAL_FRAME);
+        top[-1] = (uint64_t) (uintptr_t) _fiber_entry_asm;
+        top[-4] = (uint64_t) (uintptr_t) fiber; //r12
+        uint32_t control[2] = {0x1F80, 0x037F}; //default mxcsr and x87 control word
+        memcpy(sp, control, sizeof control);
+        context->stack_pointer = sp;
+    }
+    #elif defined(__aarch64__)
+    __asm__(
+        ".text\n"
+        ".globl _fiber_switch_asm\n"
+        ".type _fiber_switch_asm, %function\n"
+        "_fiber_switch_asm:\n"
+        "    sub sp, sp, #176\n"
+        "    stp x19, x20, [sp, #0]\n"
+        "    stp x21, x22, [sp, #16]\n"
+        "    stp x23, x24, [sp, #32]\n"
+        "    stp x25, x26, [sp, #48]\n"
+        "    stp x27, x28, [sp, #64]\n"
+        "    stp x29, x30, [sp, #80]\n"
+        "    stp d8, d9, [sp, #96]\n"
+        "    stp d10, d11, [sp, #112]\n"
+        "    stp d12, d13, [sp, #128]\n"
+        "    stp d14, d15, [sp, #144]\n"
+        "    mov x2, sp\n"
+        "    str x2, [x0]\n"
+        "    mov sp, x1\n"
+        "    ldp x19, x20, [sp, #0]\n"
+        "    ldp x21, x22, [sp, #16]\n"
+        "    ldp x23, x24, [sp, #32]\n"
+        "    ldp x25, x26, [sp, #48]\n"
+        "    ldp x27, x28, [sp, #64]\n"
+        "    ldp x29, x30, [sp, #80]\n"
+        "    ldp d8, d9, [sp, #96]\n"
+        "    ldp d10, d11, [sp, #112]\n"
+        "    ldp d12, d13, [sp, #128]\n"
+        "    ldp d14, d15, [sp, #144]\n"
+        "    add sp, sp, #176\n"
+        "    ret\n"
+        ".size _fiber_switch_asm, .-_fiber_switch_asm\n"
+        "\n"
+        ".globl _fiber_entry_asm\n"
+        ".type _fiber_entry_asm, %function\n"
+        "_fiber_entry_asm:\n"
+        "    mov x0, x19\n"
+        "    bl _fiber_main_c\n"
+        "    brk #0\n"
+        ".size _fiber_entry_asm, .-_fiber_entry_asm\n"
+    );
+
+    enum {_FIBER_INITIAL_FRAME = 176};
+    INTERNAL void _fiber_context_make(Fiber_Context* context, uint8_t* stack_from, uint8_t* stack_to, Fiber* fiber)
+    {
+        (void) stack_from;
+        //Layout: x19-x28, x29 (fp), x30 (lr), d8-d15, 16 bytes padding.
+        uint64_t* top = (uint64_t*) ((uintptr_t) stack_to & ~(uintptr_t) 15);
+        uint64_t* sp = top - _FIBER_INITIAL_FRAME/8;
+        memset(sp, 0, _FIBER_INITIAL_FRAME);
+        sp[0] = (uint64_t) (uintptr_t) fiber;               //x19
+        sp[11] = (uint64_t) (uintptr_t) _fiber_entry_asm;   //x30
+        context->stack_pointer = sp;
+    }
+    #endif
+
+    INTERNAL void _fiber_context_switch(Fiber_Context* from, Fiber_Context* to)
+    {
+        _fiber_switch_asm(&from->stack_pointer, to->stack_pointer);
+    }
+#endif
+
+//==========================================================================
+// Scheduler
+//==========================================================================
+typedef enum Fiber_After_Switch {
+    FIBER_AFTER_NONE,
+    FIBER_AFTER_YIELD,
+    FIBER_AFTER_PARK,
+    FIBER_AFTER_FINISH,
+} Fiber_After_Switch;
+
+typedef struct Fiber_Worker {
+    Fiber_Scheduler* scheduler;
+    Fiber_Context context;
+    Fiber* current;
+    Fiber_After_Switch after;
+} Fiber_Worker;
+
+static ATTRIBUTE_THREAD_LOCAL Fiber_Worker* _fiber_worker_self = NULL;
+
+//Fibers can move between threads on every switch. Calling through a non inlined function makes sure
+// the compiler does not reuse the thread local address computed before the switch on the old thread.
+ATTRIBUTE_INLINE_NEVER static Fiber_Worker* _fiber_worker()
+{
+    return _fiber_worker_self;
+}
+
+INTERNAL void _fiber_queue_push(Fiber_Queue* queue, Fiber* fiber)
+{
+    fiber->next = NULL;
+    if(queue->last)
+        queue->last->next = fiber;
+    else
+        queue->first = fiber;
+    queue->last = fiber;
+}
+
+INTERNAL Fiber* _fiber_queue_pop(Fiber_Queue* queue)
+{
+    Fiber* fiber = queue->first;
+    if(fiber)
+    {
+        queue->first = fiber->next;
+        if(queue->first == NULL)
+            queue->last = NULL;
+        fiber->next = NULL;
+    }
+    return fiber;
+}
+
+INTERNAL void _fiber_push_ready(Fiber_Scheduler* scheduler, Fiber* fiber)
+{
+    atomic_store_explicit(&fiber->state, FIBER_STATE_RUNNING, memory_order_relaxed);
+    mutex_lock(&scheduler->lock, SYNC_WAIT_BLOCK);
+    _fiber_queue_push(&scheduler->ready, fiber);
+    mutex_unlock(&scheduler->lock, SYNC_WAIT_BLOCK);
+    eventcount_notify(&scheduler->ready_event, SYNC_WAIT_BLOCK);
+}
+
+//Makes a parked (or parking) fiber runnable. If it did not yet switch out the worker which runs it
+// pushes it into the ready queue once it does.
+INTERNAL void _fiber_make_ready(Fiber* fiber)
+{
+    uint32_t prev = atomic_exchange(&fiber->state, FIBER_STATE_NOTIFIED);
+    ASSERT(prev == FIBER_STATE_PARKING || prev == FIBER_STATE_PARKED);
+    if(prev == FIBER_STATE_PARKED)
+        _fiber_push_ready(fiber->scheduler, fiber);
+}
+
+//Switches from the currently running fiber back to its worker which then does the after action.
+INTERNAL void _fiber_switch_out(Fiber_After_Switch after)
+{
+    Fiber_Worker* worker = _fiber_worker();
+    Fiber* fiber = worker->current;
+    worker->after = after;
+    _fiber_context_switch(&fiber->context, &worker->context);
+}
+
+//Called as the first thing on the new fiber stack. Never returns.
+void _fiber_main_c(Fiber* fiber)
+{
+    fiber->func(fiber->func_context);
+
+    if(fiber->done)
+        wait_group_pop(fiber->done, 1, SYNC_WAIT_FIBER);
+
+    _fiber_switch_out(FIBER_AFTER_FINISH);
+    ASSERT(false, "finished fiber resumed");
+}
+
+#ifdef FIBER_USE_UCONTEXT
+INTERNAL void _fiber_main(Fiber* fiber)
+{
+    _fiber_main_c(fiber);
+}
+#endif
+
+INTERNAL void _fiber_stack_release(Fiber_Scheduler* scheduler, Fiber* fiber)
+{
+    bool pooled = false;
+    mutex_lock(&scheduler->lock, SYNC_WAIT_BLOCK);
+    if(scheduler->free_stack_count < FIBER_MAX_POOLED_STACKS)
+    {
+        scheduler->free_stacks[scheduler->free_stack_count++] = fiber;
+        pooled = true;
+    }
+    mutex_unlock(&scheduler->lock, SYNC_WAIT_BLOCK);
+
+    if(pooled == false)
+        platform_virtual_reallocate(NULL, fiber->stack, fiber->stack_reserved, PLATFORM_VIRTUAL_ALLOC_RELEASE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+}
+
+INTERNAL void _fiber_finish(Fiber_Scheduler* scheduler, Fiber* fiber)
+{
+    _fiber_stack_release(scheduler, fiber);
+    if(atomic_fetch_sub(&scheduler->fibers_alive, 1) == 1)
+        chan_futex_wake_all((uint32_t*) &scheduler->fibers_alive);
+}
+
+INTERNAL void _fiber_worker_func(void* context)
+{
+    Fiber_Scheduler* scheduler = (Fiber_Scheduler*) context;
+    Fiber_Worker worker = {scheduler};
+    _fiber_worker_self = &worker;
+
+    for(;;)
+    {
+        mutex_lock(&scheduler->lock, SYNC_WAIT_BLOCK);
+        Fiber* fiber = _fiber_queue_pop(&scheduler->ready);
+        mutex_unlock(&scheduler->lock, SYNC_WAIT_BLOCK);
+
+        if(fiber == NULL)
+        {
+            uint32_t key = eventcount_prepare_wait(&scheduler->ready_event);
+            mutex_lock(&scheduler->lock, SYNC_WAIT_BLOCK);
+            fiber = _fiber_queue_pop(&scheduler->ready);
+            mutex_unlock(&scheduler->lock, SYNC_WAIT_BLOCK);
+            if(fiber == NULL)
+            {
+                if(atomic_load(&scheduler->is_closed))
+                {
+                    eventcount_cancel_wait(&scheduler->ready_event);
+                    break;
+                }
+                eventcount_commit_wait(&scheduler->ready_event, key, SYNC_WAIT_BLOCK);
+                continue;
+            }
+            eventcount_cancel_wait(&scheduler->ready_event);
+        }
+
+        worker.current = fiber;
+        worker.after = FIBER_AFTER_NONE;
+        _fiber_context_switch(&worker.context, &fiber->context);
+        worker.current = NULL;
+
+        switch(worker.after)
+        {
+            case FIBER_AFTER_YIELD:
+                _fiber_push_ready(scheduler, fiber);
+                break;
+
+            case FIBER_AFTER_PARK: {
+                uint32_t state = FIBER_STATE_PARKING;
+                if(atomic_compare_exchange_strong(&fiber->state, &state, FIBER_STATE_PARKED) == false)
+                {
+                    ASSERT(state == FIBER_STATE_NOTIFIED);
+                    _fiber_push_ready(scheduler, fiber);
+                }
+            } break;
+
+            case FIBER_AFTER_FINISH:
+                _fiber_finish(scheduler, fiber);
+                break;
+
+            default:
+                ASSERT(false, "fiber switched out without reason");
+        }
+    }
+
+    _fiber_worker_self = NULL;
+    atomic_fetch_sub(&scheduler->threads_running, 1);
+    chan_futex_wake_all((uint32_t*) &scheduler->threads_running);
+}
+
+INTERNAL void _fiber_blocking_thread_func(void* context)
+{
+    Fiber_Scheduler* scheduler = (Fiber_Scheduler*) context;
+    for(;;)
+    {
+        mutex_lock(&scheduler->blocking_lock, SYNC_WAIT_BLOCK);
+        Fiber* fiber = _fiber_queue_pop(&scheduler->blocking);
+        mutex_unlock(&scheduler->blocking_lock, SYNC_WAIT_BLOCK);
+
+        if(fiber == NULL)
+        {
+            uint32_t key = eventcount_prepare_wait(&scheduler->blocking_event);
+            mutex_lock(&scheduler->blocking_lock, SYNC_WAIT_BLOCK);
+            fiber = _fiber_queue_pop(&scheduler->blocking);
+            mutex_unlock(&scheduler->blocking_lock, SYNC_WAIT_BLOCK);
+            if(fiber == NULL)
+            {
+                if(atomic_load(&scheduler->is_closed))
+                {
+                    eventcount_cancel_wait(&scheduler->blocking_event);
+                    break;
+                }
+                eventcount_commit_wait(&scheduler->blocking_event, key, SYNC_WAIT_BLOCK);
+                continue;
+            }
+            eventcount_cancel_wait(&scheduler->blocking_event);
+        }
+
+        fiber->blocking_func(fiber->blocking_context);
+        _fiber_make_ready(fiber);
+    }
+
+    atomic_fetch_sub(&scheduler->threads_running, 1);
+    chan_futex_wake_all((uint32_t*) &scheduler->threads_running);
+}
+
+EXTERNAL Platform_Error fiber_scheduler_init(Fiber_Scheduler* scheduler, isize thread_count_or_negative, isize blocking_thread_count_or_negative, isize stack_size_or_zero)
+{
+    memset(scheduler, 0, sizeof *scheduler);
+    isize page = platform_page_size();
+    isize stack_size = stack_size_or_zero > 0 ? stack_size_or_zero : FIBER_DEF_STACK_SIZE;
+    scheduler->stack_size = DIV_CEIL(stack_size, page)*page;
+
+    isize thread_count = thread_count_or_negative >= 0 ? thread_count_or_negative : platform_thread_get_processor_count();
+    isize blocking_count = blocking_thread_count_or_negative >= 0 ? blocking_thread_count_or_negative : 4;
+
+    Platform_Error error = 0;
+    for(isize i = 0; i < thread_count + blocking_count && error == 0; i++)
+    {
+        bool is_blocking = i >= thread_count;
+        atomic_fetch_add(&scheduler->threads_running, 1);
+        if(is_blocking)
+            error = platform_thread_launch(0, _fiber_blocking_thread_func, scheduler, "fiber blocking %i", (int) (i - thread_count));
+        else
+            error = platform_thread_launch(0, _fiber_worker_func, scheduler, "fiber worker %i", (int) i);
+
+        if(error)
+            atomic_fetch_sub(&scheduler->threads_running, 1);
+        else if(is_blocking)
+            scheduler->blocking_thread_count += 1;
+        else
+            scheduler->thread_count += 1;
+    }
+
+    if(error)
+        fiber_scheduler_deinit(scheduler);
+    return error;
+}
+
+EXTERNAL void fiber_scheduler_deinit(Fiber_Scheduler* scheduler)
+{
+    for(;;) {
+        uint32_t alive = atomic_load(&scheduler->fibers_alive);
+        if(alive == 0)
+            break;
+        chan_futex_wait((uint32_t*) &scheduler->fibers_alive, alive, -1);
+    }
+
+    atomic_store(&scheduler->is_closed, 1);
+    eventcount_notify_all(&scheduler->ready_event, SYNC_WAIT_BLOCK);
+    eventcount_notify_all(&scheduler->blocking_event, SYNC_WAIT_BLOCK);
+    for(;;) {
+        uint32_t running = atomic_load(&scheduler->threads_running);
+        if(running == 0)
+            break;
+        chan_futex_wait((uint32_t*) &scheduler->threads_running, running, -1);
+    }
+
+    for(isize i = 0; i < scheduler->free_stack_count; i++)
+    {
+        Fiber* fiber = scheduler->free_stacks[i];
+        platform_virtual_reallocate(NULL, fiber->stack, fiber->stack_reserved, PLATFORM_VIRTUAL_ALLOC_RELEASE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+    }
+    memset(scheduler, 0, sizeof *scheduler);
+}
+
+EXTERNAL Platform_Error fiber_spawn(Fiber_Scheduler* scheduler, Fiber_Func func, void* context, Wait_Group* done_or_null)
+{
+    REQUIRE(scheduler->thread_count > 0, "the scheduler needs at least one worker thread to run fibers");
+    Fiber* fiber = NULL;
+    mutex_lock(&scheduler->lock, SYNC_WAIT_BLOCK);
+    if(scheduler->free_stack_count > 0)
+        fiber = scheduler->free_stacks[--scheduler->free_stack_count];
+    mutex_unlock(&scheduler->lock, SYNC_WAIT_BLOCK);
+
+    //The reservation is [guard page][stack ... ][Fiber]. The guard page is never committed.
+    uint8_t* stack = NULL;
+    isize reserved = 0;
+    if(fiber)
+    {
+        stack = fiber->stack;
+        reserved = fiber->stack_reserved;
+    }
+    else
+    {
+        isize page = platform_page_size();
+        isize fiber_size = DIV_CEIL((isize) sizeof(Fiber), page)*page;
+        reserved = page + scheduler->stack_size + fiber_size;
+
+        Platform_Error error = platform_virtual_reallocate((void**) &stack, NULL, reserved, PLATFORM_VIRTUAL_ALLOC_RESERVE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+        if(error == 0)
+            error = platform_virtual_reallocate(NULL, stack + page, reserved - page, PLATFORM_VIRTUAL_ALLOC_COMMIT, PLATFORM_MEMORY_PROT_READ_WRITE);
+        if(error)
+        {
+            if(stack)
+                platform_virtual_reallocate(NULL, stack, reserved, PLATFORM_VIRTUAL_ALLOC_RELEASE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+            return error;
+        }
+
+        fiber = (Fiber*) (void*) (stack + reserved - fiber_size);
+    }
+
+    memset(fiber, 0, sizeof *fiber);
+    fiber->stack = stack;
+    fiber->stack_reserved = reserved;
+    fiber->scheduler = scheduler;
+    fiber->func = func;
+    fiber->func_context = context;
+    fiber->done = done_or_null;
+    _fiber_context_make(&fiber->context, stack + platform_page_size(), (uint8_t*) fiber, fiber);
+
+    atomic_fetch_add(&scheduler->fibers_alive, 1);
+    if(done_or_null)
+        wait_group_push(done_or_null, 1);
+    _fiber_push_ready(scheduler, fiber);
+    return 0;
+}
+
+EXTERNAL Fiber* fiber_current()
+{
+    Fiber_Worker* worker = _fiber_worker();
+    return worker ? worker->current : NULL;
+}
+
+EXTERNAL void fiber_yield()
+{
+    if(fiber_current())
+        _fiber_switch_out(FIBER_AFTER_YIELD);
+}
+
+EXTERNAL void fiber_blocking(Fiber_Func func, void* context)
+{
+    Fiber* fiber = fiber_current();
+    if(fiber == NULL || fiber->scheduler->blocking_thread_count == 0)
+    {
+        func(context);
+        return;
+    }
+
+    Fiber_Scheduler* scheduler = fiber->scheduler;
+    fiber->blocking_func = func;
+    fiber->blocking_context = context;
+    atomic_store(&fiber->state, FIBER_STATE_PARKING);
+
+    mutex_lock(&scheduler->blocking_lock, SYNC_WAIT_BLOCK);
+    _fiber_queue_push(&scheduler->blocking, fiber);
+    mutex_unlock(&scheduler->blocking_lock, SYNC_WAIT_BLOCK);
+    eventcount_notify(&scheduler->blocking_event, SYNC_WAIT_BLOCK);
+
+    _fiber_switch_out(FIBER_AFTER_PARK);
+}
+
+typedef struct _Fiber_File_Read {
+    Platform_File* file;
+    void* buffer;
+    isize size;
+    isize offset;
+    isize* read_bytes_because_eof;
+    Platform_Error error;
+} _Fiber_File_Read;
+
+INTERNAL void _fiber_file_read_blocking(void* context)
+{
+    _Fiber_File_Read* read = (_Fiber_File_Read*) context;
+    read->error = platform_file_read(read->file, read->buffer, read->size, read->offset, read->read_bytes_because_eof);
+}
+
+EXTERNAL Platform_Error fiber_file_read(Platform_File* file, void* buffer, isize size, isize offset, isize* read_bytes_because_eof)
+{
+    _Fiber_File_Read read = {file, buffer, size, offset, read_bytes_because_eof};
+    fiber_blocking(_fiber_file_read_blocking, &read);
+    return read.error;
+}
+
+//Shared by all schedulers so that anyone can wake a fiber, including regular threads and fibers of other schedulers.
+static Fiber_Wait_Bucket _fiber_wait_buckets[FIBER_WAIT_BUCKETS];
+
+INTERNAL Fiber_Wait_Bucket* _fiber_wait_bucket(volatile void* state)
+{
+    uint64_t hash = (uint64_t) (uintptr_t) state * 0x9E3779B97F4A7C15ull;
+    return &_fiber_wait_buckets[hash >> 58]; //top 6 bits for 64 buckets
+}
+
+EXTERNAL bool fiber_sync_wait(volatile void* state, uint32_t undesired, double timeout_or_negative_if_infinite)
+{
+    Fiber* fiber = fiber_current();
+    if(fiber == NULL)
+        return chan_wait_block(state, undesired, timeout_or_negative_if_infinite);
+
+    if(timeout_or_negative_if_infinite >= 0)
+    {
+        _fiber_switch_out(FIBER_AFTER_YIELD);
+        return true;
+    }
+
+    //The waiters count is incremented before the value is checked and the waker checks it after
+    // changing the value, both seq cst. Thus either we see the new value or the waker sees us.
+    Fiber_Wait_Bucket* bucket = _fiber_wait_bucket(state);
+    mutex_lock(&bucket->lock, SYNC_WAIT_BLOCK);
+    atomic_fetch_add(&bucket->waiters, 1);
+    uint32_t current = atomic_load((CHAN_ATOMIC(uint32_t)*) state);
+    if(current != undesired)
+    {
+        atomic_fetch_sub(&bucket->waiters, 1);
+        mutex_unlock(&bucket->lock, SYNC_WAIT_BLOCK);
+        return true;
+    }
+
+    fiber->wait_address = state;
+    atomic_store(&fiber->state, FIBER_STATE_PARKING);
+    _fiber_queue_push(&bucket->queue, fiber);
+    mutex_unlock(&bucket->lock, SYNC_WAIT_BLOCK);
+
+    _fiber_switch_out(FIBER_AFTER_PARK);
+    return true;
+}
+
+INTERNAL void _fiber_sync_wake(volatile void* state, bool all)
+{
+    if(all)
+        chan_futex_wake_all((uint32_t*) state);
+    else
+        chan_futex_wake_single((uint32_t*) state);
+
+    Fiber_Wait_Bucket* bucket = _fiber_wait_bucket(state);
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load(&bucket->waiters) == 0)
+        return;
+
+    Fiber_Queue woken = {0};
+    mutex_lock(&bucket->lock, SYNC_WAIT_BLOCK);
+    Fiber* prev = NULL;
+    for(Fiber* curr = bucket->queue.first; curr; )
+    {
+        Fiber* next = curr->next;
+        if(curr->wait_address == state)
+        {
+            if(prev)
+                prev->next = next;
+            else
+                bucket->queue.first = next;
+            if(bucket->queue.last == curr)
+                bucket->queue.last = prev;
+
+            atomic_fetch_sub(&bucket->waiters, 1);
+            _fiber_queue_push(&woken, curr);
+            if(all == false)
+                break;
+        }
+        else
+            prev = curr;
+        curr = next;
+    }
+    mutex_unlock(&bucket->lock, SYNC_WAIT_BLOCK);
+
+    for(Fiber* curr = woken.first; curr; )
+    {
+        Fiber* next = curr->next;
+        _fiber_make_ready(curr);
+        curr = next;
+    }
+}
+
+EXTERNAL void fiber_sync_wake(volatile void* state)
+{
+    _fiber_sync_wake(state, true);
+}
+
+EXTERNAL void fiber_sync_wake_single(volatile void* state)
+{
+    _fiber_sync_wake(state, false);
+}
+#endif
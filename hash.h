@@ -14,6 +14,7 @@ typedef struct Hash_Entry Hash_Entry;
 //Can be used to implement more fully fledged hash tables.
 typedef struct Hash {
     Allocator* allocator;                
+    Allocator* grow_temp_allocator; //if not NULL the entries are grown in place. See hash_init_grow_in_place
     Hash_Entry* entries;                          
     uint32_t count;                    
     uint32_t capacity;          
@@ -55,6 +56,10 @@ typedef struct Hash_Iter {
 #endif
 
 EXTERNAL void  hash_init(Hash* table, Allocator* allocator, uint64_t empty_value); 
+//Same as hash_init but the entries are always resized in place and rehashed from a temporary copy made with temp_allocator. 
+// This makes it possible to use allocators holding only a single resizable allocation such as Arena. 
+// Large tables can thus live in an Arena backed by huge pages (see arena_init_custom) and stay at the same address.
+EXTERNAL void  hash_init_grow_in_place(Hash* table, Allocator* allocator, Allocator* temp_allocator, uint64_t empty_value); 
 EXTERNAL void  hash_deinit(Hash* table);
 EXTERNAL void  hash_clear(Hash* to_table); 
 EXTERNAL bool  hash_find(const Hash*, uint64_t hash, isize* index);
@@ -288,6 +293,12 @@ EXTERNAL void  hash_backlink_copy_rehash(Hash* to_table, const Hash* from_table,
         table->empty_value = empty_value;
     }   
 
+    EXTERNAL void hash_init_grow_in_place(Hash* table, Allocator* allocator, Allocator* temp_allocator, uint64_t empty_value)
+    {
+        hash_init(table, allocator, empty_value);
+        table->grow_temp_allocator = temp_allocator;
+    }
+
     INTERNAL void _hash_copy_rehash(Hash* to_table, const Hash* from_table, void* items_base, isize item_size, isize item_backlink_offset)
     {   
         hash_clear(to_table);
@@ -340,7 +351,17 @@ EXTERNAL void  hash_backlink_copy_rehash(Hash* to_table, const Hash* from_table,
 
         //we can call the rehash with to_table and from_table being the same
         // thing. We should handle those cases gracefully.
-        if(to_table->entries == from_table->entries)
+        if(to_table->entries == from_table->entries && to_table->grow_temp_allocator)
+        {
+            Hash old_copy = {0};
+            hash_init(&old_copy, to_table->grow_temp_allocator, from_table->empty_value);
+            hash_copy_simple(&old_copy, from_table);
+            to_table->entries = (Hash_Entry*) _hash_alloc(to_table->allocator, rehash_to*sizeof(Hash_Entry), to_table->entries, to_table->capacity*sizeof(Hash_Entry), sizeof(Hash_Entry));
+            to_table->capacity = (int32_t) rehash_to;
+            _hash_copy_rehash(to_table, &old_copy, items_base, item_size, item_backlink_offset);
+            hash_deinit(&old_copy);
+        }
+        else if(to_table->entries == from_table->entries)
         {
             Hash old_copy = *from_table;
             to_table->entries = (Hash_Entry*) _hash_alloc(to_table->allocator, rehash_to*sizeof(Hash_Entry), NULL, 0, sizeof(Hash_Entry));
@@ -381,6 +402,7 @@ EXTERNAL void  hash_backlink_copy_rehash(Hash* to_table, const Hash* from_table,
             to_table->capacity = (int32_t) from_table->capacity;
         }
         memcpy(to_table->entries, from_table->entries, from_table->capacity*sizeof(Hash_Entry));
+        to_table->count = from_table->count;
         to_table->gravestone_count = from_table->gravestone_count;
         to_table->empty_value = from_table->empty_value;
         _hash_check_consistency(to_table);
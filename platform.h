@@ -115,8 +115,16 @@ typedef enum Platform_Virtual_Allocation {
     PLATFORM_VIRTUAL_ALLOC_COMMIT   = 2, //Commits address space causing operating system to supply physical memory or swap file
     PLATFORM_VIRTUAL_ALLOC_DECOMMIT = 4, //Removes address space from commited freeing physical memory
     PLATFORM_VIRTUAL_ALLOC_RELEASE  = 8, //Free address space
+
+    //Hints combined with RESERVE and/or COMMIT. If not supported by the OS (or out of huge pages) they are silently ignored.
+    PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES = 16,          //Back the memory with transparent huge pages (MADV_HUGEPAGE). On RESERVE also aligns the address to platform_huge_page_size()
+    PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES_EXPLICIT = 32, //On RESERVE maps from the preallocated huge page pool (MAP_HUGETLB, MEM_LARGE_PAGES). Falls back to PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES. 
+                                                     // Sizes and addresses of all later operations on the memory should be multiples of platform_huge_page_size()
+    PLATFORM_VIRTUAL_ALLOC_NUMA_BIND = 64,           //Binds the physical memory to a NUMA node. Use through PLATFORM_VIRTUAL_ALLOC_NUMA_NODE(node)
 } Platform_Virtual_Allocation;
 
+#define PLATFORM_VIRTUAL_ALLOC_NUMA_NODE(node) ((Platform_Virtual_Allocation) (PLATFORM_VIRTUAL_ALLOC_NUMA_BIND | (((node) & 0xFFFF) << 16)))
+
 typedef enum Platform_Memory_Protection {
     PLATFORM_MEMORY_PROT_NO_ACCESS  = 0,
     PLATFORM_MEMORY_PROT_READ       = 1,
@@ -128,6 +136,7 @@ typedef enum Platform_Memory_Protection {
 
 Platform_Error platform_virtual_reallocate(void** output_adress_or_null, void* address, isize bytes, Platform_Virtual_Allocation action, Platform_Memory_Protection protection);
 isize platform_page_size();
+isize platform_huge_page_size(); //Returns the size of a (transparent) huge page or 0 if huge pages are not supported
 isize platform_allocation_granularity();
 void* platform_heap_reallocate(isize new_size, void* old_ptr, isize old_size, isize align);
 
@@ -153,6 +162,66 @@ void            platform_thread_sleep(double seconds); //Sleeps the calling thre
 void            platform_thread_exit(int code); //Terminates a thread with an exit code
 void            platform_thread_yield(); //Yields the remainder of this thread's time slice to another thread
 
+//=========================================
+// Processor topology and affinity
+//=========================================
+#define PLATFORM_MAX_PROCESSORS 1024
+
+//A set of logical processors indexed by their OS id (Platform_Processor.id)
+typedef struct Platform_CPU_Set {
+    uint64_t mask[PLATFORM_MAX_PROCESSORS/64];
+} Platform_CPU_Set;
+
+typedef struct Platform_Processor {
+    int32_t id;         //OS index of this logical processor
+    int32_t core;       //index of the physical core. SMT siblings have the same core
+    int32_t smt;        //index of this hardware thread within its core. 0 for the first
+    int32_t package;    //index of the physical package (socket)
+    int32_t l2_group;   //processors with the same l2_group share an L2 cache
+    int32_t l3_group;   //processors with the same l3_group share an L3 cache (or the last level cache if there is no L3)
+    int32_t numa_node;  //index of the NUMA node
+    int32_t _;
+} Platform_Processor;
+
+//All group indices are dense, ie. core is in [0, core_count) and so on. 
+typedef struct Platform_Topology {
+    const Platform_Processor* processors; //sorted by id
+    int32_t processor_count;
+    int32_t core_count;
+    int32_t package_count;
+    int32_t l2_group_count;
+    int32_t l3_group_count;
+    int32_t numa_node_count;
+    int64_t l2_size; //size of a single L2 cache in bytes or 0 if not known
+    int64_t l3_size;
+} Platform_Topology;
+
+typedef enum Platform_Topology_Level {
+    PLATFORM_TOPOLOGY_PROCESSOR = 0,
+    PLATFORM_TOPOLOGY_CORE,
+    PLATFORM_TOPOLOGY_L2,
+    PLATFORM_TOPOLOGY_L3,
+    PLATFORM_TOPOLOGY_NUMA_NODE,
+    PLATFORM_TOPOLOGY_PACKAGE,
+} Platform_Topology_Level;
+
+//Returns the topology of all online processors. It is queried on the first call and then cached.
+//If the OS does not provide the information each processor is reported as its own core and all share a single group.
+const Platform_Topology* platform_topology();
+//Returns the set of processors in the given group of the given level. For example (PLATFORM_TOPOLOGY_L3, 1) are all processors sharing the second L3 cache.
+//For PLATFORM_TOPOLOGY_PROCESSOR index is the index into Platform_Topology.processors. Out of range index gives an empty set.
+Platform_CPU_Set platform_topology_cpu_set(Platform_Topology_Level level, int32_t index);
+
+void            platform_cpu_set_add(Platform_CPU_Set* set, int32_t processor_id);
+bool            platform_cpu_set_has(const Platform_CPU_Set* set, int32_t processor_id);
+int32_t         platform_cpu_set_count(const Platform_CPU_Set* set);
+
+//Sets the processors the calling thread is allowed to run on. Fails if none of them is usable.
+Platform_Error  platform_thread_set_affinity(const Platform_CPU_Set* set);
+Platform_Error  platform_thread_get_affinity(Platform_CPU_Set* set);
+//Same as platform_thread_launch but the thread runs only on processors in affinity. If affinity_or_null is NULL behaves exactly like platform_thread_launch.
+Platform_Error  platform_thread_launch_pinned(isize stack_size_or_zero, const Platform_CPU_Set* affinity_or_null, void (*func)(void*), void* context, const char* name_fmt, ...);
+
 //Fast recursive mutex. (pthread_mutex_t on linux, CRITICAL_SECTION win32)
 typedef struct Platform_Mutex {
     void* handle;
@@ -293,6 +362,18 @@ Platform_Error platform_file_read(Platform_File* file, void* buffer, isize size,
 Platform_Error platform_file_write(Platform_File* file, const void* buffer, isize size, isize offset); //if offset is INT64_MAX writes at end
 Platform_Error platform_file_flush(Platform_File* file);
 
+//Read only view of an entire file mapped into the address space. 
+//(file is mapped) iff (address != NULL)
+typedef struct Platform_Memory_Mapping {
+    void* address;
+    isize size;
+} Platform_Memory_Mapping;
+
+//Maps the entire file read only at an address chosen by the OS. The pages are loaded lazily on first access.
+//Empty files succeed with address == NULL. The mapping stays valid after the file is moved or removed.
+Platform_Error platform_file_memory_map(Platform_String file_path, Platform_Memory_Mapping* mapping);
+void platform_file_memory_unmap(Platform_Memory_Mapping* mapping); //Does nothing when not mapped
+
 //The fastest way to read/write/append a file. 
 //@NOTE: Maybe in the future we will want some mechanism to read as fast as possible a collection of files in async way. 
 //This could be useful for games with loose files
@@ -123,7 +123,66 @@ void _print_errno(int errno_val)
 }
 
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <errno.h>
+
+#ifndef MAP_HUGETLB
+    #define MAP_HUGETLB 0x40000
+#endif
+#ifndef MADV_HUGEPAGE
+    #define MADV_HUGEPAGE 14
+#endif
+#ifndef MPOL_BIND
+    #define MPOL_BIND 2
+#endif
+
+static void _platform_virtual_apply_hints(void* address, int64_t bytes, Platform_Virtual_Allocation action)
+{
+    if(action & (PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES | PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES_EXPLICIT))
+        madvise(address, (size_t) bytes, MADV_HUGEPAGE);
+
+    //mbind directly through syscall so that we do not depend on libnuma.
+    //Fails (and is ignored) on kernels without NUMA support or when the node does not exist.
+    #ifdef SYS_mbind
+    if(action & PLATFORM_VIRTUAL_ALLOC_NUMA_BIND)
+    {
+        uint32_t node = ((uint32_t) action >> 16) & 0xFFFF;
+        unsigned long nodemask[0x10000/(8*sizeof(unsigned long))] = {0};
+        nodemask[node/(8*sizeof(unsigned long))] |= 1ul << (node%(8*sizeof(unsigned long)));
+        syscall(SYS_mbind, address, (unsigned long) bytes, MPOL_BIND, nodemask, (unsigned long) node + 2, 0);
+    }
+    #endif
+}
+
+static void* _platform_virtual_reserve(void* allocate_at, int64_t bytes, Platform_Virtual_Allocation action)
+{
+    int64_t huge = platform_huge_page_size();
+    if((action & PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES_EXPLICIT) && huge > 0 && bytes % huge == 0)
+    {
+        void* out = mmap(allocate_at, (size_t) bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(out != MAP_FAILED)
+            return out;
+    }
+
+    //Transparent huge pages are only used for huge page aligned ranges. 
+    //Over-reserve and trim the unaligned ends.
+    if((action & (PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES | PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES_EXPLICIT)) && huge > 0 && allocate_at == NULL && bytes >= huge)
+    {
+        uint8_t* out = (uint8_t*) mmap(NULL, (size_t) (bytes + huge), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(out != MAP_FAILED)
+        {
+            uint8_t* aligned = (uint8_t*) (((uintptr_t) out + (uintptr_t) huge - 1) & ~((uintptr_t) huge - 1));
+            if(aligned > out)
+                munmap(out, (size_t) (aligned - out));
+            if(aligned + bytes < out + bytes + huge)
+                munmap(aligned + bytes, (size_t) (out + bytes + huge - (aligned + bytes)));
+            return aligned;
+        }
+    }
+
+    return mmap(allocate_at, (size_t) bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+}
+
 Platform_Error platform_virtual_reallocate(void** output_adress_or_null, void* allocate_at, int64_t bytes, Platform_Virtual_Allocation action, Platform_Memory_Protection protection)
 {
     Platform_Error error = PLATFORM_ERROR_OK;
@@ -131,12 +190,14 @@ Platform_Error platform_virtual_reallocate(void** output_adress_or_null, void* a
 
     if(action & PLATFORM_VIRTUAL_ALLOC_RESERVE)   
     {
-        out = mmap(allocate_at, (size_t) bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        out = _platform_virtual_reserve(allocate_at, bytes, action);
         if(out == MAP_FAILED)
         {
             error = (Platform_Error) errno;
             out = NULL;
         }
+        else
+            _platform_virtual_apply_hints(out, bytes, action);
     }
     if(action & PLATFORM_VIRTUAL_ALLOC_RELEASE)
     {
@@ -159,6 +220,8 @@ Platform_Error platform_virtual_reallocate(void** output_adress_or_null, void* a
             assert((size_t) allocate_at % platform_page_size() == 0);
             if(mprotect(allocate_at, (size_t) bytes, prot) == 0)
             {
+                if((action & PLATFORM_VIRTUAL_ALLOC_RESERVE) == 0)
+                    _platform_virtual_apply_hints(allocate_at, bytes, action);
                 madvise(allocate_at, (size_t) bytes, MADV_WILLNEED);
                 out = allocate_at;
             }
@@ -189,6 +252,43 @@ int64_t platform_page_size()
     return (int64_t) getpagesize();
 }
 
+int64_t platform_huge_page_size()
+{
+    static int64_t huge_page_size = -1;
+    if(huge_page_size == -1)
+    {
+        int64_t size = 0;
+        char buffer[64] = {0};
+        int fd = open("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", O_RDONLY | O_CLOEXEC);
+        if(fd != -1)
+        {
+            if(read(fd, buffer, sizeof buffer - 1) > 0)
+                size = strtoll(buffer, NULL, 10);
+            close(fd);
+        }
+
+        if(size <= 0)
+        {
+            FILE* meminfo = fopen("/proc/meminfo", "r");
+            char line[256] = {0};
+            while(meminfo && fgets(line, sizeof line, meminfo))
+            {
+                long long kb = 0;
+                if(sscanf(line, "Hugepagesize: %lld kB", &kb) == 1)
+                {
+                    size = kb*1024;
+                    break;
+                }
+            }
+            if(meminfo)
+                fclose(meminfo);
+        }
+
+        huge_page_size = size > 0 ? size : 0;
+    }
+    return huge_page_size;
+}
+
 int64_t platform_allocation_granularity()
 {
     return (int64_t) getpagesize();
@@ -286,8 +386,17 @@ void* _platform_pthread_start_routine(void* arg)
     return NULL;
 }
 
+static void _platform_cpu_set_to_os(cpu_set_t* os, const Platform_CPU_Set* set)
+{
+    CPU_ZERO(os);
+    int32_t max = PLATFORM_MAX_PROCESSORS < CPU_SETSIZE ? PLATFORM_MAX_PROCESSORS : CPU_SETSIZE;
+    for(int32_t i = 0; i < max; i++)
+        if(platform_cpu_set_has(set, i))
+            CPU_SET(i, os);
+}
+
 #include <stdarg.h>
-Platform_Error  platform_thread_launch(isize stack_size_or_zero, void (*func)(void*), void* context, const char* name_fmt, ...)
+static Platform_Error _platform_thread_launch(isize stack_size_or_zero, const Platform_CPU_Set* affinity_or_null, void (*func)(void*), void* context, const char* name_fmt, va_list args)
 {
     Platform_Error error = 0;
     Platform_Pthread_State* thread_state = (Platform_Pthread_State*) calloc(1, sizeof(Platform_Pthread_State));
@@ -298,18 +407,22 @@ Platform_Error  platform_thread_launch(isize stack_size_or_zero, void (*func)(vo
         pthread_attr_init(&attr);
         if(stack_size_or_zero > 0)
             pthread_attr_setstacksize(&attr, (size_t) stack_size_or_zero);
+        if(affinity_or_null)
+        {
+            cpu_set_t cs;
+            _platform_cpu_set_to_os(&cs, affinity_or_null);
+            pthread_attr_setaffinity_np(&attr, sizeof(cs), &cs);
+        }
 
         name_fmt = name_fmt ? name_fmt : "";
-        va_list args;
         va_list copy;
-        va_start(args, name_fmt);
         va_copy(copy, args);
         int count = vsnprintf(NULL, 0, name_fmt, copy);
+        va_end(copy);
         if(count < 16)
             count = 16;
         thread_state->name = (char*) malloc(count + 1);
         thread_state->name_size = vsnprintf(thread_state->name, count + 1, name_fmt, args);
-        va_end(args);
 
         thread_state->func = func;
         thread_state->context = context;
@@ -317,12 +430,33 @@ Platform_Error  platform_thread_launch(isize stack_size_or_zero, void (*func)(vo
         pthread_attr_destroy(&attr);
     }
 
-    if(error)
+    if(error && thread_state)
+    {
+        free(thread_state->name);
         free(thread_state);
+    }
 
     return error;
 }
 
+Platform_Error  platform_thread_launch(isize stack_size_or_zero, void (*func)(void*), void* context, const char* name_fmt, ...)
+{
+    va_list args;
+    va_start(args, name_fmt);
+    Platform_Error error = _platform_thread_launch(stack_size_or_zero, NULL, func, context, name_fmt, args);
+    va_end(args);
+    return error;
+}
+
+Platform_Error  platform_thread_launch_pinned(isize stack_size_or_zero, const Platform_CPU_Set* affinity_or_null, void (*func)(void*), void* context, const char* name_fmt, ...)
+{
+    va_list args;
+    va_start(args, name_fmt);
+    Platform_Error error = _platform_thread_launch(stack_size_or_zero, affinity_or_null, func, context, name_fmt, args);
+    va_end(args);
+    return error;
+}
+
 int32_t platform_thread_get_processor_count()
 {
     cpu_set_t cs;
@@ -401,6 +535,272 @@ void platform_thread_yield()
     sched_yield();
 }
 
+//======================================
+// Processor topology and affinity
+//======================================
+void platform_cpu_set_add(Platform_CPU_Set* set, int32_t processor_id)
+{
+    if(0 <= processor_id && processor_id < PLATFORM_MAX_PROCESSORS)
+        set->mask[processor_id/64] |= (uint64_t) 1 << (processor_id%64);
+}
+
+bool platform_cpu_set_has(const Platform_CPU_Set* set, int32_t processor_id)
+{
+    if(0 <= processor_id && processor_id < PLATFORM_MAX_PROCESSORS)
+        return (set->mask[processor_id/64] >> (processor_id%64)) & 1;
+    return false;
+}
+
+int32_t platform_cpu_set_count(const Platform_CPU_Set* set)
+{
+    int32_t count = 0;
+    for(int32_t i = 0; i < PLATFORM_MAX_PROCESSORS/64; i++)
+        count += __builtin_popcountll(set->mask[i]);
+    return count;
+}
+
+Platform_Error platform_thread_set_affinity(const Platform_CPU_Set* set)
+{
+    cpu_set_t cs;
+    _platform_cpu_set_to_os(&cs, set);
+    return _platform_error_code(sched_setaffinity(0, sizeof(cs), &cs) == 0);
+}
+
+Platform_Error platform_thread_get_affinity(Platform_CPU_Set* set)
+{
+    memset(set, 0, sizeof *set);
+    cpu_set_t cs;
+    CPU_ZERO(&cs);
+    Platform_Error error = _platform_error_code(sched_getaffinity(0, sizeof(cs), &cs) == 0);
+    int32_t max = PLATFORM_MAX_PROCESSORS < CPU_SETSIZE ? PLATFORM_MAX_PROCESSORS : CPU_SETSIZE;
+    for(int32_t i = 0; i < max; i++)
+        if(CPU_ISSET(i, &cs))
+            platform_cpu_set_add(set, i);
+    return error;
+}
+
+//Reads a small sysfs file into buffer null terminating it. Returns false if it does not exist.
+static bool _platform_sysfs_read(char* buffer, isize buffer_size, const char* path_fmt, ...)
+{
+    char path[256] = {0};
+    va_list args;
+    va_start(args, path_fmt);
+    vsnprintf(path, sizeof path, path_fmt, args);
+    va_end(args);
+
+    buffer[0] = '\0';
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd == -1)
+        return false;
+
+    isize read_bytes = read(fd, buffer, (size_t) buffer_size - 1);
+    close(fd);
+    if(read_bytes < 0)
+        read_bytes = 0;
+    buffer[read_bytes] = '\0';
+    return read_bytes > 0;
+}
+
+//Parses the kernel cpu list format such as "0-3,8,10-11"
+static void _platform_parse_cpu_list(Platform_CPU_Set* set, const char* list)
+{
+    memset(set, 0, sizeof *set);
+    for(const char* at = list; *at; )
+    {
+        char* end = NULL;
+        long from = strtol(at, &end, 10);
+        if(end == at)
+            break;
+
+        long to = from;
+        at = end;
+        if(*at == '-')
+        {
+            to = strtol(at + 1, &end, 10);
+            at = end;
+        }
+
+        for(long i = from; i <= to && i < PLATFORM_MAX_PROCESSORS; i++)
+            platform_cpu_set_add(set, (int32_t) i);
+
+        if(*at == ',')
+            at += 1;
+        else
+            break;
+    }
+}
+
+static int32_t _platform_cpu_set_first(const Platform_CPU_Set* set)
+{
+    for(int32_t i = 0; i < PLATFORM_MAX_PROCESSORS/64; i++)
+        if(set->mask[i])
+            return i*64 + __builtin_ctzll(set->mask[i]);
+    return -1;
+}
+
+//Maps an arbitrary key (such as the first processor of a group) to a dense group index
+static int32_t _platform_dense_index(int32_t* keys, int32_t* key_count, int32_t key)
+{
+    for(int32_t i = 0; i < *key_count; i++)
+        if(keys[i] == key)
+            return i;
+
+    keys[*key_count] = key;
+    return (*key_count)++;
+}
+
+static Platform_Processor g_topology_processors[PLATFORM_MAX_PROCESSORS];
+static Platform_Topology g_topology = {0};
+static uint32_t g_topology_once = 0;
+
+static void _platform_topology_query(Platform_Topology* topology, Platform_Processor* processors)
+{
+    char buffer[512] = {0};
+    Platform_CPU_Set online = {0};
+    if(_platform_sysfs_read(buffer, sizeof buffer, "/sys/devices/system/cpu/online"))
+        _platform_parse_cpu_list(&online, buffer);
+    else
+        platform_thread_get_affinity(&online);
+
+    int32_t core_keys[PLATFORM_MAX_PROCESSORS];
+    int32_t package_keys[PLATFORM_MAX_PROCESSORS];
+    int32_t l2_keys[PLATFORM_MAX_PROCESSORS];
+    int32_t l3_keys[PLATFORM_MAX_PROCESSORS];
+    int32_t numa_keys[PLATFORM_MAX_PROCESSORS];
+    int32_t core_count = 0, package_count = 0, l2_count = 0, l3_count = 0, numa_count = 0;
+
+    //NUMA nodes are listed from the node side
+    int32_t cpu_to_node[PLATFORM_MAX_PROCESSORS] = {0};
+    Platform_CPU_Set nodes = {0};
+    if(_platform_sysfs_read(buffer, sizeof buffer, "/sys/devices/system/node/online"))
+    {
+        _platform_parse_cpu_list(&nodes, buffer);
+        for(int32_t node = 0; node < PLATFORM_MAX_PROCESSORS; node++)
+        {
+            if(platform_cpu_set_has(&nodes, node) == false)
+                continue;
+
+            Platform_CPU_Set node_cpus = {0};
+            if(_platform_sysfs_read(buffer, sizeof buffer, "/sys/devices/system/node/node%i/cpulist", node))
+                _platform_parse_cpu_list(&node_cpus, buffer);
+            for(int32_t cpu = 0; cpu < PLATFORM_MAX_PROCESSORS; cpu++)
+                if(platform_cpu_set_has(&node_cpus, cpu))
+                    cpu_to_node[cpu] = node;
+        }
+    }
+
+    int32_t count = 0;
+    for(int32_t cpu = 0; cpu < PLATFORM_MAX_PROCESSORS; cpu++)
+    {
+        if(platform_cpu_set_has(&online, cpu) == false)
+            continue;
+
+        Platform_Processor* proc = &processors[count++];
+        memset(proc, 0, sizeof *proc);
+        proc->id = cpu;
+
+        //Cores are keyed by the first of their SMT siblings. smt is the rank within the siblings.
+        Platform_CPU_Set siblings = {0};
+        if(_platform_sysfs_read(buffer, sizeof buffer, "/sys/devices/system/cpu/cpu%i/topology/thread_siblings_list", cpu))
+            _platform_parse_cpu_list(&siblings, buffer);
+        else
+            platform_cpu_set_add(&siblings, cpu);
+        proc->core = _platform_dense_index(core_keys, &core_count, _platform_cpu_set_first(&siblings));
+        for(int32_t i = 0; i < cpu; i++)
+            proc->smt += platform_cpu_set_has(&siblings, i);
+
+        int32_t package = 0;
+        if(_platform_sysfs_read(buffer, sizeof buffer, "/sys/devices/system/cpu/cpu%i/topology/physical_package_id", cpu))
+            package = (int32_t) strtol(buffer, NULL, 10);
+        proc->package = _platform_dense_index(package_keys, &package_count, package);
+        proc->numa_node = _platform_dense_index(numa_keys, &numa_count, cpu_to_node[cpu]);
+
+        //Caches are keyed by the first processor sharing them. 
+        //If the cpu has no L2 (L3) it is its own group (shares the L2 group).
+        int32_t l2_key = cpu;
+        int32_t l3_key = -1;
+        for(int32_t index = 0; index < 16; index++)
+        {
+            if(_platform_sysfs_read(buffer, sizeof buffer, "/sys/devices/system/cpu/cpu%i/cache/index%i/level", cpu, index) == false)
+                break;
+
+            int32_t level = (int32_t) strtol(buffer, NULL, 10);
+            if(level != 2 && level != 3)
+                continue;
+
+            Platform_CPU_Set shared = {0};
+            if(_platform_sysfs_read(buffer, sizeof buffer, "/sys/devices/system/cpu/cpu%i/cache/index%i/shared_cpu_list", cpu, index))
+                _platform_parse_cpu_list(&shared, buffer);
+            else
+                platform_cpu_set_add(&shared, cpu);
+
+            int64_t size = 0;
+            if(_platform_sysfs_read(buffer, sizeof buffer, "/sys/devices/system/cpu/cpu%i/cache/index%i/size", cpu, index))
+            {
+                char* end = NULL;
+                size = strtoll(buffer, &end, 10);
+                if(*end == 'K') size *= 1024;
+                if(*end == 'M') size *= 1024*1024;
+            }
+
+            if(level == 2)
+            {
+                l2_key = _platform_cpu_set_first(&shared);
+                topology->l2_size = size;
+            }
+            else
+            {
+                l3_key = _platform_cpu_set_first(&shared);
+                topology->l3_size = size;
+            }
+        }
+
+        proc->l2_group = _platform_dense_index(l2_keys, &l2_count, l2_key);
+        proc->l3_group = _platform_dense_index(l3_keys, &l3_count, l3_key >= 0 ? l3_key : l2_key);
+    }
+
+    topology->processors = processors;
+    topology->processor_count = count;
+    topology->core_count = core_count;
+    topology->package_count = package_count;
+    topology->l2_group_count = l2_count;
+    topology->l3_group_count = l3_count;
+    topology->numa_node_count = numa_count;
+}
+
+const Platform_Topology* platform_topology()
+{
+    if(platform_once_begin(&g_topology_once))
+    {
+        _platform_topology_query(&g_topology, g_topology_processors);
+        platform_once_end(&g_topology_once);
+    }
+    return &g_topology;
+}
+
+Platform_CPU_Set platform_topology_cpu_set(Platform_Topology_Level level, int32_t index)
+{
+    const Platform_Topology* topology = platform_topology();
+    Platform_CPU_Set set = {0};
+    for(int32_t i = 0; i < topology->processor_count; i++)
+    {
+        const Platform_Processor* proc = &topology->processors[i];
+        int32_t group = -1;
+        switch(level)
+        {
+            case PLATFORM_TOPOLOGY_PROCESSOR: group = i; break;
+            case PLATFORM_TOPOLOGY_CORE:      group = proc->core; break;
+            case PLATFORM_TOPOLOGY_L2:        group = proc->l2_group; break;
+            case PLATFORM_TOPOLOGY_L3:        group = proc->l3_group; break;
+            case PLATFORM_TOPOLOGY_NUMA_NODE: group = proc->numa_node; break;
+            case PLATFORM_TOPOLOGY_PACKAGE:   group = proc->package; break;
+        }
+        if(group == index)
+            platform_cpu_set_add(&set, proc->id);
+    }
+    return set;
+}
+
 
 //======================================
 // MUTEX
@@ -900,6 +1300,39 @@ Platform_Error platform_file_flush(Platform_File* file)
     return _platform_error_code(state);
 }
 
+Platform_Error platform_file_memory_map(Platform_String file_path, Platform_Memory_Mapping* mapping)
+{
+    platform_file_memory_unmap(mapping);
+
+    Platform_File file = {0};
+    isize size = 0;
+    Platform_Error error = platform_file_open(&file, file_path, PLATFORM_FILE_OPEN_READ);
+    if(error == 0)
+        error = platform_file_size(&file, &size);
+    if(error == 0 && size > 0)
+    {
+        void* address = mmap(NULL, (size_t) size, PROT_READ, MAP_PRIVATE, _platform_fd(&file), 0);
+        if(address == MAP_FAILED)
+            error = (Platform_Error) errno;
+        else
+        {
+            mapping->address = address;
+            mapping->size = size;
+        }
+    }
+
+    //The mapping keeps its own reference to the file
+    platform_file_close(&file);
+    return error;
+}
+
+void platform_file_memory_unmap(Platform_Memory_Mapping* mapping)
+{
+    if(mapping->address)
+        munmap(mapping->address, (size_t) mapping->size);
+    memset(mapping, 0, sizeof *mapping);
+}
+
 Platform_Error platform_file_create(Platform_String file_path, bool fail_if_exists)
 {   
     int flags = O_WRONLY | O_CREAT | O_LARGEFILE;
@@ -1372,16 +1805,26 @@ bool platform_file_watch_poll(Platform_File_Watch* file_watch, Platform_File_Wat
 
 int64_t platform_capture_call_stack(void** stack, int64_t stack_size, int64_t skip_count)
 {
+    if(stack_size <= 0)
+        return 0;
+
     void* stack_ptrs[PLATFORM_CALLSTACKS_MAX] = {0};
-    int64_t found_size = backtrace(stack_ptrs, (int) PLATFORM_CALLSTACKS_MAX);
     if(skip_count < 0)
         skip_count = 0;
         
     skip_count += 1; //for this function
     
+    //Only unwind as deep as needed. This makes capturing just a few frames cheap.
+    int64_t max_size = skip_count + stack_size;
+    if(max_size > PLATFORM_CALLSTACKS_MAX)
+        max_size = PLATFORM_CALLSTACKS_MAX;
+
+    int64_t found_size = backtrace(stack_ptrs, (int) max_size);
     int64_t not_skipped_size = found_size - skip_count;
     if(not_skipped_size < 0)
         not_skipped_size = 0;
+    if(not_skipped_size > stack_size)
+        not_skipped_size = stack_size;
 
     memcpy(stack, stack_ptrs + skip_count, (size_t) not_skipped_size*sizeof(void*));
     return not_skipped_size;
@@ -1628,7 +2071,9 @@ bool platform_exception_sandbox(
     {
         Signal_Handler_State* prev_state = t_platform_sighandle_state;
         t_platform_sighandle_state = state;
-        switch(sigsetjmp(state->jump_buffer, 0))
+        //Save the signal mask as well. Otherwise the signal stays blocked after jumping out of the handler
+        // and the next exception of the same kind kills the process.
+        switch(sigsetjmp(state->jump_buffer, 1))
         {
             case 0: {
                 sandboxed_func(sandbox_context);
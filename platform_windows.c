@@ -84,6 +84,8 @@ Platform_Error platform_virtual_reallocate(void** output_adress_or_null, void* a
 {
     void* out_addr = NULL;
     Platform_Error out = PLATFORM_ERROR_OK;
+    Platform_Virtual_Allocation hints = action;
+    action = (Platform_Virtual_Allocation) (action & 15);
     
     if(action == PLATFORM_VIRTUAL_ALLOC_RELEASE)
         out = _platform_error_code(!!VirtualFree(address, 0, MEM_RELEASE));  
@@ -115,7 +117,20 @@ Platform_Error platform_virtual_reallocate(void** output_adress_or_null, void* a
         if(bytes > 0)
         {
             int action_code = action == PLATFORM_VIRTUAL_ALLOC_RESERVE ? MEM_RESERVE : MEM_COMMIT;
-            out_addr = VirtualAlloc(address, bytes, action_code, prot);
+
+            //Large pages cannot be reserved without being commited so they are commited right away.
+            //Requires SeLockMemoryPrivilege, if we dont have it falls back to regular pages.
+            SIZE_T large_page = GetLargePageMinimum();
+            if((hints & PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES_EXPLICIT) && action == PLATFORM_VIRTUAL_ALLOC_RESERVE && large_page > 0 && bytes % large_page == 0)
+                out_addr = VirtualAlloc(address, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+            if(out_addr == NULL)
+            {
+                if(hints & PLATFORM_VIRTUAL_ALLOC_NUMA_BIND)
+                    out_addr = VirtualAllocExNuma(GetCurrentProcess(), address, bytes, action_code, prot, ((uint32_t) hints >> 16) & 0xFFFF);
+                if(out_addr == NULL)
+                    out_addr = VirtualAlloc(address, bytes, action_code, prot);
+            }
             out = _platform_error_code(out_addr != NULL);
         }
     }
@@ -126,6 +141,11 @@ Platform_Error platform_virtual_reallocate(void** output_adress_or_null, void* a
     return out;
 }
 
+int64_t platform_huge_page_size()
+{
+    return (int64_t) GetLargePageMinimum();
+}
+
 void* platform_heap_reallocate(int64_t new_size, void* old_ptr, int64_t align)
 {
     assert(align > 0 && new_size >= 0);
@@ -205,7 +225,22 @@ unsigned _thread_func(void* args)
     return 0;
 }
 
-Platform_Error platform_thread_launch(isize stack_size_or_zero, void (*func)(void*), void* context, const char* name_fmt, ...)
+//Windows affinity masks are per processor group of 64 processors. Threads can only run in a single group 
+// so we use the group of the first processor in the set.
+static bool _platform_cpu_set_to_group_affinity(GROUP_AFFINITY* affinity, const Platform_CPU_Set* set)
+{
+    memset(affinity, 0, sizeof *affinity);
+    for(int32_t group = 0; group < PLATFORM_MAX_PROCESSORS/64; group++)
+        if(set->mask[group])
+        {
+            affinity->Group = (WORD) group;
+            affinity->Mask = (KAFFINITY) set->mask[group];
+            return true;
+        }
+    return false;
+}
+
+static Platform_Error _platform_thread_launch(isize stack_size_or_zero, const Platform_CPU_Set* affinity_or_null, void (*func)(void*), void* context, const char* name_fmt, va_list args)
 {
     if(stack_size_or_zero <= 0)
         stack_size_or_zero = 0;
@@ -220,26 +255,48 @@ Platform_Error platform_thread_launch(isize stack_size_or_zero, void (*func)(voi
         if(name_fmt == NULL)
             name_fmt = "";
 
-        va_list args;
         va_list copy;
-        va_start(args, name_fmt);
         va_copy(copy, args);
         thread_context->name_size = vsnprintf(NULL, 0, name_fmt, copy);
+        va_end(copy);
         thread_context->name = calloc(1, thread_context->name_size + 1);
         vsnprintf(thread_context->name, thread_context->name_size + 1, name_fmt, args);
-        va_end(args);
 
-        HANDLE handle = (HANDLE) _beginthreadex(NULL, (unsigned int) stack_size_or_zero, _thread_func, thread_context, 0, NULL);
+        HANDLE handle = (HANDLE) _beginthreadex(NULL, (unsigned int) stack_size_or_zero, _thread_func, thread_context, CREATE_SUSPENDED, NULL);
         if(handle) 
+        {
+            GROUP_AFFINITY affinity = {0};
+            if(affinity_or_null && _platform_cpu_set_to_group_affinity(&affinity, affinity_or_null))
+                SetThreadGroupAffinity(handle, &affinity, NULL);
+            ResumeThread(handle);
+            CloseHandle(handle);
             return PLATFORM_ERROR_OK;
+        }
 
-        freeplatform_thread_launch(thread_context->name);
+        free(thread_context->name);
     }
 
     free(thread_context);
     return (Platform_Error) GetLastError();
 }
 
+Platform_Error platform_thread_launch(isize stack_size_or_zero, void (*func)(void*), void* context, const char* name_fmt, ...)
+{
+    va_list args;
+    va_start(args, name_fmt);
+    Platform_Error error = _platform_thread_launch(stack_size_or_zero, NULL, func, context, name_fmt, args);
+    va_end(args);
+    return error;
+}
+
+Platform_Error platform_thread_launch_pinned(isize stack_size_or_zero, const Platform_CPU_Set* affinity_or_null, void (*func)(void*), void* context, const char* name_fmt, ...)
+{
+    va_list args;
+    va_start(args, name_fmt);
+    Platform_Error error = _platform_thread_launch(stack_size_or_zero, affinity_or_null, func, context, name_fmt, args);
+    va_end(args);
+    return error;
+}
 
 static _Thread_local char* t_thread_name = NULL;
 static _Thread_local char t_thread_name_string[16] = {0};
@@ -298,6 +355,178 @@ void platform_thread_yield()
     SwitchToThread();
 }
 
+//======================================
+// Processor topology and affinity
+//======================================
+void platform_cpu_set_add(Platform_CPU_Set* set, int32_t processor_id)
+{
+    if(0 <= processor_id && processor_id < PLATFORM_MAX_PROCESSORS)
+        set->mask[processor_id/64] |= (uint64_t) 1 << (processor_id%64);
+}
+
+bool platform_cpu_set_has(const Platform_CPU_Set* set, int32_t processor_id)
+{
+    if(0 <= processor_id && processor_id < PLATFORM_MAX_PROCESSORS)
+        return (set->mask[processor_id/64] >> (processor_id%64)) & 1;
+    return false;
+}
+
+int32_t platform_cpu_set_count(const Platform_CPU_Set* set)
+{
+    int32_t count = 0;
+    for(int32_t i = 0; i < PLATFORM_MAX_PROCESSORS/64; i++)
+        count += (int32_t) __popcnt64(set->mask[i]);
+    return count;
+}
+
+Platform_Error platform_thread_set_affinity(const Platform_CPU_Set* set)
+{
+    GROUP_AFFINITY affinity = {0};
+    if(_platform_cpu_set_to_group_affinity(&affinity, set) == false)
+        return ERROR_INVALID_PARAMETER;
+    return _platform_error_code(!!SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL));
+}
+
+Platform_Error platform_thread_get_affinity(Platform_CPU_Set* set)
+{
+    memset(set, 0, sizeof *set);
+    GROUP_AFFINITY affinity = {0};
+    Platform_Error error = _platform_error_code(!!GetThreadGroupAffinity(GetCurrentThread(), &affinity));
+    if(error == 0 && affinity.Group < PLATFORM_MAX_PROCESSORS/64)
+        set->mask[affinity.Group] = (uint64_t) affinity.Mask;
+    return error;
+}
+
+static Platform_Processor g_topology_processors[PLATFORM_MAX_PROCESSORS];
+static Platform_Topology g_topology = {0};
+static uint32_t g_topology_once = 0;
+
+static void _platform_topology_assign(const GROUP_AFFINITY* affinity, int32_t group_index, size_t field_offset)
+{
+    for(int32_t i = 0; i < g_topology.processor_count; i++)
+    {
+        Platform_Processor* proc = &g_topology_processors[i];
+        if(proc->id/64 == affinity->Group && ((uint64_t) affinity->Mask >> (proc->id%64)) & 1)
+            *(int32_t*) (void*) ((char*) proc + field_offset) = group_index;
+    }
+}
+
+static void _platform_topology_query()
+{
+    //Every active processor is first its own core in a single group. Then refined by what the OS reports.
+    int32_t count = 0;
+    WORD group_count = GetActiveProcessorGroupCount();
+    for(WORD group = 0; group < group_count; group++)
+    {
+        DWORD in_group = GetActiveProcessorCount(group);
+        for(DWORD i = 0; i < in_group && count < PLATFORM_MAX_PROCESSORS; i++)
+        {
+            Platform_Processor* proc = &g_topology_processors[count];
+            memset(proc, 0, sizeof *proc);
+            proc->id = group*64 + (int32_t) i;
+            proc->core = count;
+            count += 1;
+        }
+    }
+    g_topology.processors = g_topology_processors;
+    g_topology.processor_count = count;
+    g_topology.core_count = count;
+    g_topology.package_count = 1;
+    g_topology.l2_group_count = 1;
+    g_topology.l3_group_count = 1;
+    g_topology.numa_node_count = 1;
+
+    DWORD size = 0;
+    GetLogicalProcessorInformationEx(RelationAll, NULL, &size);
+    uint8_t* buffer = (uint8_t*) malloc(size);
+    if(buffer && GetLogicalProcessorInformationEx(RelationAll, (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*) buffer, &size))
+    {
+        int32_t cores = 0, packages = 0, l2s = 0, l3s = 0, nodes = 0;
+        for(DWORD offset = 0; offset < size; )
+        {
+            SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX* info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*) (buffer + offset);
+            switch(info->Relationship)
+            {
+                case RelationProcessorCore: {
+                    for(WORD g = 0; g < info->Processor.GroupCount; g++)
+                        _platform_topology_assign(&info->Processor.GroupMask[g], cores, offsetof(Platform_Processor, core));
+                    cores += 1;
+                } break;
+                case RelationProcessorPackage: {
+                    for(WORD g = 0; g < info->Processor.GroupCount; g++)
+                        _platform_topology_assign(&info->Processor.GroupMask[g], packages, offsetof(Platform_Processor, package));
+                    packages += 1;
+                } break;
+                case RelationNumaNode: {
+                    _platform_topology_assign(&info->NumaNode.GroupMask, nodes, offsetof(Platform_Processor, numa_node));
+                    nodes += 1;
+                } break;
+                case RelationCache: {
+                    if(info->Cache.Type != CacheData && info->Cache.Type != CacheUnified)
+                        break;
+                    if(info->Cache.Level == 2) {
+                        _platform_topology_assign(&info->Cache.GroupMask, l2s, offsetof(Platform_Processor, l2_group));
+                        g_topology.l2_size = info->Cache.CacheSize;
+                        l2s += 1;
+                    }
+                    if(info->Cache.Level == 3) {
+                        _platform_topology_assign(&info->Cache.GroupMask, l3s, offsetof(Platform_Processor, l3_group));
+                        g_topology.l3_size = info->Cache.CacheSize;
+                        l3s += 1;
+                    }
+                } break;
+                default: break;
+            }
+            offset += info->Size;
+        }
+
+        if(cores)    g_topology.core_count = cores;
+        if(packages) g_topology.package_count = packages;
+        if(l2s)      g_topology.l2_group_count = l2s;
+        if(l3s)      g_topology.l3_group_count = l3s;
+        if(nodes)    g_topology.numa_node_count = nodes;
+
+        //smt is the rank among processors of the same core. Processors are sorted by id.
+        for(int32_t i = 0; i < count; i++)
+            for(int32_t j = 0; j < i; j++)
+                g_topology_processors[i].smt += g_topology_processors[j].core == g_topology_processors[i].core;
+    }
+    free(buffer);
+}
+
+const Platform_Topology* platform_topology()
+{
+    if(platform_once_begin(&g_topology_once))
+    {
+        _platform_topology_query();
+        platform_once_end(&g_topology_once);
+    }
+    return &g_topology;
+}
+
+Platform_CPU_Set platform_topology_cpu_set(Platform_Topology_Level level, int32_t index)
+{
+    const Platform_Topology* topology = platform_topology();
+    Platform_CPU_Set set = {0};
+    for(int32_t i = 0; i < topology->processor_count; i++)
+    {
+        const Platform_Processor* proc = &topology->processors[i];
+        int32_t group = -1;
+        switch(level)
+        {
+            case PLATFORM_TOPOLOGY_PROCESSOR: group = i; break;
+            case PLATFORM_TOPOLOGY_CORE:      group = proc->core; break;
+            case PLATFORM_TOPOLOGY_L2:        group = proc->l2_group; break;
+            case PLATFORM_TOPOLOGY_L3:        group = proc->l3_group; break;
+            case PLATFORM_TOPOLOGY_NUMA_NODE: group = proc->numa_node; break;
+            case PLATFORM_TOPOLOGY_PACKAGE:   group = proc->package; break;
+        }
+        if(group == index)
+            platform_cpu_set_add(&set, proc->id);
+    }
+    return set;
+}
+
 void platform_thread_sleep(double seconds)
 {
     if(seconds > 0)
@@ -937,6 +1166,45 @@ Platform_Error platform_file_size(const Platform_File* file, isize* size)
     return _platform_error_code(state);
 }
 
+Platform_Error platform_file_memory_map(Platform_String file_path, Platform_Memory_Mapping* mapping)
+{
+    platform_file_memory_unmap(mapping);
+
+    Platform_File file = {0};
+    isize size = 0;
+    Platform_Error error = platform_file_open(&file, file_path, PLATFORM_FILE_OPEN_READ);
+    if(error == 0)
+        error = platform_file_size(&file, &size);
+    if(error == 0 && size > 0)
+    {
+        HANDLE map = CreateFileMappingW(_platform_flip_handle(file.handle), NULL, PAGE_READONLY, 0, 0, NULL);
+        error = _platform_error_code(map != NULL);
+        if(map)
+        {
+            void* address = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+            error = _platform_error_code(address != NULL);
+            if(address)
+            {
+                mapping->address = address;
+                mapping->size = size;
+            }
+
+            //The view keeps the mapping object alive
+            CloseHandle(map);
+        }
+    }
+
+    platform_file_close(&file);
+    return error;
+}
+
+void platform_file_memory_unmap(Platform_Memory_Mapping* mapping)
+{
+    if(mapping->address)
+        UnmapViewOfFile(mapping->address);
+    memset(mapping, 0, sizeof *mapping);
+}
+
 Platform_Error platform_file_read_entire(Platform_String file_path, void* buffer, isize buffer_size)
 {
     Platform_File file = {0};
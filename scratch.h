@@ -17,6 +17,7 @@
 #include "defines.h"
 #include "allocator.h"
 #include "profile.h"
+#include "arena.h"
 
 #ifndef SCRATCH_ARENA_DEBUG
     #ifdef DO_ASSERTS_SLOW
@@ -41,6 +42,8 @@ typedef struct Scratch_Stack {
     u8** curr_frame; 
     u8*  commit_to; 
     u8*  reserved_to;
+    u8*  peak_used_to;      //highest used_to since the stack was last fully released
+    isize resets_below_mark;
 } Scratch_Stack;
 
 typedef struct Scratch_Arena {
@@ -51,12 +54,15 @@ typedef struct Scratch_Arena {
     u8* reserved_from;
     isize reserved_size;
     isize commit_granularity;
+    Platform_Virtual_Allocation memory_hints; //passed on every reserve and commit. See arena_init_custom
+    Arena_Decommit_Policy decommit_policy;    //applied per stack whenever it is fully released. See Arena_Decommit_Policy
 
     //purely informative
     const char* name;
     isize fall_count;
     isize rise_count;
     isize commit_count;
+    isize decommit_count;
 } Scratch_Arena;
 
 //Models a single lifetime of allocations done from an arena. 
@@ -71,8 +77,11 @@ typedef struct Scratch {
 } Scratch;
 
 EXTERNAL Platform_Error scratch_arena_init(Scratch_Arena* arena, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero, isize stack_max_depth_or_zero);
+//Same as scratch_arena_init but the memory is reserved and commited with the given hints (huge pages, NUMA node - see Platform_Virtual_Allocation)
+EXTERNAL Platform_Error scratch_arena_init_custom(Scratch_Arena* arena, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero, isize stack_max_depth_or_zero, Platform_Virtual_Allocation memory_hints);
 EXTERNAL void scratch_arena_test_consistency(Scratch_Arena* arena);
 EXTERNAL void scratch_arena_deinit(Scratch_Arena* arena);
+EXTERNAL void scratch_arena_set_decommit_policy(Scratch_Arena* arena, Arena_Decommit_Policy policy);
 
 EXTERNAL Scratch scratch_acquire(Scratch_Arena* arena);
 EXTERNAL void  scratch_release(Scratch* arena);
@@ -242,6 +251,42 @@ EXTERNAL Scratch        global_scratch_acquire();
     INTERNAL void _scratch_arena_check_consistency(Scratch_Arena* arena);
     INTERNAL void _scratch_arena_fill_garbage(Scratch_Arena* arena, isize content_size);
 
+    EXTERNAL void scratch_arena_set_decommit_policy(Scratch_Arena* arena, Arena_Decommit_Policy policy)
+    {
+        REQUIRE(policy.high_water_mark >= 0 && policy.reset_count >= 0);
+        arena->decommit_policy = policy;
+        for(isize i = 0; i < SCRATCH_ARENA_CHANNELS; i++)
+            arena->stacks[i].resets_below_mark = 0;
+    }
+
+    //Called when the stack is fully released. The mark is measured from the end of the frames array.
+    static ATTRIBUTE_INLINE_NEVER void _scratch_apply_decommit_policy(Scratch_Arena* arena, Scratch_Stack* stack)
+    {
+        Arena_Decommit_Policy policy = arena->decommit_policy;
+        u8* data = *stack->frames;
+        u8* peak = stack->peak_used_to;
+        stack->peak_used_to = data;
+
+        if(stack->commit_to - data <= policy.high_water_mark)
+            return;
+
+        if(peak - data > policy.high_water_mark)
+            stack->resets_below_mark = 0;
+        else if(++stack->resets_below_mark >= policy.reset_count)
+        {
+            //Commits are done in commit_granularity steps from reserved_from so keep that alignment
+            stack->resets_below_mark = 0;
+            isize keep = data - stack->reserved_from + policy.high_water_mark;
+            u8* new_commit_to = stack->reserved_from + DIV_CEIL(keep, arena->commit_granularity)*arena->commit_granularity;
+            if(new_commit_to < stack->commit_to)
+                if(platform_virtual_reallocate(NULL, new_commit_to, stack->commit_to - new_commit_to, PLATFORM_VIRTUAL_ALLOC_DECOMMIT, PLATFORM_MEMORY_PROT_NO_ACCESS) == 0)
+                {
+                    stack->commit_to = new_commit_to;
+                    arena->decommit_count += 1;
+                }
+        }
+    }
+
     EXTERNAL void scratch_arena_deinit(Scratch_Arena* arena)
     {
         _scratch_arena_check_consistency(arena);
@@ -251,9 +296,17 @@ EXTERNAL Scratch        global_scratch_acquire();
     }
 
     EXTERNAL Platform_Error scratch_arena_init(Scratch_Arena* arena, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero, isize level_count_or_zero)
+    {
+        return scratch_arena_init_custom(arena, name, reserve_size_or_zero, commit_granularity_or_zero, level_count_or_zero, (Platform_Virtual_Allocation) 0);
+    }
+
+    EXTERNAL Platform_Error scratch_arena_init_custom(Scratch_Arena* arena, const char* name, isize reserve_size_or_zero, isize commit_granularity_or_zero, isize level_count_or_zero, Platform_Virtual_Allocation memory_hints)
     {
         scratch_arena_deinit(arena);
         isize alloc_granularity = platform_allocation_granularity();
+        memory_hints = (Platform_Virtual_Allocation) (memory_hints & ~(PLATFORM_VIRTUAL_ALLOC_RESERVE | PLATFORM_VIRTUAL_ALLOC_COMMIT | PLATFORM_VIRTUAL_ALLOC_DECOMMIT | PLATFORM_VIRTUAL_ALLOC_RELEASE));
+        if(memory_hints & (PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES | PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES_EXPLICIT))
+            alloc_granularity = MAX(alloc_granularity, platform_huge_page_size());
     
         //validate and normalize args
         REQUIRE(reserve_size_or_zero >= 0);
@@ -274,7 +327,7 @@ EXTERNAL Scratch        global_scratch_acquire();
 
         //reserve eveyrthing
         u8* reserved_from = 0;
-        Platform_Error error = platform_virtual_reallocate((void**) &reserved_from, NULL, reserve_size, PLATFORM_VIRTUAL_ALLOC_RESERVE, PLATFORM_MEMORY_PROT_NO_ACCESS);
+        Platform_Error error = platform_virtual_reallocate((void**) &reserved_from, NULL, reserve_size, (Platform_Virtual_Allocation) (PLATFORM_VIRTUAL_ALLOC_RESERVE | memory_hints), PLATFORM_MEMORY_PROT_NO_ACCESS);
             
         //commit levels
         u8* datas[SCRATCH_ARENA_CHANNELS] = {NULL};
@@ -285,7 +338,7 @@ EXTERNAL Scratch        global_scratch_acquire();
                 break;
 
             datas[i] = reserved_from + reserve_size/SCRATCH_ARENA_CHANNELS*i;
-            error = platform_virtual_reallocate(NULL, datas[i], frames_commit_size, PLATFORM_VIRTUAL_ALLOC_COMMIT, PLATFORM_MEMORY_PROT_READ_WRITE);
+            error = platform_virtual_reallocate(NULL, datas[i], frames_commit_size, (Platform_Virtual_Allocation) (PLATFORM_VIRTUAL_ALLOC_COMMIT | memory_hints), PLATFORM_MEMORY_PROT_READ_WRITE);
         }
     
         //fill struct
@@ -299,9 +352,11 @@ EXTERNAL Scratch        global_scratch_acquire();
                 stack->commit_to = datas[i] + frames_commit_size;
                 stack->curr_frame = stack->frames;
                 *stack->curr_frame = (u8*) (stack->frames + level_count/SCRATCH_ARENA_CHANNELS);
+                stack->peak_used_to = *stack->curr_frame;
             }
         
             arena->commit_granularity = commit_granularity;
+            arena->memory_hints = memory_hints;
             arena->frame_capacity = (u32) level_count;
             arena->reserved_size = reserve_size;
             arena->name = name;
@@ -358,7 +413,7 @@ EXTERNAL Scratch        global_scratch_acquire();
                 goto end;
             }
             
-            Platform_Error platform_error = platform_virtual_reallocate(NULL, stack->commit_to, commit, PLATFORM_VIRTUAL_ALLOC_COMMIT, PLATFORM_MEMORY_PROT_READ_WRITE);
+            Platform_Error platform_error = platform_virtual_reallocate(NULL, stack->commit_to, commit, (Platform_Virtual_Allocation) (PLATFORM_VIRTUAL_ALLOC_COMMIT | arena->memory_hints), PLATFORM_MEMORY_PROT_READ_WRITE);
             if(platform_error)
             {
                 out = NULL;
@@ -458,7 +513,10 @@ EXTERNAL Scratch        global_scratch_acquire();
     
         u8* old_used_to = *stack->curr_frame;
         stack->curr_frame = MIN(stack->curr_frame, scratch->frame_ptr - 1); 
+        stack->peak_used_to = MAX(stack->peak_used_to, old_used_to);
         arena->frame_count = scratch->level;
+        if(stack->curr_frame == stack->frames && arena->decommit_policy.reset_count > 0)
+            _scratch_apply_decommit_policy(arena, stack);
 
         _scratch_arena_fill_garbage(arena, old_used_to - *stack->curr_frame);
         _scratch_arena_check_consistency(arena);
@@ -493,6 +551,7 @@ EXTERNAL Scratch        global_scratch_acquire();
             stats.fixed_memory_pool_size = stack->reserved_to - start;
             stats.bytes_allocated = *scratch->frame_ptr - start;
             stats.max_bytes_allocated = *scratch->frame_ptr - start;
+            stats.bytes_committed = stack->commit_to - stack->reserved_from;
             *(Allocator_Stats*) rest = stats;
         }
         return NULL;
@@ -2,11 +2,16 @@
 // It is heavily tested for all sorts of input as well as buffer overruns, so it *should* be safe.
 // The decompressor is quite optimized being able to compress 2.7GB/s. The official one is a bit faster with 3.4GB/s.
 //   I dont fully know why that is as I am (I believe) using all the same tricks as they are. Perhpas this will change on other compilers.
-// The compressor is about 4x slower then the official LZ4 implementation because it (geedily) checks every possible comfiguration
-//   unlike the official implementation which just checks 1/4-th. The decompression speed is about 130MB/s
-//   This also means it achieves better compression ratio - though surpisingly not by much. 
+// The default compressor (greedily) checks every possible comfiguration unlike the official implementation which 
+//   just checks 1/4-th. This makes it several times slower then the fast compressor below (on the generated test text
+//   about 70MB/s against 230MB/s) but it achieves better compression ratio - though surpisingly not by much. 
 //   On the enwik8 dataset it achieves 2.10 compression ration while the official one
 //   achieves about 1.9 (the default/non-high-compression version).
+// Setting SLZ4_Compress_State.acceleration to 1 or more switches to the fast compressor which uses the same algorithm 
+//   as the official implementation. Higher accelerations trade compression ratio for speed.
+//   Incompressible data is skipped over at several GB/s. See slz4_benchmark for comparison of the two.
+// Besides the raw block format it also implements the LZ4 frame format (.lz4 files) with streaming
+//   compression/decompression in bounded memory, interoperable with the lz4 command line utility. See slz4_frame_compress_init.
 
 #ifndef MODULE_SLZ4
 #define MODULE_SLZ4
@@ -28,6 +33,7 @@
     #define SLZ4_EXPORT 
 #endif
 
+//#define SLZ4_NO_THREADS                  //if defined the parallel functions run everything on the calling thread
 //#define SLZ4_PLACE_MAGIC                 //if defined each token is prefixed with 'B' in ascii to facilitate debugging. Is not LZ4 compliant.
 //#define SLZ4_TEST_AGAINST_REFERENCE_IMPL //if defined also uses the reference lz4 implementation for validation
 #define SLZ4_MIN_MATCH            4
@@ -43,6 +49,8 @@ typedef enum SLZ4_Status {
     SLZ4_ERROR_OFFSET_BIGGER_THEN_POS = -3,
     SLZ4_ERROR_INVALID_PARAMS = -4,
     SLZ4_ERROR_MALLOC_FAILED = -5,
+    SLZ4_ERROR_INVALID_FRAME = -6,
+    SLZ4_ERROR_CHECKSUM_MISMATCH = -7,
 } SLZ4_Status;
 
 typedef struct SLZ4_Malloced {
@@ -56,6 +64,11 @@ typedef struct SLZ4_Malloced {
 typedef struct SLZ4_Compress_State {
     //between 1 and 12 determining by how many bytes to advance by before checking for a match. 
     int speed; //defaults to 1
+    //When 0 uses the greedy compressor described above. When 1 or more uses the fast compressor instead which 
+    // keeps only the single last position per hash slot and skips over incompressible data in increasingly bigger steps.
+    // Bigger values skip sooner trading compression ratio for speed (same meaning as in the official implementation).
+    // The fast compressor ignores speed and bucket_size_exponent.
+    int acceleration; //defaults to 0
     SLZ4_Status status;
 
     //If compression_table_or_null uses a default stack allocated table. 
@@ -86,18 +99,151 @@ SLZ4_EXPORT SLZ4_Malloced slz4_compress_malloc(const void* input, int input_size
 //Same as slz4_decompress except the output is placed into returned malloced memory. 
 SLZ4_EXPORT SLZ4_Malloced slz4_decompress_malloc(const void* input, int input_size, SLZ4_Decompress_State* state_or_null);
 
+//Same as slz4_compress except the prefix_size bytes directly before input are used as history. 
+// Tokens can reference the history thus it must be available to the decompressor (see slz4_decompress_prefixed).
+// Only the last SLZ4_WINDOW_SIZE bytes of the history can ever be referenced.
+SLZ4_EXPORT int slz4_compress_prefixed(void* output, int output_size, const void* input, int input_size, int prefix_size, SLZ4_Compress_State* state_or_null);
+//Same as slz4_decompress except the prefix_size bytes directly before output hold the already decompressed history.
+SLZ4_EXPORT int slz4_decompress_prefixed(void* output, int output_size, const void* input, int input_size, int prefix_size, SLZ4_Decompress_State* state_or_null);
+
 //Returns maximum size after compression of an input of the given size.
 SLZ4_EXPORT int slz4_compressed_size_upper_bound(int size_before_compression);
 //Returns the needed size in bytes for compression table (from SLZ4_Compress_State) given the provided parameters. 
 SLZ4_EXPORT size_t slz4_required_size_for_compression_table(int size_exponent, int bucket_exponent);
 
+//The LZ4 frame format as described in https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+// Frames can be of arbitrary size. The data is split into blocks of at most the block size which are compressed
+// one by one thus the memory usage is bounded regardless of how big the whole stream is. 
+// Produces and reads the same format as the lz4 command line utility (.lz4 files). 
+// Legacy frames and frames with dictionary id are not supported. Skippable frames are skipped.
+#define SLZ4_FRAME_MAGIC            0x184D2204
+#define SLZ4_FRAME_SKIPPABLE_MAGIC  0x184D2A50 //up to 0x184D2A5F
+#define SLZ4_FRAME_MAX_HEADER_SIZE  19
+#define SLZ4_FRAME_HISTORY_SIZE     (64*1024) //how much of the previous data linked blocks can reference
+
+typedef enum SLZ4_Block_Size {
+    SLZ4_BLOCK_SIZE_DEFAULT = 0, //4MB same as the lz4 utility
+    SLZ4_BLOCK_SIZE_64KB = 4,
+    SLZ4_BLOCK_SIZE_256KB = 5,
+    SLZ4_BLOCK_SIZE_1MB = 6,
+    SLZ4_BLOCK_SIZE_4MB = 7,
+} SLZ4_Block_Size;
+
+typedef struct SLZ4_Frame_Options {
+    SLZ4_Block_Size block_size;
+    bool linked_blocks;     //blocks can reference the last 64KB of the previous blocks. Compresses better but blocks cannot be decoded on their own.
+    bool block_checksum;    //each block is followed by xxHash32 of its (compressed) data
+    bool content_checksum;  //the frame ends with xxHash32 of the entire decompressed content
+    uint64_t content_size;  //if not zero is stored in the header and checked against the actual size
+} SLZ4_Frame_Options;
+
+//Streaming xxHash32 as used by the frame format
+typedef struct SLZ4_XXH32 {
+    uint32_t acc[4];
+    uint8_t buffer[16];
+    uint32_t buffer_size;
+    uint64_t total_size;
+} SLZ4_XXH32;
+
+typedef struct SLZ4_Frame_Compress {
+    SLZ4_Frame_Options options;
+    SLZ4_Compress_State state;
+    SLZ4_XXH32 content_hash;
+    
+    //history (when linked_blocks) followed by the block being filled 
+    uint8_t* buffer;
+    int buffer_capacity;
+    int block_size;
+    int history_size;
+    int block_filled;
+
+    bool header_written;
+    uint64_t total_size;
+    SLZ4_Status status;
+} SLZ4_Frame_Compress;
+
+typedef struct SLZ4_Frame_Decompress {
+    SLZ4_Frame_Options options; //of the frame currently being decompressed
+    SLZ4_Decompress_State state;
+    SLZ4_XXH32 content_hash;
+
+    uint8_t* input_buffer; //holds the currently read block if it is not entirely within the provided input
+    int input_capacity;
+    int input_filled;
+
+    uint8_t* output_buffer; //history followed by the last decompressed block
+    int output_capacity;
+    int history_size;
+    int decompressed_size;
+    int flushed_size;
+
+    uint8_t header[SLZ4_FRAME_MAX_HEADER_SIZE]; //also used for all other small fields
+    int header_filled;
+    int header_needed;
+
+    int stage;
+    int block_size;
+    uint32_t block_word;
+    uint64_t skip_remaining;
+    uint64_t total_size;
+    int64_t frame_count;
+} SLZ4_Frame_Decompress;
+
+//Prepares frame for compression using the given options and compression state (for both uses default values when null).
+// Allocates the block buffer - 4MB for the default options.
+SLZ4_EXPORT SLZ4_Status slz4_frame_compress_init(SLZ4_Frame_Compress* frame, const SLZ4_Frame_Options* options_or_null, const SLZ4_Compress_State* state_or_null);
+//Returns the output size that is always sufficient for slz4_frame_compress_update with input_size bytes of input
+// as well as for slz4_frame_compress_end (when called with input_size = 0).
+SLZ4_EXPORT int slz4_frame_compress_bound(const SLZ4_Frame_Compress* frame, int input_size);
+//Compresses the next part of the stream. Returns the number of bytes written into output or negative values from SLZ4_Status.
+// The output_size must be at least slz4_frame_compress_bound(frame, input_size) else nothing is done and SLZ4_ERROR_OUTPUT_TOO_SMALL
+// is returned. Most of the time the data is only buffered and nothing is written. Other errors are sticky.
+SLZ4_EXPORT int slz4_frame_compress_update(SLZ4_Frame_Compress* frame, void* output, int output_size, const void* input, int input_size);
+//Compresses the remaining buffered data, terminates the frame and releases the memory of frame.
+// Returns the number of bytes written into output or negative values from SLZ4_Status. 
+// Must be called even if something failed. When output is NULL only releases the memory.
+SLZ4_EXPORT int slz4_frame_compress_end(SLZ4_Frame_Compress* frame, void* output, int output_size);
+
+//Prepares frame for decompression. Buffers are allocated once the header of the first frame is read.
+// Their size is twice the block size of the frame plus SLZ4_FRAME_HISTORY_SIZE.
+SLZ4_EXPORT void slz4_frame_decompress_init(SLZ4_Frame_Decompress* frame);
+//Decompresses the next part of the stream. Returns the number of bytes written into output or negative values from SLZ4_Status. 
+// Reads the input until it is all consumed or the output is full. The number of consumed bytes is saved into input_consumed_or_null.
+// The input can be split at arbitrary points and can consist of multiple concatenated frames. 
+// Extended error information is in frame->state.error_message. Errors are sticky.
+SLZ4_EXPORT int slz4_frame_decompress_update(SLZ4_Frame_Decompress* frame, void* output, int output_size, const void* input, int input_size, int* input_consumed_or_null);
+//Releases the memory of frame. Returns SLZ4_ERROR_INPUT_TOO_SMALL if the stream ended in the middle of a frame
+// or some decompressed data was not yet retrieved, or the sticky error if one occurred.
+SLZ4_EXPORT SLZ4_Status slz4_frame_decompress_end(SLZ4_Frame_Decompress* frame);
+
+//Returns the maximum size of a whole frame holding input_size bytes compressed with the given options (default when null).
+SLZ4_EXPORT int64_t slz4_frame_compressed_size_upper_bound(int64_t input_size, const SLZ4_Frame_Options* options_or_null);
+//Compresses the whole input into a single frame of independent blocks. The blocks are compressed in parallel on 
+// thread_count threads (including the calling one) each with its own copy of state_or_null and its own compression table.
+// The output is identical to the one produced by slz4_frame_compress_update/end with the same options.
+// Returns the size of the frame or negative values from SLZ4_Status. Fails with SLZ4_ERROR_INVALID_PARAMS for linked_blocks.
+// The output_size should be slz4_frame_compressed_size_upper_bound(input_size, options_or_null).
+SLZ4_EXPORT int64_t slz4_frame_compress_parallel(void* output, int64_t output_size, const void* input, int64_t input_size, const SLZ4_Frame_Options* options_or_null, const SLZ4_Compress_State* state_or_null, int thread_count);
+//Decompresses the whole input containing one or more frames into output. Returns the decompressed size or negative values from SLZ4_Status.
+// A single frame of independent blocks is decompressed in parallel on thread_count threads (including the calling one).
+// Anything else (linked blocks, multiple frames, blocks not filled to the maximum block size) is decompressed sequentially.
+SLZ4_EXPORT int64_t slz4_frame_decompress_parallel(void* output, int64_t output_size, const void* input, int64_t input_size, SLZ4_Decompress_State* state_or_null, int thread_count);
+
+SLZ4_EXPORT void slz4_xxh32_init(SLZ4_XXH32* hash, uint32_t seed);
+SLZ4_EXPORT void slz4_xxh32_update(SLZ4_XXH32* hash, const void* data, size_t size);
+SLZ4_EXPORT uint32_t slz4_xxh32_digest(const SLZ4_XXH32* hash);
+SLZ4_EXPORT uint32_t slz4_xxh32(const void* data, size_t size, uint32_t seed);
+
 #endif
 
 #if (defined(MODULE_IMPL_ALL) || defined(MODULE_SLZ4_IMPL)) && !defined(MODULE_SLZ4_HAS_IMPL)
 #define MODULE_SLZ4_HAS_IMPL
 
 SLZ4_INTERNAL int  _slz4_find_first_set_bit64(uint64_t num);
+SLZ4_INTERNAL int  _slz4_compress_fast(uint8_t* out, uint32_t out_size, const uint8_t* in, uint32_t in_total, uint32_t prefix_size, uint32_t* table, uint32_t hash_exponent, uint32_t acceleration);
 SLZ4_INTERNAL bool _slz4_output_token(uint8_t* out, uint32_t* out_i, uint32_t output_size, uint32_t in_i, uint32_t literal_size, const uint8_t* literal_data, uint32_t match_size, uint32_t match_offset, bool is_last_literal);
+SLZ4_INTERNAL uint32_t _slz4_read32(const uint8_t* data);
+SLZ4_INTERNAL uint64_t _slz4_read64(const uint8_t* data);
 SLZ4_INTERNAL uint32_t  _slz4_read_long_size(const uint8_t* in, uint32_t size, uint32_t* in_i, bool can_safely_skip_first_check);
 
 SLZ4_EXPORT int slz4_compressed_size_upper_bound(int size_before_compression)
@@ -120,10 +266,17 @@ SLZ4_EXPORT size_t slz4_required_size_for_compression_table(int size_exponent, i
 }
 
 SLZ4_EXPORT int slz4_compress(void* output, int output_size, const void* input, int input_size, SLZ4_Compress_State* state_or_null)
+{
+    return slz4_compress_prefixed(output, output_size, input, input_size, 0, state_or_null);
+}
+
+SLZ4_EXPORT int slz4_compress_prefixed(void* output, int output_size, const void* input, int input_size, int prefix_size, SLZ4_Compress_State* state_or_null)
 {
     if((output == NULL && output_size != 0) 
         || (input == NULL && input_size != 0) 
+        || (input == NULL && prefix_size != 0) 
         || (0 > input_size || input_size > SLZ4_MAX_SIZE) 
+        || (0 > prefix_size || prefix_size > SLZ4_MAX_SIZE) 
         || (0 > output_size))
     {
         SLZ4_ASSERT(false);
@@ -147,6 +300,9 @@ SLZ4_EXPORT int slz4_compress(void* output, int output_size, const void* input,
     // stored in a separate array of u8's. This means we dont need to worry about removing items from the hash. 
     // We also dont store the keys anywhere instead see if the memory pointed to by the match really does 
     // equal the input.
+    //
+    // When we have a prefix we simply work with positions relative to its start. We insert the (last window of)
+    // prefix into the hash table and then start compressing from the end of it. 
 
     //Use provided state or default one
     SLZ4_Compress_State default_state = {0};
@@ -159,6 +315,8 @@ SLZ4_EXPORT int slz4_compress(void* output, int output_size, const void* input,
     if(hash_table_data == NULL)
     {   
         size_t needed_size = slz4_required_size_for_compression_table(state->hash_size_exponent, state->bucket_size_exponent);
+        if(state->acceleration > 0)
+            needed_size = sizeof(uint32_t) << state->hash_size_exponent;
         SLZ4_ASSERT(needed_size < 10*1024*1024 && "you probably dont want to allocate 10MB of stack space!");
         #if defined(_MSC_VER)
             hash_table_data = _alloca(needed_size);
@@ -170,6 +328,10 @@ SLZ4_EXPORT int slz4_compress(void* output, int output_size, const void* input,
     }
     
     uint32_t hash_exponent = (uint32_t) state->hash_size_exponent;
+    if(state->acceleration > 0)
+        return _slz4_compress_fast((uint8_t*) output, (uint32_t) output_size, (const uint8_t*) input - prefix_size, 
+            (uint32_t) prefix_size + (uint32_t) input_size, (uint32_t) prefix_size, (uint32_t*) hash_table_data, hash_exponent, (uint32_t) state->acceleration);
+
     uint32_t bucket_size = (uint32_t) (1 << state->bucket_size_exponent);
     uint32_t hash_size = 1 << hash_exponent;
     uint32_t bucket_size_mask = bucket_size - 1;
@@ -184,14 +346,15 @@ SLZ4_EXPORT int slz4_compress(void* output, int output_size, const void* input,
     memset(buckets_last, 0, hash_size*sizeof(uint8_t));
     
     //Used variables
-    const uint8_t* in = (const uint8_t*) input;
+    const uint8_t* in = (const uint8_t*) input - prefix_size;
     uint8_t* out = (uint8_t*) output;
 
-    uint32_t in_i = 0;
+    uint32_t in_i = (uint32_t) prefix_size;
     uint32_t out_i = 0;
     uint32_t out_size = (uint32_t) output_size;
-    uint32_t in_size = (uint32_t) input_size;
-    uint32_t last_token_in_i = 0;
+    uint32_t in_total = (uint32_t) prefix_size + (uint32_t) input_size;
+    uint32_t in_size = in_total;
+    uint32_t last_token_in_i = in_i;
 
     //By pretend the input is 12B smaller we: 
     // 1. are compliant with the standard
@@ -201,10 +364,20 @@ SLZ4_EXPORT int slz4_compress(void* output, int output_size, const void* input,
     uint32_t token_count = 0;
     if(input_size > END_BLOCK_RESERVED)
     {
-        in_size = (uint32_t) input_size - END_BLOCK_RESERVED;
+        #define slz4_hash(val) (((val) * 2654435761U) >> (32-hash_exponent))
+        in_size = in_total - END_BLOCK_RESERVED;
+        
+        uint32_t prefix_from = prefix_size > SLZ4_WINDOW_SIZE ? (uint32_t) prefix_size - SLZ4_WINDOW_SIZE : 0;
+        for(uint32_t i = prefix_from; i < (uint32_t) prefix_size; i++)
+        {
+            uint32_t curr_read = 0; memcpy(&curr_read, in + i, sizeof curr_read);
+            uint32_t curr_hash = slz4_hash(curr_read);
+            hash[curr_hash*bucket_size + buckets_last[curr_hash]] = i;
+            buckets_last[curr_hash] = (buckets_last[curr_hash] + 1) & bucket_size_mask;
+        }
+
         for(; in_i < in_size; token_count++)
         {
-            #define slz4_hash(val) (((val) * 2654435761U) >> (32-hash_exponent))
 
             //Read 8 bytes. Calculate the hash using the first 4 and lookup the appropriate bucket.
             uint64_t first_input_read = 0; memcpy(&first_input_read, in + in_i, sizeof first_input_read);
@@ -310,8 +483,8 @@ SLZ4_EXPORT int slz4_compress(void* output, int output_size, const void* input,
     }
     
     //Add a last token literal of the size not used. We do not attempt to perform any compression here.
-    uint32_t remaining = (uint32_t) input_size - last_token_in_i;
-    okay = okay && _slz4_output_token(out, &out_i, out_size, in_i, remaining, (const uint8_t*) input + last_token_in_i, 0, 0, true);
+    uint32_t remaining = in_total - last_token_in_i;
+    okay = okay && _slz4_output_token(out, &out_i, out_size, in_i, remaining, in + last_token_in_i, 0, 0, true);
 
     //When in 'dry' run mode add some extra bytes so that the real decompression works
     // (the decompression needs a few extra bytes to make checks faster see _slz4_output_token)
@@ -321,6 +494,177 @@ SLZ4_EXPORT int slz4_compress(void* output, int output_size, const void* input,
     return okay ? out_i : SLZ4_ERROR_OUTPUT_TOO_SMALL;
 }
 
+SLZ4_INTERNAL int _slz4_compress_fast(uint8_t* out, uint32_t out_size, const uint8_t* in, uint32_t in_total, uint32_t prefix_size, uint32_t* table, uint32_t hash_exponent, uint32_t acceleration)
+{
+    //Fast compression algorithm (same as the official implementation):
+    // 0. We keep a hash table of only the last seen position for each hash of 5 consequetive bytes.
+    // 1. We look up the current position. If the position found is within the window and its first 4 bytes 
+    //    match we have a match. Otherwise we move forward by a step.
+    // 2. Every 64 failed lookups the step increases by one. This means incompressible data is skipped 
+    //    over quickly. Acceleration sets the initial step.
+    // 3. On a match we first extend it backwards into the literals then forwards as far as possible.
+    //    The next lookup happens right at the end of the match because repeated data tends to follow repeated data.
+    enum { 
+        END_BLOCK_RESERVED = 12, //the last match must start at least 12 bytes before the end
+        LAST_LITERALS = 5,       //the last 5 bytes are always literals
+        SKIP_TRIGGER = 6,        //the number of failed lookups it takes to increment the step is 2^SKIP_TRIGGER
+    };
+
+    uint32_t in_i = prefix_size;
+    uint32_t out_i = 0;
+    uint32_t last_token_in_i = in_i;
+    bool okay = true;
+    if(in_total - prefix_size > END_BLOCK_RESERVED)
+    {
+        //Reads 8 bytes but hashes only the first 5. Using 5 bytes gives much fewer false positives on text 
+        // than 4 while we can still read past as we are always at least END_BLOCK_RESERVED away from the end. 
+        #define slz4_hash_fast(pos) (uint32_t) ((_slz4_read64(in + (pos)) << 24) * 889523592379ULL >> (64 - hash_exponent))
+        
+        uint32_t match_start_limit = in_total - END_BLOCK_RESERVED;
+        uint32_t match_end_limit = in_total - LAST_LITERALS;
+        memset(table, 0, sizeof(uint32_t) << hash_exponent);
+        
+        //Insert every few positions of the prefix. This is way cheaper and nearly as good as inserting all of them
+        uint32_t prefix_from = prefix_size > SLZ4_WINDOW_SIZE ? prefix_size - SLZ4_WINDOW_SIZE : 0;
+        for(uint32_t i = prefix_from; i < prefix_size; i += 3)
+            table[slz4_hash_fast(i)] = i;
+        
+        table[slz4_hash_fast(in_i)] = in_i;
+        in_i += 1;
+        uint32_t match_pos = 0;
+        bool has_match = false;
+        for(;;)
+        {
+            //Find a match
+            uint32_t next_in_i = in_i;
+            uint32_t step = 1;
+            uint32_t search_count = acceleration << SKIP_TRIGGER;
+            uint32_t next_hash = slz4_hash_fast(next_in_i);
+            for(; has_match == false;)
+            {
+                uint32_t hash = next_hash;
+                in_i = next_in_i;
+                next_in_i += step;
+                step = search_count++ >> SKIP_TRIGGER;
+                if(next_in_i > match_start_limit)
+                    goto last_literals;
+
+                //Calculate the next hash before we need it so that it can overlap with the table lookup
+                match_pos = table[hash];
+                next_hash = slz4_hash_fast(next_in_i);
+                table[hash] = in_i;
+
+                SLZ4_ASSERT(match_pos < in_i);
+                has_match = in_i - match_pos <= SLZ4_WINDOW_SIZE && _slz4_read32(in + match_pos) == _slz4_read32(in + in_i);
+            }
+
+            //Extend backwards. This often recovers bytes we have skipped over
+            while(in_i > last_token_in_i && match_pos > 0 && in[in_i - 1] == in[match_pos - 1])
+            {
+                in_i -= 1;
+                match_pos -= 1;
+            }
+
+            //Extend forwards 8 bytes at a time 
+            uint32_t match_size = SLZ4_MIN_MATCH;
+            for(;;)
+            {
+                if(in_i + match_size + 8 > match_end_limit)
+                {
+                    while(in_i + match_size < match_end_limit && in[in_i + match_size] == in[match_pos + match_size])
+                        match_size += 1;
+                    break;
+                }
+
+                uint64_t comp = _slz4_read64(in + in_i + match_size) ^ _slz4_read64(in + match_pos + match_size);
+                if(comp != 0)
+                {
+                    match_size += (uint32_t) _slz4_find_first_set_bit64(comp)/8;
+                    break;
+                }
+                match_size += 8;
+            }
+
+            SLZ4_ASSERT(in_i + match_size <= match_end_limit);
+            uint32_t literal_size = in_i - last_token_in_i;
+            uint32_t match_offset = in_i - match_pos;
+
+            //Fast path for when there is plenty of space in the output. Copies the literals 8 bytes at a time 
+            // possibly overshooting by up to 7 bytes. On the input side this is fine because in_i is at least 
+            // END_BLOCK_RESERVED bytes away from the end. On the output side it is covered by the generous check.
+            if(out != NULL && out_i + literal_size + literal_size/0xFF + match_size/0xFF + 16 <= out_size)
+            {
+                #ifdef SLZ4_PLACE_MAGIC
+                    out[out_i++] = 'B';
+                #endif 
+
+                uint8_t* token = &out[out_i++];
+                uint32_t tok_literals = literal_size;
+                if(literal_size >= 0xF)
+                {
+                    tok_literals = 0xF;
+                    uint32_t curr_literal_size = literal_size - 0xF;
+                    for(; curr_literal_size >= 0xFF; curr_literal_size -= 0xFF)
+                        out[out_i++] = 0xFF;
+                    out[out_i++] = (uint8_t) curr_literal_size;
+                }
+
+                for(uint32_t k = 0; k < literal_size; k += 8)
+                    memcpy(out + out_i + k, in + last_token_in_i + k, 8);
+                out_i += literal_size;
+
+                out[out_i++] = (uint8_t) match_offset;
+                out[out_i++] = (uint8_t) (match_offset >> 8);
+
+                uint32_t tok_match = match_size - SLZ4_MIN_MATCH;
+                if(tok_match >= 0xF)
+                {
+                    uint32_t curr_match_size = tok_match - 0xF;
+                    tok_match = 0xF;
+                    for(; curr_match_size >= 0xFF; curr_match_size -= 0xFF)
+                        out[out_i++] = 0xFF;
+                    out[out_i++] = (uint8_t) curr_match_size;
+                }
+
+                *token = (uint8_t) (tok_literals << 4 | tok_match);
+            }
+            else if(_slz4_output_token(out, &out_i, out_size, in_i, literal_size, in + last_token_in_i, match_size, match_offset, false) == false)
+            {
+                okay = false;
+                break;
+            }
+
+            in_i += match_size;
+            last_token_in_i = in_i;
+            if(in_i >= match_start_limit)
+                break;
+            
+            //Insert a position from within the match so that it can be referenced later
+            table[slz4_hash_fast(in_i - 2)] = in_i - 2;
+
+            //Immediately test the position right after the match as repeated data tends to be followed by more repeated data
+            uint32_t hash = slz4_hash_fast(in_i);
+            match_pos = table[hash];
+            table[hash] = in_i;
+            has_match = in_i - match_pos <= SLZ4_WINDOW_SIZE && _slz4_read32(in + match_pos) == _slz4_read32(in + in_i);
+            if(has_match == false)
+                in_i += 1;
+        }
+        
+        last_literals:;
+        #undef slz4_hash_fast
+    }
+
+    uint32_t remaining = in_total - last_token_in_i;
+    okay = okay && _slz4_output_token(out, &out_i, out_size, in_i, remaining, in + last_token_in_i, 0, 0, true);
+
+    //See slz4_compress_prefixed
+    if(out == NULL)
+        out_i += 16;
+
+    return okay ? (int) out_i : SLZ4_ERROR_OUTPUT_TOO_SMALL;
+}
+
 SLZ4_INTERNAL bool _slz4_output_token(uint8_t* out, uint32_t* out_i, uint32_t output_size, uint32_t in_i, uint32_t literal_size, const uint8_t* literal_data, uint32_t match_size, uint32_t match_offset, bool is_last_literal)
 {
     //Check if we have enough space in output. This is an upper bound check, 
@@ -402,17 +746,25 @@ SLZ4_INTERNAL bool _slz4_output_token(uint8_t* out, uint32_t* out_i, uint32_t ou
 
 SLZ4_EXPORT int slz4_decompress(void* output, int output_size, const void* input, int input_size, SLZ4_Decompress_State* state_or_null)
 {
+    return slz4_decompress_prefixed(output, output_size, input, input_size, 0, state_or_null);
+}
+
+SLZ4_EXPORT int slz4_decompress_prefixed(void* output, int output_size, const void* input, int input_size, int prefix_size, SLZ4_Decompress_State* state_or_null)
+{
+    //With prefix all positions are relative to the start of the prefix. 
+    // This way matches reaching into the prefix are handled exactly the same as any other.
     const uint8_t* in = (const uint8_t*) input;
-    uint8_t* out = (uint8_t*) output;
+    uint8_t* out = output ? (uint8_t*) output - (prefix_size > 0 ? prefix_size : 0) : NULL;
 
     uint32_t in_i = 0;
-    uint32_t out_i = 0;
+    uint32_t out_i = (uint32_t) (prefix_size > 0 ? prefix_size : 0);
     
     uint32_t in_size = 0;
     uint32_t out_size = 0;
+    uint32_t out_total = 0;
 
     uint32_t last_token_in_i = 0;
-    uint32_t last_token_out_i = 0;
+    uint32_t last_token_out_i = out_i;
     
     uint8_t token = 0; 
     uint32_t literals_size = 0;
@@ -426,12 +778,14 @@ SLZ4_EXPORT int slz4_decompress(void* output, int output_size, const void* input
         goto error_invalid_params_in;
         
     if((output == NULL && output_size != 0)
-        || (0 > output_size || output_size > SLZ4_MAX_SIZE))
+        || (0 > output_size || output_size > SLZ4_MAX_SIZE)
+        || (0 > prefix_size || prefix_size > SLZ4_MAX_SIZE))
         goto error_invalid_params_out;
 
     //"dry" run to get size only. Assume output is as big as it needs to be
     if(output == NULL && output_size == 0)
         output_size = SLZ4_MAX_SIZE;
+    out_total = (uint32_t) prefix_size + (uint32_t) output_size;
 
     //We drastically speed up the decoding by not performing any bounds checks for
     // all things that have bounded offset/lenght. We simply again pretend the output_size
@@ -446,7 +800,7 @@ SLZ4_EXPORT int slz4_decompress(void* output, int output_size, const void* input
     if(input_size > FAST_PHASE_PADDING && output_size > FAST_PHASE_PADDING)
     {
         in_size = (uint32_t) input_size - FAST_PHASE_PADDING;
-        out_size = (uint32_t) output_size - FAST_PHASE_PADDING;
+        out_size = out_total - FAST_PHASE_PADDING;
 
         for(;;)
         {
@@ -459,8 +813,10 @@ SLZ4_EXPORT int slz4_decompress(void* output, int output_size, const void* input
             #endif // DEBUG
             
             //*hot path*
-            //The only size check on the hot path!
-            if(in_i >= in_size)  
+            //The only size checks on the hot path! Each token writes at most 14 + 20 bytes
+            // past out_i before the next check, which the padding covers. The output check only matters
+            // for corrupted input as valid input never decompresses past the output.
+            if(in_i >= in_size || out_i >= out_size)  
                 break;
                 
             token = in[in_i++]; 
@@ -559,7 +915,7 @@ SLZ4_EXPORT int slz4_decompress(void* output, int output_size, const void* input
     in_i = last_token_in_i;
     out_i = last_token_out_i;
     in_size = (uint32_t) input_size;
-    out_size = (uint32_t) output_size;
+    out_size = out_total;
     
     //The "careful" loop handling the last ~64B. 
     // This is the vanilla implementation. Because its performance 
@@ -627,7 +983,7 @@ SLZ4_EXPORT int slz4_decompress(void* output, int output_size, const void* input
     }
 
     //Report errors
-    return_value = (int) out_i;
+    return_value = (int) (out_i - (uint32_t) prefix_size);
     while(0) 
     {
         error_invalid_params_in: {
@@ -792,189 +1148,1293 @@ SLZ4_EXPORT SLZ4_Malloced slz4_decompress_malloc(const void* input, int input_si
     return malloced;
 }
 
-#endif
-
-#if (defined(MODULE_ALL_TEST) || defined(MODULE_SLZ4_TEST)) && !defined(MODULE_SLZ4_HAS_TEST)
-#define MODULE_SLZ4_HAS_TEST
+#define _SLZ4_XXH_PRIME1 2654435761U
+#define _SLZ4_XXH_PRIME2 2246822519U
+#define _SLZ4_XXH_PRIME3 3266489917U
+#define _SLZ4_XXH_PRIME4 668265263U
+#define _SLZ4_XXH_PRIME5 374761393U
 
-#include <time.h>
-SLZ4_EXPORT void slz4_test_unit();
-SLZ4_EXPORT void slz4_test_sizes(double seconds);
-SLZ4_EXPORT void slz4_test_invalid_decompress(double seconds);
+SLZ4_INTERNAL uint32_t _slz4_rotl32(uint32_t x, uint32_t r)
+{
+    return (x << r) | (x >> (32 - r));
+}
 
-SLZ4_INTERNAL void _slz4_test_get_rotated_text(char* string, int size);
-SLZ4_INTERNAL double _slz4_now();
+SLZ4_INTERNAL uint32_t _slz4_read32(const uint8_t* data)
+{
+    return (uint32_t) data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 | (uint32_t) data[3] << 24;
+}
 
-SLZ4_EXPORT void slz4_test(double seconds)
+//Native endian - only used for hashing and comparing
+SLZ4_INTERNAL uint64_t _slz4_read64(const uint8_t* data)
 {
-    slz4_test_unit();
-    slz4_test_sizes(seconds/2);
-    slz4_test_invalid_decompress(seconds/2);
+    uint64_t val = 0; memcpy(&val, data, sizeof val);
+    return val;
 }
 
-SLZ4_EXPORT void slz4_test_roundtrip(const void* data, int size)
+SLZ4_INTERNAL void _slz4_write32(uint8_t* data, uint32_t val)
 {
-    //Compress and decompress and test whether we got back the same thing
-    int compressed_capacity = slz4_compress(NULL, 0, data, size, NULL);
-    SLZ4_TEST(compressed_capacity >= 0);
-    
-    char* compressed = (char*) calloc(compressed_capacity, 1);
-    SLZ4_TEST(compressed != NULL);
-    int compressed_size = slz4_compress(compressed, compressed_capacity, data, size, NULL);
-    SLZ4_TEST(compressed_size > 0);
-    
-    int decompressed_capacity = slz4_decompress(NULL, 0, compressed, compressed_size, NULL);
-    SLZ4_TEST(decompressed_capacity == size);
-    
-    char* decompressed = (char*) calloc(decompressed_capacity, 1);
-    SLZ4_TEST(decompressed != NULL);
-    int decompressed_size = slz4_decompress(decompressed, decompressed_capacity, compressed, compressed_size, NULL);
-    SLZ4_TEST(decompressed_size >= 0);
-    SLZ4_TEST(memcmp(data, decompressed, size) == 0);
+    data[0] = (uint8_t) val;
+    data[1] = (uint8_t) (val >> 8);
+    data[2] = (uint8_t) (val >> 16);
+    data[3] = (uint8_t) (val >> 24);
+}
 
-    //Test malloc interface. It should give the exact same results.
-    SLZ4_Malloced compressed_malloc = slz4_compress_malloc(data, size, NULL);
-    SLZ4_Malloced decompressed_malloc = slz4_decompress_malloc(compressed_malloc.data, compressed_malloc.size, NULL);
-    SLZ4_TEST(compressed_malloc.size == compressed_size);
-    SLZ4_TEST(decompressed_malloc.size == decompressed_size);
-    SLZ4_TEST(memcmp(compressed_malloc.data, compressed, compressed_size) == 0);
-    SLZ4_TEST(memcmp(decompressed_malloc.data, decompressed, decompressed_size) == 0);
+SLZ4_INTERNAL uint32_t _slz4_xxh32_round(uint32_t acc, uint32_t input)
+{
+    acc += input * _SLZ4_XXH_PRIME2;
+    acc = _slz4_rotl32(acc, 13);
+    return acc * _SLZ4_XXH_PRIME1;
+}
 
-    //printf("Compressed %i -> %i Bytes ~%.2lf \n", size, compressed_size, (double) size / (double) compressed_size);
-    
-    //Test against the reference implementation. 
-    //It should be able to decompress our compression and we should be able to decompress its compression.
-    #ifdef SLZ4_TEST_AGAINST_REFERENCE_IMPL
-        int ref_decompressed_size = LZ4_decompress_safe(compressed, decompressed, compressed_size, decompressed_capacity);
-        SLZ4_TEST(ref_decompressed_size == size);
-        SLZ4_TEST(memcmp(data, decompressed, size) == 0);
+SLZ4_EXPORT void slz4_xxh32_init(SLZ4_XXH32* hash, uint32_t seed)
+{
+    memset(hash, 0, sizeof *hash);
+    hash->acc[0] = seed + _SLZ4_XXH_PRIME1 + _SLZ4_XXH_PRIME2;
+    hash->acc[1] = seed + _SLZ4_XXH_PRIME2;
+    hash->acc[2] = seed;
+    hash->acc[3] = seed - _SLZ4_XXH_PRIME1;
+}
 
-        int ref_compressed_capacity = LZ4_compressBound(size);
-        char* ref_compressed = (char*) malloc((size_t) ref_compressed_capacity);
-        SLZ4_TEST(ref_compressed != NULL);
+SLZ4_EXPORT void slz4_xxh32_update(SLZ4_XXH32* hash, const void* data, size_t size)
+{
+    const uint8_t* in = (const uint8_t*) data;
+    hash->total_size += size;
 
-        int ref_compressed_size = LZ4_compress_default(data, ref_compressed, size, ref_compressed_capacity);
-        SLZ4_TEST(ref_compressed_size > 0);
-    
-        decompressed_size = slz4_decompress(decompressed, decompressed_capacity, ref_compressed, ref_compressed_size, NULL);
-        SLZ4_TEST(decompressed_size == size);
-        SLZ4_TEST(memcmp(data, decompressed, size) == 0);
+    //Complete the partially filled stripe
+    if(hash->buffer_size > 0)
+    {
+        size_t fill = 16 - hash->buffer_size;
+        if(fill > size)
+            fill = size;
+        memcpy(hash->buffer + hash->buffer_size, in, fill);
+        hash->buffer_size += (uint32_t) fill;
+        in += fill;
+        size -= fill;
+        if(hash->buffer_size < 16)
+            return;
+
+        for(int k = 0; k < 4; k++)
+            hash->acc[k] = _slz4_xxh32_round(hash->acc[k], _slz4_read32(hash->buffer + k*4));
+        hash->buffer_size = 0;
+    }
 
-        free(ref_compressed);
-    #endif
+    uint32_t a0 = hash->acc[0], a1 = hash->acc[1], a2 = hash->acc[2], a3 = hash->acc[3];
+    for(; size >= 16; in += 16, size -= 16)
+    {
+        a0 = _slz4_xxh32_round(a0, _slz4_read32(in));
+        a1 = _slz4_xxh32_round(a1, _slz4_read32(in + 4));
+        a2 = _slz4_xxh32_round(a2, _slz4_read32(in + 8));
+        a3 = _slz4_xxh32_round(a3, _slz4_read32(in + 12));
+    }
+    hash->acc[0] = a0; hash->acc[1] = a1; hash->acc[2] = a2; hash->acc[3] = a3;
 
-    free(compressed);
-    free(decompressed);
-    SLZ4_FREE(compressed_malloc.data, compressed_malloc.capacity);
-    SLZ4_FREE(decompressed_malloc.data, decompressed_malloc.capacity);
+    memcpy(hash->buffer, in, size);
+    hash->buffer_size = (uint32_t) size;
 }
 
-SLZ4_EXPORT void slz4_test_roundtrip_string(const char* data)
+SLZ4_EXPORT uint32_t slz4_xxh32_digest(const SLZ4_XXH32* hash)
 {
-    slz4_test_roundtrip(data, (int) strlen(data));
+    uint32_t h = 0;
+    //When not a single stripe was processed acc[2] still holds the seed
+    if(hash->total_size >= 16)
+        h = _slz4_rotl32(hash->acc[0], 1) + _slz4_rotl32(hash->acc[1], 7) + _slz4_rotl32(hash->acc[2], 12) + _slz4_rotl32(hash->acc[3], 18);
+    else
+        h = hash->acc[2] + _SLZ4_XXH_PRIME5;
+
+    h += (uint32_t) hash->total_size;
+    uint32_t i = 0;
+    for(; i + 4 <= hash->buffer_size; i += 4)
+    {
+        h += _slz4_read32(hash->buffer + i) * _SLZ4_XXH_PRIME3;
+        h = _slz4_rotl32(h, 17) * _SLZ4_XXH_PRIME4;
+    }
+    for(; i < hash->buffer_size; i++)
+    {
+        h += hash->buffer[i] * _SLZ4_XXH_PRIME5;
+        h = _slz4_rotl32(h, 11) * _SLZ4_XXH_PRIME1;
+    }
+
+    h ^= h >> 15;
+    h *= _SLZ4_XXH_PRIME2;
+    h ^= h >> 13;
+    h *= _SLZ4_XXH_PRIME3;
+    h ^= h >> 16;
+    return h;
 }
 
-SLZ4_EXPORT void slz4_test_unit()
+SLZ4_EXPORT uint32_t slz4_xxh32(const void* data, size_t size, uint32_t seed)
 {
-    enum {MAX_TEST_SIZE = 1 << 24};
-    char* testing_buffer = (char*) malloc(MAX_TEST_SIZE);
+    SLZ4_XXH32 hash = {0};
+    slz4_xxh32_init(&hash, seed);
+    slz4_xxh32_update(&hash, data, size);
+    return slz4_xxh32_digest(&hash);
+}
 
-    printf("sLZ4 Testing on few specific strings\n");
-    slz4_test_roundtrip_string("");
-    slz4_test_roundtrip_string("a");
-    slz4_test_roundtrip_string("aa");
-    slz4_test_roundtrip_string("aaa");
-    slz4_test_roundtrip_string("aaaaa");
-    slz4_test_roundtrip_string("aaaaaaaa");
-    slz4_test_roundtrip_string("aaaaaaaaaaaaaaaa");
-    slz4_test_roundtrip_string("aaaaaaaaaaaaaaaaaaaaaaaaaa");
-    slz4_test_roundtrip_string("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
-    slz4_test_roundtrip_string("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
-    slz4_test_roundtrip_string("Hello world! xxx Hello world! yyy Hello world! zzz Hello world! xxx Hello world! xxx ");
-    slz4_test_roundtrip_string("abcdefghijklmnopqrstuvwxyz0123456789_ABCDEFGHIJKLMNOPQRTSUVWXYZ");
-    slz4_test_roundtrip_string("abcdefghijklmnopqrstuvwxyz0123456789_____________________abcdefghijklmnopqrstuvwxyz0123456789_________");
-    slz4_test_roundtrip_string(
-        "_____________________________________________________________________________________________________"
-        "_____________________________________________________________________________________________________"
-        "_____________________________________________________________________________________________________"
-        "_____________________________________________________________________________________________________"
-        "_____________________________________________________________________________________________________"
-        "__________________________________________________________________________________________________XXX"
-        );
-    slz4_test_roundtrip_string(
-        "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore e"
-        "t dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut ali"
-        "quip ex ea commodo consequat. Duis aute irure dolor in reprehenderit in voluptate velit esse cillum d"
-        "olore eu fugiat nulla pariatur. Excepteur sint occaecat cupidatat non proident, sunt in culpa qui off"
-        "icia deserunt mollit anim id est laborum");
-    slz4_test_roundtrip_string(
-        "p=function(t,e,s,i){var a,r,n,h,o,l,p=P,f=0,d=[],m=[],c=Ft.newElement();for(n=s.length,a=0;a<p;a+=1)"
-        "{for(o=a/(p-1),r=l=0;r<n;r+=1)h=_(1-o,3)*t[r]+3*_(1-o,2)*o*s[r]+3*(1-o)*_(o,2)*i[r]+_(o,3)*e[r],d[r]"
-        "=h,null!==m[r]&&(l+=_(d[r]-m[r],2)),m[r]=d[r];l&&(f+=l=k(l)),c.percents[a]=o,c.lengths[a]=f}return c"
-        ".addedLength=f,c};function y(t){this.segmentLength=0,this");
-        
-    printf("sLZ4 Testing on big semi-random latin text of size %i\n", MAX_TEST_SIZE);
-    _slz4_test_get_rotated_text(testing_buffer, 4096);
-    slz4_test_roundtrip_string(testing_buffer);
-    
-    _slz4_test_get_rotated_text(testing_buffer, 4096*4);
-    slz4_test_roundtrip_string(testing_buffer);
-    
-    _slz4_test_get_rotated_text(testing_buffer, MAX_TEST_SIZE);
-    slz4_test_roundtrip_string(testing_buffer);
+//Frame layout: 
+// magic (4B) | FLG (1B) | BD (1B) | content size (0 or 8B) | header checksum (1B)
+// blocks: size (4B, highest bit set means uncompressed) | data | block checksum (0 or 4B)
+// end mark (4B of zero) | content checksum (0 or 4B)
+enum {
+    _SLZ4_FLG_VERSION = 0x40,
+    _SLZ4_FLG_VERSION_MASK = 0xC0,
+    _SLZ4_FLG_BLOCK_INDEPENDENCE = 0x20,
+    _SLZ4_FLG_BLOCK_CHECKSUM = 0x10,
+    _SLZ4_FLG_CONTENT_SIZE = 0x08,
+    _SLZ4_FLG_CONTENT_CHECKSUM = 0x04,
+    _SLZ4_FLG_RESERVED = 0x02,
+    _SLZ4_FLG_DICT_ID = 0x01,
+    _SLZ4_BD_RESERVED = 0x8F,
+};
+#define _SLZ4_BLOCK_UNCOMPRESSED 0x80000000u
+
+SLZ4_INTERNAL int _slz4_frame_block_size(SLZ4_Block_Size block_size)
+{
+    if(block_size == SLZ4_BLOCK_SIZE_DEFAULT)
+        block_size = SLZ4_BLOCK_SIZE_4MB;
+    if(block_size < SLZ4_BLOCK_SIZE_64KB || block_size > SLZ4_BLOCK_SIZE_4MB)
+        return 0;
 
-    free(testing_buffer);
+    return 1 << (8 + 2*block_size);
 }
 
-SLZ4_EXPORT void slz4_test_sizes(double seconds)
+SLZ4_INTERNAL int _slz4_frame_write_header(const SLZ4_Frame_Options* options, uint8_t* out)
 {
-    enum {
-        MAX_TEST_SIZE = 1 << 24, //16MB
-        DETAILED_TESTING = 256,
-    };
-    char* testing_buffer = (char*) malloc(MAX_TEST_SIZE);
-    double start = _slz4_now();
-
-    //Runs are perfectly compressible. The result should be just two tokens. 
-    //One for the run the seconds for the last few bytes
-    printf("sLZ4 Testing on runs of all sizes <= %i\n", DETAILED_TESTING);
-    for(uint32_t size = 0; size < DETAILED_TESTING; size ++)
+    SLZ4_Block_Size block_size = options->block_size ? options->block_size : SLZ4_BLOCK_SIZE_4MB;
+    int size = 0;
+    _slz4_write32(out, SLZ4_FRAME_MAGIC); size += 4;
+    out[size++] = (uint8_t) (_SLZ4_FLG_VERSION
+        | (options->linked_blocks ? 0 : _SLZ4_FLG_BLOCK_INDEPENDENCE)
+        | (options->block_checksum ? _SLZ4_FLG_BLOCK_CHECKSUM : 0)
+        | (options->content_size ? _SLZ4_FLG_CONTENT_SIZE : 0)
+        | (options->content_checksum ? _SLZ4_FLG_CONTENT_CHECKSUM : 0));
+    out[size++] = (uint8_t) (block_size << 4);
+    if(options->content_size)
     {
-        memset(testing_buffer, 'x', size);
-        slz4_test_roundtrip(testing_buffer, size);
+        _slz4_write32(out + size, (uint32_t) options->content_size);
+        _slz4_write32(out + size + 4, (uint32_t) (options->content_size >> 32));
+        size += 8;
     }
-    
-    printf("sLZ4 Testing on runs of all power of two sizes of <= %i\n", MAX_TEST_SIZE);
-    for(uint32_t size = DETAILED_TESTING; size <= MAX_TEST_SIZE; size *= 2)
+
+    //The header checksum covers the descriptor - everything after magic
+    out[size] = (uint8_t) (slz4_xxh32(out + 4, (size_t) size - 4, 0) >> 8);
+    size += 1;
+    return size;
+}
+
+SLZ4_EXPORT SLZ4_Status slz4_frame_compress_init(SLZ4_Frame_Compress* frame, const SLZ4_Frame_Options* options_or_null, const SLZ4_Compress_State* state_or_null)
+{
+    memset(frame, 0, sizeof *frame);
+    if(options_or_null)
+        frame->options = *options_or_null;
+    if(state_or_null)
+        frame->state = *state_or_null;
+    else
     {
-        memset(testing_buffer, 'x', size);
-        slz4_test_roundtrip(testing_buffer, size);
+        frame->state.hash_size_exponent = 12;
+        frame->state.bucket_size_exponent = 2;
     }
-    
-    //Courrpted text is compressible by about 33%. 
-    for(int i = 0; _slz4_now() < start + seconds/2; i ++)
-    {
-        _slz4_test_get_rotated_text(testing_buffer, MAX_TEST_SIZE);
 
-        printf("sLZ4 Testing on data of all sizes <= %i #%i\n", DETAILED_TESTING, i+1);
-        for(uint32_t size = 0; size < DETAILED_TESTING; size ++)
-            slz4_test_roundtrip(testing_buffer, size);
-            
-        printf("sLZ4 Testing on data of all power of two sizes <= %i #%i\n", MAX_TEST_SIZE, i+1);
-        for(uint32_t size = DETAILED_TESTING; size < MAX_TEST_SIZE; size *= 2)
-            slz4_test_roundtrip(testing_buffer, size);
+    frame->block_size = _slz4_frame_block_size(frame->options.block_size);
+    if(frame->block_size == 0)
+    {
+        SLZ4_ASSERT(false);
+        frame->status = SLZ4_ERROR_INVALID_PARAMS;
+        return frame->status;
     }
 
-    //Random data is typically uncompressible
-    srand(clock());
-    for(int i = 0; _slz4_now() < start + seconds/2; i ++)
+    frame->buffer_capacity = frame->block_size + (frame->options.linked_blocks ? SLZ4_FRAME_HISTORY_SIZE : 0);
+    frame->buffer = (uint8_t*) SLZ4_MALLOC((size_t) frame->buffer_capacity);
+    if(frame->buffer == NULL)
     {
-        for(int j = 0; j < MAX_TEST_SIZE; j++)
-            testing_buffer[j] = (char) (rand() % 256);
+        frame->buffer_capacity = 0;
+        frame->status = SLZ4_ERROR_MALLOC_FAILED;
+        return frame->status;
+    }
 
-        printf("sLZ4 Testing on random data of all sizes <= %i #%i\n", DETAILED_TESTING, i+1);
-        for(uint32_t size = 0; size < DETAILED_TESTING; size ++)
-            slz4_test_roundtrip(testing_buffer, size);
+    slz4_xxh32_init(&frame->content_hash, 0);
+    return SLZ4_SUCCESS;
+}
+
+SLZ4_EXPORT int slz4_frame_compress_bound(const SLZ4_Frame_Compress* frame, int input_size)
+{
+    if(frame->block_size <= 0)
+        return 0;
+
+    //Every block takes at most its size plus block size field and checksum because 
+    // blocks which do not compress are stored uncompressed.
+    int64_t block_count = ((int64_t) frame->block_filled + input_size)/frame->block_size + 1;
+    int64_t bound = SLZ4_FRAME_MAX_HEADER_SIZE + block_count*((int64_t) frame->block_size + 8) + 8;
+    return bound < INT32_MAX ? (int) bound : INT32_MAX;
+}
+
+//Writes the block including its size and checksum into out. Returns the number of bytes written which is at most size + 8.
+SLZ4_INTERNAL int _slz4_frame_write_block(uint8_t* out, const uint8_t* block, int size, int history_size, bool block_checksum, SLZ4_Compress_State* state)
+{
+    if(size == 0)
+        return 0;
+
+    //Store the block uncompressed if it does not fit into its original size
+    int compressed_size = slz4_compress_prefixed(out + 4, size, block, size, history_size, state);
+    int stored_size = 0;
+    if(compressed_size > 0 && compressed_size < size)
+    {
+        _slz4_write32(out, (uint32_t) compressed_size);
+        stored_size = compressed_size;
+    }
+    else
+    {
+        _slz4_write32(out, (uint32_t) size | _SLZ4_BLOCK_UNCOMPRESSED);
+        memcpy(out + 4, block, (size_t) size);
+        stored_size = size;
+    }
+
+    int written = 4 + stored_size;
+    if(block_checksum)
+    {
+        _slz4_write32(out + written, slz4_xxh32(out + 4, (size_t) stored_size, 0));
+        written += 4;
+    }
+    return written;
+}
+
+//Compresses the filled block into out followed by moving the history (if any) for the next block.
+SLZ4_INTERNAL int _slz4_frame_compress_block(SLZ4_Frame_Compress* frame, uint8_t* out)
+{
+    int size = frame->block_filled;
+    int written = _slz4_frame_write_block(out, frame->buffer + frame->history_size, size, frame->history_size, frame->options.block_checksum, &frame->state);
+    if(frame->options.linked_blocks)
+    {
+        int total = frame->history_size + size;
+        int keep = total < SLZ4_FRAME_HISTORY_SIZE ? total : SLZ4_FRAME_HISTORY_SIZE;
+        memmove(frame->buffer, frame->buffer + total - keep, (size_t) keep);
+        frame->history_size = keep;
+    }
+    frame->block_filled = 0;
+    return written;
+}
+
+SLZ4_EXPORT int slz4_frame_compress_update(SLZ4_Frame_Compress* frame, void* output, int output_size, const void* input, int input_size)
+{
+    if((output == NULL && output_size != 0) 
+        || (input == NULL && input_size != 0) 
+        || (0 > input_size || input_size > SLZ4_MAX_SIZE) 
+        || (0 > output_size))
+    {
+        SLZ4_ASSERT(false);
+        frame->status = SLZ4_ERROR_INVALID_PARAMS;
+    }
+
+    if(frame->status != SLZ4_SUCCESS)
+        return frame->status;
+
+    //Nothing was done so there is no need to fail the whole frame 
+    if(output_size < slz4_frame_compress_bound(frame, input_size))
+        return SLZ4_ERROR_OUTPUT_TOO_SMALL;
+
+    const uint8_t* in = (const uint8_t*) input;
+    uint8_t* out = (uint8_t*) output;
+    int out_i = 0;
+    if(frame->header_written == false)
+    {
+        out_i += _slz4_frame_write_header(&frame->options, out);
+        frame->header_written = true;
+    }
+
+    slz4_xxh32_update(&frame->content_hash, in, (size_t) input_size);
+    frame->total_size += (uint64_t) input_size;
+    for(int in_i = 0; in_i < input_size; )
+    {
+        int copy = frame->block_size - frame->block_filled;
+        if(copy > input_size - in_i)
+            copy = input_size - in_i;
+
+        memcpy(frame->buffer + frame->history_size + frame->block_filled, in + in_i, (size_t) copy);
+        frame->block_filled += copy;
+        in_i += copy;
+
+        if(frame->block_filled == frame->block_size)
+            out_i += _slz4_frame_compress_block(frame, out + out_i);
+    }
+
+    return out_i;
+}
+
+SLZ4_EXPORT int slz4_frame_compress_end(SLZ4_Frame_Compress* frame, void* output, int output_size)
+{
+    uint8_t* out = (uint8_t*) output;
+    int out_i = 0;
+    if(output != NULL && frame->status == SLZ4_SUCCESS)
+    {
+        if(output_size < slz4_frame_compress_bound(frame, 0))
+            frame->status = SLZ4_ERROR_OUTPUT_TOO_SMALL;
+        else if(frame->options.content_size != 0 && frame->options.content_size != frame->total_size)
+            frame->status = SLZ4_ERROR_INVALID_PARAMS;
+        else
+        {
+            if(frame->header_written == false)
+                out_i += _slz4_frame_write_header(&frame->options, out);
+
+            out_i += _slz4_frame_compress_block(frame, out + out_i);
+            _slz4_write32(out + out_i, 0);
+            out_i += 4;
+
+            if(frame->options.content_checksum)
+            {
+                _slz4_write32(out + out_i, slz4_xxh32_digest(&frame->content_hash));
+                out_i += 4;
+            }
+        }
+    }
+
+    SLZ4_Status status = output == NULL ? SLZ4_SUCCESS : frame->status;
+    SLZ4_FREE(frame->buffer, frame->buffer_capacity);
+    memset(frame, 0, sizeof *frame);
+    return status != SLZ4_SUCCESS ? status : out_i;
+}
+
+enum {
+    _SLZ4_STAGE_MAGIC = 0,
+    _SLZ4_STAGE_HEADER,
+    _SLZ4_STAGE_SKIPPABLE_SIZE,
+    _SLZ4_STAGE_SKIPPABLE,
+    _SLZ4_STAGE_BLOCK_SIZE,
+    _SLZ4_STAGE_BLOCK,
+    _SLZ4_STAGE_FLUSH,
+    _SLZ4_STAGE_CONTENT_CHECKSUM,
+};
+
+SLZ4_EXPORT void slz4_frame_decompress_init(SLZ4_Frame_Decompress* frame)
+{
+    memset(frame, 0, sizeof *frame);
+    frame->stage = _SLZ4_STAGE_MAGIC;
+    frame->header_needed = 4;
+}
+
+//Copies bytes from input until there are needed bytes in into. Returns true once the needed size is reached.
+SLZ4_INTERNAL bool _slz4_frame_gather(uint8_t* into, int* filled, int needed, const uint8_t* in, int in_size, int* in_i)
+{
+    int copy = needed - *filled;
+    if(copy > in_size - *in_i)
+        copy = in_size - *in_i;
+
+    memcpy(into + *filled, in + *in_i, (size_t) copy);
+    *filled += copy;
+    *in_i += copy;
+    return *filled == needed;
+}
+
+SLZ4_INTERNAL SLZ4_Status _slz4_frame_decompress_error(SLZ4_Frame_Decompress* frame, SLZ4_Status status, const char* message)
+{
+    frame->state.status = status;
+    snprintf(frame->state.error_message, sizeof frame->state.error_message, "%s (frame #%lli content offset %llu)", 
+        message, (long long) frame->frame_count, (unsigned long long) frame->total_size);
+    return status;
+}
+
+//Parses the frame header (starting with magic) of which header_filled bytes are available. 
+// If more bytes are needed returns success with header_size bigger than header_filled.
+SLZ4_INTERNAL SLZ4_Status _slz4_frame_read_header(const uint8_t* header, int header_filled, int* header_size, SLZ4_Frame_Options* options, const char** error)
+{
+    uint8_t flg = header[4];
+    uint8_t bd = header[5];
+    *error = NULL;
+    if((flg & _SLZ4_FLG_VERSION_MASK) != _SLZ4_FLG_VERSION)
+        *error = "Unsupported frame version";
+    else if((flg & _SLZ4_FLG_RESERVED) || (bd & _SLZ4_BD_RESERVED))
+        *error = "Reserved bits set in frame descriptor";
+    else if(flg & _SLZ4_FLG_DICT_ID)
+        *error = "Frames with dictionary id are not supported";
+    else if(bd >> 4 < SLZ4_BLOCK_SIZE_64KB)
+        *error = "Invalid block maximum size";
+    if(*error)
+        return SLZ4_ERROR_INVALID_FRAME;
+
+    //We first only gather the minimal header and then the rest once we know how big it is
+    *header_size = 7 + (flg & _SLZ4_FLG_CONTENT_SIZE ? 8 : 0);
+    if(header_filled < *header_size)
+        return SLZ4_SUCCESS;
+
+    uint8_t checksum = (uint8_t) (slz4_xxh32(header + 4, (size_t) *header_size - 5, 0) >> 8);
+    if(checksum != header[*header_size - 1])
+    {
+        *error = "Frame header checksum mismatch";
+        return SLZ4_ERROR_CHECKSUM_MISMATCH;
+    }
+
+    memset(options, 0, sizeof *options);
+    options->block_size = (SLZ4_Block_Size) (bd >> 4);
+    options->linked_blocks = (flg & _SLZ4_FLG_BLOCK_INDEPENDENCE) == 0;
+    options->block_checksum = (flg & _SLZ4_FLG_BLOCK_CHECKSUM) != 0;
+    options->content_checksum = (flg & _SLZ4_FLG_CONTENT_CHECKSUM) != 0;
+    if(flg & _SLZ4_FLG_CONTENT_SIZE)
+        options->content_size = (uint64_t) _slz4_read32(header + 6) | (uint64_t) _slz4_read32(header + 10) << 32;
+    return SLZ4_SUCCESS;
+}
+
+SLZ4_INTERNAL SLZ4_Status _slz4_frame_decompress_header(SLZ4_Frame_Decompress* frame)
+{
+    SLZ4_Frame_Options options = {0};
+    const char* error = NULL;
+    SLZ4_Status status = _slz4_frame_read_header(frame->header, frame->header_filled, &frame->header_needed, &options, &error);
+    if(status != SLZ4_SUCCESS)
+        return _slz4_frame_decompress_error(frame, status, error);
+    if(frame->header_filled < frame->header_needed)
+        return SLZ4_SUCCESS;
+
+    int block_size = _slz4_frame_block_size(options.block_size);
+    //Grow the buffers if this frame uses bigger blocks than any of the previous ones
+    if(frame->input_capacity < block_size + 4)
+    {
+        SLZ4_FREE(frame->input_buffer, frame->input_capacity);
+        SLZ4_FREE(frame->output_buffer, frame->output_capacity);
+        frame->input_capacity = block_size + 4;
+        frame->output_capacity = block_size + SLZ4_FRAME_HISTORY_SIZE;
+        frame->input_buffer = (uint8_t*) SLZ4_MALLOC((size_t) frame->input_capacity);
+        frame->output_buffer = (uint8_t*) SLZ4_MALLOC((size_t) frame->output_capacity);
+        if(frame->input_buffer == NULL || frame->output_buffer == NULL)
+        {
+            SLZ4_FREE(frame->input_buffer, frame->input_capacity);
+            SLZ4_FREE(frame->output_buffer, frame->output_capacity);
+            frame->input_buffer = NULL;
+            frame->output_buffer = NULL;
+            frame->input_capacity = 0;
+            frame->output_capacity = 0;
+            return _slz4_frame_decompress_error(frame, SLZ4_ERROR_MALLOC_FAILED, "Failed to allocate block buffers");
+        }
+    }
+
+    frame->options = options;
+    frame->block_size = block_size;
+    frame->history_size = 0;
+    frame->decompressed_size = 0;
+    frame->flushed_size = 0;
+    frame->total_size = 0;
+    slz4_xxh32_init(&frame->content_hash, 0);
+    frame->stage = _SLZ4_STAGE_BLOCK_SIZE;
+    frame->header_filled = 0;
+    frame->header_needed = 4;
+    return SLZ4_SUCCESS;
+}
+
+//Decompresses block data described by block_word into block (with history_size bytes of history before it). 
+// Returns the decompressed size or negative values from SLZ4_Status in which case the state holds the error.
+SLZ4_INTERNAL int _slz4_frame_read_block(uint8_t* block, int capacity, const uint8_t* data, uint32_t block_word, int history_size, bool block_checksum, SLZ4_Decompress_State* state)
+{
+    int data_size = (int) (block_word & ~_SLZ4_BLOCK_UNCOMPRESSED);
+    if(block_checksum && slz4_xxh32(data, (size_t) data_size, 0) != _slz4_read32(data + data_size))
+    {
+        state->status = SLZ4_ERROR_CHECKSUM_MISMATCH;
+        snprintf(state->error_message, sizeof state->error_message, "Block checksum mismatch");
+        return state->status;
+    }
+
+    if((block_word & _SLZ4_BLOCK_UNCOMPRESSED) == 0)
+        return slz4_decompress_prefixed(block, capacity, data, data_size, history_size, state);
+
+    if(data_size > capacity)
+    {
+        state->status = SLZ4_ERROR_OUTPUT_TOO_SMALL;
+        snprintf(state->error_message, sizeof state->error_message, "Uncompressed block of size %i does not fit into output of size %i", data_size, capacity);
+        return state->status;
+    }
+
+    memcpy(block, data, (size_t) data_size);
+    return data_size;
+}
+
+SLZ4_INTERNAL SLZ4_Status _slz4_frame_decompress_block(SLZ4_Frame_Decompress* frame, const uint8_t* data)
+{
+    //Keep the last 64KB of the previous blocks for linked blocks to reference
+    if(frame->options.linked_blocks)
+    {
+        int total = frame->history_size + frame->decompressed_size;
+        int keep = total < SLZ4_FRAME_HISTORY_SIZE ? total : SLZ4_FRAME_HISTORY_SIZE;
+        memmove(frame->output_buffer, frame->output_buffer + total - keep, (size_t) keep);
+        frame->history_size = keep;
+    }
+    
+    uint8_t* block = frame->output_buffer + frame->history_size;
+    int size = _slz4_frame_read_block(block, frame->block_size, data, frame->block_word, frame->history_size, frame->options.block_checksum, &frame->state);
+    if(size < 0)
+        return (SLZ4_Status) size;
+
+    slz4_xxh32_update(&frame->content_hash, block, (size_t) size);
+    frame->total_size += (uint64_t) size;
+    frame->decompressed_size = size;
+    frame->flushed_size = 0;
+    frame->stage = _SLZ4_STAGE_FLUSH;
+    return SLZ4_SUCCESS;
+}
+
+SLZ4_EXPORT int slz4_frame_decompress_update(SLZ4_Frame_Decompress* frame, void* output, int output_size, const void* input, int input_size, int* input_consumed_or_null)
+{
+    const uint8_t* in = (const uint8_t*) input;
+    uint8_t* out = (uint8_t*) output;
+    int in_i = 0;
+    int out_i = 0;
+
+    if((output == NULL && output_size != 0) 
+        || (input == NULL && input_size != 0) 
+        || (0 > input_size) 
+        || (0 > output_size))
+    {
+        SLZ4_ASSERT(false);
+        _slz4_frame_decompress_error(frame, SLZ4_ERROR_INVALID_PARAMS, "Invalid params provided");
+    }
+
+    while(frame->state.status == SLZ4_SUCCESS)
+    {
+        //Hand out the decompressed block before reading anything else. 
+        // Only this stage can be processed without any input.
+        if(frame->stage == _SLZ4_STAGE_FLUSH)
+        {
+            int copy = frame->decompressed_size - frame->flushed_size;
+            if(copy > output_size - out_i)
+                copy = output_size - out_i;
+
+            if(copy > 0)
+                memcpy(out + out_i, frame->output_buffer + frame->history_size + frame->flushed_size, (size_t) copy);
+            out_i += copy;
+            frame->flushed_size += copy;
+            if(frame->flushed_size < frame->decompressed_size)
+                break;
+
+            frame->stage = _SLZ4_STAGE_BLOCK_SIZE;
+        }
+
+        if(in_i >= input_size)
+            break;
+        
+        switch(frame->stage)
+        {
+            case _SLZ4_STAGE_MAGIC: {
+                if(_slz4_frame_gather(frame->header, &frame->header_filled, frame->header_needed, in, input_size, &in_i) == false)
+                    break;
+
+                uint32_t magic = _slz4_read32(frame->header);
+                if(magic == SLZ4_FRAME_MAGIC)
+                {
+                    frame->stage = _SLZ4_STAGE_HEADER;
+                    frame->header_needed = 7;
+                    frame->frame_count += 1;
+                }
+                else if((magic & 0xFFFFFFF0) == SLZ4_FRAME_SKIPPABLE_MAGIC)
+                {
+                    frame->stage = _SLZ4_STAGE_SKIPPABLE_SIZE;
+                    frame->header_needed = 8;
+                }
+                else
+                    _slz4_frame_decompress_error(frame, SLZ4_ERROR_INVALID_FRAME, "Invalid frame magic number");
+            } break;
+            
+            case _SLZ4_STAGE_HEADER: {
+                if(_slz4_frame_gather(frame->header, &frame->header_filled, frame->header_needed, in, input_size, &in_i))
+                    _slz4_frame_decompress_header(frame);
+            } break;
+
+            case _SLZ4_STAGE_SKIPPABLE_SIZE: {
+                if(_slz4_frame_gather(frame->header, &frame->header_filled, frame->header_needed, in, input_size, &in_i))
+                {
+                    frame->skip_remaining = _slz4_read32(frame->header + 4);
+                    frame->stage = _SLZ4_STAGE_SKIPPABLE;
+                }
+            } break;
+
+            case _SLZ4_STAGE_SKIPPABLE: {
+                uint64_t skip = (uint64_t) (input_size - in_i);
+                if(skip > frame->skip_remaining)
+                    skip = frame->skip_remaining;
+
+                in_i += (int) skip;
+                frame->skip_remaining -= skip;
+                if(frame->skip_remaining == 0)
+                {
+                    frame->stage = _SLZ4_STAGE_MAGIC;
+                    frame->header_filled = 0;
+                    frame->header_needed = 4;
+                }
+            } break;
+
+            case _SLZ4_STAGE_BLOCK_SIZE: {
+                if(_slz4_frame_gather(frame->header, &frame->header_filled, frame->header_needed, in, input_size, &in_i) == false)
+                    break;
+
+                frame->block_word = _slz4_read32(frame->header);
+                frame->header_filled = 0;
+                if(frame->block_word == 0)
+                {
+                    frame->stage = _SLZ4_STAGE_CONTENT_CHECKSUM;
+                    frame->header_needed = frame->options.content_checksum ? 4 : 0;
+                    break;
+                }
+
+                int data_size = (int) (frame->block_word & ~_SLZ4_BLOCK_UNCOMPRESSED);
+                if(data_size > frame->block_size)
+                    _slz4_frame_decompress_error(frame, SLZ4_ERROR_INVALID_FRAME, "Block bigger than the block maximum size");
+                else
+                {
+                    frame->stage = _SLZ4_STAGE_BLOCK;
+                    frame->header_needed = data_size + (frame->options.block_checksum ? 4 : 0);
+                    frame->input_filled = 0;
+                }
+            } break;
+
+            case _SLZ4_STAGE_BLOCK: {
+                //If the whole block is in the input use it directly. Else gather it into the input buffer.
+                if(frame->input_filled == 0 && input_size - in_i >= frame->header_needed)
+                {
+                    const uint8_t* data = in + in_i;
+                    in_i += frame->header_needed;
+                    _slz4_frame_decompress_block(frame, data);
+                }
+                else if(_slz4_frame_gather(frame->input_buffer, &frame->input_filled, frame->header_needed, in, input_size, &in_i))
+                    _slz4_frame_decompress_block(frame, frame->input_buffer);
+
+                if(frame->stage == _SLZ4_STAGE_FLUSH)
+                    frame->header_needed = 4;
+            } break;
+
+            case _SLZ4_STAGE_CONTENT_CHECKSUM: {
+                //Handled below so that frames without content checksum do not need any more input
+            } break;
+
+            default: {
+                SLZ4_ASSERT(false);
+            } break;
+        }
+
+        //The end of frame
+        if(frame->stage == _SLZ4_STAGE_CONTENT_CHECKSUM && frame->state.status == SLZ4_SUCCESS
+            && _slz4_frame_gather(frame->header, &frame->header_filled, frame->header_needed, in, input_size, &in_i))
+        {
+            if(frame->options.content_checksum && slz4_xxh32_digest(&frame->content_hash) != _slz4_read32(frame->header))
+                _slz4_frame_decompress_error(frame, SLZ4_ERROR_CHECKSUM_MISMATCH, "Content checksum mismatch");
+            else if(frame->options.content_size != 0 && frame->options.content_size != frame->total_size)
+                _slz4_frame_decompress_error(frame, SLZ4_ERROR_INVALID_FRAME, "Content size does not match the frame header");
+            else
+            {
+                frame->stage = _SLZ4_STAGE_MAGIC;
+                frame->header_filled = 0;
+                frame->header_needed = 4;
+            }
+        }
+    }
+
+    if(input_consumed_or_null)
+        *input_consumed_or_null = in_i;
+
+    return frame->state.status != SLZ4_SUCCESS ? frame->state.status : out_i;
+}
+
+SLZ4_EXPORT SLZ4_Status slz4_frame_decompress_end(SLZ4_Frame_Decompress* frame)
+{
+    SLZ4_Status status = frame->state.status;
+    if(status == SLZ4_SUCCESS && (frame->stage != _SLZ4_STAGE_MAGIC || frame->header_filled != 0))
+        status = frame->stage == _SLZ4_STAGE_FLUSH ? SLZ4_ERROR_OUTPUT_TOO_SMALL : SLZ4_ERROR_INPUT_TOO_SMALL;
+
+    SLZ4_FREE(frame->input_buffer, frame->input_capacity);
+    SLZ4_FREE(frame->output_buffer, frame->output_capacity);
+    memset(frame, 0, sizeof *frame);
+    return status;
+}
+
+//Minimal threading for the parallel functions. Every thread (including the calling one) repeatedly claims 
+// the next unprocessed item until all are taken. If a thread fails to launch the others simply do its share.
+typedef struct _SLZ4_Parallel_For {
+    void (*process)(void* context, int64_t item, int thread_i);
+    void* context;
+    int64_t item_count;
+    volatile int64_t next_item;
+} _SLZ4_Parallel_For;
+
+typedef struct _SLZ4_Parallel_Thread {
+    _SLZ4_Parallel_For* job;
+    int thread_i;
+} _SLZ4_Parallel_Thread;
+
+#if defined(SLZ4_NO_THREADS)
+    #define _slz4_atomic_fetch_add64(value, add) ((*(value) += (add)) - (add))
+#elif defined(_MSC_VER)
+    #define _slz4_atomic_fetch_add64(value, add) _InterlockedExchangeAdd64((volatile long long*) (value), (add))
+#elif defined(__GNUC__) || defined(__clang__)
+    #define _slz4_atomic_fetch_add64(value, add) __atomic_fetch_add((value), (add), __ATOMIC_RELAXED)
+#else
+    #error unsupported compiler!
+#endif
+
+SLZ4_INTERNAL void _slz4_parallel_for_run(_SLZ4_Parallel_Thread* thread)
+{
+    _SLZ4_Parallel_For* job = thread->job;
+    for(;;)
+    {
+        int64_t item = _slz4_atomic_fetch_add64(&job->next_item, 1);
+        if(item >= job->item_count)
+            break;
+
+        job->process(job->context, item, thread->thread_i);
+    }
+}
+
+#if defined(SLZ4_NO_THREADS)
+    typedef int _SLZ4_Thread;
+    SLZ4_INTERNAL bool _slz4_thread_launch(_SLZ4_Thread* thread, _SLZ4_Parallel_Thread* arg) { (void) thread; (void) arg; return false; }
+    SLZ4_INTERNAL void _slz4_thread_join(_SLZ4_Thread thread) { (void) thread; }
+#elif defined(_WIN32)
+    #include <windows.h>
+    typedef HANDLE _SLZ4_Thread;
+    static DWORD WINAPI _slz4_thread_func(LPVOID arg) 
+    { 
+        _slz4_parallel_for_run((_SLZ4_Parallel_Thread*) arg); 
+        return 0; 
+    }
+    SLZ4_INTERNAL bool _slz4_thread_launch(_SLZ4_Thread* thread, _SLZ4_Parallel_Thread* arg) 
+    { 
+        *thread = CreateThread(NULL, 0, _slz4_thread_func, arg, 0, NULL);
+        return *thread != NULL; 
+    }
+    SLZ4_INTERNAL void _slz4_thread_join(_SLZ4_Thread thread) 
+    { 
+        WaitForSingleObject(thread, INFINITE); 
+        CloseHandle(thread); 
+    }
+#else
+    #include <pthread.h>
+    typedef pthread_t _SLZ4_Thread;
+    static void* _slz4_thread_func(void* arg) 
+    { 
+        _slz4_parallel_for_run((_SLZ4_Parallel_Thread*) arg); 
+        return NULL; 
+    }
+    SLZ4_INTERNAL bool _slz4_thread_launch(_SLZ4_Thread* thread, _SLZ4_Parallel_Thread* arg) 
+    { 
+        return pthread_create(thread, NULL, _slz4_thread_func, arg) == 0; 
+    }
+    SLZ4_INTERNAL void _slz4_thread_join(_SLZ4_Thread thread) 
+    { 
+        pthread_join(thread, NULL); 
+    }
+#endif
+
+//Calls process for every item in [0, item_count) on thread_count threads. Returns once all items are processed.
+SLZ4_INTERNAL void _slz4_parallel_for(int thread_count, int64_t item_count, void (*process)(void* context, int64_t item, int thread_i), void* context)
+{
+    _SLZ4_Parallel_For job = {process, context, item_count, 0};
+    _SLZ4_Parallel_Thread calling = {&job, 0};
+    if(thread_count <= 1)
+    {
+        _slz4_parallel_for_run(&calling);
+        return;
+    }
+
+    size_t threads_size = (size_t) thread_count*sizeof(_SLZ4_Parallel_Thread);
+    size_t handles_size = (size_t) thread_count*sizeof(_SLZ4_Thread);
+    size_t launched_size = (size_t) thread_count*sizeof(bool);
+    size_t alloced_size = threads_size + handles_size + launched_size;
+    uint8_t* alloced = (uint8_t*) SLZ4_MALLOC(alloced_size);
+    if(alloced == NULL)
+    {
+        _slz4_parallel_for_run(&calling);
+        return;
+    }
+
+    _SLZ4_Parallel_Thread* threads = (_SLZ4_Parallel_Thread*) (void*) alloced;
+    _SLZ4_Thread* handles = (_SLZ4_Thread*) (void*) (alloced + threads_size);
+    bool* launched = (bool*) (alloced + threads_size + handles_size);
+    for(int i = 1; i < thread_count; i++)
+    {
+        threads[i].job = &job;
+        threads[i].thread_i = i;
+        launched[i] = _slz4_thread_launch(&handles[i], &threads[i]);
+    }
+
+    _slz4_parallel_for_run(&calling);
+    for(int i = 1; i < thread_count; i++)
+        if(launched[i])
+            _slz4_thread_join(handles[i]);
+
+    SLZ4_FREE(alloced, alloced_size);
+}
+
+SLZ4_EXPORT int64_t slz4_frame_compressed_size_upper_bound(int64_t input_size, const SLZ4_Frame_Options* options_or_null)
+{
+    int block_size = _slz4_frame_block_size(options_or_null ? options_or_null->block_size : SLZ4_BLOCK_SIZE_DEFAULT);
+    if(block_size == 0 || input_size < 0)
+        return 0;
+
+    //Every block takes at most its size plus block size field and checksum
+    int64_t full_blocks = input_size/block_size;
+    int64_t remaining = input_size%block_size;
+    return SLZ4_FRAME_MAX_HEADER_SIZE + full_blocks*(block_size + 8) + (remaining ? remaining + 8 : 0) + 8;
+}
+
+typedef struct _SLZ4_Parallel_Compress {
+    uint8_t* out;
+    const uint8_t* in;
+    int64_t in_size;
+    int64_t header_size;
+    int block_size;
+    bool block_checksum;
+    bool content_checksum;
+    uint32_t content_hash;
+    SLZ4_Compress_State* states; //one per thread
+    int* written;                //one per block
+} _SLZ4_Parallel_Compress;
+
+SLZ4_INTERNAL void _slz4_parallel_compress_item(void* context, int64_t item, int thread_i)
+{
+    _SLZ4_Parallel_Compress* job = (_SLZ4_Parallel_Compress*) context;
+
+    //The content checksum is the first item so that it runs alongside the blocks instead of after them 
+    int64_t block_i = item;
+    if(job->content_checksum)
+    {
+        if(item == 0)
+        {
+            job->content_hash = slz4_xxh32(job->in, (size_t) job->in_size, 0);
+            return;
+        }
+        block_i -= 1;
+    }
+
+    //Each block is written to its worst case position and moved into place once all are done
+    int64_t from = block_i*job->block_size;
+    int size = job->in_size - from < job->block_size ? (int) (job->in_size - from) : job->block_size;
+    uint8_t* slot = job->out + job->header_size + block_i*(job->block_size + 8);
+    job->written[block_i] = _slz4_frame_write_block(slot, job->in + from, size, 0, job->block_checksum, &job->states[thread_i]);
+}
+
+SLZ4_EXPORT int64_t slz4_frame_compress_parallel(void* output, int64_t output_size, const void* input, int64_t input_size, const SLZ4_Frame_Options* options_or_null, const SLZ4_Compress_State* state_or_null, int thread_count)
+{
+    SLZ4_Frame_Options options = {0};
+    if(options_or_null)
+        options = *options_or_null;
+
+    int block_size = _slz4_frame_block_size(options.block_size);
+    if(output == NULL || (input == NULL && input_size != 0) 
+        || 0 > input_size || 0 > output_size
+        || block_size == 0 || options.linked_blocks
+        || (options.content_size != 0 && options.content_size != (uint64_t) input_size))
+    {
+        SLZ4_ASSERT(false);
+        return SLZ4_ERROR_INVALID_PARAMS;
+    }
+
+    if(output_size < slz4_frame_compressed_size_upper_bound(input_size, &options))
+        return SLZ4_ERROR_OUTPUT_TOO_SMALL;
+
+    SLZ4_Compress_State state = {0};
+    state.hash_size_exponent = 12;
+    state.bucket_size_exponent = 2;
+    if(state_or_null)
+        state = *state_or_null;
+
+    _SLZ4_Parallel_Compress job = {0};
+    job.out = (uint8_t*) output;
+    job.in = (const uint8_t*) input;
+    job.in_size = input_size;
+    job.block_size = block_size;
+    job.block_checksum = options.block_checksum;
+    job.content_checksum = options.content_checksum;
+    job.header_size = _slz4_frame_write_header(&options, job.out);
+
+    int64_t block_count = (input_size + block_size - 1)/block_size;
+    if(thread_count > block_count)
+        thread_count = (int) block_count;
+    if(thread_count < 1)
+        thread_count = 1;
+
+    //Every thread gets its own state and table 
+    size_t table_size = slz4_required_size_for_compression_table(state.hash_size_exponent, state.bucket_size_exponent);
+    size_t states_size = (size_t) thread_count*sizeof(SLZ4_Compress_State);
+    size_t written_size = (size_t) block_count*sizeof(int);
+    size_t alloced_size = states_size + written_size + (size_t) thread_count*table_size;
+    uint8_t* alloced = (uint8_t*) SLZ4_MALLOC(alloced_size);
+    if(alloced == NULL)
+        return SLZ4_ERROR_MALLOC_FAILED;
+
+    job.states = (SLZ4_Compress_State*) (void*) alloced;
+    job.written = (int*) (void*) (alloced + states_size);
+    for(int i = 0; i < thread_count; i++)
+    {
+        job.states[i] = state;
+        job.states[i].compression_table_or_null = alloced + states_size + written_size + (size_t) i*table_size;
+    }
+
+    _slz4_parallel_for(thread_count, block_count + (options.content_checksum ? 1 : 0), _slz4_parallel_compress_item, &job);
+
+    //Move the blocks right after each other. Blocks are never bigger than their worst case 
+    // thus we never overwrite a block that was not yet moved.
+    int64_t out_i = job.header_size;
+    for(int64_t i = 0; i < block_count; i++)
+    {
+        memmove(job.out + out_i, job.out + job.header_size + i*(block_size + 8), (size_t) job.written[i]);
+        out_i += job.written[i];
+    }
+
+    _slz4_write32(job.out + out_i, 0);
+    out_i += 4;
+    if(options.content_checksum)
+    {
+        _slz4_write32(job.out + out_i, job.content_hash);
+        out_i += 4;
+    }
+    
+    SLZ4_FREE(alloced, alloced_size);
+    return out_i;
+}
+
+//Decompresses all frames in input one after the other using the streaming interface.
+SLZ4_INTERNAL int64_t _slz4_frame_decompress_sequential(uint8_t* out, int64_t output_size, const uint8_t* in, int64_t input_size, SLZ4_Decompress_State* state_or_null)
+{
+    SLZ4_Frame_Decompress frame = {0};
+    slz4_frame_decompress_init(&frame);
+
+    int64_t in_i = 0;
+    int64_t out_i = 0;
+    for(;;)
+    {
+        int in_chunk = input_size - in_i < SLZ4_MAX_SIZE ? (int) (input_size - in_i) : SLZ4_MAX_SIZE;
+        int out_chunk = output_size - out_i < SLZ4_MAX_SIZE ? (int) (output_size - out_i) : SLZ4_MAX_SIZE;
+        int consumed = 0;
+        int written = slz4_frame_decompress_update(&frame, out + out_i, out_chunk, in + in_i, in_chunk, &consumed);
+        if(written < 0 || (written == 0 && consumed == 0))
+            break;
+
+        in_i += consumed;
+        out_i += written;
+    }
+
+    SLZ4_Decompress_State state = frame.state;
+    SLZ4_Status status = slz4_frame_decompress_end(&frame);
+    if(state.status == SLZ4_SUCCESS && status != SLZ4_SUCCESS)
+    {
+        state.status = status;
+        snprintf(state.error_message, sizeof state.error_message, status == SLZ4_ERROR_OUTPUT_TOO_SMALL 
+            ? "Output of size %lli is too small" : "Input of size %lli ends in the middle of a frame", 
+            (long long) (status == SLZ4_ERROR_OUTPUT_TOO_SMALL ? output_size : input_size));
+    }
+
+    if(state_or_null)
+        *state_or_null = state;
+    return state.status != SLZ4_SUCCESS ? state.status : out_i;
+}
+
+typedef struct _SLZ4_Parallel_Decompress {
+    uint8_t* out;
+    int64_t out_size;
+    const uint8_t* in;
+    int64_t* block_offsets; //one per block. Points to the block size field
+    int* decompressed;      //one per block
+    int block_size;
+    bool block_checksum;
+    SLZ4_Decompress_State* states; //one per thread
+} _SLZ4_Parallel_Decompress;
+
+SLZ4_INTERNAL void _slz4_parallel_decompress_item(void* context, int64_t block_i, int thread_i)
+{
+    _SLZ4_Parallel_Decompress* job = (_SLZ4_Parallel_Decompress*) context;
+    int64_t to = block_i*job->block_size;
+    int capacity = job->out_size - to < job->block_size ? (int) (job->out_size - to) : job->block_size;
+    const uint8_t* block = job->in + job->block_offsets[block_i];
+    job->decompressed[block_i] = _slz4_frame_read_block(job->out + to, capacity, block + 4, _slz4_read32(block), 0, job->block_checksum, &job->states[thread_i]);
+}
+
+SLZ4_EXPORT int64_t slz4_frame_decompress_parallel(void* output, int64_t output_size, const void* input, int64_t input_size, SLZ4_Decompress_State* state_or_null, int thread_count)
+{
+    uint8_t* out = (uint8_t*) output;
+    const uint8_t* in = (const uint8_t*) input;
+    if((output == NULL && output_size != 0) || (input == NULL && input_size != 0) || 0 > input_size || 0 > output_size)
+    {
+        SLZ4_ASSERT(false);
+        if(state_or_null) 
+        {
+            state_or_null->status = SLZ4_ERROR_INVALID_PARAMS;
+            snprintf(state_or_null->error_message, sizeof state_or_null->error_message, "Invalid params provided");
+        }
+        return SLZ4_ERROR_INVALID_PARAMS;
+    }
+
+    //Check if the input is a single valid frame of independent blocks each of which
+    // (except the last) decompresses to exactly the block size. This is what we and the lz4 utility produce.
+    // Anything else including all kinds of errors is left to the sequential path.
+    SLZ4_Frame_Options options = {0};
+    int header_size = 0;
+    const char* error = NULL;
+    if(input_size < 7 || _slz4_read32(in) != SLZ4_FRAME_MAGIC
+        || _slz4_frame_read_header(in, input_size < SLZ4_FRAME_MAX_HEADER_SIZE ? (int) input_size : SLZ4_FRAME_MAX_HEADER_SIZE, &header_size, &options, &error) != SLZ4_SUCCESS
+        || header_size > input_size || options.linked_blocks)
+        return _slz4_frame_decompress_sequential(out, output_size, in, input_size, state_or_null);
+
+    int block_size = _slz4_frame_block_size(options.block_size);
+    int checksum_size = options.block_checksum ? 4 : 0;
+    int64_t block_count = 0;
+    int64_t in_i = header_size;
+    for(;; block_count++)
+    {
+        if(in_i + 4 > input_size)
+            return _slz4_frame_decompress_sequential(out, output_size, in, input_size, state_or_null);
+
+        uint32_t block_word = _slz4_read32(in + in_i);
+        int64_t data_size = block_word & ~_SLZ4_BLOCK_UNCOMPRESSED;
+        if(block_word == 0)
+            break;
+        if(data_size > block_size || in_i + 4 + data_size + checksum_size > input_size)
+            return _slz4_frame_decompress_sequential(out, output_size, in, input_size, state_or_null);
+        in_i += 4 + data_size + checksum_size;
+    }
+
+    int64_t frame_end = in_i + 4 + (options.content_checksum ? 4 : 0);
+    if(frame_end != input_size || (block_count > 0 && (block_count - 1)*block_size >= output_size))
+        return _slz4_frame_decompress_sequential(out, output_size, in, input_size, state_or_null);
+
+    if(thread_count > block_count)
+        thread_count = (int) block_count;
+    if(thread_count < 1)
+        thread_count = 1;
+
+    size_t offsets_size = (size_t) block_count*sizeof(int64_t);
+    size_t decompressed_size = (size_t) block_count*sizeof(int);
+    size_t states_size = (size_t) thread_count*sizeof(SLZ4_Decompress_State);
+    size_t alloced_size = offsets_size + decompressed_size + states_size;
+    uint8_t* alloced = (uint8_t*) SLZ4_MALLOC(alloced_size);
+    if(alloced == NULL)
+        return _slz4_frame_decompress_sequential(out, output_size, in, input_size, state_or_null);
+
+    _SLZ4_Parallel_Decompress job = {0};
+    job.out = out;
+    job.out_size = output_size;
+    job.in = in;
+    job.block_size = block_size;
+    job.block_checksum = options.block_checksum;
+    job.block_offsets = (int64_t*) (void*) alloced;
+    job.decompressed = (int*) (void*) (alloced + offsets_size);
+    job.states = (SLZ4_Decompress_State*) (void*) (alloced + offsets_size + decompressed_size);
+    memset(job.states, 0, states_size);
+
+    in_i = header_size;
+    for(int64_t i = 0; i < block_count; i++)
+    {
+        job.block_offsets[i] = in_i;
+        in_i += 4 + (_slz4_read32(in + in_i) & ~_SLZ4_BLOCK_UNCOMPRESSED) + checksum_size;
+    }
+
+    _slz4_parallel_for(thread_count, block_count, _slz4_parallel_decompress_item, &job);
+
+    bool okay = true;
+    int64_t out_i = 0;
+    for(int64_t i = 0; i < block_count && okay; i++)
+    {
+        okay = job.decompressed[i] >= 0 && (i == block_count - 1 || job.decompressed[i] == block_size);
+        out_i += job.decompressed[i];
+    }
+
+    if(okay && options.content_checksum)
+        okay = slz4_xxh32(out, (size_t) out_i, 0) == _slz4_read32(in + frame_end - 4);
+    if(okay && options.content_size != 0)
+        okay = options.content_size == (uint64_t) out_i;
+
+    SLZ4_FREE(alloced, alloced_size);
+    if(okay == false)
+        return _slz4_frame_decompress_sequential(out, output_size, in, input_size, state_or_null);
+
+    if(state_or_null)
+        state_or_null->status = SLZ4_SUCCESS;
+    return out_i;
+}
+
+#endif
+
+#if (defined(MODULE_ALL_TEST) || defined(MODULE_SLZ4_TEST)) && !defined(MODULE_SLZ4_HAS_TEST)
+#define MODULE_SLZ4_HAS_TEST
+
+#include <time.h>
+#ifdef _WIN32
+    #include <windows.h>
+#endif
+SLZ4_EXPORT void slz4_test_unit();
+SLZ4_EXPORT void slz4_test_sizes(double seconds);
+SLZ4_EXPORT void slz4_test_invalid_decompress(double seconds);
+SLZ4_EXPORT void slz4_test_frame(double seconds);
+SLZ4_EXPORT void slz4_test_parallel(double seconds);
+SLZ4_EXPORT void slz4_test_fast(double seconds);
+SLZ4_EXPORT void slz4_benchmark(const char* path_or_null);
+
+SLZ4_INTERNAL void _slz4_test_get_rotated_text(char* string, int size);
+SLZ4_INTERNAL double _slz4_now();
+
+SLZ4_EXPORT void slz4_test(double seconds)
+{
+    slz4_test_unit();
+    slz4_test_sizes(seconds/4);
+    slz4_test_invalid_decompress(seconds/4);
+    slz4_test_frame(seconds/4);
+    slz4_test_parallel(seconds/4);
+    slz4_test_fast(seconds/4);
+}
+
+SLZ4_EXPORT void slz4_test_roundtrip(const void* data, int size)
+{
+    //Compress and decompress and test whether we got back the same thing
+    int compressed_capacity = slz4_compress(NULL, 0, data, size, NULL);
+    SLZ4_TEST(compressed_capacity >= 0);
+    
+    char* compressed = (char*) calloc(compressed_capacity, 1);
+    SLZ4_TEST(compressed != NULL);
+    int compressed_size = slz4_compress(compressed, compressed_capacity, data, size, NULL);
+    SLZ4_TEST(compressed_size > 0);
+    
+    int decompressed_capacity = slz4_decompress(NULL, 0, compressed, compressed_size, NULL);
+    SLZ4_TEST(decompressed_capacity == size);
+    
+    char* decompressed = (char*) calloc(decompressed_capacity, 1);
+    SLZ4_TEST(decompressed != NULL);
+    int decompressed_size = slz4_decompress(decompressed, decompressed_capacity, compressed, compressed_size, NULL);
+    SLZ4_TEST(decompressed_size >= 0);
+    SLZ4_TEST(memcmp(data, decompressed, size) == 0);
+
+    //Test malloc interface. It should give the exact same results.
+    SLZ4_Malloced compressed_malloc = slz4_compress_malloc(data, size, NULL);
+    SLZ4_Malloced decompressed_malloc = slz4_decompress_malloc(compressed_malloc.data, compressed_malloc.size, NULL);
+    SLZ4_TEST(compressed_malloc.size == compressed_size);
+    SLZ4_TEST(decompressed_malloc.size == decompressed_size);
+    SLZ4_TEST(memcmp(compressed_malloc.data, compressed, compressed_size) == 0);
+    SLZ4_TEST(memcmp(decompressed_malloc.data, decompressed, decompressed_size) == 0);
+
+    //printf("Compressed %i -> %i Bytes ~%.2lf \n", size, compressed_size, (double) size / (double) compressed_size);
+    
+    //Test against the reference implementation. 
+    //It should be able to decompress our compression and we should be able to decompress its compression.
+    #ifdef SLZ4_TEST_AGAINST_REFERENCE_IMPL
+        int ref_decompressed_size = LZ4_decompress_safe(compressed, decompressed, compressed_size, decompressed_capacity);
+        SLZ4_TEST(ref_decompressed_size == size);
+        SLZ4_TEST(memcmp(data, decompressed, size) == 0);
+
+        int ref_compressed_capacity = LZ4_compressBound(size);
+        char* ref_compressed = (char*) malloc((size_t) ref_compressed_capacity);
+        SLZ4_TEST(ref_compressed != NULL);
+
+        int ref_compressed_size = LZ4_compress_default(data, ref_compressed, size, ref_compressed_capacity);
+        SLZ4_TEST(ref_compressed_size > 0);
+    
+        decompressed_size = slz4_decompress(decompressed, decompressed_capacity, ref_compressed, ref_compressed_size, NULL);
+        SLZ4_TEST(decompressed_size == size);
+        SLZ4_TEST(memcmp(data, decompressed, size) == 0);
+
+        free(ref_compressed);
+    #endif
+
+    free(compressed);
+    free(decompressed);
+    SLZ4_FREE(compressed_malloc.data, compressed_malloc.capacity);
+    SLZ4_FREE(decompressed_malloc.data, decompressed_malloc.capacity);
+}
+
+SLZ4_EXPORT void slz4_test_roundtrip_string(const char* data)
+{
+    slz4_test_roundtrip(data, (int) strlen(data));
+}
+
+SLZ4_EXPORT void slz4_test_unit()
+{
+    enum {MAX_TEST_SIZE = 1 << 24};
+    char* testing_buffer = (char*) malloc(MAX_TEST_SIZE);
+
+    printf("sLZ4 Testing on few specific strings\n");
+    slz4_test_roundtrip_string("");
+    slz4_test_roundtrip_string("a");
+    slz4_test_roundtrip_string("aa");
+    slz4_test_roundtrip_string("aaa");
+    slz4_test_roundtrip_string("aaaaa");
+    slz4_test_roundtrip_string("aaaaaaaa");
+    slz4_test_roundtrip_string("aaaaaaaaaaaaaaaa");
+    slz4_test_roundtrip_string("aaaaaaaaaaaaaaaaaaaaaaaaaa");
+    slz4_test_roundtrip_string("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+    slz4_test_roundtrip_string("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+    slz4_test_roundtrip_string("Hello world! xxx Hello world! yyy Hello world! zzz Hello world! xxx Hello world! xxx ");
+    slz4_test_roundtrip_string("abcdefghijklmnopqrstuvwxyz0123456789_ABCDEFGHIJKLMNOPQRTSUVWXYZ");
+    slz4_test_roundtrip_string("abcdefghijklmnopqrstuvwxyz0123456789_____________________abcdefghijklmnopqrstuvwxyz0123456789_________");
+    slz4_test_roundtrip_string(
+        "_____________________________________________________________________________________________________"
+        "_____________________________________________________________________________________________________"
+        "_____________________________________________________________________________________________________"
+        "_____________________________________________________________________________________________________"
+        "_____________________________________________________________________________________________________"
+        "__________________________________________________________________________________________________XXX"
+        );
+    slz4_test_roundtrip_string(
+        "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore e"
+        "t dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut ali"
+        "quip ex ea commodo consequat. Duis aute irure dolor in reprehenderit in voluptate velit esse cillum d"
+        "olore eu fugiat nulla pariatur. Excepteur sint occaecat cupidatat non proident, sunt in culpa qui off"
+        "icia deserunt mollit anim id est laborum");
+    slz4_test_roundtrip_string(
+        "p=function(t,e,s,i){var a,r,n,h,o,l,p=P,f=0,d=[],m=[],c=Ft.newElement();for(n=s.length,a=0;a<p;a+=1)"
+        "{for(o=a/(p-1),r=l=0;r<n;r+=1)h=_(1-o,3)*t[r]+3*_(1-o,2)*o*s[r]+3*(1-o)*_(o,2)*i[r]+_(o,3)*e[r],d[r]"
+        "=h,null!==m[r]&&(l+=_(d[r]-m[r],2)),m[r]=d[r];l&&(f+=l=k(l)),c.percents[a]=o,c.lengths[a]=f}return c"
+        ".addedLength=f,c};function y(t){this.segmentLength=0,this");
+        
+    printf("sLZ4 Testing on big semi-random latin text of size %i\n", MAX_TEST_SIZE);
+    _slz4_test_get_rotated_text(testing_buffer, 4096);
+    slz4_test_roundtrip_string(testing_buffer);
+    
+    _slz4_test_get_rotated_text(testing_buffer, 4096*4);
+    slz4_test_roundtrip_string(testing_buffer);
+    
+    _slz4_test_get_rotated_text(testing_buffer, MAX_TEST_SIZE);
+    slz4_test_roundtrip_string(testing_buffer);
+
+    free(testing_buffer);
+}
+
+SLZ4_EXPORT void slz4_test_sizes(double seconds)
+{
+    enum {
+        MAX_TEST_SIZE = 1 << 24, //16MB
+        DETAILED_TESTING = 256,
+    };
+    char* testing_buffer = (char*) malloc(MAX_TEST_SIZE);
+    double start = _slz4_now();
+
+    //Runs are perfectly compressible. The result should be just two tokens. 
+    //One for the run the seconds for the last few bytes
+    printf("sLZ4 Testing on runs of all sizes <= %i\n", DETAILED_TESTING);
+    for(uint32_t size = 0; size < DETAILED_TESTING; size ++)
+    {
+        memset(testing_buffer, 'x', size);
+        slz4_test_roundtrip(testing_buffer, size);
+    }
+    
+    printf("sLZ4 Testing on runs of all power of two sizes of <= %i\n", MAX_TEST_SIZE);
+    for(uint32_t size = DETAILED_TESTING; size <= MAX_TEST_SIZE; size *= 2)
+    {
+        memset(testing_buffer, 'x', size);
+        slz4_test_roundtrip(testing_buffer, size);
+    }
+    
+    //Courrpted text is compressible by about 33%. 
+    for(int i = 0; _slz4_now() < start + seconds/2; i ++)
+    {
+        _slz4_test_get_rotated_text(testing_buffer, MAX_TEST_SIZE);
+
+        printf("sLZ4 Testing on data of all sizes <= %i #%i\n", DETAILED_TESTING, i+1);
+        for(uint32_t size = 0; size < DETAILED_TESTING; size ++)
+            slz4_test_roundtrip(testing_buffer, size);
+            
+        printf("sLZ4 Testing on data of all power of two sizes <= %i #%i\n", MAX_TEST_SIZE, i+1);
+        for(uint32_t size = DETAILED_TESTING; size < MAX_TEST_SIZE; size *= 2)
+            slz4_test_roundtrip(testing_buffer, size);
+    }
+
+    //Random data is typically uncompressible
+    srand(clock());
+    for(int i = 0; _slz4_now() < start + seconds/2; i ++)
+    {
+        for(int j = 0; j < MAX_TEST_SIZE; j++)
+            testing_buffer[j] = (char) (rand() % 256);
+
+        printf("sLZ4 Testing on random data of all sizes <= %i #%i\n", DETAILED_TESTING, i+1);
+        for(uint32_t size = 0; size < DETAILED_TESTING; size ++)
+            slz4_test_roundtrip(testing_buffer, size);
 
         printf("sLZ4 Testing on random data of all power of two sizes <= %i #%i\n", MAX_TEST_SIZE, i+1);
         for(uint32_t size = DETAILED_TESTING; size < MAX_TEST_SIZE; size *= 2)
@@ -1066,18 +2526,641 @@ SLZ4_EXPORT void slz4_test_invalid_decompress(double seconds)
     free(decode_into);
 }
 
-SLZ4_INTERNAL double _slz4_now()
+//Compresses data as a frame feeding it in random chunks of at most chunk_max bytes. Returns the malloced frame.
+SLZ4_INTERNAL uint8_t* _slz4_test_frame_compress(const void* data, int size, const SLZ4_Frame_Options* options, int chunk_max, int* frame_size)
+{
+    SLZ4_Frame_Compress frame = {0};
+    SLZ4_TEST(slz4_frame_compress_init(&frame, options, NULL) == SLZ4_SUCCESS);
+
+    //The whole frame is never bigger than the bound of a single update with all of the data.
+    // Each call gets its own scratch output just as it would when streaming to a file.
+    int capacity = slz4_frame_compress_bound(&frame, size);
+    uint8_t* compressed = (uint8_t*) malloc((size_t) capacity);
+    int scratch_capacity = 0;
+    uint8_t* scratch = NULL;
+    SLZ4_TEST(compressed != NULL);
+
+    int compressed_size = 0;
+    for(int i = 0; i <= size; )
+    {
+        int chunk = rand() % chunk_max + 1;
+        if(chunk > size - i)
+            chunk = size - i;
+
+        int needed = slz4_frame_compress_bound(&frame, chunk);
+        if(scratch_capacity < needed)
+        {
+            free(scratch);
+            scratch = (uint8_t*) malloc((size_t) needed);
+            scratch_capacity = needed;
+            SLZ4_TEST(scratch != NULL);
+        }
+
+        //Too small output is rejected without any effect
+        if(rand() % 8 == 0)
+            SLZ4_TEST(slz4_frame_compress_update(&frame, scratch, needed - 1, (const uint8_t*) data + i, chunk) == SLZ4_ERROR_OUTPUT_TOO_SMALL);
+
+        int written = 0;
+        if(i < size)
+            written = slz4_frame_compress_update(&frame, scratch, scratch_capacity, (const uint8_t*) data + i, chunk);
+        else
+        {
+            written = slz4_frame_compress_end(&frame, scratch, scratch_capacity);
+            SLZ4_TEST(written > 0 && frame.buffer == NULL);
+            chunk = 1;
+        }
+
+        SLZ4_TEST(written >= 0 && compressed_size + written <= capacity);
+        memcpy(compressed + compressed_size, scratch, (size_t) written);
+        compressed_size += written;
+        i += chunk;
+    }
+
+    free(scratch);
+    *frame_size = compressed_size;
+    return compressed;
+}
+
+//Decompresses the frame feeding it in random chunks of at most chunk_max bytes and retrieving the output
+// into random sized buffers. Returns the status of slz4_frame_decompress_end.
+SLZ4_INTERNAL SLZ4_Status _slz4_test_frame_decompress(const uint8_t* compressed, int compressed_size, uint8_t* decompressed, int decompressed_capacity, int chunk_max, int* decompressed_size)
+{
+    SLZ4_Frame_Decompress frame = {0};
+    slz4_frame_decompress_init(&frame);
+
+    *decompressed_size = 0;
+    int in_i = 0;
+    for(int stuck = 0; stuck < 2; )
+    {
+        int chunk = rand() % chunk_max + 1;
+        if(chunk > compressed_size - in_i)
+            chunk = compressed_size - in_i;
+
+        int out_chunk = rand() % chunk_max + 1;
+        if(out_chunk > decompressed_capacity - *decompressed_size)
+            out_chunk = decompressed_capacity - *decompressed_size;
+
+        int consumed = 0;
+        int written = slz4_frame_decompress_update(&frame, decompressed + *decompressed_size, out_chunk, compressed + in_i, chunk, &consumed);
+        if(written < 0)
+        {
+            SLZ4_TEST(frame.state.status == written);
+            SLZ4_TEST(strlen(frame.state.error_message) != 0);
+            break;
+        }
+
+        SLZ4_TEST(0 <= consumed && consumed <= chunk);
+        SLZ4_TEST(written <= out_chunk);
+        *decompressed_size += written;
+        in_i += consumed;
+
+        //Stop when no progress can be made anymore 
+        if(consumed == 0 && written == 0)
+            stuck += 1;
+        else
+            stuck = 0;
+    }
+
+    return slz4_frame_decompress_end(&frame);
+}
+
+SLZ4_INTERNAL void _slz4_test_frame_roundtrip(const void* data, int size, const SLZ4_Frame_Options* options, int chunk_max)
+{
+    int compressed_size = 0;
+    uint8_t* compressed = _slz4_test_frame_compress(data, size, options, chunk_max, &compressed_size);
+
+    int decompressed_size = 0;
+    uint8_t* decompressed = (uint8_t*) malloc((size_t) size + 1);
+    SLZ4_TEST(decompressed != NULL);
+    SLZ4_TEST(_slz4_test_frame_decompress(compressed, compressed_size, decompressed, size, chunk_max, &decompressed_size) == SLZ4_SUCCESS);
+    SLZ4_TEST(decompressed_size == size);
+    SLZ4_TEST(memcmp(data, decompressed, (size_t) size) == 0);
+
+    //The output is the same regardless of how the input was split
+    int same_size = 0;
+    uint8_t* same = _slz4_test_frame_compress(data, size, options, size + 1, &same_size);
+    SLZ4_TEST(same_size == compressed_size && memcmp(same, compressed, (size_t) same_size) == 0);
+    free(same);
+
+    #ifdef SLZ4_TEST_AGAINST_REFERENCE_IMPL
+        LZ4F_dctx* ref = NULL;
+        SLZ4_TEST(LZ4F_isError(LZ4F_createDecompressionContext(&ref, LZ4F_VERSION)) == false);
+        size_t ref_decompressed = (size_t) size;
+        size_t ref_compressed = (size_t) compressed_size;
+        SLZ4_TEST(LZ4F_decompress(ref, decompressed, &ref_decompressed, compressed, &ref_compressed, NULL) == 0);
+        SLZ4_TEST(ref_decompressed == (size_t) size && ref_compressed == (size_t) compressed_size);
+        SLZ4_TEST(memcmp(data, decompressed, (size_t) size) == 0);
+        LZ4F_freeDecompressionContext(ref);
+
+        LZ4F_preferences_t prefs = {0};
+        prefs.frameInfo.blockSizeID = (LZ4F_blockSizeID_t) (options->block_size ? options->block_size : 7);
+        prefs.frameInfo.blockMode = options->linked_blocks ? LZ4F_blockLinked : LZ4F_blockIndependent;
+        prefs.frameInfo.blockChecksumFlag = options->block_checksum ? LZ4F_blockChecksumEnabled : LZ4F_noBlockChecksum;
+        prefs.frameInfo.contentChecksumFlag = options->content_checksum ? LZ4F_contentChecksumEnabled : LZ4F_noContentChecksum;
+        size_t ref_capacity = LZ4F_compressFrameBound((size_t) size, &prefs);
+        uint8_t* ref_frame = (uint8_t*) malloc(ref_capacity);
+        size_t ref_frame_size = LZ4F_compressFrame(ref_frame, ref_capacity, data, (size_t) size, &prefs);
+        SLZ4_TEST(LZ4F_isError(ref_frame_size) == false);
+        memset(decompressed, 0, (size_t) size);
+        SLZ4_TEST(_slz4_test_frame_decompress(ref_frame, (int) ref_frame_size, decompressed, size, chunk_max, &decompressed_size) == SLZ4_SUCCESS);
+        SLZ4_TEST(decompressed_size == size && memcmp(data, decompressed, (size_t) size) == 0);
+        free(ref_frame);
+    #endif
+
+    free(compressed);
+    free(decompressed);
+}
+
+SLZ4_EXPORT void slz4_test_frame(double seconds)
+{
+    enum {MAX_TEST_SIZE = 1 << 24};
+    printf("sLZ4 Testing frame format\n");
+
+    //Known answers
+    SLZ4_TEST(slz4_xxh32("", 0, 0) == 0x02CC5D05);
+    SLZ4_TEST(slz4_xxh32("abc", 3, 0) == 0x32D153FF);
+    const char* text = "Nobody inspects the spammish repetition";
+    SLZ4_XXH32 streamed = {0};
+    slz4_xxh32_init(&streamed, 0);
+    for(size_t i = 0; i < strlen(text); i += 3)
+        slz4_xxh32_update(&streamed, text + i, strlen(text) - i < 3 ? strlen(text) - i : 3);
+    SLZ4_TEST(slz4_xxh32_digest(&streamed) == slz4_xxh32(text, strlen(text), 0));
+    
+    //Produced by the lz4 command line utility: printf 'Hello world! Hello world! Hello world!' | lz4 -c
+    const uint8_t cli_frame[] = {
+        0x04, 0x22, 0x4d, 0x18, 0x64, 0x40, 0xa7, 0x17, 0x00, 0x00, 0x00, 0xdf, 0x48, 0x65, 0x6c, 0x6c,
+        0x6f, 0x20, 0x77, 0x6f, 0x72, 0x6c, 0x64, 0x21, 0x20, 0x0d, 0x00, 0x01, 0x50, 0x6f, 0x72, 0x6c,
+        0x64, 0x21, 0x00, 0x00, 0x00, 0x00, 0x50, 0xf6, 0xc4, 0x9e,
+    };
+    const char* cli_content = "Hello world! Hello world! Hello world!";
+    char cli_decompressed[64] = {0};
+    int cli_size = 0;
+    SLZ4_TEST(_slz4_test_frame_decompress(cli_frame, sizeof cli_frame, (uint8_t*) cli_decompressed, sizeof cli_decompressed, 8, &cli_size) == SLZ4_SUCCESS);
+    SLZ4_TEST(cli_size == (int) strlen(cli_content) && memcmp(cli_decompressed, cli_content, strlen(cli_content)) == 0);
+
+    //We produce the exact same empty frame as the utility
+    const uint8_t cli_empty_frame[] = {0x04, 0x22, 0x4d, 0x18, 0x64, 0x40, 0xa7, 0x00, 0x00, 0x00, 0x00, 0x05, 0x5d, 0xcc, 0x02};
+    SLZ4_Frame_Options cli_options = {0};
+    cli_options.block_size = SLZ4_BLOCK_SIZE_64KB;
+    cli_options.content_checksum = true;
+    int empty_size = 0;
+    uint8_t* empty = _slz4_test_frame_compress("", 0, &cli_options, 1, &empty_size);
+    SLZ4_TEST(empty_size == sizeof cli_empty_frame && memcmp(empty, cli_empty_frame, sizeof cli_empty_frame) == 0);
+    free(empty);
+
+    char* testing_buffer = (char*) malloc(MAX_TEST_SIZE);
+    SLZ4_TEST(testing_buffer != NULL);
+    _slz4_test_get_rotated_text(testing_buffer, MAX_TEST_SIZE);
+
+    //Linked compression can reference the history. It must decompress with the same history.
+    {
+        enum {PREFIX = 100000, SIZE = 50000};
+        char* decompressed = (char*) malloc(PREFIX + SIZE);
+        int capacity = slz4_compressed_size_upper_bound(SIZE);
+        char* compressed = (char*) malloc((size_t) capacity);
+        int prefixed_size = slz4_compress_prefixed(compressed, capacity, testing_buffer + PREFIX, SIZE, PREFIX, NULL);
+        int plain_size = slz4_compress(NULL, 0, testing_buffer + PREFIX, SIZE, NULL);
+        SLZ4_TEST(0 < prefixed_size && prefixed_size <= plain_size);
+
+        memcpy(decompressed, testing_buffer, PREFIX);
+        SLZ4_TEST(slz4_decompress_prefixed(NULL, 0, compressed, prefixed_size, PREFIX, NULL) == SIZE);
+        SLZ4_TEST(slz4_decompress_prefixed(decompressed + PREFIX, SIZE, compressed, prefixed_size, PREFIX, NULL) == SIZE);
+        SLZ4_TEST(memcmp(decompressed, testing_buffer, PREFIX + SIZE) == 0);
+
+        free(compressed);
+        free(decompressed);
+    }
+
+    //All option combinations on small and large sizes with random splits of the input and output
+    double start = _slz4_now();
+    for(int i = 0; i == 0 || _slz4_now() < start + seconds/2; i++)
+    {
+        for(int option_bits = 0; option_bits < 8; option_bits++)
+        {
+            SLZ4_Frame_Options options = {0};
+            options.block_size = (SLZ4_Block_Size) (i % 5 == 0 ? 0 : i % 5 + 3);
+            options.linked_blocks = option_bits & 1;
+            options.block_checksum = option_bits & 2;
+            options.content_checksum = option_bits & 4;
+
+            int size = i == 0 ? option_bits*1000 : rand() % (i % 3 == 0 ? MAX_TEST_SIZE : 300000);
+            bool store_size = rand() % 2;
+            int chunk_max = rand() % 2 ? 64 : 1 << (rand() % 22 + 1);
+            options.content_size = store_size ? (uint64_t) (size - size/2) : 0;
+            _slz4_test_frame_roundtrip(testing_buffer + rand() % 1000, size - size/2, &options, chunk_max);
+
+            //Random data is stored uncompressed
+            for(int k = 0; k < size/2; k++)
+                testing_buffer[MAX_TEST_SIZE - k - 1] = (char) rand();
+            options.content_size = store_size ? (uint64_t) (size/2) : 0;
+            _slz4_test_frame_roundtrip(testing_buffer + MAX_TEST_SIZE - size/2, size/2, &options, chunk_max);
+        }
+    }
+
+    //Concatenated frames with skippable frames in between decompress into concatenated content
+    {
+        SLZ4_Frame_Options options = {0};
+        options.block_size = SLZ4_BLOCK_SIZE_64KB;
+        options.linked_blocks = true;
+        int a_size = 0, b_size = 0;
+        uint8_t* a = _slz4_test_frame_compress(testing_buffer, 200000, &options, 4096, &a_size);
+        options.block_size = SLZ4_BLOCK_SIZE_1MB;
+        uint8_t* b = _slz4_test_frame_compress(testing_buffer + 200000, 300000, &options, 4096, &b_size);
+        uint8_t skippable[8 + 5] = {0x53, 0x2A, 0x4D, 0x18, 5, 0, 0, 0, 1, 2, 3, 4, 5};
+
+        int joined_size = a_size + (int) sizeof skippable + b_size;
+        uint8_t* joined = (uint8_t*) malloc((size_t) joined_size);
+        memcpy(joined, a, (size_t) a_size);
+        memcpy(joined + a_size, skippable, sizeof skippable);
+        memcpy(joined + a_size + sizeof skippable, b, (size_t) b_size);
+
+        uint8_t* decompressed = (uint8_t*) malloc(500000);
+        int decompressed_size = 0;
+        SLZ4_TEST(_slz4_test_frame_decompress(joined, joined_size, decompressed, 500000, 1000, &decompressed_size) == SLZ4_SUCCESS);
+        SLZ4_TEST(decompressed_size == 500000 && memcmp(decompressed, testing_buffer, 500000) == 0);
+
+        //Truncated stream is detected
+        SLZ4_TEST(_slz4_test_frame_decompress(joined, joined_size - 1, decompressed, 500000, 1000, &decompressed_size) == SLZ4_ERROR_INPUT_TOO_SMALL);
+        SLZ4_TEST(_slz4_test_frame_decompress(joined, a_size + 3, decompressed, 500000, 1000, &decompressed_size) == SLZ4_ERROR_INPUT_TOO_SMALL);
+
+        //Not retrieving all output is detected
+        SLZ4_TEST(_slz4_test_frame_decompress(joined, joined_size, decompressed, 400000, 1000, &decompressed_size) == SLZ4_ERROR_OUTPUT_TOO_SMALL);
+        
+        free(a);
+        free(b);
+        free(joined);
+        free(decompressed);
+    }
+
+    //Corrupted frames with checksums must never decompress successfully
+    {
+        SLZ4_Frame_Options options = {0};
+        options.block_size = SLZ4_BLOCK_SIZE_64KB;
+        options.linked_blocks = true;
+        options.block_checksum = true;
+        options.content_checksum = true;
+        int frame_size = 0;
+        uint8_t* frame = _slz4_test_frame_compress(testing_buffer, 300000, &options, 300000, &frame_size);
+        uint8_t* decompressed = (uint8_t*) malloc(300000);
+        start = _slz4_now();
+        for(int i = 0; i == 0 || _slz4_now() < start + seconds/4; i++)
+        {
+            //Skip the frame descriptor as its checksum is only 8 bits
+            int index = 7 + rand() % (frame_size - 7);
+            uint8_t corrupt_by = (uint8_t) (rand() % 255 + 1);
+            frame[index] = (uint8_t) (frame[index] + corrupt_by);
+
+            int decompressed_size = 0;
+            SLZ4_Status status = _slz4_test_frame_decompress(frame, frame_size, decompressed, 300000, 100000, &decompressed_size);
+            SLZ4_TEST(status != SLZ4_SUCCESS);
+            frame[index] = (uint8_t) (frame[index] - corrupt_by);
+        }
+        free(frame);
+        free(decompressed);
+    }
+
+    free(testing_buffer);
+}
+
+SLZ4_EXPORT void slz4_test_parallel(double seconds)
+{
+    enum {MAX_TEST_SIZE = 1 << 24};
+    printf("sLZ4 Testing parallel frame compression\n");
+    char* testing_buffer = (char*) malloc(MAX_TEST_SIZE);
+    SLZ4_TEST(testing_buffer != NULL);
+    _slz4_test_get_rotated_text(testing_buffer, MAX_TEST_SIZE);
+    for(int k = MAX_TEST_SIZE/2; k < MAX_TEST_SIZE/2 + MAX_TEST_SIZE/8; k++)
+        testing_buffer[k] = (char) rand();
+
+    double start = _slz4_now();
+    for(int i = 0; i == 0 || _slz4_now() < start + seconds; i++)
+    {
+        SLZ4_Frame_Options options = {0};
+        options.block_size = (SLZ4_Block_Size) (i % 5 == 0 ? 0 : i % 5 + 3);
+        options.block_checksum = rand() % 2;
+        options.content_checksum = rand() % 2;
+        
+        int size = i == 0 ? 0 : rand() % (i % 4 == 0 ? MAX_TEST_SIZE : 1000000);
+        int offset = rand() % (MAX_TEST_SIZE - size + 1);
+        int thread_count = i % 9;
+        options.content_size = rand() % 2 ? (uint64_t) size : 0;
+
+        //The output is exactly the same as from the streaming interface
+        int streamed_size = 0;
+        uint8_t* streamed = _slz4_test_frame_compress(testing_buffer + offset, size, &options, size + 1, &streamed_size);
+
+        int64_t capacity = slz4_frame_compressed_size_upper_bound(size, &options);
+        uint8_t* compressed = (uint8_t*) malloc((size_t) capacity);
+        SLZ4_TEST(slz4_frame_compress_parallel(compressed, capacity - 1, testing_buffer + offset, size, &options, NULL, thread_count) == SLZ4_ERROR_OUTPUT_TOO_SMALL);
+        int64_t compressed_size = slz4_frame_compress_parallel(compressed, capacity, testing_buffer + offset, size, &options, NULL, thread_count);
+        SLZ4_TEST(compressed_size == streamed_size && memcmp(compressed, streamed, (size_t) streamed_size) == 0);
+
+        uint8_t* decompressed = (uint8_t*) malloc((size_t) size + 1);
+        SLZ4_Decompress_State state = {0};
+        SLZ4_TEST(slz4_frame_decompress_parallel(decompressed, size, compressed, compressed_size, &state, thread_count) == size);
+        SLZ4_TEST(state.status == SLZ4_SUCCESS && memcmp(decompressed, testing_buffer + offset, (size_t) size) == 0);
+        
+        //Errors are reported by the sequential fallback
+        if(size > 0)
+        {
+            SLZ4_TEST(slz4_frame_decompress_parallel(decompressed, size - 1, compressed, compressed_size, &state, thread_count) == SLZ4_ERROR_OUTPUT_TOO_SMALL);
+            SLZ4_TEST(state.status == SLZ4_ERROR_OUTPUT_TOO_SMALL && strlen(state.error_message) > 0);
+            SLZ4_TEST(slz4_frame_decompress_parallel(decompressed, size, compressed, compressed_size - 1, &state, thread_count) == SLZ4_ERROR_INPUT_TOO_SMALL);
+            
+            int64_t corrupt_at = compressed_size/2;
+            compressed[corrupt_at] ^= 0x10;
+            int64_t corrupted_size = slz4_frame_decompress_parallel(decompressed, size, compressed, compressed_size, &state, thread_count);
+            SLZ4_TEST(corrupted_size < 0 || options.block_checksum == false || options.content_checksum == false);
+            compressed[corrupt_at] ^= 0x10;
+        }
+
+        //Linked frames are decompressed sequentially
+        options.linked_blocks = true;
+        int linked_size = 0;
+        uint8_t* linked = _slz4_test_frame_compress(testing_buffer + offset, size, &options, size + 1, &linked_size);
+        memset(decompressed, 0, (size_t) size);
+        SLZ4_TEST(slz4_frame_decompress_parallel(decompressed, size, linked, linked_size, NULL, thread_count) == size);
+        SLZ4_TEST(memcmp(decompressed, testing_buffer + offset, (size_t) size) == 0);
+        
+        free(linked);
+        free(streamed);
+        free(compressed);
+        free(decompressed);
+    }
+
+    //Blocks smaller than the block size are valid. The parallel decompression cannot know where 
+    // to put them so it has to fall back to sequential.
+    {
+        SLZ4_Frame_Options options = {0};
+        options.block_size = SLZ4_BLOCK_SIZE_64KB;
+        options.content_checksum = true;
+        uint8_t frame[SLZ4_FRAME_MAX_HEADER_SIZE + 3*(4 + 100) + 8] = {0};
+        int frame_size = _slz4_frame_write_header(&options, frame);
+        for(int i = 0; i < 3; i++)
+        {
+            _slz4_write32(frame + frame_size, 100 | _SLZ4_BLOCK_UNCOMPRESSED);
+            memcpy(frame + frame_size + 4, testing_buffer + i*100, 100);
+            frame_size += 4 + 100;
+        }
+        _slz4_write32(frame + frame_size, 0);
+        _slz4_write32(frame + frame_size + 4, slz4_xxh32(testing_buffer, 300, 0));
+        frame_size += 8;
+
+        char decompressed[300] = {0};
+        SLZ4_TEST(slz4_frame_decompress_parallel(decompressed, sizeof decompressed, frame, frame_size, NULL, 3) == 300);
+        SLZ4_TEST(memcmp(decompressed, testing_buffer, 300) == 0);
+    }
+
+    free(testing_buffer);
+}
+
+SLZ4_INTERNAL void _slz4_test_fast_roundtrip(const char* data, int size, int prefix_size, int acceleration)
+{
+    SLZ4_Compress_State state = {0};
+    state.hash_size_exponent = 12;
+    state.acceleration = acceleration;
+    
+    int compressed_capacity = slz4_compress_prefixed(NULL, 0, data + prefix_size, size, prefix_size, &state);
+    SLZ4_TEST(compressed_capacity > 0);
+    char* compressed = (char*) malloc((size_t) compressed_capacity);
+    int compressed_size = slz4_compress_prefixed(compressed, compressed_capacity, data + prefix_size, size, prefix_size, &state);
+    SLZ4_TEST(0 < compressed_size && compressed_size <= compressed_capacity && compressed_size <= slz4_compressed_size_upper_bound(size));
+    
+    //Fails cleanly when the output is too small. Writes only within the given size.
+    char* too_small = (char*) malloc((size_t) compressed_size);
+    SLZ4_TEST(slz4_compress_prefixed(too_small, compressed_size - 1, data + prefix_size, size, prefix_size, &state) == SLZ4_ERROR_OUTPUT_TOO_SMALL);
+    free(too_small);
+
+    //The prefix is copied so that the decompressor cannot cheat by looking at the original data
+    char* decompressed = (char*) malloc((size_t) (prefix_size + size + 1));
+    memcpy(decompressed, data, (size_t) prefix_size);
+    int decompressed_size = slz4_decompress_prefixed(decompressed + prefix_size, size, compressed, compressed_size, prefix_size, NULL);
+    SLZ4_TEST(decompressed_size == size && memcmp(decompressed + prefix_size, data + prefix_size, (size_t) size) == 0);
+
+    #ifdef SLZ4_TEST_AGAINST_REFERENCE_IMPL
+        if(prefix_size == 0)
+        {
+            memset(decompressed, 0, (size_t) size);
+            SLZ4_TEST(LZ4_decompress_safe(compressed, decompressed, compressed_size, size + 1) == size);
+            SLZ4_TEST(memcmp(decompressed, data, (size_t) size) == 0);
+        }
+    #endif
+
+    free(compressed);
+    free(decompressed);
+}
+
+SLZ4_EXPORT void slz4_test_fast(double seconds)
+{
+    enum {
+        MAX_TEST_SIZE = 1 << 22,
+        DETAILED_TESTING = 256,
+    };
+    char* testing_buffer = (char*) malloc(MAX_TEST_SIZE);
+    SLZ4_TEST(testing_buffer != NULL);
+    int accelerations[] = {1, 2, 7, 1000};
+    
+    printf("sLZ4 Testing fast compression on runs, text and random data\n");
+    double start = _slz4_now();
+    for(int i = 0; i == 0 || _slz4_now() < start + seconds/2; i++)
+    {
+        //Runs, text, random data and text interrupted by random data
+        int kind = i % 4;
+        if(kind == 0)
+            memset(testing_buffer, 'x', MAX_TEST_SIZE);
+        else
+            _slz4_test_get_rotated_text(testing_buffer, MAX_TEST_SIZE);
+        
+        if(kind == 2)
+            for(int j = 0; j < MAX_TEST_SIZE; j++)
+                testing_buffer[j] = (char) rand();
+        if(kind == 3)
+            for(int j = rand() % 1000; j < MAX_TEST_SIZE; j += rand() % 1000)
+                testing_buffer[j] = (char) rand();
+
+        int acceleration = accelerations[i/4 % 4];
+        for(int size = 0; size < DETAILED_TESTING; size++)
+            _slz4_test_fast_roundtrip(testing_buffer, size, 0, acceleration);
+        for(int size = DETAILED_TESTING; size <= MAX_TEST_SIZE; size *= 2)
+            _slz4_test_fast_roundtrip(testing_buffer, size - rand() % 16, 0, acceleration);
+        
+        //Prefixes of all sorts of sizes, also bigger than the window
+        for(int k = 0; k < 16; k++)
+        {
+            int prefix_size = rand() % (k < 8 ? 1000 : 200000);
+            int size = rand() % (MAX_TEST_SIZE - prefix_size);
+            _slz4_test_fast_roundtrip(testing_buffer, size % 4 ? size % 1000 : size, prefix_size, acceleration);
+        }
+    }
+
+    //Fast compression plugs into the frame format 
+    printf("sLZ4 Testing fast compression of frames\n");
+    _slz4_test_get_rotated_text(testing_buffer, MAX_TEST_SIZE);
+    start = _slz4_now();
+    for(int i = 0; i == 0 || _slz4_now() < start + seconds/2; i++)
+    {
+        SLZ4_Compress_State state = {0};
+        state.hash_size_exponent = 10 + i % 6;
+        state.bucket_size_exponent = 2;
+        state.acceleration = accelerations[i % 4];
+        
+        SLZ4_Frame_Options options = {0};
+        options.block_size = (SLZ4_Block_Size) (i % 5 == 0 ? 0 : i % 5 + 3);
+        options.linked_blocks = rand() % 2;
+        options.content_checksum = true;
+
+        int size = rand() % MAX_TEST_SIZE;
+        int thread_count = i % 3;
+        int64_t capacity = slz4_frame_compressed_size_upper_bound(size, &options);
+        SLZ4_Frame_Compress frame = {0};
+        SLZ4_TEST(slz4_frame_compress_init(&frame, &options, &state) == SLZ4_SUCCESS);
+        if(options.linked_blocks)
+            capacity = (int64_t) slz4_frame_compress_bound(&frame, size) + slz4_frame_compress_bound(&frame, 0);
+
+        uint8_t* compressed = (uint8_t*) malloc((size_t) capacity);
+        uint8_t* decompressed = (uint8_t*) malloc((size_t) size + 1);
+        SLZ4_TEST(compressed != NULL && decompressed != NULL);
+        
+        int64_t compressed_size = 0;
+        if(options.linked_blocks)
+        {
+            int written = slz4_frame_compress_update(&frame, compressed, (int) capacity, testing_buffer, size);
+            SLZ4_TEST(written >= 0);
+            int ended = slz4_frame_compress_end(&frame, compressed + written, (int) capacity - written);
+            SLZ4_TEST(ended >= 0);
+            compressed_size = written + ended;
+        }
+        else
+        {
+            slz4_frame_compress_end(&frame, NULL, 0);
+            compressed_size = slz4_frame_compress_parallel(compressed, capacity, testing_buffer, size, &options, &state, thread_count);
+        }
+
+        SLZ4_TEST(compressed_size > 0);
+        SLZ4_TEST(slz4_frame_decompress_parallel(decompressed, size, compressed, compressed_size, NULL, thread_count) == size);
+        SLZ4_TEST(memcmp(decompressed, testing_buffer, (size_t) size) == 0);
+
+        free(compressed);
+        free(decompressed);
+    }
+
+    free(testing_buffer);
+}
+
+//Compares the compression ratio and speed of the greedy and the fast compressors
+// and the speed of frame compression/decompression on different thread counts. 
+// Uses the file at path_or_null or the one given by SLZ4_BENCHMARK_FILE environment variable.
+// The standard file to test on is enwik8 (http://mattmahoney.net/dc/enwik8.zip). 
+// When no file is given or it cannot be read uses generated text instead.
+SLZ4_EXPORT void slz4_benchmark(const char* path_or_null)
 {
-    static bool first_time_init = false;
-    static clock_t first_time = 0;
-    if(first_time_init == false)
+    enum {BLOCK_SIZE = 4 << 20, FALLBACK_SIZE = 1 << 24};
+    const char* path = path_or_null ? path_or_null : getenv("SLZ4_BENCHMARK_FILE");
+    
+    char* data = NULL;
+    int64_t data_size = 0;
+    FILE* file = path ? fopen(path, "rb") : NULL;
+    if(file)
+    {
+        fseek(file, 0, SEEK_END);
+        data_size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        data = (char*) malloc((size_t) data_size + 1);
+        if(data == NULL || fread(data, 1, (size_t) data_size, file) != (size_t) data_size)
+            data_size = 0;
+        fclose(file);
+    }
+    
+    if(data_size <= 0)
+    {
+        path = "generated text";
+        data_size = FALLBACK_SIZE;
+        data = (char*) realloc(data, FALLBACK_SIZE);
+        SLZ4_TEST(data != NULL);
+        _slz4_test_get_rotated_text(data, FALLBACK_SIZE);
+    }
+    
+    int capacity = slz4_compressed_size_upper_bound(BLOCK_SIZE);
+    char* compressed = (char*) malloc((size_t) capacity);
+    char* decompressed = (char*) malloc(BLOCK_SIZE);
+    SLZ4_TEST(compressed != NULL && decompressed != NULL);
+
+    //The data is compressed in independent blocks (as in the frame format) 
+    printf("sLZ4 Benchmark on %s of size %.2lfMB\n", path, data_size/1e6);
+    int accelerations[] = {0, 1, 2, 8};
+    for(int k = 0; k < 4; k++)
+    {
+        SLZ4_Compress_State state = {0};
+        state.hash_size_exponent = 12;
+        state.bucket_size_exponent = 2;
+        state.acceleration = accelerations[k];
+
+        int64_t compressed_total = 0;
+        double compress_time = 0;
+        double decompress_time = 0;
+        for(int64_t offset = 0; offset < data_size; offset += BLOCK_SIZE)
+        {
+            int size = data_size - offset < BLOCK_SIZE ? (int) (data_size - offset) : BLOCK_SIZE;
+            double before = _slz4_now();
+            int compressed_size = slz4_compress(compressed, capacity, data + offset, size, &state);
+            double middle = _slz4_now();
+            int decompressed_size = slz4_decompress(decompressed, BLOCK_SIZE, compressed, compressed_size, NULL);
+            double after = _slz4_now();
+            
+            SLZ4_TEST(compressed_size > 0 && decompressed_size == size);
+            SLZ4_TEST(memcmp(decompressed, data + offset, (size_t) size) == 0);
+            compressed_total += compressed_size;
+            compress_time += middle - before;
+            decompress_time += after - middle;
+        }
+
+        printf("sLZ4 Benchmark %-10s acceleration %i: ratio %.3lf compression %.0lfMB/s decompression %.0lfMB/s\n", 
+            k == 0 ? "greedy" : "fast", accelerations[k], (double) data_size/compressed_total, 
+            data_size/compress_time/1e6, data_size/decompress_time/1e6);
+    }
+
+    //Frames are compressed and decompressed block-parallel
+    int64_t frame_capacity = slz4_frame_compressed_size_upper_bound(data_size, NULL);
+    uint8_t* frame = (uint8_t*) malloc((size_t) frame_capacity);
+    char* frame_decompressed = (char*) malloc((size_t) data_size);
+    SLZ4_TEST(frame != NULL && frame_decompressed != NULL);
+    for(int thread_count = 1; thread_count <= 8; thread_count *= 2)
     {
-        first_time = clock();
-        first_time_init = true;
+        double before = _slz4_now();
+        int64_t frame_size = slz4_frame_compress_parallel(frame, frame_capacity, data, data_size, NULL, NULL, thread_count);
+        double middle = _slz4_now();
+        int64_t frame_decompressed_size = slz4_frame_decompress_parallel(frame_decompressed, data_size, frame, frame_size, NULL, thread_count);
+        double after = _slz4_now();
+
+        SLZ4_TEST(frame_size > 0 && frame_decompressed_size == data_size);
+        SLZ4_TEST(memcmp(frame_decompressed, data, (size_t) data_size) == 0);
+        printf("sLZ4 Benchmark frame on %i threads: compression %.0lfMB/s decompression %.0lfMB/s\n", 
+            thread_count, data_size/(middle - before)/1e6, data_size/(after - middle)/1e6);
     }
 
-    double now = (double) (clock() - first_time) / CLOCKS_PER_SEC;
-    return now;
+    free(frame);
+    free(frame_decompressed);
+
+    free(data);
+    free(compressed);
+    free(decompressed);
+}
+
+//Wall clock time in seconds. clock() would measure cpu time of the whole process
+// which does not go down when work is split among threads.
+SLZ4_INTERNAL double _slz4_now()
+{
+    #ifdef _WIN32
+        LARGE_INTEGER counter = {0};
+        LARGE_INTEGER frequency = {0};
+        QueryPerformanceCounter(&counter);
+        QueryPerformanceFrequency(&frequency);
+        return (double) counter.QuadPart / (double) frequency.QuadPart;
+    #else
+        struct timespec ts = {0};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double) ts.tv_sec + (double) ts.tv_nsec*1e-9;
+    #endif
 }
 
 SLZ4_INTERNAL void _slz4_test_get_rotated_text(char* into, int size)
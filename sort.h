@@ -480,7 +480,8 @@ SORT_API isize lower_bound_no_fail(const void* search_for, const void* sorted_it
 #endif
 
 //================== TESTS =======================
-#if defined(MODULE_TEST_SORT) || defined(MODULE_ALL_TEST) 
+#if (defined(MODULE_TEST_SORT) || defined(MODULE_ALL_TEST)) && !defined(MODULE_SORT_HAS_TEST)
+#define MODULE_SORT_HAS_TEST
     static bool _sort_test_i32_less(const void* a, const void* b, void* context)
     {
         (void) context;
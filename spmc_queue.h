@@ -15,6 +15,16 @@
 // while the pop has both st and non-st variant. The st. variant runs a bit faster because
 // it doesnt have to use any synchronization with other popping threads, thus should be 
 // used when we are only dealing with SPSC situation.
+//
+// When the queue grows the old block is retired and freed once no consumer can still be reading it.
+// This is done using a simple epoch based scheme: consumers announce themselves by incrementing
+// a counter for the current epoch parity right before loading the block and decrement it right after
+// copying the item out. The counters are striped across SPMC_QUEUE_READER_SLOTS cache lines by thread 
+// so a pop only touches a mostly private cache line. The producer advances the epoch only once 
+// all readers from the previous epoch have left, thus a block retired in epoch e can be freed once
+// the epoch gets advanced past e + 1. Reclamation is attempted by the producer when it refreshes its
+// top estimate (so roughly once per capacity pushes) or explicitly through spmc_queue_reclaim().
+// Optionally the queue also shrinks itself after sustained low occupancy, see spmc_queue_set_shrink().
 
 #if defined(_MSC_VER)
     #define SPMC_QUEUE_INLINE_ALWAYS   __forceinline
@@ -41,20 +51,38 @@
 #ifdef __cplusplus
     #include <atomic>
     #define SPMC_QUEUE_ATOMIC(T)    std::atomic<T>
+    #define SPMC_QUEUE_THREAD_LOCAL thread_local
 #else
     #include <stdatomic.h>
     #include <stdalign.h>
     #define SPMC_QUEUE_ATOMIC(T)    _Atomic(T) 
+    #if defined(_MSC_VER)
+        #define SPMC_QUEUE_THREAD_LOCAL __declspec(thread)
+    #else
+        #define SPMC_QUEUE_THREAD_LOCAL _Thread_local
+    #endif
+#endif
+
+#ifndef SPMC_QUEUE_READER_SLOTS
+    #define SPMC_QUEUE_READER_SLOTS 16
 #endif
 
 typedef int64_t isize;
 
 typedef struct SPMC_Queue_Block {
-    struct SPMC_Queue_Block* next;
+    struct SPMC_Queue_Block* next; //next retired block
     uint64_t mask; //capacity - 1
+    uint64_t retired_epoch;
+    uint64_t _pad;
     //items here...
 } SPMC_Queue_Block;
 
+typedef struct SPMC_Queue_Reader_Slot {
+    alignas(64)
+    SPMC_QUEUE_ATOMIC(uint64_t) active[2]; //number of readers inside the block for each epoch parity
+    uint64_t _pad[6];
+} SPMC_Queue_Reader_Slot;
+
 typedef struct SPMC_Queue {
     alignas(64)
     SPMC_QUEUE_ATOMIC(uint64_t) top; //changed by pop
@@ -64,18 +92,36 @@ typedef struct SPMC_Queue {
     alignas(64)
     SPMC_QUEUE_ATOMIC(uint64_t) bot; //changed by push
     uint64_t estimate_top;
-    uint64_t _pad2[6];
+    SPMC_Queue_Block* retired; //only touched by push
+    uint64_t low_occupancy_checks; 
+    uint64_t _pad2[4];
 
     alignas(64)
     SPMC_QUEUE_ATOMIC(SPMC_Queue_Block*) block;
     SPMC_QUEUE_ATOMIC(uint32_t) item_size;
     SPMC_QUEUE_ATOMIC(uint32_t) max_capacity_log2; //0 means max capacity off!
-    uint64_t _pad3[6];
+    SPMC_QUEUE_ATOMIC(uint64_t) epoch; //changed by push
+    uint32_t shrink_after; //0 means shrinking off!
+    uint32_t _pad3[9];
+
+    SPMC_Queue_Reader_Slot readers[SPMC_QUEUE_READER_SLOTS];
 } SPMC_Queue;
 
 SPMC_QUEUE_API void spmc_queue_deinit(SPMC_Queue* queue);
 SPMC_QUEUE_API void spmc_queue_init(SPMC_Queue* queue, isize item_size, isize max_capacity_or_negative_if_infinite);
 SPMC_QUEUE_API void spmc_queue_reserve(SPMC_Queue* queue, isize to_size);
+
+//Frees all retired blocks which can no longer be read by any consumer. Returns the number of freed blocks.
+// Can only be called from the producer thread. Is called automatically from push once in a while.
+SPMC_QUEUE_API isize spmc_queue_reclaim(SPMC_Queue* queue);
+//Shrinks the queue to the smallest power of two capacity able to hold both to_size and the current items (but at least 64). 
+// Can only be called from the producer thread. The old block is retired.
+SPMC_QUEUE_API void spmc_queue_shrink(SPMC_Queue* queue, isize to_size);
+//Makes push halve the capacity once the queue was found to be at most quarter full 
+// after_checks times in a row. A check happens every time the producer refreshes its top estimate 
+// (that is roughly once per capacity pushes). Passing 0 turns shrinking off (default).
+SPMC_QUEUE_API void spmc_queue_set_shrink(SPMC_Queue* queue, isize after_checks);
+SPMC_QUEUE_API isize spmc_queue_retired_count(const SPMC_Queue* queue);
 SPMC_QUEUE_API_INLINE bool spmc_queue_push_st(SPMC_Queue *q, const void* item, isize item_size);
 SPMC_QUEUE_API_INLINE bool spmc_queue_pop_st(SPMC_Queue *q, void* item, isize item_size);
 SPMC_QUEUE_API_INLINE bool spmc_queue_pop(SPMC_Queue *q, void* item, isize item_size);
@@ -103,6 +149,15 @@ SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_push_st(SPMC_Queue *q,
 SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop_st(SPMC_Queue *q, void* item, isize item_size);
 SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop(SPMC_Queue *q, void* item, isize item_size);
 SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop_weak(SPMC_Queue *q, void* item, isize item_size);
+
+//Bulk pop interface - claims up to max_count items with a single CAS on top and copies them into items.
+// Returns the number of popped items. This is meant for work stealing where a thief wants to
+// take over big chunk of the work at once instead of paying one CAS (and one contended cache line) per item.
+// The *_half variant takes half (rounded up) of the items currently in the queue but at most max_count.
+SPMC_QUEUE_API_INLINE isize spmc_queue_pop_many(SPMC_Queue *q, void* items, isize max_count, isize item_size);
+SPMC_QUEUE_API_INLINE isize spmc_queue_pop_half(SPMC_Queue *q, void* items, isize max_count, isize item_size);
+SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop_many_weak(SPMC_Queue *q, void* items, isize max_count, bool half, isize* popped_count, isize item_size);
+SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop_many(SPMC_Queue *q, void* items, isize max_count, bool half, isize* popped_count, isize item_size);
 #endif
 
 #if (defined(MODULE_ALL_IMPL) || defined(MODULE_SPMC_QUEUE_IMPL)) && !defined(MODULE_SPMC_QUEUE_HAS_IMPL)
@@ -130,12 +185,13 @@ SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop_weak(SPMC_Queue *q
 
 SPMC_QUEUE_API void spmc_queue_deinit(SPMC_Queue* queue)
 {
-    for(SPMC_Queue_Block* curr = queue->block; curr; )
+    for(SPMC_Queue_Block* curr = queue->retired; curr; )
     {
         SPMC_Queue_Block* next = curr->next;
         free(curr);
         curr = next;
     }
+    free(queue->block);
     memset(queue, 0, sizeof *queue);
     atomic_store(&queue->block, NULL);
 }
@@ -162,13 +218,111 @@ SPMC_QUEUE_API_INLINE void* _spmc_queue_slot(SPMC_Queue_Block* block, uint64_t i
     return data + mapped*item_size;
 }
 
+SPMC_QUEUE_API_INLINE SPMC_QUEUE_ATOMIC(uint64_t)* _spmc_queue_read_begin(SPMC_Queue* queue)
+{
+    _SPMC_QUEUE_USE_ATOMICS;
+    static SPMC_QUEUE_THREAD_LOCAL uint32_t slot_plus_one = 0;
+    if(slot_plus_one == 0)
+    {
+        static SPMC_QUEUE_ATOMIC(uint32_t) slot_counter = 0;
+        slot_plus_one = atomic_fetch_add_explicit(&slot_counter, 1, memory_order_relaxed) % SPMC_QUEUE_READER_SLOTS + 1;
+    }
+
+    //The epoch can be arbitrarily stale here, we only use it to pick a parity. 
+    // What matters is that the increment is ordered before the load of the block.
+    uint64_t epoch = atomic_load_explicit(&queue->epoch, memory_order_relaxed);
+    SPMC_QUEUE_ATOMIC(uint64_t)* active = &queue->readers[slot_plus_one - 1].active[epoch & 1];
+    atomic_fetch_add_explicit(active, 1, memory_order_seq_cst);
+    return active;
+}
+
+SPMC_QUEUE_API_INLINE void _spmc_queue_read_end(SPMC_QUEUE_ATOMIC(uint64_t)* active)
+{
+    _SPMC_QUEUE_USE_ATOMICS;
+    atomic_fetch_sub_explicit(active, 1, memory_order_release);
+}
+
+SPMC_QUEUE_API isize spmc_queue_reclaim(SPMC_Queue* queue)
+{
+    _SPMC_QUEUE_USE_ATOMICS;
+    isize freed = 0;
+    
+    //Two advances are needed before blocks retired in the current epoch can be freed
+    for(int advance = 0; advance < 2 && queue->retired; advance++)
+    {
+        //Readers which entered in the epoch before the current one use the opposite parity 
+        // to the current epoch. If there are none left we can advance. 
+        uint64_t epoch = atomic_load_explicit(&queue->epoch, memory_order_relaxed);
+        for(isize i = 0; i < SPMC_QUEUE_READER_SLOTS; i++)
+            if(atomic_load_explicit(&queue->readers[i].active[(epoch + 1) & 1], memory_order_seq_cst) != 0)
+                return freed;
+        
+        atomic_store_explicit(&queue->epoch, epoch + 1, memory_order_seq_cst);
+
+        //blocks retired before the current epoch cannot be reached by anyone anymore
+        for(SPMC_Queue_Block** curr = &queue->retired; *curr; )
+        {
+            SPMC_Queue_Block* block = *curr;
+            if((int64_t) (block->retired_epoch - epoch) < 0)
+            {
+                *curr = block->next;
+                free(block);
+                freed += 1;
+            }
+            else
+                curr = &block->next;
+        }
+    }
+
+    return freed;
+}
+
+SPMC_QUEUE_API isize spmc_queue_retired_count(const SPMC_Queue* queue)
+{
+    isize count = 0;
+    for(SPMC_Queue_Block* curr = queue->retired; curr; curr = curr->next)
+        count += 1;
+    return count;
+}
+
+SPMC_QUEUE_API SPMC_Queue_Block* _spmc_queue_resize(SPMC_Queue* queue, uint64_t new_cap)
+{
+    _SPMC_QUEUE_USE_ATOMICS;
+    SPMC_Queue_Block* old_block = atomic_load(&queue->block);
+    isize item_size = queue->item_size;
+
+    SPMC_Queue_Block* new_block = (SPMC_Queue_Block*) malloc(sizeof(SPMC_Queue_Block) + new_cap*item_size);
+    if(new_block == NULL)
+        return old_block;
+
+    new_block->next = NULL;
+    new_block->mask = new_cap - 1;
+    new_block->retired_epoch = 0;
+    if(old_block)
+    {
+        uint64_t t = atomic_load(&queue->top);
+        uint64_t b = atomic_load(&queue->bot);
+        for(uint64_t i = t; (int64_t) (i - b) < 0; i++) //i < b
+            memcpy(_spmc_queue_slot(new_block, i, item_size), _spmc_queue_slot(old_block, i, item_size), item_size);
+    }
+
+    atomic_store(&queue->block, new_block);
+    if(old_block)
+    {
+        old_block->retired_epoch = atomic_load_explicit(&queue->epoch, memory_order_relaxed);
+        old_block->next = queue->retired;
+        queue->retired = old_block;
+    }
+
+    return new_block;
+}
+
 SPMC_QUEUE_INLINE_NEVER
 SPMC_QUEUE_API SPMC_Queue_Block* _spmc_queue_reserve(SPMC_Queue* queue, isize to_size)
 {
     SPMC_Queue_Block* old_block = atomic_load(&queue->block);
     SPMC_Queue_Block* out_block = old_block;
     isize old_cap = old_block ? (isize) (old_block->mask + 1) : 0;
-    isize item_size = queue->item_size;
     isize max_capacity = queue->max_capacity_log2 > 0 
         ? (isize) 1 << (queue->max_capacity_log2 - 1) 
         : INT64_MAX;
@@ -179,24 +333,7 @@ SPMC_QUEUE_API SPMC_Queue_Block* _spmc_queue_reserve(SPMC_Queue* queue, isize to
         while((isize) new_cap < to_size)
             new_cap *= 2;
 
-        SPMC_Queue_Block* new_block = (SPMC_Queue_Block*) malloc(sizeof(SPMC_Queue_Block) + new_cap*item_size);
-        if(new_block)
-        {
-            new_block->next = old_block;
-            new_block->mask = new_cap - 1;
-
-            if(old_block)
-            {
-                uint64_t t = atomic_load(&queue->top);
-                uint64_t b = atomic_load(&queue->bot);
-                for(uint64_t i = t; (int64_t) (i - b) < 0; i++) //i < b
-                    memcpy(_spmc_queue_slot(new_block, i, item_size), _spmc_queue_slot(old_block, i, item_size), item_size);
-            }
-
-            atomic_store(&queue->block, new_block);
-            out_block = new_block;
-        }
-        
+        out_block = _spmc_queue_resize(queue, new_cap);
     }
 
     return out_block;
@@ -207,6 +344,56 @@ SPMC_QUEUE_API void spmc_queue_reserve(SPMC_Queue* queue, isize to_size)
     _spmc_queue_reserve(queue, to_size);
 }
 
+SPMC_QUEUE_API void spmc_queue_shrink(SPMC_Queue* queue, isize to_size)
+{
+    SPMC_Queue_Block* old_block = atomic_load(&queue->block);
+    if(old_block)
+    {
+        isize count = (isize) (atomic_load(&queue->bot) - atomic_load(&queue->top));
+        if(to_size < count)
+            to_size = count;
+
+        uint64_t new_cap = 64;
+        while((isize) new_cap < to_size)
+            new_cap *= 2;
+
+        if(new_cap < old_block->mask + 1)
+            _spmc_queue_resize(queue, new_cap);
+    }
+}
+
+SPMC_QUEUE_API void spmc_queue_set_shrink(SPMC_Queue* queue, isize after_checks)
+{
+    queue->shrink_after = after_checks > 0 ? (uint32_t) after_checks : 0;
+    queue->low_occupancy_checks = 0;
+}
+
+//Called by push whenever it refreshes its top estimate. Returns the current block.
+SPMC_QUEUE_INLINE_NEVER
+SPMC_QUEUE_API SPMC_Queue_Block* _spmc_queue_maintain(SPMC_Queue* queue, uint64_t b, uint64_t t)
+{
+    SPMC_Queue_Block* block = atomic_load(&queue->block);
+    if(queue->shrink_after && block)
+    {
+        uint64_t cap = block->mask + 1;
+        if(cap > 64 && (b - t)*4 <= cap)
+        {
+            if(++queue->low_occupancy_checks >= queue->shrink_after)
+            {
+                queue->low_occupancy_checks = 0;
+                block = _spmc_queue_resize(queue, cap/2);
+            }
+        }
+        else
+            queue->low_occupancy_checks = 0;
+    }
+
+    if(queue->retired)
+        spmc_queue_reclaim(queue);
+
+    return block;
+}
+
 SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_push_st(SPMC_Queue *q, const void* item, isize item_size)
 {
     _SPMC_QUEUE_USE_ATOMICS;
@@ -219,6 +406,9 @@ SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_push_st(SPMC_Queue *q,
     if (a == NULL || (int64_t)(b - t) > (int64_t) a->mask) { 
         t = atomic_load_explicit(&q->top, memory_order_acquire);
         q->estimate_top = t;
+        if (q->retired || q->shrink_after)
+            a = _spmc_queue_maintain(q, b, t);
+
         if (a == NULL || (int64_t)(b - t) > (int64_t) a->mask) { 
             SPMC_Queue_Block* new_a = _spmc_queue_reserve(q, b - t + 1);
             if(new_a == a)
@@ -244,14 +434,14 @@ SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop_st(SPMC_Queue *q,
     _SPMC_QUEUE_USE_ATOMICS;
     ASSERT(atomic_load_explicit(&q->item_size, memory_order_relaxed) == item_size);
     uint64_t t = atomic_load_explicit(&q->top, memory_order_relaxed);
-    uint64_t b = atomic_load_explicit(&q->estimate_bot, memory_order_relaxed);
+    uint64_t b = atomic_load_explicit(&q->estimate_bot, memory_order_acquire);
     
     SPMC_Queue_Result out = {b, t, SPMC_QUEUE_EMPTY};
 
     //if empty reload bot estimate
     if ((int64_t) (b - t) <= 0) {
-        b = atomic_load_explicit(&q->bot, memory_order_relaxed);
-        atomic_store_explicit(&q->estimate_bot, b, memory_order_relaxed);
+        b = atomic_load_explicit(&q->bot, memory_order_acquire);
+        atomic_store_explicit(&q->estimate_bot, b, memory_order_release);
         out.bot = b;
         if ((int64_t) (b - t) <= 0) 
             return out;
@@ -264,10 +454,12 @@ SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop_st(SPMC_Queue *q,
     // If you dont like this you can instead store all of the fields of queue (top, estimate_bot, bot...)
     //  in the block header instead. That way it will be again impossible to get top, bot and old block.
     //  I dont bother with this as I primarily care about x86 and I find the code written like this be easier to read. 
+    SPMC_QUEUE_ATOMIC(uint64_t)* active = _spmc_queue_read_begin(q);
     SPMC_Queue_Block *a = atomic_load_explicit(&q->block, memory_order_seq_cst);
 
     void* slot = _spmc_queue_slot(a, t, item_size);
     memcpy(item, slot, item_size);
+    _spmc_queue_read_end(active);
 
     atomic_store_explicit(&q->top, t + 1, memory_order_relaxed);
     out.state = SPMC_QUEUE_OK;
@@ -280,23 +472,25 @@ SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop_weak(SPMC_Queue *q
     _SPMC_QUEUE_USE_ATOMICS;
     ASSERT(atomic_load_explicit(&q->item_size, memory_order_relaxed) == item_size);
     uint64_t t = atomic_load_explicit(&q->top, memory_order_relaxed);
-    uint64_t b = atomic_load_explicit(&q->estimate_bot, memory_order_relaxed);
+    uint64_t b = atomic_load_explicit(&q->estimate_bot, memory_order_acquire);
     
     SPMC_Queue_Result out = {b, t, SPMC_QUEUE_EMPTY};
 
     //if empty reload bot estimate
     if ((int64_t) (t - b) >= 0) {
-        b = atomic_load_explicit(&q->bot, memory_order_relaxed);
-        atomic_store_explicit(&q->estimate_bot, b, memory_order_relaxed);
+        b = atomic_load_explicit(&q->bot, memory_order_acquire);
+        atomic_store_explicit(&q->estimate_bot, b, memory_order_release);
         out.bot = b;
         if ((int64_t) (t - b) >= 0) 
             return out;
     }
     
+    SPMC_QUEUE_ATOMIC(uint64_t)* active = _spmc_queue_read_begin(q);
     SPMC_Queue_Block *a = atomic_load_explicit(&q->block, memory_order_seq_cst);
 
     void* slot = _spmc_queue_slot(a, t, item_size);
     memcpy(item, slot, item_size);
+    _spmc_queue_read_end(active);
 
     if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
         out.state = SPMC_QUEUE_FAILED_RACE;
@@ -315,6 +509,100 @@ SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop(SPMC_Queue *q, voi
     }
 }
 
+SPMC_QUEUE_API_INLINE void _spmc_queue_copy_out(SPMC_Queue_Block* block, uint64_t from, uint64_t count, void* items, isize item_size)
+{
+    //the range can wrap around the end of the block so copy it in (at most) two pieces
+    uint64_t mapped = from & block->mask;
+    uint64_t first_count = block->mask + 1 - mapped;
+    if(first_count > count)
+        first_count = count;
+
+    uint8_t* data = (uint8_t*) (void*) (block + 1);
+    memcpy(items, data + mapped*item_size, first_count*item_size);
+    memcpy((uint8_t*) items + first_count*item_size, data, (count - first_count)*item_size);
+}
+
+SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop_many_weak(SPMC_Queue *q, void* items, isize max_count, bool half, isize* popped_count, isize item_size)
+{
+    _SPMC_QUEUE_USE_ATOMICS;
+    ASSERT(atomic_load_explicit(&q->item_size, memory_order_relaxed) == item_size);
+    uint64_t t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    uint64_t b = atomic_load_explicit(&q->estimate_bot, memory_order_acquire);
+
+    SPMC_Queue_Result out = {b, t, SPMC_QUEUE_EMPTY};
+    *popped_count = 0;
+    if(max_count <= 0)
+        return out;
+
+    //Since bot only ever grows every estimate is a lower bound for the true bot. 
+    // Thus we can safely take items below the estimate without ever looking at bot.
+    // We only reload it when the estimate is not enough to satisfy the whole request.
+    // This keeps the common case of stealing from a big queue free of reads 
+    // from the producer's cache line, same as spmc_queue_result_pop_weak.
+    int64_t available = (int64_t) (b - t);
+    int64_t count = half ? (available + 1)/2 : available;
+    if (count < max_count) {
+        b = atomic_load_explicit(&q->bot, memory_order_acquire);
+        atomic_store_explicit(&q->estimate_bot, b, memory_order_release);
+        out.bot = b;
+
+        available = (int64_t) (b - t);
+        count = half ? (available + 1)/2 : available;
+    }
+
+    if (count <= 0) 
+        return out;
+    if (count > max_count)
+        count = max_count;
+    
+    //seq cst for the same reason as in spmc_queue_result_pop_st
+    SPMC_QUEUE_ATOMIC(uint64_t)* active = _spmc_queue_read_begin(q);
+    SPMC_Queue_Block *a = atomic_load_explicit(&q->block, memory_order_seq_cst);
+
+    //A stale top together with a fresh bot can describe a range bigger than the block 
+    // (for example after the block shrunk). The CAS below fails in that case anyway
+    // but we must not read past the end of the block while finding out.
+    if ((uint64_t) count > a->mask + 1)
+        count = (int64_t) (a->mask + 1);
+    _spmc_queue_copy_out(a, t, (uint64_t) count, items, item_size);
+    _spmc_queue_read_end(active);
+
+    //The producer cannot overwrite any of the copied slots before top moves past them
+    // so if the CAS succeeds all of the copied items are valid.
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + (uint64_t) count, memory_order_seq_cst, memory_order_relaxed))
+        out.state = SPMC_QUEUE_FAILED_RACE;
+    else
+    {
+        out.state = SPMC_QUEUE_OK;
+        *popped_count = count;
+    }
+
+    return out;
+}
+
+SPMC_QUEUE_API_INLINE SPMC_Queue_Result spmc_queue_result_pop_many(SPMC_Queue *q, void* items, isize max_count, bool half, isize* popped_count, isize item_size)
+{
+    for(;;) {
+        SPMC_Queue_Result result = spmc_queue_result_pop_many_weak(q, items, max_count, half, popped_count, item_size);
+        if(result.state != SPMC_QUEUE_FAILED_RACE)
+            return result;
+    }
+}
+
+SPMC_QUEUE_API_INLINE isize spmc_queue_pop_many(SPMC_Queue *q, void* items, isize max_count, isize item_size)
+{
+    isize popped = 0;
+    spmc_queue_result_pop_many(q, items, max_count, false, &popped, item_size);
+    return popped;
+}
+
+SPMC_QUEUE_API_INLINE isize spmc_queue_pop_half(SPMC_Queue *q, void* items, isize max_count, isize item_size)
+{
+    isize popped = 0;
+    spmc_queue_result_pop_many(q, items, max_count, true, &popped, item_size);
+    return popped;
+}
+
 SPMC_QUEUE_API_INLINE bool spmc_queue_push_st(SPMC_Queue *q, const void* item, isize item_size)
 {
     return spmc_queue_result_push_st(q, item, item_size).state == SPMC_QUEUE_OK;
@@ -1,3 +1,6 @@
+#ifndef MODULE_SYNC
+#define MODULE_SYNC
+
 #include "channel.h"
 
 //TODO SIMPLIFY AND ALSO ISOLATE
@@ -30,11 +33,14 @@
 // This can be used to implement wait groups, semaphores and much more.
 // Alternatively there is also timed version which gives up after certain 
 // amount of time and returns failure (false).
+//wake_single is optional and wakes at most one waiter. Primitives which only need 
+// to wake a single thread use it when provided and fall back to wake otherwise.
 typedef struct Sync_Wait {
     Sync_Wait_Func wait;
     Sync_Wake_Func wake;
     uint32_t notify_bit;
     uint32_t _;
+    Sync_Wake_Func wake_single;
 } Sync_Wait;
 
 #ifdef __cplusplus
@@ -42,10 +48,10 @@ typedef struct Sync_Wait {
 #else
     #define _CHAN_SINIT(T) (T)
 #endif
-#define SYNC_WAIT_BLOCK          _CHAN_SINIT(Sync_Wait){chan_wait_block, chan_wake_block}
+#define SYNC_WAIT_BLOCK          _CHAN_SINIT(Sync_Wait){chan_wait_block, chan_wake_block, 0, 0, chan_wake_block_single}
 #define SYNC_WAIT_YIELD          _CHAN_SINIT(Sync_Wait){chan_wait_yield}
 #define SYNC_WAIT_SPIN           _CHAN_SINIT(Sync_Wait){}
-#define SYNC_WAIT_BLOCK_BIT(bit) _CHAN_SINIT(Sync_Wait){chan_wait_block, chan_wake_block, 1u << bit}
+#define SYNC_WAIT_BLOCK_BIT(bit) _CHAN_SINIT(Sync_Wait){chan_wait_block, chan_wake_block, 1u << bit, 0, chan_wake_block_single}
 
 CHANAPI bool sync_wait(volatile void* state, uint32_t current, isize timeout, Sync_Wait wait);
 CHANAPI void sync_wake(volatile void* state, uint32_t prev, Sync_Wait wait);
@@ -158,6 +164,755 @@ CHANAPI void ticket_unlock(Ticket_Lock* lock, Sync_Wait wait)
         wait.wake((void*) &lock->atomic_completed);
 }
 
+//==========================================================================
+// RW Lock
+//==========================================================================
+// A compact 32 bit reader-writer lock. Multiple readers may hold the lock at once
+// but only a single writer may hold it at once (and excludes all readers). 
+// The whole state lives in a single uint32_t: 
+//  [31] writer holds the lock
+//  [30] writer is waiting (blocks new readers unless RW_LOCK_PREFER_READERS is set)
+//  [29] someone is sleeping on the lock and needs to be woken on unlock
+//  [28] RW_LOCK_PREFER_READERS mode flag
+//  [0-27] number of readers holding the lock
+// Zero initialized lock is unlocked and prefers writers. The writer preference
+// is only a heuristic and does not guarantee fairness. Use rw_lock_init to select the mode.
+// Is not recursive.
+#define RW_LOCK_WRITER              ((uint32_t) 1 << 31)
+#define RW_LOCK_WRITER_WAITING      ((uint32_t) 1 << 30)
+#define RW_LOCK_SLEEPING            ((uint32_t) 1 << 29)
+#define RW_LOCK_PREFER_READERS      ((uint32_t) 1 << 28)
+#define RW_LOCK_READERS_MASK        (RW_LOCK_PREFER_READERS - 1)
+
+typedef union RW_Lock {
+    uint32_t state;
+    CHAN_ATOMIC(uint32_t) atomic_state;
+} RW_Lock;
+
+CHANAPI void rw_lock_init(RW_Lock* lock, bool prefer_readers);
+CHANAPI void rw_lock_reader_lock(RW_Lock* lock, Sync_Wait wait);
+CHANAPI void rw_lock_reader_unlock(RW_Lock* lock, Sync_Wait wait);
+CHANAPI bool rw_lock_reader_try_lock(RW_Lock* lock);
+CHANAPI void rw_lock_writer_lock(RW_Lock* lock, Sync_Wait wait);
+CHANAPI void rw_lock_writer_unlock(RW_Lock* lock, Sync_Wait wait);
+CHANAPI bool rw_lock_writer_try_lock(RW_Lock* lock);
+
+CHANAPI void rw_lock_init(RW_Lock* lock, bool prefer_readers)
+{
+    atomic_store(&lock->atomic_state, prefer_readers ? RW_LOCK_PREFER_READERS : 0);
+}
+
+CHANAPI bool _rw_lock_reader_blocked(uint32_t state)
+{
+    if(state & RW_LOCK_WRITER)
+        return true;
+    if((state & RW_LOCK_WRITER_WAITING) && (state & RW_LOCK_PREFER_READERS) == 0)
+        return true;
+    return false;
+}
+
+//Marks the lock as having sleepers and sleeps or spins if wait is not provided. 
+// Returns after the state possibly changed.
+CHANAPI void _rw_lock_wait(RW_Lock* lock, uint32_t state, uint32_t set_bits, Sync_Wait wait)
+{
+    if(wait.wait)
+        set_bits |= RW_LOCK_SLEEPING;
+
+    if((state & set_bits) != set_bits)
+    {
+        if(atomic_compare_exchange_weak(&lock->atomic_state, &state, state | set_bits) == false)
+            return;
+        state |= set_bits;
+    }
+
+    if(wait.wait)
+        wait.wait((void*) &lock->atomic_state, state, -1);
+    else
+        chan_pause();
+}
+
+CHANAPI bool rw_lock_reader_try_lock(RW_Lock* lock)
+{
+    uint32_t state = atomic_load_explicit(&lock->atomic_state, memory_order_relaxed);
+    return _rw_lock_reader_blocked(state) == false 
+        && (state & RW_LOCK_READERS_MASK) != RW_LOCK_READERS_MASK
+        && atomic_compare_exchange_strong(&lock->atomic_state, &state, state + 1);
+}
+
+CHANAPI void rw_lock_reader_lock(RW_Lock* lock, Sync_Wait wait)
+{
+    for(uint32_t state = atomic_load_explicit(&lock->atomic_state, memory_order_relaxed);;) {
+        if(_rw_lock_reader_blocked(state) == false)
+        {
+            ASSERT((state & RW_LOCK_READERS_MASK) != RW_LOCK_READERS_MASK, "too many readers");
+            if(atomic_compare_exchange_weak(&lock->atomic_state, &state, state + 1))
+                break;
+        }
+        else
+        {
+            _rw_lock_wait(lock, state, 0, wait);
+            state = atomic_load_explicit(&lock->atomic_state, memory_order_relaxed);
+        }
+    }
+}
+
+CHANAPI void rw_lock_reader_unlock(RW_Lock* lock, Sync_Wait wait)
+{
+    uint32_t state = atomic_load_explicit(&lock->atomic_state, memory_order_relaxed);
+    uint32_t new_state = 0;
+    do {
+        ASSERT(state & RW_LOCK_READERS_MASK, "unlocking unlocked lock");
+        new_state = state - 1;
+        //Only the last reader leaving can unblock someone (a writer) so only it wakes.
+        if((new_state & RW_LOCK_READERS_MASK) == 0)
+            new_state &= ~RW_LOCK_SLEEPING;
+    } while(atomic_compare_exchange_weak(&lock->atomic_state, &state, new_state) == false);
+
+    if((state & RW_LOCK_SLEEPING) && (new_state & RW_LOCK_SLEEPING) == 0 && wait.wake)
+        wait.wake((void*) &lock->atomic_state);
+}
+
+CHANAPI bool rw_lock_writer_try_lock(RW_Lock* lock)
+{
+    uint32_t state = atomic_load_explicit(&lock->atomic_state, memory_order_relaxed);
+    return (state & (RW_LOCK_WRITER | RW_LOCK_READERS_MASK)) == 0
+        && atomic_compare_exchange_strong(&lock->atomic_state, &state, (state & ~RW_LOCK_WRITER_WAITING) | RW_LOCK_WRITER);
+}
+
+CHANAPI void rw_lock_writer_lock(RW_Lock* lock, Sync_Wait wait)
+{
+    for(uint32_t state = atomic_load_explicit(&lock->atomic_state, memory_order_relaxed);;) {
+        if((state & (RW_LOCK_WRITER | RW_LOCK_READERS_MASK)) == 0)
+        {
+            if(atomic_compare_exchange_weak(&lock->atomic_state, &state, (state & ~RW_LOCK_WRITER_WAITING) | RW_LOCK_WRITER))
+                break;
+        }
+        else
+        {
+            _rw_lock_wait(lock, state, RW_LOCK_WRITER_WAITING, wait);
+            state = atomic_load_explicit(&lock->atomic_state, memory_order_relaxed);
+        }
+    }
+}
+
+CHANAPI void rw_lock_writer_unlock(RW_Lock* lock, Sync_Wait wait)
+{
+    //Keep the waiting writer flag so that readers do not overtake the writers woken below
+    uint32_t prev = atomic_fetch_and(&lock->atomic_state, ~(RW_LOCK_WRITER | RW_LOCK_SLEEPING));
+    ASSERT(prev & RW_LOCK_WRITER, "unlocking unlocked lock");
+    if((prev & RW_LOCK_SLEEPING) && wait.wake)
+        wait.wake((void*) &lock->atomic_state);
+}
+
+//==========================================================================
+// Mutex
+//==========================================================================
+// A 4 byte non-recursive mutex using the three state futex protocol from 
+// "U. Drepper - Futexes Are Tricky, 2011" (unlocked / locked / locked with waiters).
+// Uncontended lock and unlock are a single atomic operation each and unlock only 
+// wakes (a single thread) when someone might be sleeping.
+//
+// Before going to sleep the locking thread spins for a while. The spin count is adapted 
+// per mutex based on how many spins it took to acquire it in the past (like glibc's 
+// PTHREAD_MUTEX_ADAPTIVE_NP) and is bounded by MUTEX_SPIN_MAX. The estimate is stored in
+// the upper bits of the state so the mutex stays 4 bytes. It is only ever changed by the 
+// current holder.
+//
+// Optionally mutex_lock_stats/mutex_unlock_stats can be used to gather contention and hold 
+// time statistics into Mutex_Stats. The stats are only ever modified while holding the mutex
+// thus each mutex needs its own Mutex_Stats. Zero initialized Mutex is unlocked.
+#define MUTEX_LOCKED        ((uint32_t) 1)
+#define MUTEX_WAITERS       ((uint32_t) 2)
+#define MUTEX_SPIN_SHIFT    8
+#define MUTEX_SPIN_MAX      100
+
+typedef union Mutex {
+    uint32_t state;
+    CHAN_ATOMIC(uint32_t) atomic_state;
+} Mutex;
+
+typedef struct Mutex_Stats {
+    uint64_t lock_count;        //number of successful locks
+    uint64_t contended_count;   //number of locks which did not succeed on the first try
+    uint64_t sleep_count;       //number of times a locking thread went to sleep
+    uint64_t spin_count;        //total number of spin iterations
+    int64_t wait_ticks;         //total time spent acquiring the mutex in chan_perf_counter() ticks
+    int64_t hold_ticks;         //total time the mutex was held in chan_perf_counter() ticks
+    int64_t max_wait_ticks;
+    int64_t max_hold_ticks;
+    int64_t locked_at;          //time of the last acquisition
+} Mutex_Stats;
+
+CHANAPI bool mutex_try_lock(Mutex* mutex);
+CHANAPI void mutex_lock(Mutex* mutex, Sync_Wait wait);
+CHANAPI void mutex_unlock(Mutex* mutex, Sync_Wait wait);
+CHANAPI bool mutex_is_locked(const Mutex* mutex);
+CHANAPI void mutex_lock_stats(Mutex* mutex, Mutex_Stats* stats_or_null, Sync_Wait wait);
+CHANAPI void mutex_unlock_stats(Mutex* mutex, Mutex_Stats* stats_or_null, Sync_Wait wait);
+
+CHANAPI void _sync_wake_single(volatile void* state, Sync_Wait wait)
+{
+    if(wait.wake_single)
+        wait.wake_single(state);
+    else if(wait.wake)
+        wait.wake(state);
+}
+
+CHANAPI bool mutex_try_lock(Mutex* mutex)
+{
+    uint32_t state = atomic_load_explicit(&mutex->atomic_state, memory_order_relaxed);
+    return (state & MUTEX_LOCKED) == 0
+        && atomic_compare_exchange_strong_explicit(&mutex->atomic_state, &state, state | MUTEX_LOCKED, memory_order_acquire, memory_order_relaxed);
+}
+
+CHANAPI bool mutex_is_locked(const Mutex* mutex)
+{
+    return (atomic_load_explicit(&mutex->atomic_state, memory_order_relaxed) & MUTEX_LOCKED) != 0;
+}
+
+_CHAN_INLINE_NEVER 
+static void _mutex_lock_slow(Mutex* mutex, Sync_Wait wait, uint64_t* spin_count, uint64_t* sleep_count)
+{
+    uint32_t state = atomic_load_explicit(&mutex->atomic_state, memory_order_relaxed);
+    uint32_t max_spins = (state >> MUTEX_SPIN_SHIFT)*2 + 10;
+    if(max_spins > MUTEX_SPIN_MAX)
+        max_spins = MUTEX_SPIN_MAX;
+
+    uint32_t spins = 0;
+    bool acquired = false;
+    for(; spins < max_spins; spins++)
+    {
+        if((state & MUTEX_LOCKED) == 0 && atomic_compare_exchange_weak_explicit(&mutex->atomic_state, &state, state | MUTEX_LOCKED, memory_order_acquire, memory_order_relaxed))
+        {
+            acquired = true;
+            break;
+        }
+
+        chan_pause();
+        state = atomic_load_explicit(&mutex->atomic_state, memory_order_relaxed);
+    }
+
+    while(acquired == false)
+    {
+        if(wait.wait)
+        {
+            //We cannot know if there are other waiters so we have to conservatively 
+            // set the waiters flag even when we do acquire the lock. 
+            uint32_t prev = atomic_fetch_or_explicit(&mutex->atomic_state, MUTEX_LOCKED | MUTEX_WAITERS, memory_order_acquire);
+            if((prev & MUTEX_LOCKED) == 0)
+                break;
+
+            *sleep_count += 1;
+            wait.wait((void*) &mutex->atomic_state, prev | MUTEX_LOCKED | MUTEX_WAITERS, -1);
+        }
+        else
+        {
+            state = atomic_load_explicit(&mutex->atomic_state, memory_order_relaxed);
+            if((state & MUTEX_LOCKED) == 0 && atomic_compare_exchange_weak_explicit(&mutex->atomic_state, &state, state | MUTEX_LOCKED, memory_order_acquire, memory_order_relaxed))
+                break;
+            chan_pause();
+        }
+    }
+
+    //We hold the lock so nobody else can change the estimate. Move it 1/8 of the way towards this run.
+    uint32_t estimate = atomic_load_explicit(&mutex->atomic_state, memory_order_relaxed) >> MUTEX_SPIN_SHIFT;
+    int32_t delta = ((int32_t) spins - (int32_t) estimate)/8;
+    if(delta != 0)
+        atomic_fetch_add_explicit(&mutex->atomic_state, (uint32_t) delta << MUTEX_SPIN_SHIFT, memory_order_relaxed);
+
+    *spin_count += spins;
+}
+
+CHANAPI void mutex_lock(Mutex* mutex, Sync_Wait wait)
+{
+    uint32_t prev = atomic_fetch_or_explicit(&mutex->atomic_state, MUTEX_LOCKED, memory_order_acquire);
+    if(prev & MUTEX_LOCKED)
+    {
+        uint64_t spins = 0, sleeps = 0;
+        _mutex_lock_slow(mutex, wait, &spins, &sleeps);
+    }
+}
+
+CHANAPI void mutex_unlock(Mutex* mutex, Sync_Wait wait)
+{
+    uint32_t prev = atomic_fetch_and_explicit(&mutex->atomic_state, ~(MUTEX_LOCKED | MUTEX_WAITERS), memory_order_release);
+    ASSERT(prev & MUTEX_LOCKED, "unlocking unlocked mutex");
+    if(prev & MUTEX_WAITERS)
+        _sync_wake_single((void*) &mutex->atomic_state, wait);
+}
+
+CHANAPI void mutex_lock_stats(Mutex* mutex, Mutex_Stats* stats_or_null, Sync_Wait wait)
+{
+    if(stats_or_null == NULL)
+        mutex_lock(mutex, wait);
+    else
+    {
+        int64_t before = chan_perf_counter();
+        uint64_t spins = 0, sleeps = 0;
+        uint32_t prev = atomic_fetch_or_explicit(&mutex->atomic_state, MUTEX_LOCKED, memory_order_acquire);
+        if(prev & MUTEX_LOCKED)
+            _mutex_lock_slow(mutex, wait, &spins, &sleeps);
+        int64_t after = chan_perf_counter();
+
+        //we hold the mutex so the stats are protected by it
+        Mutex_Stats* stats = stats_or_null;
+        stats->lock_count += 1;
+        stats->contended_count += (prev & MUTEX_LOCKED) != 0;
+        stats->sleep_count += sleeps;
+        stats->spin_count += spins;
+        stats->wait_ticks += after - before;
+        if(stats->max_wait_ticks < after - before)
+            stats->max_wait_ticks = after - before;
+        stats->locked_at = after;
+    }
+}
+
+CHANAPI void mutex_unlock_stats(Mutex* mutex, Mutex_Stats* stats_or_null, Sync_Wait wait)
+{
+    if(stats_or_null)
+    {
+        Mutex_Stats* stats = stats_or_null;
+        int64_t held = chan_perf_counter() - stats->locked_at;
+        stats->hold_ticks += held;
+        if(stats->max_hold_ticks < held)
+            stats->max_hold_ticks = held;
+    }
+    mutex_unlock(mutex, wait);
+}
+
+//==========================================================================
+// Seq Lock
+//==========================================================================
+// A sequence lock for small, frequently read and rarely written data.
+// Readers never write to shared memory so they do not bounce any cache lines
+// between each other. Instead they read optimistically and retry if a writer 
+// interfered. Writers are serialized between each other. 
+// Usage:
+//  uint32_t seq = 0;
+//  do {
+//      seq = seq_lock_read_begin(&lock, SYNC_WAIT_SPIN);
+//      copy = shared;
+//  } while(seq_lock_read_retry(&lock, seq));
+//
+// The readers must not dereference pointers inside the protected data as they may be
+// reading torn data. The data is only consistent after seq_lock_read_retry returns false.
+// Alternatively use seq_lock_read/seq_lock_write which do exactly this with memcpy.
+#define SEQ_LOCK_WRITING    ((uint32_t) 1)
+#define SEQ_LOCK_SLEEPING   ((uint32_t) 2)
+#define SEQ_LOCK_INCREMENT  ((uint32_t) 4)
+
+typedef union Seq_Lock {
+    uint32_t sequence;
+    CHAN_ATOMIC(uint32_t) atomic_sequence;
+} Seq_Lock;
+
+CHANAPI uint32_t seq_lock_read_begin(Seq_Lock* lock, Sync_Wait wait);
+CHANAPI bool     seq_lock_read_retry(Seq_Lock* lock, uint32_t sequence);
+CHANAPI void     seq_lock_write_begin(Seq_Lock* lock, Sync_Wait wait);
+CHANAPI void     seq_lock_write_end(Seq_Lock* lock, Sync_Wait wait);
+CHANAPI void     seq_lock_read(Seq_Lock* lock, void* into, const void* shared, isize size, Sync_Wait wait);
+CHANAPI void     seq_lock_write(Seq_Lock* lock, void* shared, const void* from, isize size, Sync_Wait wait);
+
+CHANAPI void _seq_lock_wait(Seq_Lock* lock, uint32_t sequence, Sync_Wait wait)
+{
+    if(wait.wait)
+    {
+        if((sequence & SEQ_LOCK_SLEEPING) == 0)
+        {
+            if(atomic_compare_exchange_weak(&lock->atomic_sequence, &sequence, sequence | SEQ_LOCK_SLEEPING) == false)
+                return;
+            sequence |= SEQ_LOCK_SLEEPING;
+        }
+        wait.wait((void*) &lock->atomic_sequence, sequence, -1);
+    }
+    else
+        chan_pause();
+}
+
+CHANAPI uint32_t seq_lock_read_begin(Seq_Lock* lock, Sync_Wait wait)
+{
+    for(;;) {
+        uint32_t sequence = atomic_load_explicit(&lock->atomic_sequence, memory_order_acquire);
+        if((sequence & SEQ_LOCK_WRITING) == 0)
+            return sequence & ~SEQ_LOCK_SLEEPING;
+
+        _seq_lock_wait(lock, sequence, wait);
+    }
+}
+
+CHANAPI bool seq_lock_read_retry(Seq_Lock* lock, uint32_t sequence)
+{
+    //The fence keeps the data reads from moving below the sequence reload
+    atomic_thread_fence(memory_order_acquire);
+    uint32_t now = atomic_load_explicit(&lock->atomic_sequence, memory_order_relaxed);
+    return (now & ~SEQ_LOCK_SLEEPING) != sequence;
+}
+
+CHANAPI void seq_lock_write_begin(Seq_Lock* lock, Sync_Wait wait)
+{
+    for(;;) {
+        uint32_t sequence = atomic_load_explicit(&lock->atomic_sequence, memory_order_relaxed);
+        if(sequence & SEQ_LOCK_WRITING)
+            _seq_lock_wait(lock, sequence, wait);
+        else if(atomic_compare_exchange_weak_explicit(&lock->atomic_sequence, &sequence, sequence | SEQ_LOCK_WRITING, memory_order_acquire, memory_order_relaxed))
+            break;
+    }
+
+    //The fence keeps the data writes from moving above the sequence change
+    atomic_thread_fence(memory_order_release);
+}
+
+CHANAPI void seq_lock_write_end(Seq_Lock* lock, Sync_Wait wait)
+{
+    uint32_t sequence = atomic_load_explicit(&lock->atomic_sequence, memory_order_relaxed);
+    uint32_t new_sequence = 0;
+    do {
+        ASSERT(sequence & SEQ_LOCK_WRITING, "ending write that was not started");
+        new_sequence = (sequence & ~(SEQ_LOCK_WRITING | SEQ_LOCK_SLEEPING)) + SEQ_LOCK_INCREMENT;
+    } while(atomic_compare_exchange_weak_explicit(&lock->atomic_sequence, &sequence, new_sequence, memory_order_release, memory_order_relaxed) == false);
+
+    if((sequence & SEQ_LOCK_SLEEPING) && wait.wake)
+        wait.wake((void*) &lock->atomic_sequence);
+}
+
+CHANAPI void seq_lock_read(Seq_Lock* lock, void* into, const void* shared, isize size, Sync_Wait wait)
+{
+    uint32_t sequence = 0;
+    do {
+        sequence = seq_lock_read_begin(lock, wait);
+        memcpy(into, shared, (size_t) size);
+    } while(seq_lock_read_retry(lock, sequence));
+}
+
+CHANAPI void seq_lock_write(Seq_Lock* lock, void* shared, const void* from, isize size, Sync_Wait wait)
+{
+    seq_lock_write_begin(lock, wait);
+    memcpy(shared, from, (size_t) size);
+    seq_lock_write_end(lock, wait);
+}
+
+//==========================================================================
+// Latch
+//==========================================================================
+// A single use countdown. Threads call latch_wait until the count reaches zero
+// by latch_count_down. Only wakes when someone is actually sleeping on the latch.
+// Layout: [31] someone is sleeping, [0-30] the remaining count. 
+#define LATCH_SLEEPING      ((uint32_t) 1 << 31)
+#define LATCH_COUNT_MASK    (LATCH_SLEEPING - 1)
+
+typedef union Latch {
+    uint32_t state;
+    CHAN_ATOMIC(uint32_t) atomic_state;
+} Latch;
+
+CHANAPI void latch_init(Latch* latch, isize count);
+CHANAPI bool latch_count_down(Latch* latch, isize count, Sync_Wait wait); //returns true if this call reached zero
+CHANAPI bool latch_try_wait(Latch* latch);
+CHANAPI void latch_wait(Latch* latch, Sync_Wait wait);
+CHANAPI void latch_arrive_and_wait(Latch* latch, Sync_Wait wait);
+
+//==========================================================================
+// Barrier
+//==========================================================================
+// A reusable phase barrier for a fixed number of threads. Each thread calls 
+// barrier_arrive_and_wait and all return once the last one arrives. The last thread 
+// to arrive returns true (like PTHREAD_BARRIER_SERIAL_THREAD) and can be used to run 
+// serial code between phases. The waiters sleep on the phase word which is only 
+// changed once per phase so there are no spurious wakeups from arriving threads.
+// Layout of phase: [1-31] phase counter, [0] someone is sleeping. 
+#define BARRIER_SLEEPING    ((uint32_t) 1)
+#define BARRIER_PHASE_INC   ((uint32_t) 2)
+
+typedef struct Barrier {
+    CHAN_ATOMIC(uint32_t) arrived;
+    CHAN_ATOMIC(uint32_t) phase;
+    uint32_t thread_count;
+    uint32_t _;
+} Barrier;
+
+CHANAPI void barrier_init(Barrier* barrier, isize thread_count);
+CHANAPI bool barrier_arrive_and_wait(Barrier* barrier, Sync_Wait wait);
+CHANAPI uint32_t barrier_phase(const Barrier* barrier);
+
+//==========================================================================
+// Semaphore
+//==========================================================================
+// A counting semaphore. semaphore_post wakes at most as many sleeping threads as it 
+// posted permits and does not touch the kernel at all when nobody sleeps. 
+// The waiters futex-wait on count while it is zero. The number of sleeping threads is 
+// tracked separately in waiters so that the count stays a plain counter. 
+typedef struct Semaphore {
+    CHAN_ATOMIC(uint32_t) count;
+    CHAN_ATOMIC(uint32_t) waiters;
+} Semaphore;
+
+CHANAPI void semaphore_init(Semaphore* sem, isize count);
+CHANAPI bool semaphore_try_wait(Semaphore* sem);
+CHANAPI void semaphore_wait(Semaphore* sem, Sync_Wait wait);
+CHANAPI bool semaphore_wait_timed(Semaphore* sem, double timeout, Sync_Wait wait);
+CHANAPI void semaphore_post(Semaphore* sem, isize count, Sync_Wait wait);
+
+//==========================================================================
+// Event Count
+//==========================================================================
+// Lets lock-free data structures block when there is nothing to do without 
+// lost wakeups. The consumer registers its intent to wait, checks the 
+// condition again and only then commits to sleeping:
+//
+//  for(;;) {
+//      if(try_pop(queue, &item)) break;
+//      uint32_t key = eventcount_prepare_wait(&ec);
+//      if(try_pop(queue, &item)) { eventcount_cancel_wait(&ec); break; }
+//      eventcount_commit_wait(&ec, key, SYNC_WAIT_BLOCK);
+//  }
+//
+// The producer calls eventcount_notify (or eventcount_notify_all) after making the 
+// condition true. When nobody is waiting the notify is just a fence and a load.
+// Layout: [16-31] epoch incremented by each notify, [0-15] number of prepared waiters.
+// Thus at most 65535 threads can wait at once. 
+#define EVENTCOUNT_WAITER       ((uint32_t) 1)
+#define EVENTCOUNT_WAITERS_MASK ((uint32_t) 0xFFFF)
+#define EVENTCOUNT_EPOCH        ((uint32_t) 1 << 16)
+
+typedef union Event_Count {
+    uint32_t state;
+    CHAN_ATOMIC(uint32_t) atomic_state;
+} Event_Count;
+
+CHANAPI uint32_t eventcount_prepare_wait(Event_Count* ec);
+CHANAPI void eventcount_cancel_wait(Event_Count* ec);
+CHANAPI void eventcount_commit_wait(Event_Count* ec, uint32_t key, Sync_Wait wait);
+CHANAPI void eventcount_notify(Event_Count* ec, Sync_Wait wait);
+CHANAPI void eventcount_notify_all(Event_Count* ec, Sync_Wait wait);
+
+CHANAPI void latch_init(Latch* latch, isize count)
+{
+    ASSERT(0 <= count && count <= LATCH_COUNT_MASK);
+    atomic_store_explicit(&latch->atomic_state, (uint32_t) count, memory_order_relaxed);
+}
+
+CHANAPI bool latch_count_down(Latch* latch, isize count, Sync_Wait wait)
+{
+    uint32_t prev = atomic_fetch_sub_explicit(&latch->atomic_state, (uint32_t) count, memory_order_acq_rel);
+    ASSERT((prev & LATCH_COUNT_MASK) >= (uint32_t) count, "latch counted below zero");
+    if((prev & LATCH_COUNT_MASK) != (uint32_t) count)
+        return false;
+
+    if((prev & LATCH_SLEEPING) && wait.wake)
+        wait.wake((void*) &latch->atomic_state);
+    return true;
+}
+
+CHANAPI bool latch_try_wait(Latch* latch)
+{
+    return (atomic_load_explicit(&latch->atomic_state, memory_order_acquire) & LATCH_COUNT_MASK) == 0;
+}
+
+CHANAPI void latch_wait(Latch* latch, Sync_Wait wait)
+{
+    for(;;) {
+        uint32_t state = atomic_load_explicit(&latch->atomic_state, memory_order_acquire);
+        if((state & LATCH_COUNT_MASK) == 0)
+            break;
+
+        if(wait.wait)
+        {
+            if((state & LATCH_SLEEPING) == 0 
+                && atomic_compare_exchange_weak(&latch->atomic_state, &state, state | LATCH_SLEEPING) == false)
+                continue;
+            wait.wait((void*) &latch->atomic_state, state | LATCH_SLEEPING, -1);
+        }
+        else
+            chan_pause();
+    }
+}
+
+CHANAPI void latch_arrive_and_wait(Latch* latch, Sync_Wait wait)
+{
+    if(latch_count_down(latch, 1, wait) == false)
+        latch_wait(latch, wait);
+}
+
+CHANAPI void barrier_init(Barrier* barrier, isize thread_count)
+{
+    ASSERT(thread_count > 0);
+    atomic_store_explicit(&barrier->arrived, 0, memory_order_relaxed);
+    atomic_store_explicit(&barrier->phase, 0, memory_order_relaxed);
+    barrier->thread_count = (uint32_t) thread_count;
+}
+
+CHANAPI uint32_t barrier_phase(const Barrier* barrier)
+{
+    return atomic_load_explicit(&barrier->phase, memory_order_acquire) / BARRIER_PHASE_INC;
+}
+
+CHANAPI bool barrier_arrive_and_wait(Barrier* barrier, Sync_Wait wait)
+{
+    //The phase must be loaded before arriving. Nobody can arrive for the next phase 
+    // before the phase is incremented as all threads are waiting for exactly that.
+    uint32_t phase = atomic_load_explicit(&barrier->phase, memory_order_acquire) & ~BARRIER_SLEEPING;
+    uint32_t arrived = atomic_fetch_add_explicit(&barrier->arrived, 1, memory_order_acq_rel) + 1;
+    if(arrived == barrier->thread_count)
+    {
+        atomic_store_explicit(&barrier->arrived, 0, memory_order_relaxed);
+        uint32_t prev = atomic_exchange_explicit(&barrier->phase, phase + BARRIER_PHASE_INC, memory_order_acq_rel);
+        if((prev & BARRIER_SLEEPING) && wait.wake)
+            wait.wake((void*) &barrier->phase);
+        return true;
+    }
+
+    for(;;) {
+        uint32_t current = atomic_load_explicit(&barrier->phase, memory_order_acquire);
+        if((current & ~BARRIER_SLEEPING) != phase)
+            break;
+
+        if(wait.wait)
+        {
+            if((current & BARRIER_SLEEPING) == 0 
+                && atomic_compare_exchange_weak(&barrier->phase, &current, current | BARRIER_SLEEPING) == false)
+                continue;
+            wait.wait((void*) &barrier->phase, current | BARRIER_SLEEPING, -1);
+        }
+        else
+            chan_pause();
+    }
+    return false;
+}
+
+CHANAPI void semaphore_init(Semaphore* sem, isize count)
+{
+    ASSERT(count >= 0);
+    atomic_store_explicit(&sem->count, (uint32_t) count, memory_order_relaxed);
+    atomic_store_explicit(&sem->waiters, 0, memory_order_relaxed);
+}
+
+CHANAPI bool semaphore_try_wait(Semaphore* sem)
+{
+    uint32_t count = atomic_load_explicit(&sem->count, memory_order_relaxed);
+    while(count > 0)
+        if(atomic_compare_exchange_weak_explicit(&sem->count, &count, count - 1, memory_order_acquire, memory_order_relaxed))
+            return true;
+
+    return false;
+}
+
+//Waits for a single permit. If timeout is negative waits forever.
+CHANAPI bool _semaphore_wait(Semaphore* sem, double timeout, Sync_Wait wait)
+{
+    int64_t start = 0;
+    double freq = 0;
+    if(timeout >= 0)
+    {
+        start = chan_perf_counter();
+        freq = (double) chan_perf_frequency();
+    }
+
+    for(;;) {
+        if(semaphore_try_wait(sem))
+            return true;
+
+        double remaining = -1;
+        if(timeout >= 0)
+        {
+            remaining = timeout - (double) (chan_perf_counter() - start)/freq;
+            if(remaining <= 0)
+                return false;
+        }
+
+        if(wait.wait)
+        {
+            //Seq cst on both sides: either we see the posted count or the poster sees us in waiters.
+            atomic_fetch_add_explicit(&sem->waiters, 1, memory_order_seq_cst);
+            wait.wait((void*) &sem->count, 0, remaining);
+            atomic_fetch_sub_explicit(&sem->waiters, 1, memory_order_relaxed);
+        }
+        else
+            chan_pause();
+    }
+}
+
+CHANAPI void semaphore_wait(Semaphore* sem, Sync_Wait wait)
+{
+    _semaphore_wait(sem, -1, wait);
+}
+
+CHANAPI bool semaphore_wait_timed(Semaphore* sem, double timeout, Sync_Wait wait)
+{
+    return _semaphore_wait(sem, timeout < 0 ? 0 : timeout, wait);
+}
+
+CHANAPI void semaphore_post(Semaphore* sem, isize count, Sync_Wait wait)
+{
+    ASSERT(count >= 0);
+    atomic_fetch_add_explicit(&sem->count, (uint32_t) count, memory_order_seq_cst);
+    uint32_t waiters = atomic_load_explicit(&sem->waiters, memory_order_seq_cst);
+    if(waiters == 0)
+        return;
+
+    if(wait.wake_single)
+    {
+        isize wakes = (isize) waiters < count ? (isize) waiters : count;
+        for(isize i = 0; i < wakes; i++)
+            wait.wake_single((void*) &sem->count);
+    }
+    else if(wait.wake)
+        wait.wake((void*) &sem->count);
+}
+
+CHANAPI uint32_t eventcount_prepare_wait(Event_Count* ec)
+{
+    uint32_t prev = atomic_fetch_add_explicit(&ec->atomic_state, EVENTCOUNT_WAITER, memory_order_seq_cst);
+    ASSERT((prev & EVENTCOUNT_WAITERS_MASK) != EVENTCOUNT_WAITERS_MASK, "too many waiters");
+    return prev + EVENTCOUNT_WAITER;
+}
+
+CHANAPI void eventcount_cancel_wait(Event_Count* ec)
+{
+    atomic_fetch_sub_explicit(&ec->atomic_state, EVENTCOUNT_WAITER, memory_order_relaxed);
+}
+
+CHANAPI void eventcount_commit_wait(Event_Count* ec, uint32_t key, Sync_Wait wait)
+{
+    for(;;) {
+        //The waiters count in the low bits may change as other threads prepare/cancel 
+        // so we wait on the current value and only compare the epochs.
+        uint32_t state = atomic_load_explicit(&ec->atomic_state, memory_order_acquire);
+        if((state & ~EVENTCOUNT_WAITERS_MASK) != (key & ~EVENTCOUNT_WAITERS_MASK))
+            break;
+
+        if(wait.wait)
+            wait.wait((void*) &ec->atomic_state, state, -1);
+        else
+            chan_pause();
+    }
+    eventcount_cancel_wait(ec);
+}
+
+CHANAPI void _eventcount_notify(Event_Count* ec, bool all, Sync_Wait wait)
+{
+    //Pairs with the seq cst in prepare_wait: either the waiter sees the producer's 
+    // change on its recheck or we see the waiter here.
+    atomic_thread_fence(memory_order_seq_cst);
+    uint32_t state = atomic_load_explicit(&ec->atomic_state, memory_order_relaxed);
+    if((state & EVENTCOUNT_WAITERS_MASK) == 0)
+        return;
+
+    atomic_fetch_add_explicit(&ec->atomic_state, EVENTCOUNT_EPOCH, memory_order_release);
+    if(all == false)
+        _sync_wake_single((void*) &ec->atomic_state, wait);
+    else if(wait.wake)
+        wait.wake((void*) &ec->atomic_state);
+}
+
+CHANAPI void eventcount_notify(Event_Count* ec, Sync_Wait wait)
+{
+    _eventcount_notify(ec, false, wait);
+}
+
+CHANAPI void eventcount_notify_all(Event_Count* ec, Sync_Wait wait)
+{
+    _eventcount_notify(ec, true, wait);
+}
 
 #if 0
 CHANAPI bool sync_wait(volatile void* state, uint32_t current, isize timeout, Sync_Wait wait)
@@ -330,7 +1085,7 @@ CHANAPI bool sync_timed_wait_for_greater(volatile void* state, uint32_t desired,
 CHANAPI bool sync_once_begin(volatile Sync_Once* once, Sync_Wait wait)
 {
     uint32_t before_value = atomic_load(once);
-    if(before_value != SYNC_ONCE_INIT)
+    if(before_value == SYNC_ONCE_INIT)
         return false;
 
     uint32_t curr_val = SYNC_ONCE_UNINIT;
@@ -344,7 +1099,7 @@ CHANAPI bool sync_once_begin(volatile Sync_Once* once, Sync_Wait wait)
                 break;
 
             if(wait.wait)
-                return wait.wait((void*) once, current, -1);
+                wait.wait((void*) once, current, -1);
             else
                 chan_pause();
         }
@@ -454,3 +1209,83 @@ CHANAPI bool wait_group_wait_timed(volatile Wait_Group* wg, double timeout, Sync
             chan_pause();
     }
 }
+
+//==========================================================================
+// Thread slots
+//==========================================================================
+// A small table binding the calling thread to its own state of some shared object
+// (for example a per thread cache of an allocator). The object is identified by a unique 
+// id from sync_thread_slots_make_id. The table is meant to be thread local so it is only 
+// ever touched by a single thread and needs no synchronization:
+//  static ATTRIBUTE_THREAD_LOCAL Sync_Thread_Slots _slots;
+//  Cache* cache = (Cache*) sync_thread_slots_get(&_slots, allocator->id);
+//
+// Once all SYNC_THREAD_SLOTS slots are used the next binding evicts one of the existing 
+// ones (round robin). The evicted state is not touched - it stays with the object.
+#define SYNC_THREAD_SLOTS 4
+
+typedef struct Sync_Thread_Slots {
+    uint64_t ids[SYNC_THREAD_SLOTS];    //0 for unused slot
+    void* values[SYNC_THREAD_SLOTS];
+    uint32_t evict;
+} Sync_Thread_Slots;
+
+//Adds val to an atomic counter which is only ever written by a single thread (but can be read by others).
+// Is a plain load and store instead of the much more expensive atomic read-modify-write.
+#define sync_single_writer_add(var_ptr, val) \
+    atomic_store_explicit((var_ptr), atomic_load_explicit((var_ptr), memory_order_relaxed) + (val), memory_order_relaxed)
+
+//Returns a unique nonzero id
+CHANAPI uint64_t sync_thread_slots_make_id()
+{
+    static CHAN_ATOMIC(uint64_t) id_counter = 0;
+    return atomic_fetch_add(&id_counter, 1) + 1;
+}
+
+//Returns the value bound to id or NULL if there is none
+CHANAPI void* sync_thread_slots_get(const Sync_Thread_Slots* slots, uint64_t id)
+{
+    for(uint32_t i = 0; i < SYNC_THREAD_SLOTS; i++)
+        if(slots->ids[i] == id)
+            return slots->values[i];
+    return NULL;
+}
+
+//Binds value to id which must not be bound yet. Returns the evicted value or NULL.
+CHANAPI void* sync_thread_slots_set(Sync_Thread_Slots* slots, uint64_t id, void* value)
+{
+    uint32_t slot = SYNC_THREAD_SLOTS;
+    for(uint32_t i = 0; i < SYNC_THREAD_SLOTS; i++)
+        if(slots->ids[i] == 0)
+        {
+            slot = i;
+            break;
+        }
+
+    void* evicted = NULL;
+    if(slot == SYNC_THREAD_SLOTS)
+    {
+        slot = slots->evict++ % SYNC_THREAD_SLOTS;
+        evicted = slots->values[slot];
+    }
+
+    slots->ids[slot] = id;
+    slots->values[slot] = value;
+    return evicted;
+}
+
+//Unbinds id and returns the value it was bound to or NULL if there is none
+CHANAPI void* sync_thread_slots_remove(Sync_Thread_Slots* slots, uint64_t id)
+{
+    for(uint32_t i = 0; i < SYNC_THREAD_SLOTS; i++)
+        if(slots->ids[i] == id)
+        {
+            void* value = slots->values[i];
+            slots->ids[i] = 0;
+            slots->values[i] = NULL;
+            return value;
+        }
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,326 @@
+#ifndef MODULE_TASK_GRAPH
+#define MODULE_TASK_GRAPH
+
+// A graph of small tasks with dependencies executed on a Thread_Pool.
+// Tasks are declared with task_graph_add and ordered with task_graph_depend(before, after).
+// task_graph_run then executes the whole graph and returns once every task finished.
+//
+// Each task has an atomic counter of unfinished dependencies. When a task finishes it decrements
+// the counters of its successors and the successors which reach zero become runnable. Runnable
+// tasks are pushed into the SPMC_Queue of the thread which made them runnable (so the data they
+// consume is likely still in its cache). Threads pop from their own queue and steal from the
+// queues of others when it is empty. When there is nothing to steal they sleep on an eventcount.
+//
+// The graph is meant to be built once and run many times (for example every frame).
+// task_graph_build lays out the successors into a single array, checks there are no cycles
+// and sizes all queues so that they never need to grow. task_graph_run then does not allocate.
+// Adding more tasks or edges after a build makes the next run rebuild the graph.
+//
+// Task functions may themselves use parallel_for or run other graphs on the same pool.
+
+#include "thread_pool.h"
+#include "spmc_queue.h"
+#include "array.h"
+#include "allocator.h"
+
+typedef void (*Task_Func)(void* context);
+
+typedef struct Task_Graph_Task {
+    Task_Func func;
+    void* context;
+    uint32_t dependency_count;
+    uint32_t successors_from; //range inside Task_Graph.successors. Only valid after build
+    uint32_t successors_to;
+    uint32_t _;
+} Task_Graph_Task;
+
+typedef struct Task_Graph_Edge {
+    uint32_t before;
+    uint32_t after;
+} Task_Graph_Edge;
+
+typedef Array(Task_Graph_Task) Task_Graph_Task_Array;
+typedef Array(Task_Graph_Edge) Task_Graph_Edge_Array;
+typedef Array(CHAN_ATOMIC(uint32_t)) Task_Graph_Counter_Array;
+typedef Array(SPMC_Queue) Task_Graph_Queue_Array;
+
+typedef struct Task_Graph {
+    Allocator* allocator;
+    Task_Graph_Task_Array tasks;
+    Task_Graph_Edge_Array edges;
+    u32_Array successors;
+    u32_Array roots;
+    Task_Graph_Counter_Array pending;
+    Task_Graph_Queue_Array queues; //one per participating thread
+    bool is_built;
+    bool has_cycle;
+
+    //State of the current run
+    Thread_Pool* pool;
+    Event_Count work;
+    CHAN_ATOMIC(isize) remaining;
+} Task_Graph;
+
+EXTERNAL void task_graph_init(Task_Graph* graph, Allocator* alloc_or_null);
+EXTERNAL void task_graph_deinit(Task_Graph* graph);
+EXTERNAL void task_graph_clear(Task_Graph* graph); //removes all tasks and edges but keeps the memory
+EXTERNAL isize task_graph_add(Task_Graph* graph, Task_Func func, void* context); //returns the index of the added task
+EXTERNAL void task_graph_depend(Task_Graph* graph, isize before, isize after); //after will only start once before finished
+EXTERNAL bool task_graph_build(Task_Graph* graph, Thread_Pool* pool_or_null); //returns false if the graph contains a cycle
+EXTERNAL bool task_graph_run(Task_Graph* graph, Thread_Pool* pool_or_null); //if pool is NULL uses thread_pool_global(). Returns false if the graph contains a cycle
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_TASK_GRAPH)) && !defined(MODULE_HAS_IMPL_TASK_GRAPH)
+#define MODULE_HAS_IMPL_TASK_GRAPH
+
+EXTERNAL void task_graph_init(Task_Graph* graph, Allocator* alloc_or_null)
+{
+    task_graph_deinit(graph);
+    graph->allocator = alloc_or_null ? alloc_or_null : allocator_get_default();
+    array_init(&graph->tasks, graph->allocator);
+    array_init(&graph->edges, graph->allocator);
+    array_init(&graph->successors, graph->allocator);
+    array_init(&graph->roots, graph->allocator);
+    array_init(&graph->pending, graph->allocator);
+    array_init(&graph->queues, graph->allocator);
+}
+
+EXTERNAL void task_graph_deinit(Task_Graph* graph)
+{
+    for(isize i = 0; i < graph->queues.count; i++)
+        spmc_queue_deinit(&graph->queues.data[i]);
+
+    array_deinit(&graph->tasks);
+    array_deinit(&graph->edges);
+    array_deinit(&graph->successors);
+    array_deinit(&graph->roots);
+    array_deinit(&graph->pending);
+    array_deinit(&graph->queues);
+    memset(graph, 0, sizeof *graph);
+}
+
+EXTERNAL void task_graph_clear(Task_Graph* graph)
+{
+    array_clear(&graph->tasks);
+    array_clear(&graph->edges);
+    graph->is_built = false;
+}
+
+EXTERNAL isize task_graph_add(Task_Graph* graph, Task_Func func, void* context)
+{
+    Task_Graph_Task task = {func, context};
+    array_push(&graph->tasks, task);
+    graph->is_built = false;
+    return graph->tasks.count - 1;
+}
+
+EXTERNAL void task_graph_depend(Task_Graph* graph, isize before, isize after)
+{
+    CHECK_BOUNDS(before, graph->tasks.count);
+    CHECK_BOUNDS(after, graph->tasks.count);
+    Task_Graph_Edge edge = {(uint32_t) before, (uint32_t) after};
+    array_push(&graph->edges, edge);
+    graph->is_built = false;
+}
+
+EXTERNAL bool task_graph_build(Task_Graph* graph, Thread_Pool* pool_or_null)
+{
+    Thread_Pool* pool = pool_or_null ? pool_or_null : thread_pool_global();
+    isize task_count = graph->tasks.count;
+
+    //Lay out successors of each task contiguously (counting sort by edge.before)
+    for(isize i = 0; i < task_count; i++)
+    {
+        Task_Graph_Task* task = &graph->tasks.data[i];
+        task->dependency_count = 0;
+        task->successors_from = 0;
+        task->successors_to = 0;
+    }
+
+    for(isize i = 0; i < graph->edges.count; i++)
+    {
+        Task_Graph_Edge edge = graph->edges.data[i];
+        graph->tasks.data[edge.before].successors_to += 1;
+        graph->tasks.data[edge.after].dependency_count += 1;
+    }
+
+    uint32_t offset = 0;
+    for(isize i = 0; i < task_count; i++)
+    {
+        Task_Graph_Task* task = &graph->tasks.data[i];
+        uint32_t count = task->successors_to;
+        task->successors_from = offset;
+        task->successors_to = offset;
+        offset += count;
+    }
+
+    array_resize(&graph->successors, graph->edges.count);
+    for(isize i = 0; i < graph->edges.count; i++)
+    {
+        Task_Graph_Edge edge = graph->edges.data[i];
+        graph->successors.data[graph->tasks.data[edge.before].successors_to++] = edge.after;
+    }
+
+    array_clear(&graph->roots);
+    for(isize i = 0; i < task_count; i++)
+        if(graph->tasks.data[i].dependency_count == 0)
+            array_push(&graph->roots, (uint32_t) i);
+
+    //Check for cycles by doing a dry run of the scheduling serially (Kahn's algorithm).
+    // Reuses the successors order and the pending counters.
+    array_resize(&graph->pending, task_count);
+    for(isize i = 0; i < task_count; i++)
+        graph->pending.data[i] = graph->tasks.data[i].dependency_count;
+
+    u32_Array* order = &graph->roots;
+    isize root_count = order->count;
+    isize reached = order->count;
+    for(isize i = 0; i < reached; i++)
+    {
+        Task_Graph_Task* task = &graph->tasks.data[order->data[i]];
+        for(uint32_t s = task->successors_from; s < task->successors_to; s++)
+        {
+            uint32_t succ = graph->successors.data[s];
+            if(--graph->pending.data[succ] == 0)
+            {
+                array_push(order, succ);
+                reached += 1;
+            }
+        }
+    }
+    graph->has_cycle = reached != task_count;
+    array_resize(order, root_count);
+
+    //Size the queues so that they never grow during the run
+    isize participants = pool->thread_count + 1;
+    isize old_queue_count = graph->queues.count;
+    for(isize i = participants; i < old_queue_count; i++)
+        spmc_queue_deinit(&graph->queues.data[i]);
+    array_resize(&graph->queues, participants);
+    for(isize i = 0; i < participants; i++)
+    {
+        if(i >= old_queue_count)
+            spmc_queue_init(&graph->queues.data[i], sizeof(uint32_t), -1);
+        spmc_queue_reserve(&graph->queues.data[i], task_count + 1);
+    }
+
+    graph->pool = pool;
+    graph->is_built = true;
+    return graph->has_cycle == false;
+}
+
+INTERNAL bool _task_graph_steal(Task_Graph* graph, isize self, uint32_t* task)
+{
+    isize queue_count = graph->queues.count;
+    for(isize i = 0; i < queue_count; i++)
+    {
+        isize index = (self + i) % queue_count;
+        SPMC_Queue* queue = &graph->queues.data[index];
+        if(spmc_queue_pop(queue, task, sizeof *task))
+        {
+            //When we stole from someone else and there is more left pass the wake along. 
+            // Otherwise a single producer of many tasks would get help from just one thread.
+            if(index != self && spmc_queue_count(queue) > 0)
+                eventcount_notify(&graph->work, SYNC_WAIT_BLOCK);
+            return true;
+        }
+    }
+    return false;
+}
+
+//Wakes up to count sleeping participants. The first notify also does the fence which makes 
+// the waiter count reliable. Woken waiters stay counted until they run so we never overshoot.
+INTERNAL void _task_graph_wake(Task_Graph* graph, isize count)
+{
+    eventcount_notify(&graph->work, SYNC_WAIT_BLOCK);
+    uint32_t state = atomic_load_explicit(&graph->work.atomic_state, memory_order_relaxed);
+    isize waiters = (isize) (state & EVENTCOUNT_WAITERS_MASK);
+    for(isize i = 1; i < MIN(count, waiters); i++)
+        eventcount_notify(&graph->work, SYNC_WAIT_BLOCK);
+}
+
+INTERNAL void _task_graph_participant(isize begin, isize end, void* context)
+{
+    Task_Graph* graph = (Task_Graph*) context;
+    for(isize self = begin; self < end; self++)
+    {
+        SPMC_Queue* own = &graph->queues.data[self];
+        while(atomic_load_explicit(&graph->remaining, memory_order_acquire) > 0)
+        {
+            uint32_t index = 0;
+            if(_task_graph_steal(graph, self, &index) == false)
+            {
+                uint32_t key = eventcount_prepare_wait(&graph->work);
+                if(atomic_load_explicit(&graph->remaining, memory_order_acquire) == 0)
+                {
+                    eventcount_cancel_wait(&graph->work);
+                    break;
+                }
+
+                if(_task_graph_steal(graph, self, &index) == false)
+                {
+                    eventcount_commit_wait(&graph->work, key, SYNC_WAIT_BLOCK);
+                    continue;
+                }
+                eventcount_cancel_wait(&graph->work);
+            }
+
+            Task_Graph_Task* task = &graph->tasks.data[index];
+            task->func(task->context);
+
+            //Successors which became runnable go to our own queue. We are its only producer
+            // as each participant index is run by exactly one thread.
+            isize pushed = 0;
+            for(uint32_t s = task->successors_from; s < task->successors_to; s++)
+            {
+                uint32_t succ = graph->successors.data[s];
+                if(atomic_fetch_sub_explicit(&graph->pending.data[succ], 1, memory_order_acq_rel) == 1)
+                {
+                    spmc_queue_push_st(own, &succ, sizeof succ);
+                    pushed += 1;
+                }
+            }
+
+            //We will run one of the pushed tasks ourselves so wake others only for the rest
+            if(pushed > 1)
+                _task_graph_wake(graph, pushed - 1);
+
+            if(atomic_fetch_sub_explicit(&graph->remaining, 1, memory_order_acq_rel) == 1)
+                eventcount_notify_all(&graph->work, SYNC_WAIT_BLOCK);
+        }
+    }
+}
+
+EXTERNAL bool task_graph_run(Task_Graph* graph, Thread_Pool* pool_or_null)
+{
+    Thread_Pool* pool = pool_or_null ? pool_or_null : thread_pool_global();
+    if(graph->is_built == false || graph->pool != pool)
+        task_graph_build(graph, pool);
+
+    if(graph->has_cycle)
+        return false;
+
+    isize task_count = graph->tasks.count;
+    if(task_count == 0)
+        return true;
+
+    for(isize i = 0; i < task_count; i++)
+        atomic_store_explicit(&graph->pending.data[i], graph->tasks.data[i].dependency_count, memory_order_relaxed);
+    atomic_store_explicit(&graph->remaining, task_count, memory_order_relaxed);
+
+    //Deal out the roots. Nobody else touches the queues yet so we can push into all of them.
+    isize queue_count = graph->queues.count;
+    for(isize i = 0; i < graph->roots.count; i++)
+        spmc_queue_push_st(&graph->queues.data[i % queue_count], &graph->roots.data[i], sizeof(uint32_t));
+
+    Thread_Pool_Job job = {0};
+    job.begin = 0;
+    job.end = queue_count;
+    job.grain = 1;
+    job.for_func = _task_graph_participant;
+    job.context = graph;
+    job.no_helpers = true;
+    _thread_pool_execute(pool, &job);
+    return true;
+}
+#endif
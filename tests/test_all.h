@@ -28,6 +28,8 @@
 #include "test_platform.h"
 #include "test_random.h"
 #include "test_arena.h"
+#include "test_arena_shared.h"
+#include "test_arena_snapshot.h"
 #include "test_array.h"
 #include "test_hash.h"
 #include "test_log.h"
@@ -40,7 +42,18 @@
 #include "test_base64.h"
 #include "test_serialize.h"
 #include "test_spmc_queue.h"
+#include "test_sync.h"
+#include "test_thread_pool.h"
+#include "test_task_graph.h"
+#include "test_fiber.h"
 #include "test_debug_allocator.h"
+#include "test_allocator_tlsf_mt.h"
+#include "test_allocator_slab.h"
+#include "test_allocator_pool.h"
+#include "test_allocator_sampling.h"
+#include "test_allocator_compacting.h"
+#include "test_allocator_tracking.h"
+#include "test_allocator_trace.h"
 #include "test_unicode.h"
 
 typedef enum Test_Func_Type {
@@ -70,6 +83,7 @@ static void test_all(double total_time)
     //unicode_format_ranges_file("GeneralCategory.txt", "GeneralCategory_C.txt");
     run_tests(NULL, total_time, 
         UNIT_TEST(platform_test_all),
+        UNIT_TEST(platform_test_topology),
         UNIT_TEST(test_unicode_unit),
         UNIT_TEST(test_list),
         UNIT_TEST(test_image),
@@ -86,13 +100,27 @@ static void test_all(double total_time)
         TIMED_TEST(test_hash),
         TIMED_TEST(test_hash),
         TIMED_TEST(test_arena),
+        TIMED_TEST(test_arena_shared),
+        TIMED_TEST(test_arena_snapshot),
         TIMED_TEST(test_math),
         TIMED_TEST(test_mem),
         TIMED_TEST(test_sort),
         TIMED_TEST(test_debug_allocator),
+        TIMED_TEST(test_debug_allocator_guard_pages),
         TIMED_TEST(slz4_test),
         TIMED_TEST(test_allocator_tlsf),
+        TIMED_TEST(test_allocator_tlsf_mt),
+        TIMED_TEST(test_allocator_slab),
+        TIMED_TEST(test_allocator_pool),
+        TIMED_TEST(test_allocator_sampling),
+        TIMED_TEST(test_allocator_compacting),
+        TIMED_TEST(test_allocator_tracking),
+        TIMED_TEST(test_allocator_trace),
         TIMED_TEST(test_spmc_queue),
+        TIMED_TEST(test_sync),
+        TIMED_TEST(test_thread_pool),
+        TIMED_TEST(test_task_graph),
+        TIMED_TEST(test_fiber),
         UNIT_TEST(NULL)
     );
 }
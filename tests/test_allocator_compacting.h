@@ -0,0 +1,122 @@
+#pragma once
+
+#include "../allocator_compacting.h"
+#include "../time.h"
+#include "../random.h"
+
+#define TEST_COMPACT_LIVE 512
+
+typedef struct Test_Compact_Item {
+    Compacted handle;
+    isize size;
+    uint8_t stamp;
+    bool is_pinned;
+    uint8_t* pinned_ptr;
+} Test_Compact_Item;
+
+static void _test_compact_check(Compacting_Allocator* compact, Test_Compact_Item* items, isize count)
+{
+    for(isize i = 0; i < count; i++)
+    {
+        if(items[i].handle == 0)
+            continue;
+
+        uint8_t* data = (uint8_t*) compact_get(compact, items[i].handle);
+        TEST(data != NULL && compact_size(compact, items[i].handle) == items[i].size);
+        if(items[i].is_pinned)
+            TEST(data == items[i].pinned_ptr);
+        for(isize k = 0; k < items[i].size; k++)
+            TEST(data[k] == items[i].stamp);
+    }
+    compact_test_consistency(compact);
+}
+
+static void test_allocator_compacting(double max_time)
+{
+    Test_Compact_Item* items = (Test_Compact_Item*) calloc(TEST_COMPACT_LIVE, sizeof(Test_Compact_Item));
+    double start = clock_sec();
+    for(isize iter = 0; iter == 0 || clock_sec() - start < max_time; iter++)
+    {
+        Compacting_Allocator compact = {0};
+        compact_init(&compact, NULL, 64*1024, "test_allocator_compacting");
+        memset(items, 0, TEST_COMPACT_LIVE*sizeof(Test_Compact_Item));
+
+        //Stale and null handles resolve to nothing
+        Compacted stale = compact_alloc(&compact, 10, 8);
+        TEST(compact_get(&compact, stale) != NULL);
+        compact_dealloc(&compact, stale);
+        TEST(compact_get(&compact, stale) == NULL && compact_size(&compact, stale) == 0);
+        TEST(compact_get(&compact, 0) == NULL);
+        compact_dealloc(&compact, stale);
+
+        //Cache like workload - fill all items then random items get replaced
+        for(isize op = 0; op < 4000; op++)
+        {
+            isize i = op < TEST_COMPACT_LIVE ? op : random_range(0, TEST_COMPACT_LIVE);
+            Test_Compact_Item* item = &items[i];
+            if(item->is_pinned)
+            {
+                compact_unpin(&compact, item->handle);
+                item->is_pinned = false;
+            }
+            compact_dealloc(&compact, item->handle);
+
+            item->size = random_range(0, 10) == 0 ? random_range(1, 20000) : random_range(1, 300);
+            item->stamp = (uint8_t) random_range(0, 256);
+            item->handle = compact_alloc(&compact, item->size, (isize) 1 << random_range(0, 7));
+            memset(compact_get(&compact, item->handle), item->stamp, (size_t) item->size);
+
+            if(random_range(0, 50) == 0)
+            {
+                item->is_pinned = true;
+                item->pinned_ptr = (uint8_t*) compact_pin(&compact, item->handle);
+            }
+
+            if(op % 100 == 0)
+            {
+                compact_incremental(&compact, 0);
+                _test_compact_check(&compact, items, TEST_COMPACT_LIVE);
+            }
+        }
+
+        _test_compact_check(&compact, items, TEST_COMPACT_LIVE);
+        Compact_Stats before = compact_get_stats(&compact);
+        TEST(before.live_count == TEST_COMPACT_LIVE);
+        TEST(before.bytes_used == before.bytes_live + before.bytes_padding + before.bytes_holes);
+
+        //After full compaction only blocks with pinned allocations can stay fragmented
+        compact_all(&compact);
+        _test_compact_check(&compact, items, TEST_COMPACT_LIVE);
+        Compact_Stats after = compact_get_stats(&compact);
+        TEST(after.bytes_holes <= before.bytes_holes);
+        TEST(after.bytes_live == before.bytes_live);
+        for(uint32_t b = 0; b < compact.block_count; b++)
+        {
+            Compact_Block* block = &compact.blocks[b];
+            if(block->data && block->pinned_count == 0 && block->used_to > 0)
+                TEST(block->used_to - block->live_bytes - block->padding_bytes < block->used_to*compact.fragmentation_threshold);
+        }
+
+        //With nothing pinned compaction reclaims everything
+        for(isize i = 0; i < TEST_COMPACT_LIVE; i++)
+            if(items[i].is_pinned)
+            {
+                compact_unpin(&compact, items[i].handle);
+                items[i].is_pinned = false;
+            }
+        compact_all(&compact);
+        _test_compact_check(&compact, items, TEST_COMPACT_LIVE);
+        after = compact_get_stats(&compact);
+        TEST(after.pinned_count == 0);
+        TEST(after.fragmentation < compact.fragmentation_threshold);
+        TEST(compact_incremental(&compact, 0) == 0);
+
+        for(isize i = 0; i < TEST_COMPACT_LIVE; i++)
+            compact_dealloc(&compact, items[i].handle);
+        after = compact_get_stats(&compact);
+        TEST(after.live_count == 0 && after.bytes_used == 0 && after.block_count <= 1);
+        compact_test_consistency(&compact);
+        compact_deinit(&compact);
+    }
+    free(items);
+}
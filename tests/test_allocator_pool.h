@@ -0,0 +1,176 @@
+#pragma once
+
+#include "../allocator_pool.h"
+#include "../platform.h"
+#include "../time.h"
+#include "../random.h"
+
+#define TEST_POOL_MAX_THREADS 8
+#define TEST_POOL_LIVE 256
+
+typedef struct Test_Pool_Item {
+    uint8_t* ptr;
+    uint8_t stamp;
+} Test_Pool_Item;
+
+typedef struct Test_Pool {
+    Pool* pool;
+    Channel* exchange; //items handed to other threads to be put there
+    Channel_Info info;
+    Wait_Group done;
+    isize iters;
+} Test_Pool;
+
+static Test_Pool_Item _test_pool_get(Pool* pool)
+{
+    Test_Pool_Item item = {0};
+    item.ptr = (uint8_t*) pool_get(pool);
+    item.stamp = (uint8_t) random_range(0, 256);
+    TEST(item.ptr != NULL);
+    TEST((uintptr_t) item.ptr % (uintptr_t) pool->item_align == 0);
+    memset(item.ptr, item.stamp, (size_t) pool->item_size);
+    return item;
+}
+
+static void _test_pool_put(Pool* pool, Test_Pool_Item item)
+{
+    //Detects items handed out twice
+    for(isize i = 0; i < pool->item_size; i++)
+        TEST(item.ptr[i] == item.stamp);
+    pool_put(pool, item.ptr);
+}
+
+static void _test_pool_thread(void* context)
+{
+    Test_Pool* test = (Test_Pool*) context;
+    Test_Pool_Item live[TEST_POOL_LIVE] = {0};
+    isize live_count = 0;
+
+    for(isize i = 0; i < test->iters; i++)
+    {
+        isize op = random_range(0, 10);
+        Test_Pool_Item item = {0};
+        if(op < 5 && live_count < TEST_POOL_LIVE)
+            live[live_count++] = _test_pool_get(test->pool);
+        else if(op < 8 && live_count > 0)
+        {
+            isize index = random_range(0, live_count);
+            _test_pool_put(test->pool, live[index]);
+            live[index] = live[--live_count];
+        }
+        else if(op < 9 && live_count > 0)
+        {
+            isize index = random_range(0, live_count);
+            if(channel_try_push(test->exchange, &live[index], test->info) == CHANNEL_OK)
+                live[index] = live[--live_count];
+        }
+        else if(channel_try_pop(test->exchange, &item, test->info) == CHANNEL_OK)
+            _test_pool_put(test->pool, item);
+    }
+
+    for(isize i = 0; i < live_count; i++)
+        _test_pool_put(test->pool, live[i]);
+
+    //Leave the cache for the next round of threads
+    if(random_range(0, 2))
+        pool_thread_detach(test->pool);
+    wait_group_pop(&test->done, 1, SYNC_WAIT_BLOCK);
+}
+
+static void test_allocator_pool_unit(uint64_t flags)
+{
+    Pool pool = {0};
+    TEST(pool_init(&pool, 40, 32, "test", flags));
+
+    //Put item is reused right away
+    void* a = pool_get(&pool);
+    TEST((uintptr_t) a % 32 == 0);
+    pool_put(&pool, a);
+    void* b = pool_get(&pool);
+    TEST(a == b);
+
+    //Allocator interface serves only items which fit
+    Allocator_Error error = {0};
+    TEST(allocator_try_reallocate(pool.alloc, 41, NULL, 0, 8, &error) == NULL);
+    TEST(error.error == ALLOCATOR_ERROR_INVALID_PARAMS);
+    TEST(allocator_try_reallocate(pool.alloc, 8, NULL, 0, 64, &error) == NULL);
+    void* c = allocator_allocate(pool.alloc, 10, 16);
+    TEST(c != NULL && c != b);
+    TEST(allocator_reallocate(pool.alloc, 40, c, 10, 16) == c);
+    allocator_deallocate(pool.alloc, c, 40, 16);
+
+    //Going through many magazines in both directions
+    enum {COUNT = 10*POOL_MAGAZINE_SIZE + 3};
+    void** items = (void**) malloc(COUNT*sizeof(void*));
+    for(isize i = 0; i < COUNT; i++)
+    {
+        items[i] = pool_get(&pool);
+        memset(items[i], 0x11, 40);
+        for(isize j = 0; j < i; j++)
+            TEST(items[i] != items[j]);
+    }
+    for(isize i = 0; i < COUNT; i++)
+        pool_put(&pool, items[i]);
+    for(isize i = 0; i < COUNT; i++)
+        items[i] = pool_get(&pool);
+    for(isize i = 0; i < COUNT; i++)
+        pool_put(&pool, items[i]);
+    free(items);
+    pool_put(&pool, b);
+
+    //Only the first pass carves new items
+    TEST(pool.item_count <= COUNT + 2 + POOL_MAGAZINE_SIZE);
+
+    Allocator_Stats stats = allocator_get_stats(pool.alloc);
+    TEST(stats.type_name != NULL && strcmp(stats.type_name, "Pool") == 0);
+    TEST(stats.allocation_count > 0);
+    TEST(stats.allocation_count == stats.deallocation_count);
+    TEST(stats.bytes_allocated == 0);
+
+    pool_thread_detach(&pool);
+    pool_deinit(&pool);
+}
+
+static void test_allocator_pool_stress(uint64_t flags, isize thread_count, isize rounds, isize iters)
+{
+    Pool pool = {0};
+    TEST(pool_init(&pool, random_range(1, 200), (isize) 1 << random_range(0, 7), "test", flags));
+
+    Test_Pool test = {&pool};
+    test.info = SINIT(Channel_Info){sizeof(Test_Pool_Item)};
+    test.exchange = channel_malloc(256, test.info);
+    test.iters = iters;
+
+    for(isize round = 0; round < rounds; round++)
+    {
+        wait_group_push(&test.done, thread_count);
+        for(isize i = 0; i < thread_count; i++)
+            TEST(platform_thread_launch(0, _test_pool_thread, &test, "pool %lli", (long long) i) == 0);
+        wait_group_wait(&test.done, SYNC_WAIT_BLOCK);
+    }
+
+    Test_Pool_Item item = {0};
+    while(channel_try_pop(test.exchange, &item, test.info) == CHANNEL_OK)
+        _test_pool_put(&pool, item);
+    channel_deinit(test.exchange);
+
+    Allocator_Stats stats = allocator_get_stats(pool.alloc);
+    TEST(stats.allocation_count == stats.deallocation_count);
+    TEST(stats.bytes_allocated == 0);
+
+    pool_thread_detach(&pool);
+    pool_deinit(&pool);
+}
+
+static void test_allocator_pool(double max_time)
+{
+    test_allocator_pool_unit(0);
+    test_allocator_pool_unit(POOL_DEBUG);
+
+    double start = clock_sec();
+    for(isize iter = 0; clock_sec() - start < max_time; iter++)
+    {
+        uint64_t flags = random_range(0, 2) ? POOL_DEBUG : 0;
+        test_allocator_pool_stress(flags, random_range(1, TEST_POOL_MAX_THREADS + 1), random_range(1, 4), random_range(100, 20000));
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "../allocator_sampling.h"
+#include "../time.h"
+#include "../random.h"
+
+#define TEST_SAMPLING_PERIOD 4096
+#define TEST_SAMPLING_COUNT  50000
+
+static ATTRIBUTE_INLINE_NEVER void* _test_sampling_site_a(Sampling_Allocator* sampling, isize size)
+{
+    return allocator_allocate(sampling->alloc, size, 8);
+}
+
+static ATTRIBUTE_INLINE_NEVER void* _test_sampling_site_b(Sampling_Allocator* sampling, isize size)
+{
+    return allocator_allocate(sampling->alloc, size, 8);
+}
+
+static void _test_sampling_totals(const Sampling_Allocator* sampling, isize* live_bytes, isize* total_bytes, isize* sampled_live)
+{
+    *live_bytes = 0, *total_bytes = 0, *sampled_live = 0;
+    for(isize i = 0; i < sampling->site_count; i++)
+    {
+        *live_bytes += sampling->sites[i].live_bytes;
+        *total_bytes += sampling->sites[i].total_bytes;
+        *sampled_live += sampling->sites[i].sampled_live_count;
+    }
+}
+
+static void test_allocator_sampling(double max_time)
+{
+    double start = clock_sec();
+    for(isize iter = 0; iter == 0 || clock_sec() - start < max_time; iter++)
+    {
+        Sampling_Allocator sampling = {0};
+        sampling_allocator_init(&sampling, NULL, NULL, TEST_SAMPLING_PERIOD, "test_allocator_sampling");
+
+        //Site b allocates twice as much as site a
+        void** ptrs = (void**) calloc(TEST_SAMPLING_COUNT, sizeof(void*));
+        isize* sizes = (isize*) calloc(TEST_SAMPLING_COUNT, sizeof(isize));
+        isize actual_a = 0, actual_b = 0;
+        for(isize i = 0; i < TEST_SAMPLING_COUNT; i++)
+        {
+            sizes[i] = random_range(1, 129);
+            if(i % 3 == 0)
+            {
+                ptrs[i] = _test_sampling_site_a(&sampling, sizes[i]);
+                actual_a += sizes[i];
+            }
+            else
+            {
+                ptrs[i] = _test_sampling_site_b(&sampling, sizes[i]);
+                actual_b += sizes[i];
+            }
+            memset(ptrs[i], 0x55, (size_t) sizes[i]);
+        }
+
+        isize live_bytes = 0, total_bytes = 0, sampled_live = 0;
+        _test_sampling_totals(&sampling, &live_bytes, &total_bytes, &sampled_live);
+        isize actual = actual_a + actual_b;
+        TEST(sampling.bytes_allocated == actual);
+        TEST(sampling.sample_count > 0 && sampling.sample_count == sampled_live);
+        TEST(live_bytes == total_bytes);
+
+        //The estimate is unbiased. With ~800 expected samples its standard deviation is about 3.5% so this never fails by chance.
+        TEST(llabs(total_bytes - actual) < actual*25/100);
+
+        //Each function is its own call site (possibly more than one if the compiler duplicated the call)
+        TEST(sampling.site_count >= 2);
+
+        //Exporting produces something
+        String_Builder folded = builder_make(allocator_get_default(), 0);
+        String_Builder pprof = builder_make(allocator_get_default(), 0);
+        sampling_allocator_export(&sampling, &folded, SAMPLING_EXPORT_FOLDED_LIVE);
+        sampling_allocator_export(&sampling, &pprof, SAMPLING_EXPORT_PPROF);
+        TEST(folded.count > 0);
+        TEST(pprof.count > 0 && strncmp(pprof.data, "heap profile:", 13) == 0);
+        TEST(strstr(pprof.data, "@ heap_v2/4096") != NULL);
+        builder_deinit(&folded);
+        builder_deinit(&pprof);
+
+        //Reallocations of sampled pointers move the sample
+        for(isize i = 0; i < TEST_SAMPLING_COUNT; i += 7)
+        {
+            isize new_size = random_range(1, 129);
+            ptrs[i] = allocator_reallocate(sampling.alloc, new_size, ptrs[i], sizes[i], 8);
+            sizes[i] = new_size;
+        }
+
+        //After freeing everything nothing is live and the cumulative values stay
+        for(isize i = 0; i < TEST_SAMPLING_COUNT; i++)
+            allocator_deallocate(sampling.alloc, ptrs[i], sizes[i], 8);
+
+        _test_sampling_totals(&sampling, &live_bytes, &total_bytes, &sampled_live);
+        TEST(sampling.bytes_allocated == 0);
+        TEST(live_bytes == 0 && sampled_live == 0);
+        TEST(sampling.sample_hash.count == 0);
+        TEST(total_bytes > 0);
+
+        free(ptrs);
+        free(sizes);
+        sampling_allocator_deinit(&sampling);
+    }
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "../allocator_slab.h"
+#include "../time.h"
+#include "../random.h"
+
+//Counts the bytes the slab allocator holds. (Tracking_Allocator cannot store the slab alignment)
+static isize _test_slab_parent_bytes = 0;
+static void* _test_slab_parent_func(void* self, int mode, isize new_size, void* old_ptr, isize old_size, isize align, void* rest)
+{
+    (void) self;
+    if(mode == ALLOCATOR_MODE_ALLOC)
+        _test_slab_parent_bytes += new_size - old_size;
+    return (*allocator_get_malloc())(allocator_get_malloc(), mode, new_size, old_ptr, old_size, align, rest);
+}
+static Allocator _test_slab_parent = _test_slab_parent_func;
+
+static void test_allocator_slab_unit()
+{
+    TEST(slab_size_class(0, 8) == -1);
+    TEST(slab_size_class(1, 8) == 0);
+    TEST(slab_size_class(17, 8) == 1);
+    TEST(slab_size_class(65, 8) == 4);
+    TEST(slab_size_class(48, 32) == 3);
+    TEST(slab_size_class(SLAB_MAX_SIZE, 8) == SLAB_SIZE_CLASSES - 1);
+    TEST(slab_size_class(SLAB_MAX_SIZE + 1, 8) == -1);
+    TEST(slab_size_class(8, 2*SLAB_MAX_ALIGN) == -1);
+    for(isize size = 1; size <= SLAB_MAX_SIZE; size++)
+        for(isize align = 1; align <= SLAB_MAX_ALIGN; align *= 2)
+        {
+            int32_t size_class = slab_size_class(size, align);
+            TEST(size_class >= 0);
+            TEST(slab_size_class_size(size_class) >= size);
+            TEST(slab_size_class_size(size_class) % MIN(align, 16) == 0);
+        }
+
+    _test_slab_parent_bytes = 0;
+
+    Slab_Allocator slab = {0};
+    slab_allocator_init(&slab, &_test_slab_parent, "test");
+
+    void* a = allocator_allocate(slab.alloc, 24, 8);
+    allocator_deallocate(slab.alloc, a, 24, 8);
+    void* b = allocator_allocate(slab.alloc, 32, 8);
+    TEST(a == b);
+    TEST(allocator_reallocate(slab.alloc, 20, b, 32, 8) == b);
+    b = allocator_reallocate(slab.alloc, 5000, b, 20, 8);
+    TEST(b != NULL);
+    allocator_deallocate(slab.alloc, b, 5000, 8);
+
+    //Fill more than one slab and free everything. At most one empty slab per class is kept.
+    enum {COUNT = 3*SLAB_ALLOCATOR_SLAB_SIZE/64};
+    void** ptrs = (void**) malloc(COUNT*sizeof(void*));
+    for(isize i = 0; i < COUNT; i++)
+    {
+        ptrs[i] = allocator_allocate(slab.alloc, 64, 64);
+        TEST((uintptr_t) ptrs[i] % 64 == 0);
+    }
+    TEST(slab.classes[3].slab_count >= 3);
+
+    //Querying stats goes through the same function as allocation and must not allocate
+    isize allocations_before = slab.allocation_count;
+    Allocator_Stats stats = allocator_get_stats(slab.alloc);
+    TEST(stats.type_name != NULL && strcmp(stats.type_name, "Slab_Allocator") == 0);
+    TEST(stats.parent == &_test_slab_parent);
+    TEST(stats.bytes_allocated == COUNT*64);
+    TEST(stats.max_concurrent_allocations >= COUNT);
+    TEST(stats.allocation_count == allocations_before);
+    TEST(slab.allocation_count == allocations_before);
+
+    for(isize i = 0; i < COUNT; i++)
+        allocator_deallocate(slab.alloc, ptrs[COUNT - i - 1], 64, 64);
+    TEST(slab.classes[3].slab_count == 1);
+    TEST(_test_slab_parent_bytes == slab.slab_count*SLAB_ALLOCATOR_SLAB_SIZE);
+    TEST(slab.bytes_allocated == 0);
+    TEST(slab.allocation_count == slab.deallocation_count);
+    stats = allocator_get_stats(slab.alloc);
+    TEST(stats.bytes_allocated == 0);
+    TEST(stats.allocation_count == stats.deallocation_count);
+    free(ptrs);
+
+    slab_allocator_deinit(&slab);
+    TEST(_test_slab_parent_bytes == 0);
+}
+
+typedef struct Test_Slab_Item {
+    uint8_t* ptr;
+    isize size;
+    isize align;
+} Test_Slab_Item;
+
+static void test_allocator_slab_stress(double max_time)
+{
+    enum {MAX_LIVE = 4096};
+    Test_Slab_Item* items = (Test_Slab_Item*) calloc(MAX_LIVE, sizeof *items);
+
+    _test_slab_parent_bytes = 0;
+    Slab_Allocator slab = {0};
+    slab_allocator_init(&slab, &_test_slab_parent, "test");
+
+    isize live = 0;
+    double start = clock_sec();
+    for(isize iter = 0; clock_sec() - start < max_time; iter++)
+    {
+        //Phases of growing and shrinking so that slabs get emptied and returned
+        isize target = random_range(0, MAX_LIVE);
+        while(live != target)
+        {
+            if(live < target)
+            {
+                Test_Slab_Item item = {0};
+                item.size = random_range(0, 10) == 0 ? random_range(1, 3*SLAB_MAX_SIZE) : random_range(1, 257);
+                item.align = (isize) 1 << random_range(0, 8);
+                item.ptr = (uint8_t*) allocator_allocate(slab.alloc, item.size, item.align);
+                TEST((uintptr_t) item.ptr % (uintptr_t) item.align == 0);
+                memset(item.ptr, (int) (live & 0xFF), (size_t) item.size);
+                items[live++] = item;
+            }
+            else
+            {
+                isize index = random_range(0, live);
+                Test_Slab_Item* item = &items[index];
+                for(isize k = 0; k < item->size; k++)
+                    TEST(item->ptr[k] == (uint8_t) (index & 0xFF));
+
+                if(random_range(0, 4) == 0)
+                {
+                    //Reallocate in place of freeing
+                    isize new_size = random_range(1, 2*SLAB_MAX_SIZE);
+                    item->ptr = (uint8_t*) allocator_reallocate(slab.alloc, new_size, item->ptr, item->size, item->align);
+                    for(isize k = 0; k < MIN(new_size, item->size); k++)
+                        TEST(item->ptr[k] == (uint8_t) (index & 0xFF));
+                    item->size = new_size;
+                    memset(item->ptr, (int) (index & 0xFF), (size_t) item->size);
+                }
+
+                allocator_deallocate(slab.alloc, item->ptr, item->size, item->align);
+                items[index] = items[--live];
+                if(index < live)
+                    memset(items[index].ptr, (int) (index & 0xFF), (size_t) items[index].size);
+            }
+        }
+    }
+
+    for(isize i = 0; i < live; i++)
+        allocator_deallocate(slab.alloc, items[i].ptr, items[i].size, items[i].align);
+
+    TEST(slab.bytes_allocated == 0);
+    TEST(slab.live_allocations == 0);
+    TEST(slab.slab_count <= SLAB_SIZE_CLASSES);
+    TEST(_test_slab_parent_bytes == slab.slab_count*SLAB_ALLOCATOR_SLAB_SIZE);
+    slab_allocator_deinit(&slab);
+    TEST(_test_slab_parent_bytes == 0);
+    free(items);
+}
+
+static void test_allocator_slab(double max_time)
+{
+    test_allocator_slab_unit();
+    test_allocator_slab_stress(max_time);
+}
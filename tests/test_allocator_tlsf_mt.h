@@ -0,0 +1,243 @@
+#pragma once
+
+#include "../allocator_tlsf_mt.h"
+#include "../platform.h"
+#include "../time.h"
+#include "../random.h"
+
+#define TEST_TLSF_MT_MAX_THREADS 8
+#define TEST_TLSF_MT_LIVE 64
+
+typedef struct Test_Tlsf_Mt_Item {
+    uint8_t* ptr;
+    isize size;
+    isize align;
+} Test_Tlsf_Mt_Item;
+
+typedef struct Test_Tlsf_Mt {
+    Tlsf_Mt_Allocator* allocator;
+    Channel* exchange; //blocks handed to other threads to be freed there
+    Channel_Info info;
+    Wait_Group done;
+    isize iters;
+} Test_Tlsf_Mt;
+
+static Test_Tlsf_Mt_Item _test_tlsf_mt_alloc(Tlsf_Mt_Allocator* allocator)
+{
+    //Mostly small cached sizes with a few direct ones
+    Test_Tlsf_Mt_Item item = {0};
+    item.size = random_range(0, 8) == 0 ? random_range(1, 4096) : random_range(1, TLSF_MT_MAX_CACHED_SIZE + 1);
+    item.align = (isize) 1 << random_range(0, 7);
+    item.ptr = (uint8_t*) tlsf_mt_allocator_func(allocator, ALLOCATOR_MODE_ALLOC, item.size, NULL, 0, item.align, NULL);
+    TEST(item.ptr != NULL);
+    TEST((uintptr_t) item.ptr % (uintptr_t) item.align == 0);
+    memset(item.ptr, (int) (item.size & 0xFF), (size_t) item.size);
+    return item;
+}
+
+static void _test_tlsf_mt_free(Tlsf_Mt_Allocator* allocator, Test_Tlsf_Mt_Item item)
+{
+    //Detects blocks handed out twice
+    for(isize i = 0; i < item.size; i++)
+        TEST(item.ptr[i] == (uint8_t) (item.size & 0xFF));
+    tlsf_mt_allocator_func(allocator, ALLOCATOR_MODE_ALLOC, 0, item.ptr, item.size, item.align, NULL);
+}
+
+static void _test_tlsf_mt_thread(void* context)
+{
+    Test_Tlsf_Mt* test = (Test_Tlsf_Mt*) context;
+    Test_Tlsf_Mt_Item live[TEST_TLSF_MT_LIVE] = {0};
+    isize live_count = 0;
+
+    for(isize i = 0; i < test->iters; i++)
+    {
+        isize op = random_range(0, 10);
+        Test_Tlsf_Mt_Item item = {0};
+        if(op < 4 && live_count < TEST_TLSF_MT_LIVE)
+            live[live_count++] = _test_tlsf_mt_alloc(test->allocator);
+        else if(op < 6 && live_count > 0)
+        {
+            isize index = random_range(0, live_count);
+            _test_tlsf_mt_free(test->allocator, live[index]);
+            live[index] = live[--live_count];
+        }
+        else if(op < 7 && live_count > 0)
+        {
+            Test_Tlsf_Mt_Item* old = &live[random_range(0, live_count)];
+            isize new_size = random_range(1, 2*TLSF_MT_MAX_CACHED_SIZE);
+            uint8_t* new_ptr = (uint8_t*) tlsf_mt_allocator_func(test->allocator, ALLOCATOR_MODE_ALLOC, new_size, old->ptr, old->size, old->align, NULL);
+            TEST(new_ptr != NULL);
+            for(isize k = 0; k < MIN(old->size, new_size); k++)
+                TEST(new_ptr[k] == (uint8_t) (old->size & 0xFF));
+
+            old->ptr = new_ptr;
+            old->size = new_size;
+            memset(old->ptr, (int) (old->size & 0xFF), (size_t) old->size);
+        }
+        else if(op < 8 && live_count > 0)
+        {
+            isize index = random_range(0, live_count);
+            if(channel_try_push(test->exchange, &live[index], test->info) == CHANNEL_OK)
+                live[index] = live[--live_count];
+        }
+        else if(channel_try_pop(test->exchange, &item, test->info) == CHANNEL_OK)
+            _test_tlsf_mt_free(test->allocator, item);
+    }
+
+    for(isize i = 0; i < live_count; i++)
+        _test_tlsf_mt_free(test->allocator, live[i]);
+
+    //Leave the cache for the next round of threads
+    if(random_range(0, 2))
+        tlsf_mt_thread_detach(test->allocator);
+    wait_group_pop(&test->done, 1, SYNC_WAIT_BLOCK);
+}
+
+static void test_allocator_tlsf_mt_unit()
+{
+    TEST(tlsf_mt_size_class(0, 1) == -1);
+    TEST(tlsf_mt_size_class(1, 1) == 0);
+    TEST(tlsf_mt_size_class(16, 16) == 0);
+    TEST(tlsf_mt_size_class(17, 8) == 1);
+    TEST(tlsf_mt_size_class(129, 8) == 8);
+    TEST(tlsf_mt_size_class(TLSF_MT_MAX_CACHED_SIZE, 8) == TLSF_MT_SIZE_CLASSES - 1);
+    TEST(tlsf_mt_size_class(TLSF_MT_MAX_CACHED_SIZE + 1, 8) == -1);
+    TEST(tlsf_mt_size_class(8, 32) == -1);
+    for(isize size = 1; size <= TLSF_MT_MAX_CACHED_SIZE; size++)
+        TEST(tlsf_mt_size_class_size(tlsf_mt_size_class(size, 1)) >= size);
+
+    isize memory_size = 4*MB;
+    isize node_size = 64*KB;
+    void* memory = malloc((size_t) memory_size);
+    void* nodes = malloc((size_t) node_size);
+    Tlsf_Allocator tlsf = {0};
+    TEST(tlsf_init(&tlsf, memory, memory_size, nodes, node_size));
+
+    Tlsf_Mt_Allocator allocator = {0};
+    tlsf_mt_init(&allocator, &tlsf, "test");
+
+    //Freed block is reused right away
+    void* a = tlsf_mt_malloc(&allocator, 24, 8);
+    tlsf_mt_free(&allocator, a, 24, 8);
+    void* b = tlsf_mt_malloc(&allocator, 30, 8);
+    TEST(a == b);
+
+    //Resizing inside the size class keeps the pointer
+    TEST(tlsf_mt_allocator_func(&allocator, ALLOCATOR_MODE_ALLOC, 32, b, 30, 8, NULL) == b);
+    b = tlsf_mt_allocator_func(&allocator, ALLOCATOR_MODE_ALLOC, 5000, b, 32, 8, NULL);
+    TEST(b != NULL);
+    tlsf_mt_free(&allocator, b, 5000, 8);
+
+    //The refilled batch stays cached until detach
+    tlsf_mt_free(&allocator, tlsf_mt_malloc(&allocator, 64, 8), 64, 8);
+    isize tlsf_allocations = tlsf.allocation_count;
+    for(isize i = 0; i < 3; i++)
+        tlsf_mt_free(&allocator, tlsf_mt_malloc(&allocator, 64, 8), 64, 8);
+    TEST(tlsf.allocation_count == tlsf_allocations);
+
+    tlsf_mt_thread_detach(&allocator);
+    tlsf_mt_deinit(&allocator);
+    TEST(tlsf.allocation_count == tlsf.deallocation_count);
+    tlsf_test_consistency(&tlsf, 0);
+
+    free(memory);
+    free(nodes);
+}
+
+static void test_allocator_tlsf_mt_no_cache()
+{
+    isize memory_size = 16*KB;
+    isize node_size = 64*KB;
+    void* memory = malloc((size_t) memory_size);
+    void* nodes = malloc((size_t) node_size);
+    Tlsf_Allocator tlsf = {0};
+    TEST(tlsf_init(&tlsf, memory, memory_size, nodes, node_size));
+
+    Tlsf_Mt_Allocator allocator = {0};
+    tlsf_mt_init(&allocator, &tlsf, "test");
+
+    //Fill the memory with smallest blocks and free a few neighbouring ones. There is now room for
+    // a small block but not for the cache so the allocation has to take the direct path.
+    void* fill[1024] = {0};
+    isize fill_count = 0;
+    for(; fill_count < 1024; fill_count++)
+    {
+        fill[fill_count] = tlsf_malloc(&tlsf, 16 + (isize) sizeof(Tlsf_Mt_Header), TLSF_MT_MAX_CACHED_ALIGN, 0);
+        if(fill[fill_count] == NULL)
+            break;
+    }
+    TEST(4 < fill_count && fill_count < 1024);
+    for(isize i = 0; i < 4; i++)
+        tlsf_free(&tlsf, fill[i]);
+
+    uint8_t* ptr = (uint8_t*) tlsf_mt_malloc(&allocator, 16, 8);
+    TEST(ptr != NULL);
+    TEST(allocator.caches == NULL);
+    TEST(allocator.direct_allocation_count == 1);
+    memset(ptr, 0x55, 16);
+
+    //Resizing inside the size class keeps the pointer even without a cache
+    TEST(tlsf_mt_allocator_func(&allocator, ALLOCATOR_MODE_ALLOC, 12, ptr, 16, 8, NULL) == ptr);
+    tlsf_mt_free(&allocator, ptr, 12, 8);
+    TEST(allocator.direct_deallocation_count == 1);
+    TEST(allocator.direct_bytes_allocated == 0);
+
+    for(isize i = 4; i < fill_count; i++)
+        tlsf_free(&tlsf, fill[i]);
+
+    tlsf_mt_deinit(&allocator);
+    TEST(tlsf.allocation_count == tlsf.deallocation_count);
+    tlsf_test_consistency(&tlsf, 0);
+
+    free(memory);
+    free(nodes);
+}
+
+static void test_allocator_tlsf_mt_stress(isize thread_count, isize rounds, isize iters)
+{
+    isize memory_size = 64*MB;
+    isize node_size = 4*MB;
+    void* memory = malloc((size_t) memory_size);
+    void* nodes = malloc((size_t) node_size);
+    Tlsf_Allocator tlsf = {0};
+    TEST(tlsf_init(&tlsf, memory, memory_size, nodes, node_size));
+
+    Tlsf_Mt_Allocator allocator = {0};
+    tlsf_mt_init(&allocator, &tlsf, "test");
+
+    Test_Tlsf_Mt test = {&allocator};
+    test.info = SINIT(Channel_Info){sizeof(Test_Tlsf_Mt_Item)};
+    test.exchange = channel_malloc(256, test.info);
+    test.iters = iters;
+
+    for(isize round = 0; round < rounds; round++)
+    {
+        wait_group_push(&test.done, thread_count);
+        for(isize i = 0; i < thread_count; i++)
+            TEST(platform_thread_launch(0, _test_tlsf_mt_thread, &test, "tlsf mt %lli", (long long) i) == 0);
+        wait_group_wait(&test.done, SYNC_WAIT_BLOCK);
+    }
+
+    Test_Tlsf_Mt_Item item = {0};
+    while(channel_try_pop(test.exchange, &item, test.info) == CHANNEL_OK)
+        _test_tlsf_mt_free(&allocator, item);
+    channel_deinit(test.exchange);
+
+    tlsf_mt_deinit(&allocator);
+    TEST(tlsf.allocation_count == tlsf.deallocation_count);
+    TEST(tlsf.bytes_allocated == 0);
+    tlsf_test_consistency(&tlsf, 0);
+
+    free(memory);
+    free(nodes);
+}
+
+static void test_allocator_tlsf_mt(double max_time)
+{
+    test_allocator_tlsf_mt_unit();
+    test_allocator_tlsf_mt_no_cache();
+
+    double start = clock_sec();
+    for(isize iter = 0; clock_sec() - start < max_time; iter++)
+        test_allocator_tlsf_mt_stress(random_range(1, TEST_TLSF_MT_MAX_THREADS + 1), random_range(1, 4), random_range(100, 20000));
+}
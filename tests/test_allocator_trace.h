@@ -0,0 +1,180 @@
+#pragma once
+
+#include "../allocator_trace.h"
+#include "../allocator_debug.h"
+#include "../allocator_tlsf.h"
+#include "../allocator_tracking.h"
+#include "../scratch.h"
+#include "../log.h"
+#include "../time.h"
+#include "../random.h"
+
+#define TEST_ALLOCATION_TRACE_PATH "__allocation_trace_test__.bin"
+#define TEST_ALLOCATION_TRACE_LIVE 1000
+
+static void _test_allocation_trace_record(Allocator* alloc, Allocator* parent, isize ops)
+{
+    void* ptrs[TEST_ALLOCATION_TRACE_LIVE] = {0};
+    isize sizes[TEST_ALLOCATION_TRACE_LIVE] = {0};
+    isize aligns[TEST_ALLOCATION_TRACE_LIVE] = {0};
+    for(isize op = 0; op < ops; op++)
+    {
+        isize i = random_range(0, TEST_ALLOCATION_TRACE_LIVE);
+        isize new_size = random_range(0, 8) == 0 ? random_range(1, 64*1024) : random_range(1, 256);
+        if(ptrs[i] == NULL)
+        {
+            aligns[i] = (isize) 1 << random_range(0, 7);
+            ptrs[i] = allocator_allocate(alloc, new_size, aligns[i]);
+            sizes[i] = new_size;
+        }
+        else if(random_range(0, 3) == 0)
+        {
+            ptrs[i] = allocator_reallocate(alloc, new_size, ptrs[i], sizes[i], aligns[i]);
+            sizes[i] = new_size;
+        }
+        else
+        {
+            allocator_deallocate(alloc, ptrs[i], sizes[i], aligns[i]);
+            ptrs[i] = NULL;
+        }
+    }
+
+    //Leave about half of the allocations alive at the end of the trace. Free them directly through the parent
+    // so that the recorder does not see it.
+    for(isize i = 0; i < TEST_ALLOCATION_TRACE_LIVE; i++)
+        if(ptrs[i])
+            allocator_deallocate(i % 2 ? parent : alloc, ptrs[i], sizes[i], aligns[i]);
+}
+
+static void _test_allocation_trace_log(const char* name, Allocation_Replay_Stats stats)
+{
+    LOG_INFO("TEST", "replay %-18s %9.0lf events/s peak live %7.2lfMB peak rss %7.2lfMB fragmentation %.2lf",
+        name, stats.events_per_second, (double) stats.peak_live_bytes/MB, (double) stats.peak_rss_bytes/MB, stats.fragmentation);
+}
+
+//Records a random trace and replays it against the allocators we have and reports how each of them does.
+// Not part of test_allocator_trace as it only prints numbers.
+static void benchmark_allocation_trace_replay(isize ops)
+{
+    Platform_String path = {TEST_ALLOCATION_TRACE_PATH, sizeof TEST_ALLOCATION_TRACE_PATH - 1};
+    Allocation_Trace_Recorder recorder = {0};
+    TEST(allocation_trace_recorder_init(&recorder, allocator_get_malloc(), NULL, path, "benchmark_allocation_trace_replay") == 0);
+    _test_allocation_trace_record(recorder.alloc, recorder.parent, ops);
+    TEST(allocation_trace_recorder_deinit(&recorder) == 0);
+
+    Allocation_Trace trace = {0};
+    TEST(allocation_trace_load(&trace, path) == 0);
+
+    _test_allocation_trace_log("malloc", allocation_trace_replay(&trace, allocator_get_malloc()));
+
+    Tracking_Allocator tracking = {0};
+    tracking_allocator_init(&tracking, "benchmark_allocation_trace_replay", 0);
+    _test_allocation_trace_log("Tracking_Allocator", allocation_trace_replay(&trace, tracking.alloc));
+    tracking_allocator_deinit(&tracking);
+
+    isize memory_size = trace.peak_live_bytes*2 + MB;
+    isize node_memory_size = (trace.peak_live_count*2 + 64)*(isize) sizeof(Tlsf_Node);
+    void* memory = malloc((size_t) memory_size);
+    void* nodes = malloc((size_t) node_memory_size);
+    Tlsf_Allocator tlsf = {0};
+    tlsf_init(&tlsf, memory, memory_size, nodes, node_memory_size);
+    _test_allocation_trace_log("Tlsf_Allocator", allocation_trace_replay(&trace, &tlsf.allocator));
+    free(memory);
+    free(nodes);
+
+    Scratch_Arena scratch_arena = {0};
+    scratch_arena_init(&scratch_arena, "benchmark_allocation_trace_replay", 0, 0, 0);
+    Scratch scratch = scratch_acquire(&scratch_arena);
+    _test_allocation_trace_log("Scratch", allocation_trace_replay(&trace, scratch.alloc));
+    scratch_release(&scratch);
+    scratch_arena_deinit(&scratch_arena);
+
+    allocation_trace_unload(&trace);
+    platform_file_remove(path, false);
+}
+
+//Writes a trace file made of header followed by event_bytes bytes of (zeroed) events and tries to load it
+static Platform_Error _test_allocation_trace_load_crafted(Platform_String path, Allocation_Trace_Header header, isize event_bytes)
+{
+    uint8_t file[sizeof(Allocation_Trace_Header) + 4*sizeof(Allocation_Trace_Event)] = {0};
+    TEST(event_bytes <= 4*(isize) sizeof(Allocation_Trace_Event));
+    memcpy(file, &header, sizeof header);
+    TEST(platform_file_write_entire(path, file, (isize) sizeof header + event_bytes, false) == 0);
+
+    Allocation_Trace trace = {0};
+    Platform_Error error = allocation_trace_load(&trace, path);
+    if(error == 0)
+        TEST(trace.event_count == event_bytes/(isize) sizeof(Allocation_Trace_Event));
+    else
+        TEST(trace.events == NULL && trace.event_count == 0);
+    allocation_trace_unload(&trace);
+    return error;
+}
+
+static void test_allocator_trace(double max_time)
+{
+    Platform_String path = {TEST_ALLOCATION_TRACE_PATH, sizeof TEST_ALLOCATION_TRACE_PATH - 1};
+    double start = clock_sec();
+    for(isize iter = 0; iter == 0 || clock_sec() - start < max_time; iter++)
+    {
+        Allocation_Trace_Recorder recorder = {0};
+        TEST(allocation_trace_recorder_init(&recorder, allocator_get_malloc(), NULL, path, "test_allocator_trace") == 0);
+        isize ops = random_range(0, 20000);
+        _test_allocation_trace_record(recorder.alloc, recorder.parent, ops);
+
+        isize recorded = recorder.event_count;
+        isize max_bytes_allocated = recorder.max_bytes_allocated;
+        isize allocation_count = recorder.allocation_count;
+        isize deallocation_count = recorder.deallocation_count;
+        isize reallocation_count = recorder.reallocation_count;
+        TEST(recorded == allocation_count + deallocation_count + reallocation_count);
+        TEST(allocation_trace_recorder_deinit(&recorder) == 0);
+
+        Allocation_Trace trace = {0};
+        TEST(allocation_trace_load(&trace, path) == 0);
+        TEST(trace.event_count == recorded);
+        TEST(trace.thread_count == (recorded > 0));
+        TEST(trace.peak_live_bytes == max_bytes_allocated);
+        TEST(trace.peak_live_count <= TEST_ALLOCATION_TRACE_LIVE);
+
+        //Ids are reused so we never need more of them than there are live allocations at once
+        TEST(trace.max_id == trace.peak_live_count);
+
+        //The debug allocator checks that every free and resize matches size and alignment of the allocation
+        Debug_Allocator debug = debug_allocator_make(allocator_get_malloc(), DEBUG_ALLOC_LEAK_CHECK);
+        Allocation_Replay_Stats stats = allocation_trace_replay(&trace, debug.alloc);
+        TEST(stats.event_count == recorded && stats.failed_count == 0);
+        TEST(stats.allocation_count == allocation_count);
+        TEST(stats.deallocation_count == deallocation_count);
+        TEST(stats.reallocation_count == reallocation_count);
+        TEST(stats.peak_live_bytes == max_bytes_allocated);
+        TEST(debug.allocation_count == allocation_count);
+        TEST(debug.alive_count == 0);
+        debug_allocator_deinit(&debug);
+        allocation_trace_unload(&trace);
+    }
+
+    //Traces with a valid header but inconsistent contents are rejected
+    Allocation_Trace_Header header = {0};
+    header.magic = ALLOCATION_TRACE_MAGIC;
+    header.version = ALLOCATION_TRACE_VERSION;
+    header.event_size = sizeof(Allocation_Trace_Event);
+    isize event_size = (isize) sizeof(Allocation_Trace_Event);
+    TEST(_test_allocation_trace_load_crafted(path, header, 0) == 0);
+    TEST(_test_allocation_trace_load_crafted(path, header, 4*event_size) == 0);
+
+    //the event stream was cut short mid event (for example the recording process crashed mid write)
+    TEST(_test_allocation_trace_load_crafted(path, header, 3*event_size + event_size/2) != 0);
+    TEST(_test_allocation_trace_load_crafted(path, header, 1) != 0);
+
+    //the file was written by a different version of the recorder
+    Allocation_Trace_Header other_version = header;
+    other_version.version = ALLOCATION_TRACE_VERSION + 1;
+    TEST(_test_allocation_trace_load_crafted(path, other_version, 4*event_size) != 0);
+
+    Allocation_Trace_Header other_event_size = header;
+    other_event_size.event_size = sizeof(Allocation_Trace_Event) + 8;
+    TEST(_test_allocation_trace_load_crafted(path, other_event_size, 4*event_size) != 0);
+
+    platform_file_remove(path, false);
+}
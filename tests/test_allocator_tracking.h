@@ -0,0 +1,121 @@
+#pragma once
+
+#include "../allocator_tracking.h"
+#include "../time.h"
+#include "../random.h"
+
+#define TEST_TRACKING_COUNT 1000
+
+//Both go through the allocator.h helpers yet are told apart as two sites
+static ATTRIBUTE_INLINE_NEVER void* _test_tracking_site_a(Tracking_Allocator* tracking, isize size, isize align)
+{
+    return allocator_allocate(tracking->alloc, size, align);
+}
+
+static ATTRIBUTE_INLINE_NEVER void* _test_tracking_site_b(Tracking_Allocator* tracking, isize size, isize align)
+{
+    return allocator_allocate(tracking->alloc, size, align);
+}
+
+static isize _test_tracking_site_live(const Tracking_Allocator* tracking, isize* live_count)
+{
+    isize live_bytes = 0;
+    *live_count = 0;
+    for(isize i = 0; i < tracking->site_count; i++)
+    {
+        TEST(tracking->sites[i].live_bytes >= 0 && tracking->sites[i].live_count >= 0);
+        TEST(tracking->sites[i].max_live_bytes >= tracking->sites[i].live_bytes);
+        live_bytes += tracking->sites[i].live_bytes;
+        *live_count += tracking->sites[i].live_count;
+    }
+    return live_bytes;
+}
+
+static void test_allocator_tracking(double max_time)
+{
+    void** ptrs = (void**) calloc(TEST_TRACKING_COUNT, sizeof(void*));
+    isize* sizes = (isize*) calloc(TEST_TRACKING_COUNT, sizeof(isize));
+    isize* aligns = (isize*) calloc(TEST_TRACKING_COUNT, sizeof(isize));
+
+    double start = clock_sec();
+    for(isize iter = 0; iter == 0 || clock_sec() - start < max_time; iter++)
+    {
+        Tracking_Allocator tracking = {0};
+        tracking_allocator_init(&tracking, "test_allocator_tracking", TRACKING_ALLOCATOR_INIT_SITES);
+
+        //Site b allocates about twice as much as site a. Some of site b is tagged.
+        const char* tag = "tagged";
+        isize bytes_a = 0, bytes_b = 0, bytes_tagged = 0;
+        for(isize i = 0; i < TEST_TRACKING_COUNT; i++)
+        {
+            sizes[i] = random_range(1, 200);
+            aligns[i] = (isize) 1 << random_range(0, 8);
+            if(i % 4 == 0)
+            {
+                ptrs[i] = _test_tracking_site_a(&tracking, sizes[i], aligns[i]);
+                bytes_a += sizes[i];
+            }
+            else if(i % 4 != 3)
+            {
+                ptrs[i] = _test_tracking_site_b(&tracking, sizes[i], aligns[i]);
+                bytes_b += sizes[i];
+            }
+            else
+            {
+                const char* prev = tracking_allocator_set_site_tag(&tracking, tag);
+                ptrs[i] = _test_tracking_site_b(&tracking, sizes[i], aligns[i]);
+                TEST(tracking_allocator_set_site_tag(&tracking, prev) == tag);
+                bytes_tagged += sizes[i];
+            }
+            TEST(((uintptr_t) ptrs[i] & (uintptr_t) (aligns[i] - 1)) == 0);
+            memset(ptrs[i], 0x55, (size_t) sizes[i]);
+        }
+
+        //Each function is its own call site plus the tag
+        isize live_count = 0;
+        TEST(tracking.site_count == 3);
+        TEST(_test_tracking_site_live(&tracking, &live_count) == tracking.bytes_allocated);
+        TEST(live_count == TEST_TRACKING_COUNT);
+
+        //The dump is sorted by live bytes so the site b comes before site a
+        String_Builder dump = builder_make(allocator_get_default(), 0);
+        tracking_allocator_dump_sites(&tracking, &dump);
+        isize b_line = -1, a_line = -1;
+        for(isize i = 0; i < tracking.site_count; i++)
+        {
+            if(tracking.sites[i].live_bytes == bytes_a)
+                a_line = i;
+            if(tracking.sites[i].live_bytes == bytes_b)
+                b_line = i;
+        }
+        TEST(a_line != -1 && b_line != -1 && strstr(dump.data, "tagged") != NULL);
+        char a_prefix[64] = {0}, b_prefix[64] = {0};
+        snprintf(a_prefix, sizeof a_prefix, "%lli %lli ", (lli) bytes_a, (lli) tracking.sites[a_line].live_count);
+        snprintf(b_prefix, sizeof b_prefix, "%lli %lli ", (lli) bytes_b, (lli) tracking.sites[b_line].live_count);
+        TEST(strstr(dump.data, b_prefix) != NULL && strstr(dump.data, b_prefix) < strstr(dump.data, a_prefix));
+        builder_deinit(&dump);
+
+        //Reallocations stay with the original site
+        isize site_count = tracking.site_count;
+        for(isize i = 0; i < TEST_TRACKING_COUNT; i += 7)
+        {
+            isize new_size = random_range(1, 200);
+            ptrs[i] = allocator_reallocate(tracking.alloc, new_size, ptrs[i], sizes[i], aligns[i]);
+            sizes[i] = new_size;
+        }
+        TEST(tracking.site_count == site_count);
+        TEST(_test_tracking_site_live(&tracking, &live_count) == tracking.bytes_allocated);
+        TEST(live_count == TEST_TRACKING_COUNT);
+
+        //Free half of the allocations and let deinit take care of the rest
+        for(isize i = 0; i < TEST_TRACKING_COUNT; i += 2)
+            allocator_deallocate(tracking.alloc, ptrs[i], sizes[i], aligns[i]);
+        TEST(_test_tracking_site_live(&tracking, &live_count) == tracking.bytes_allocated);
+        TEST(live_count == TEST_TRACKING_COUNT/2);
+        tracking_allocator_deinit(&tracking);
+    }
+
+    free(ptrs);
+    free(sizes);
+    free(aligns);
+}
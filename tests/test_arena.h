@@ -1,5 +1,6 @@
 #pragma once
 #include "../scratch.h"
+#include "../arena.h"
 #include "../random.h"
 #include "../time.h"
 
@@ -182,9 +183,158 @@ void test_arena_assembly()
         scratch_push_nonzero(&arena, 200, void*);
 }
 
+static void test_arena_memory_hints()
+{
+    isize huge = platform_huge_page_size();
+    Platform_Virtual_Allocation hints[] = {
+        (Platform_Virtual_Allocation) 0,
+        PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES,
+        PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES_EXPLICIT,
+        (Platform_Virtual_Allocation) (PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES | PLATFORM_VIRTUAL_ALLOC_NUMA_NODE(0)),
+    };
+
+    for(isize i = 0; i < ARRAY_COUNT(hints); i++)
+    {
+        Arena arena = {0};
+        TEST(arena_init_custom(&arena, "test_arena_hints", 64*MB, 64*KB, hints[i]) == 0);
+        if(hints[i] && huge > 0)
+        {
+            TEST((uintptr_t) arena.data % (uintptr_t) huge == 0);
+            TEST(arena.commit_granularity % huge == 0);
+        }
+
+        //Pushes spanning multiple commits must all be usable 
+        uint8_t* small = (uint8_t*) arena_push(&arena, 100, 1);
+        uint8_t* big = (uint8_t*) arena_push(&arena, 3*arena.commit_granularity + 7, 8);
+        memset(small, 0x55, 100);
+        memset(big, 0x66, (size_t) (3*arena.commit_granularity + 7));
+        TEST(arena.commit_to >= arena.used_to);
+        TEST((arena.commit_to - arena.data) % arena.commit_granularity == 0);
+        arena_deinit(&arena);
+
+        Scratch_Arena scratch_arena = {0};
+        TEST(scratch_arena_init_custom(&scratch_arena, "test_scratch_hints", 64*MB, 0, 0, hints[i]) == 0);
+        SCRATCH_SCOPE_FROM(scratch, &scratch_arena)
+        {
+            uint8_t* data = scratch_push(&scratch, 10*MB, uint8_t);
+            memset(data, 0x77, 10*MB);
+        }
+        scratch_arena_deinit(&scratch_arena);
+    }
+}
+
+static void test_arena_decommit()
+{
+    Arena_Decommit_Policy policy = {256*KB, 3};
+    {
+        Arena arena = {0};
+        TEST(arena_init(&arena, "test_arena_decommit", 64*MB, 64*KB) == 0);
+        arena_set_decommit_policy(&arena, policy);
+
+        //Spike
+        memset(arena_push_nonzero(&arena, 4*MB, 8, NULL), 0x11, 4*MB);
+        arena_reset(&arena, 0);
+        TEST(arena.commit_to - arena.data >= 4*MB);
+
+        //Usage above the mark restarts the count
+        for(isize i = 0; i < 2; i++)
+        {
+            arena_push(&arena, 100*KB, 8);
+            arena_reset(&arena, 0);
+        }
+        arena_push(&arena, 1*MB, 8);
+        arena_reset(&arena, 0);
+        for(isize i = 0; i < 2; i++)
+        {
+            arena_push(&arena, 100*KB, 8);
+            arena_reset(&arena, 0);
+        }
+        TEST(arena.decommit_count == 0);
+        
+        //Third reset below the mark in a row decommits down to the mark
+        arena_push(&arena, 100*KB, 8);
+        arena_reset(&arena, 0);
+        TEST(arena.decommit_count == 1);
+        TEST(arena.commit_to - arena.data == 256*KB);
+
+        //Decommitted memory is committed again when needed
+        uint8_t* data = (uint8_t*) arena_push(&arena, 2*MB, 8);
+        for(isize i = 0; i < 2*MB; i++)
+            TEST(data[i] == 0);
+
+        Allocator_Stats stats = allocator_get_stats(arena.alloc);
+        TEST(stats.type_name != NULL && strcmp(stats.type_name, "Arena") == 0);
+        TEST(stats.bytes_allocated == 2*MB);
+        TEST(stats.bytes_committed == arena.commit_to - arena.data);
+        TEST(stats.bytes_committed >= 2*MB);
+        arena_reset(&arena, 0);
+
+        //Popping back to the middle is not a reset and does not count for the policy
+        for(isize i = 0; i < 2*policy.reset_count; i++)
+        {
+            arena_push(&arena, 10*KB, 8);
+            uint8_t* mark = arena.used_to;
+            arena_push(&arena, 100*KB, 8);
+            arena_reset_ptr(&arena, mark);
+        }
+        TEST(arena.decommit_count == 1);
+
+        //...but the usage before the pop still counts as the peak
+        arena_push(&arena, 1*MB, 8);
+        arena_reset(&arena, 100*KB);
+        arena_reset(&arena, 0);
+        for(isize i = 0; i < policy.reset_count - 1; i++)
+        {
+            arena_push(&arena, 100*KB, 8);
+            arena_reset(&arena, 0);
+        }
+        TEST(arena.decommit_count == 1);
+        arena_reset(&arena, 0);
+        TEST(arena.decommit_count == 2);
+        TEST(allocator_get_stats(arena.alloc).bytes_committed == 256*KB);
+        arena_deinit(&arena);
+    }
+
+    {
+        Scratch_Arena scratch_arena = {0};
+        TEST(scratch_arena_init(&scratch_arena, "test_scratch_decommit", 64*MB, 64*KB, 0) == 0);
+        scratch_arena_set_decommit_policy(&scratch_arena, policy);
+
+        SCRATCH_SCOPE_FROM(level1, &scratch_arena)
+            SCRATCH_SCOPE_FROM(level2, &scratch_arena)
+                SCRATCH_SCOPE_FROM(level3, &scratch_arena)
+                    memset(scratch_push_nonzero(&level3, 4*MB, uint8_t), 0x22, 4*MB);
+
+        Scratch_Stack* stack = &scratch_arena.stacks[0];
+        isize spike_commit = stack->commit_to - stack->reserved_from;
+        TEST(spike_commit >= 4*MB);
+        for(isize i = 0; i < policy.reset_count; i++)
+            SCRATCH_SCOPE_FROM(level1, &scratch_arena)
+            {
+                scratch_push(&level1, 100*KB, uint8_t);
+                TEST(stack->commit_to - stack->reserved_from == spike_commit);
+            }
+
+        TEST(scratch_arena.decommit_count == 1);
+        TEST(stack->commit_to - *stack->frames <= policy.high_water_mark + 64*KB);
+        SCRATCH_SCOPE_FROM(level1, &scratch_arena)
+        {
+            memset(scratch_push_nonzero(&level1, 2*MB, uint8_t), 0x33, 2*MB);
+            Allocator_Stats stats = allocator_get_stats(level1.alloc);
+            TEST(stats.type_name != NULL && strcmp(stats.type_name, "Scratch") == 0);
+            TEST(stats.bytes_allocated >= 2*MB);
+            TEST(stats.bytes_committed == stack->commit_to - stack->reserved_from);
+            TEST(stats.bytes_committed >= 2*MB);
+        }
+        scratch_arena_deinit(&scratch_arena);
+    }
+}
+
 static void test_arena(f64 time)
 {
     test_arena_unit();
+    test_arena_memory_hints();
+    test_arena_decommit();
     test_arena_stress(time);
     test_arena_assembly();
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "../arena_shared.h"
+#include "../platform.h"
+#include "../time.h"
+#include "../random.h"
+
+#define TEST_ARENA_SHARED_MAX_THREADS 8
+#define TEST_ARENA_SHARED_PUSHES 2000
+
+typedef struct Test_Arena_Shared_Push {
+    uint8_t* ptr;
+    isize size;
+} Test_Arena_Shared_Push;
+
+typedef struct Test_Arena_Shared {
+    Arena_Shared* shared;
+    Wait_Group done;
+    CHAN_ATOMIC(isize) thread_index;
+    Test_Arena_Shared_Push pushes[TEST_ARENA_SHARED_MAX_THREADS][TEST_ARENA_SHARED_PUSHES];
+} Test_Arena_Shared;
+
+static void _test_arena_shared_thread(void* context)
+{
+    Test_Arena_Shared* test = (Test_Arena_Shared*) context;
+    isize index = atomic_fetch_add(&test->thread_index, 1);
+    for(isize i = 0; i < TEST_ARENA_SHARED_PUSHES; i++)
+    {
+        Test_Arena_Shared_Push push = {0};
+        push.size = random_range(0, 10) == 0 ? random_range(0, 64*KB) : random_range(0, 100);
+        isize align = (isize) 1 << random_range(0, 8);
+        push.ptr = (uint8_t*) arena_shared_push_nonzero(test->shared, push.size, align, NULL);
+        TEST(push.ptr != NULL);
+        TEST((uintptr_t) push.ptr % (uintptr_t) align == 0);
+        memset(push.ptr, (int) index, (size_t) push.size);
+        test->pushes[index][i] = push;
+    }
+
+    //Nobody wrote over our pushes
+    for(isize i = 0; i < TEST_ARENA_SHARED_PUSHES; i++)
+        for(isize k = 0; k < test->pushes[index][i].size; k++)
+            TEST(test->pushes[index][i].ptr[k] == (uint8_t) index);
+
+    wait_group_pop(&test->done, 1, SYNC_WAIT_BLOCK);
+}
+
+static void test_arena_shared(double max_time)
+{
+    Test_Arena_Shared* test = (Test_Arena_Shared*) calloc(1, sizeof *test);
+    Arena_Shared shared = {0};
+    TEST(arena_shared_init(&shared, "test_arena_shared", 256*MB, 64*KB) == 0);
+    test->shared = &shared;
+
+    //Single threaded behaves just like an arena
+    uint8_t* a = (uint8_t*) arena_shared_push(&shared, 3, 1);
+    uint8_t* b = (uint8_t*) arena_shared_push(&shared, 8, 8);
+    uint8_t* c = (uint8_t*) arena_shared_push(&shared, 1, 64);
+    TEST(a == shared.arena.data && b == a + ARENA_SHARED_ALIGN);
+    TEST((uintptr_t) c % 64 == 0 && c >= b + 8);
+    TEST(arena_shared_used(&shared) == c + ARENA_SHARED_ALIGN - a);
+    arena_shared_reset(&shared, 0);
+    TEST(arena_shared_push_nonzero(&shared, 1, 1, NULL) == a);
+
+    //Running out of reserved memory is reported and leaves the arena usable
+    Allocator_Error error = {0};
+    TEST(arena_shared_push_nonzero(&shared, 512*MB, 8, &error) == NULL);
+    TEST(error.error == ALLOCATOR_ERROR_OUT_OF_MEM);
+    TEST(arena_shared_push_nonzero(&shared, 512*MB, 64, &error) == NULL);
+    TEST(arena_shared_used(&shared) == ARENA_SHARED_ALIGN);
+    TEST(arena_shared_push_nonzero(&shared, 1, 1, NULL) == a + ARENA_SHARED_ALIGN);
+    arena_shared_reset(&shared, 0);
+
+    double start = clock_sec();
+    for(isize iter = 0; clock_sec() - start < max_time; iter++)
+    {
+        isize thread_count = random_range(1, TEST_ARENA_SHARED_MAX_THREADS + 1);
+        atomic_store(&test->thread_index, 0);
+        wait_group_push(&test->done, thread_count);
+        for(isize i = 0; i < thread_count; i++)
+            TEST(platform_thread_launch(0, _test_arena_shared_thread, test, "arena shared %lli", (long long) i) == 0);
+        wait_group_wait(&test->done, SYNC_WAIT_BLOCK);
+
+        //All pushes fit contiguously into the used region
+        isize total = 0;
+        for(isize t = 0; t < thread_count; t++)
+            for(isize i = 0; i < TEST_ARENA_SHARED_PUSHES; i++)
+            {
+                Test_Arena_Shared_Push push = test->pushes[t][i];
+                TEST(shared.arena.data <= push.ptr && push.ptr + push.size <= shared.arena.data + arena_shared_used(&shared));
+                total += push.size;
+            }
+        TEST(total <= arena_shared_used(&shared));
+        TEST(arena_shared_used(&shared) <= shared.arena.commit_to - shared.arena.data);
+
+        //Quiescent point
+        arena_shared_reset(&shared, 0);
+    }
+
+    arena_shared_deinit(&shared);
+    free(test);
+}
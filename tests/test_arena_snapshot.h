@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../arena_snapshot.h"
+#include "../random.h"
+#include "../time.h"
+
+#define TEST_ARENA_SNAPSHOT_PATH "__arena_snapshot_test__.bin"
+
+typedef struct Test_Snapshot_Node {
+    REL_PTR(struct Test_Snapshot_Node) next;
+    REL_PTR(char) name;
+    int64_t value;
+} Test_Snapshot_Node;
+
+typedef struct Test_Snapshot_Root {
+    REL_PTR(Test_Snapshot_Node) first;
+    REL_PTR(int64_t) table;
+    int64_t count;
+} Test_Snapshot_Root;
+
+static void test_arena_snapshot(double max_time)
+{
+    Platform_String path = {TEST_ARENA_SNAPSHOT_PATH, sizeof TEST_ARENA_SNAPSHOT_PATH - 1};
+    double start = clock_sec();
+    for(isize iter = 0; iter == 0 || clock_sec() - start < max_time; iter++)
+    {
+        Arena arena = {0};
+        TEST(arena_init(&arena, "test_arena_snapshot", 64*MB, 64*KB) == 0);
+
+        //Some padding so that the root is not at the start
+        arena_push(&arena, random_range(0, 100), 8);
+
+        isize count = random_range(0, 1000);
+        Test_Snapshot_Root* root = ARENA_PUSH(&arena, 1, Test_Snapshot_Root);
+        int64_t* table = ARENA_PUSH(&arena, count, int64_t);
+        REL_PTR_SET(root->table, count ? table : NULL);
+        root->count = count;
+
+        REL_PTR(Test_Snapshot_Node)* last = &root->first;
+        for(isize i = 0; i < count; i++)
+        {
+            Test_Snapshot_Node* node = ARENA_PUSH(&arena, 1, Test_Snapshot_Node);
+            char* name = ARENA_PUSH(&arena, 32, char);
+            snprintf(name, 32, "node %lli", (long long) i);
+            node->value = i*i;
+            table[i] = i*3;
+            REL_PTR_SET(node->name, name);
+            REL_PTR_SET(*last, node);
+            last = &node->next;
+        }
+
+        TEST(arena_snapshot_save(&arena, root, path) == 0);
+
+        Arena_Snapshot snapshot = {0};
+        TEST(arena_snapshot_load(&snapshot, path) == 0);
+        TEST(snapshot.size == arena.used_to - arena.data);
+        TEST(snapshot.data != arena.data);
+        TEST((uintptr_t) snapshot.data % ARENA_SNAPSHOT_HEADER_SIZE == 0);
+        arena_deinit(&arena);
+
+        //Walk the structure in its new location
+        const Test_Snapshot_Root* loaded = (const Test_Snapshot_Root*) snapshot.root;
+        TEST(loaded != NULL && loaded->count == count);
+        const int64_t* loaded_table = REL_PTR_GET(const int64_t, loaded->table);
+        TEST((loaded_table == NULL) == (count == 0));
+
+        isize walked = 0;
+        for(const Test_Snapshot_Node* node = REL_PTR_GET(const Test_Snapshot_Node, loaded->first); node; node = REL_PTR_GET(const Test_Snapshot_Node, node->next))
+        {
+            char expected[32] = {0};
+            snprintf(expected, sizeof expected, "node %lli", (long long) walked);
+            TEST(strcmp(REL_PTR_GET(const char, node->name), expected) == 0);
+            TEST(node->value == walked*walked);
+            TEST(loaded_table[walked] == walked*3);
+            TEST((const uint8_t*) snapshot.data <= (const uint8_t*) node && (const uint8_t*) node < (const uint8_t*) snapshot.data + snapshot.size);
+            walked += 1;
+        }
+        TEST(walked == count);
+        arena_snapshot_unload(&snapshot);
+    }
+
+    //Files which are not snapshots are rejected
+    const char garbage[] = "definitely not a snapshot file... definitely not a snapshot file...";
+    TEST(platform_file_write_entire(path, garbage, sizeof garbage, false) == 0);
+    Arena_Snapshot snapshot = {0};
+    TEST(arena_snapshot_load(&snapshot, path) != 0);
+    TEST(snapshot.data == NULL);
+
+    platform_file_remove(path, false);
+}
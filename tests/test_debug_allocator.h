@@ -58,3 +58,147 @@ INTERNAL void test_debug_allocator(double time)
     }
     debug_allocator_deinit(&debugdebug);
 }
+
+typedef struct Test_Debug_Guard_Access {
+    volatile uint8_t* ptr;
+    isize offset;
+    bool write;
+} Test_Debug_Guard_Access;
+
+static void _test_debug_allocator_guard_access(void* context)
+{
+    Test_Debug_Guard_Access* access = (Test_Debug_Guard_Access*) context;
+    if(access->write)
+        access->ptr[access->offset] = 0x11;
+    else
+        (void) access->ptr[access->offset];
+}
+
+static bool _test_debug_allocator_guard_faults(void* ptr, isize offset, bool write)
+{
+    Test_Debug_Guard_Access access = {(volatile uint8_t*) ptr, offset, write};
+    return platform_exception_sandbox(_test_debug_allocator_guard_access, &access, NULL) == false;
+}
+
+//Bytes of address space mapped by the process or -1 if we have no way of telling
+static isize _test_debug_allocator_mapped_bytes()
+{
+    isize out = -1;
+    #ifdef __linux__
+        long long pages = 0;
+        FILE* file = fopen("/proc/self/statm", "r");
+        if(file && fscanf(file, "%lli", &pages) == 1)
+            out = (isize) pages*platform_page_size();
+        if(file)
+            fclose(file);
+    #endif
+    return out;
+}
+
+//Sizes just around page boundaries make the alignment slack push the start of the block into different 
+// pages of the guarded region. Freeing has to release the whole region in every case.
+static void _test_debug_allocator_guard_page_release()
+{
+    isize page_size = platform_page_size();
+    Debug_Allocator_Options options = {0};
+    options.pre_dead_zone_size = 16;
+    options.capture_stack_frames_count = 4;
+    options.guard_page_sample_rate = 1;
+    options.guard_quarantine_count = 8;
+
+    Debug_Allocator debug = {0};
+    debug_allocator_init(&debug, allocator_get_default(), allocator_get_default(), options);
+    isize mapped_before = 0;
+    for(isize pass = 0; pass < 4; pass++)
+    {
+        //The first pass only warms up the bookkeeping
+        if(pass == 1)
+            mapped_before = _test_debug_allocator_mapped_bytes();
+
+        for(isize pages = 1; pages <= 3; pages++)
+            for(isize size = pages*page_size - 128; size <= pages*page_size + 128; size++)
+                for(isize align = 1; align <= 64; align *= 8)
+                {
+                    uint8_t* ptr = (uint8_t*) allocator_allocate(debug.alloc, size, align);
+                    memset(ptr, 0x44, (size_t) size);
+                    allocator_deallocate(debug.alloc, ptr, size, align);
+                }
+    }
+
+    //What is still in the quarantine is not yet released
+    isize mapped_after = _test_debug_allocator_mapped_bytes();
+    TEST(mapped_after - mapped_before <= options.guard_quarantine_count*4*page_size);
+    TEST(debug.alive_count == 0);
+    debug_allocator_deinit(&debug);
+}
+
+INTERNAL void test_debug_allocator_guard_pages(double time)
+{
+    _test_debug_allocator_guard_page_release();
+
+    isize page_size = platform_page_size();
+    for(double start = clock_sec(); clock_sec() - start < time; ) {
+        Debug_Allocator debug = debug_allocator_make(allocator_get_default(), DEBUG_ALLOC_GUARD_PAGES | DEBUG_ALLOC_LEAK_CHECK | DEBUG_ALLOC_CAPTURE_CALLSTACK);
+
+        //Every allocation ends right before a guard page (up to alignment)
+        enum {COUNT = 64};
+        uint8_t* ptrs[COUNT] = {0};
+        isize sizes[COUNT] = {0};
+        isize aligns[COUNT] = {0};
+        for(isize i = 0; i < COUNT; i++) {
+            sizes[i] = random_range(1, 3*page_size);
+            aligns[i] = 1ll << random_range(0, 7);
+            ptrs[i] = (uint8_t*) allocator_allocate(debug.alloc, sizes[i], aligns[i]);
+            TEST((uintptr_t) ptrs[i] % (uintptr_t) aligns[i] == 0);
+            
+            isize till_guard = (uint8_t*) align_forward(ptrs[i] + sizes[i], page_size) - (ptrs[i] + sizes[i]);
+            TEST(till_guard < aligns[i]);
+            memset(ptrs[i], 0x33, (size_t) sizes[i]);
+        }
+        TEST(debug.guarded_count == COUNT);
+        debug_allocator_test_all_allocations(debug.alloc);
+
+        //Overrun faults immediately
+        isize i = random_range(0, COUNT);
+        isize till_guard = (uint8_t*) align_forward(ptrs[i] + sizes[i], page_size) - (ptrs[i] + sizes[i]);
+        TEST(_test_debug_allocator_guard_faults(ptrs[i], sizes[i] + till_guard, true));
+        TEST(_test_debug_allocator_guard_faults(ptrs[i], sizes[i] - 1, true) == false);
+
+        //Use after free faults while in quarantine
+        uint8_t* freed = ptrs[i];
+        allocator_deallocate(debug.alloc, ptrs[i], sizes[i], aligns[i]);
+        TEST(_test_debug_allocator_guard_faults(freed, 0, false));
+        
+        //Reallocation moves the data to a new guarded allocation
+        isize j = (i + 1) % COUNT;
+        isize new_size = random_range(1, 3*page_size);
+        ptrs[j] = (uint8_t*) allocator_reallocate(debug.alloc, new_size, ptrs[j], sizes[j], aligns[j]);
+        for(isize k = 0; k < MIN(new_size, sizes[j]); k++)
+            TEST(ptrs[j][k] == 0x33);
+        sizes[j] = new_size;
+
+        for(isize k = 0; k < COUNT; k++)
+            if(k != i)
+                allocator_deallocate(debug.alloc, ptrs[k], sizes[k], aligns[k]);
+
+        TEST(debug.quarantine_pushed == COUNT + 1);
+        debug_allocator_deinit(&debug);
+
+        //Sampling guards only a fraction of allocations
+        Debug_Allocator_Options options = {0};
+        options.pre_dead_zone_size = 8;
+        options.post_dead_zone_size = 16;
+        options.guard_page_sample_rate = 8;
+        options.guard_quarantine_count = 16;
+        debug_allocator_init(&debug, allocator_get_default(), allocator_get_default(), options);
+        enum {SAMPLED_COUNT = 2048};
+        void** sampled = (void**) allocator_allocate(allocator_get_default(), SAMPLED_COUNT*sizeof(void*), 8);
+        for(isize k = 0; k < SAMPLED_COUNT; k++)
+            sampled[k] = allocator_allocate(debug.alloc, 24, 8);
+        TEST(SAMPLED_COUNT/16 < debug.guarded_count && debug.guarded_count < SAMPLED_COUNT/4);
+        for(isize k = 0; k < SAMPLED_COUNT; k++)
+            allocator_deallocate(debug.alloc, sampled[k], 24, 8);
+        allocator_deallocate(allocator_get_default(), sampled, SAMPLED_COUNT*sizeof(void*), 8);
+        debug_allocator_deinit(&debug);
+    }
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "../fiber.h"
+#include "../channel.h"
+#include "../time.h"
+#include "../random.h"
+
+typedef struct Test_Fiber {
+    Fiber_Scheduler* scheduler;
+    Channel* ping;
+    Channel* pong;
+    CHAN_ATOMIC(isize) counter;
+    CHAN_ATOMIC(isize) blocking_inside;
+    CHAN_ATOMIC(isize) blocking_max_inside;
+    isize iters;
+} Test_Fiber;
+
+static void _test_fiber_yielder(void* context)
+{
+    Test_Fiber* test = (Test_Fiber*) context;
+    volatile uint8_t touch_stack[4096];
+    for(isize i = 0; i < test->iters; i++)
+    {
+        touch_stack[i % sizeof touch_stack] = (uint8_t) i;
+        fiber_yield();
+        atomic_fetch_add(&test->counter, 1);
+    }
+    (void) touch_stack;
+}
+
+static void _test_fiber_pinger(void* context)
+{
+    Test_Fiber* test = (Test_Fiber*) context;
+    Channel_Info info = {sizeof(isize), fiber_sync_wait, fiber_sync_wake};
+    for(isize i = 0; i < test->iters; i++)
+    {
+        isize got = -1;
+        TEST(channel_push(test->ping, &i, info));
+        TEST(channel_pop(test->pong, &got, info));
+        TEST(got == i + 1);
+    }
+}
+
+static void _test_fiber_ponger(void* context)
+{
+    Test_Fiber* test = (Test_Fiber*) context;
+    Channel_Info info = {sizeof(isize), fiber_sync_wait, fiber_sync_wake};
+    for(isize i = 0; i < test->iters; i++)
+    {
+        isize got = -1;
+        TEST(channel_pop(test->ping, &got, info));
+        TEST(got == i);
+        got += 1;
+        TEST(channel_push(test->pong, &got, info));
+    }
+}
+
+static void _test_fiber_inner(void* context)
+{
+    Test_Fiber* test = (Test_Fiber*) context;
+    fiber_yield();
+    atomic_fetch_add(&test->counter, 1);
+}
+
+static void _test_fiber_outer(void* context)
+{
+    Test_Fiber* test = (Test_Fiber*) context;
+    Wait_Group done = {0};
+    for(isize i = 0; i < test->iters; i++)
+        TEST(fiber_spawn(test->scheduler, _test_fiber_inner, test, &done) == 0);
+
+    //With a single worker this only works if waiting parks the fiber instead of the thread
+    wait_group_wait(&done, SYNC_WAIT_FIBER);
+    TEST(atomic_load(&test->counter) == test->iters);
+}
+
+static void _test_fiber_sleep(void* context)
+{
+    Test_Fiber* test = (Test_Fiber*) context;
+    isize inside = atomic_fetch_add(&test->blocking_inside, 1) + 1;
+    isize max_inside = atomic_load(&test->blocking_max_inside);
+    while(inside > max_inside && atomic_compare_exchange_weak(&test->blocking_max_inside, &max_inside, inside) == false);
+
+    platform_thread_sleep(0.02);
+    atomic_fetch_sub(&test->blocking_inside, 1);
+}
+
+static void _test_fiber_blocker(void* context)
+{
+    Test_Fiber* test = (Test_Fiber*) context;
+    fiber_blocking(_test_fiber_sleep, test);
+    atomic_fetch_add(&test->counter, 1);
+}
+
+static void test_fiber_unit()
+{
+    //Outside of fibers everything degrades to plain thread calls
+    TEST(fiber_current() == NULL);
+    fiber_yield();
+    Test_Fiber test = {0};
+    fiber_blocking(_test_fiber_sleep, &test);
+    TEST(test.blocking_max_inside == 1);
+
+    //Nested waits on a single worker
+    Fiber_Scheduler scheduler = {0};
+    TEST(fiber_scheduler_init(&scheduler, 1, 4, 64*KB) == 0);
+    test.scheduler = &scheduler;
+    test.iters = 50;
+    Wait_Group done = {0};
+    TEST(fiber_spawn(&scheduler, _test_fiber_outer, &test, &done) == 0);
+    wait_group_wait(&done, SYNC_WAIT_FIBER);
+    TEST(test.counter == 50);
+
+    //Channel ping pong between two fibers on the single worker
+    Channel_Info info = {sizeof(isize), fiber_sync_wait, fiber_sync_wake};
+    test.ping = channel_malloc(1, info);
+    test.pong = channel_malloc(1, info);
+    test.iters = 1000;
+    TEST(fiber_spawn(&scheduler, _test_fiber_ponger, &test, &done) == 0);
+    TEST(fiber_spawn(&scheduler, _test_fiber_pinger, &test, &done) == 0);
+    wait_group_wait(&done, SYNC_WAIT_FIBER);
+    channel_deinit(test.ping);
+    channel_deinit(test.pong);
+
+    //Blocking calls overlap even though there is just one worker
+    test.counter = 0;
+    test.blocking_max_inside = 0;
+    for(isize i = 0; i < 4; i++)
+        TEST(fiber_spawn(&scheduler, _test_fiber_blocker, &test, &done) == 0);
+    wait_group_wait(&done, SYNC_WAIT_FIBER);
+    TEST(test.counter == 4);
+    TEST(test.blocking_max_inside > 1);
+
+    fiber_scheduler_deinit(&scheduler);
+}
+
+static void test_fiber_stress(isize threads, isize fibers, isize iters)
+{
+    Fiber_Scheduler scheduler = {0};
+    TEST(fiber_scheduler_init(&scheduler, threads, 2, 0) == 0);
+
+    Test_Fiber test = {&scheduler};
+    test.iters = iters;
+    Wait_Group done = {0};
+    for(isize i = 0; i < fibers; i++)
+        TEST(fiber_spawn(&scheduler, _test_fiber_yielder, &test, &done) == 0);
+
+    Channel_Info info = {sizeof(isize), fiber_sync_wait, fiber_sync_wake};
+    test.ping = channel_malloc(random_range(1, 4), info);
+    test.pong = channel_malloc(random_range(1, 4), info);
+    TEST(fiber_spawn(&scheduler, _test_fiber_ponger, &test, &done) == 0);
+    TEST(fiber_spawn(&scheduler, _test_fiber_pinger, &test, &done) == 0);
+
+    wait_group_wait(&done, SYNC_WAIT_FIBER);
+    TEST(test.counter == fibers*iters);
+    channel_deinit(test.ping);
+    channel_deinit(test.pong);
+
+    //Second round runs on the pooled stacks
+    for(isize i = 0; i < fibers; i++)
+        TEST(fiber_spawn(&scheduler, _test_fiber_yielder, &test, &done) == 0);
+    wait_group_wait(&done, SYNC_WAIT_FIBER);
+    TEST(test.counter == 2*fibers*iters);
+    fiber_scheduler_deinit(&scheduler);
+}
+
+static void test_fiber(double max_time)
+{
+    test_fiber_unit();
+
+    double start = clock_sec();
+    for(isize iter = 0; clock_sec() - start < max_time; iter++)
+        test_fiber_stress(random_range(1, 5), random_range(1, 300), random_range(1, 100));
+}
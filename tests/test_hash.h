@@ -248,7 +248,49 @@ INTERNAL void test_hash_stress(f64 max_seconds)
 	debug_allocator_deinit(&debug_alloc);
 }
 
+//A large table in an Arena backed by huge pages. The Arena holds only a single allocation so each rehash 
+// has to happen in place.
+INTERNAL void test_hash_grow_in_place()
+{
+	enum {COUNT = 200*1000};
+	Arena arena = {0};
+	TEST(arena_init_custom(&arena, "test_hash_grow_in_place", 64*MB, 0, PLATFORM_VIRTUAL_ALLOC_HUGE_PAGES) == 0);
+
+	Debug_Allocator debug_alloc = debug_allocator_make(allocator_get_default(), DEBUG_ALLOC_LEAK_CHECK);
+	Hash table = {0};
+	hash_init_grow_in_place(&table, arena.alloc, debug_alloc.alloc, 0);
+	for(u64 i = 0; i < COUNT; i++)
+	{
+		hash_insert(&table, i*0x9E3779B97F4A7C15ull, i + 2);
+		TEST(table.entries == (Hash_Entry*) (void*) arena.data);
+	}
+	TEST(table.rehashed_times > 10);
+	TEST(table.count == COUNT);
+
+	//Remove some so that the next rehash also has gravestones to get rid of
+	for(u64 i = 0; i < COUNT; i += 3)
+		TEST(hash_remove_with_value(&table, i*0x9E3779B97F4A7C15ull, i + 2) == 1);
+	TEST(table.gravestone_count > 0);
+	hash_copy_rehash(&table, &table, 0);
+	TEST(table.gravestone_count == 0 && table.entries == (Hash_Entry*) (void*) arena.data);
+	hash_test_consistency(&table, true);
+
+	for(u64 i = 0; i < COUNT; i++)
+	{
+		isize found = 0;
+		TEST(hash_find(&table, i*0x9E3779B97F4A7C15ull, &found) == (i % 3 != 0));
+		if(i % 3 != 0)
+			TEST(table.entries[found].value == i + 2);
+	}
+
+	hash_deinit(&table);
+	TEST(arena.used_to == arena.data);
+	debug_allocator_deinit(&debug_alloc);
+	arena_deinit(&arena);
+}
+
 INTERNAL void test_hash(f64 max_seconds)
 {
+	test_hash_grow_in_place();
 	test_hash_stress(max_seconds/2);
 }
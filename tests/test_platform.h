@@ -374,6 +374,81 @@ static void platform_test_file_watch()
     PTEST(true, platform_directory_remove(_platform_cstring(PLATFORM_TEST_DIR), true));
 }
 
+typedef struct Platform_Test_Pinned {
+    Platform_CPU_Set expected;
+    Platform_CPU_Set got;
+    PLATFORM_ATOMIC(uint32_t) done;
+} Platform_Test_Pinned;
+
+static void _platform_test_pinned_func(void* context)
+{
+    Platform_Test_Pinned* pinned = (Platform_Test_Pinned*) context;
+    platform_thread_get_affinity(&pinned->got);
+    atomic_store(&pinned->done, 1);
+    platform_futex_wake_all(&pinned->done);
+}
+
+static void platform_test_topology()
+{
+    const Platform_Topology* topology = platform_topology();
+    TEST(topology == platform_topology());
+    TEST(topology->processor_count > 0);
+    TEST(0 < topology->core_count && topology->core_count <= topology->processor_count);
+    TEST(0 < topology->package_count && topology->package_count <= topology->core_count);
+    TEST(0 < topology->l2_group_count && topology->l2_group_count <= topology->processor_count);
+    TEST(0 < topology->l3_group_count && topology->l3_group_count <= topology->l2_group_count);
+    TEST(0 < topology->numa_node_count && topology->numa_node_count <= topology->processor_count);
+
+    int32_t total = 0;
+    for(int32_t core = 0; core < topology->core_count; core++)
+    {
+        Platform_CPU_Set set = platform_topology_cpu_set(PLATFORM_TOPOLOGY_CORE, core);
+        total += platform_cpu_set_count(&set);
+    }
+    TEST(total == topology->processor_count, "every processor belongs to exactly one core");
+
+    for(int32_t i = 0; i < topology->processor_count; i++)
+    {
+        const Platform_Processor* proc = &topology->processors[i];
+        TEST(i == 0 || topology->processors[i - 1].id < proc->id);
+        TEST(0 <= proc->core && proc->core < topology->core_count);
+        TEST(0 <= proc->l2_group && proc->l2_group < topology->l2_group_count);
+        TEST(0 <= proc->l3_group && proc->l3_group < topology->l3_group_count);
+        TEST(0 <= proc->numa_node && proc->numa_node < topology->numa_node_count);
+        TEST(0 <= proc->package && proc->package < topology->package_count);
+
+        Platform_CPU_Set l3 = platform_topology_cpu_set(PLATFORM_TOPOLOGY_L3, proc->l3_group);
+        TEST(platform_cpu_set_has(&l3, proc->id));
+    }
+    Platform_CPU_Set none = platform_topology_cpu_set(PLATFORM_TOPOLOGY_CORE, -1);
+    TEST(platform_cpu_set_count(&none) == 0);
+
+    //Pin a thread to the first processor we are allowed to run on
+    Platform_CPU_Set allowed = {0};
+    PTEST(true, platform_thread_get_affinity(&allowed));
+    TEST(platform_cpu_set_count(&allowed) > 0);
+
+    Platform_Test_Pinned pinned = {0};
+    for(int32_t i = 0; i < PLATFORM_MAX_PROCESSORS; i++)
+        if(platform_cpu_set_has(&allowed, i))
+        {
+            platform_cpu_set_add(&pinned.expected, i);
+            break;
+        }
+
+    PTEST(true, platform_thread_launch_pinned(0, &pinned.expected, _platform_test_pinned_func, &pinned, "pinned"));
+    while(atomic_load(&pinned.done) == 0)
+        platform_futex_wait(&pinned.done, 0, -1);
+    TEST(memcmp(&pinned.got, &pinned.expected, sizeof pinned.got) == 0);
+
+    //Setting and restoring affinity of the calling thread
+    PTEST(true, platform_thread_set_affinity(&pinned.expected));
+    Platform_CPU_Set got = {0};
+    PTEST(true, platform_thread_get_affinity(&got));
+    TEST(memcmp(&got, &pinned.expected, sizeof got) == 0);
+    PTEST(true, platform_thread_set_affinity(&allowed));
+}
+
 static void platform_test_all() 
 {   
     printf("platform_test_all() running at directory: '%s'\n", platform_directory_get_startup_working());
@@ -68,6 +68,107 @@ static void test_spmc_sequential(isize count, isize reserve_to)
     spmc_queue_deinit(&q);
 }
 
+static void test_spmc_sequential_pop_many(isize count, isize reserve_to)
+{
+    SPMC_Queue q = {0};
+    spmc_queue_init(&q, sizeof(int), -1);
+    spmc_queue_reserve(&q, reserve_to);
+
+    int popped[256] = {0};
+    TEST(spmc_queue_pop_many(&q, popped, 256, sizeof(int)) == 0);
+    TEST(spmc_queue_pop_half(&q, popped, 256, sizeof(int)) == 0);
+
+    //move top and bot forward so that the popped ranges wrap around the block
+    for(int i = 0; i < reserve_to/2; i++)
+    {
+        TEST(spmc_queue_push_st(&q, &i, sizeof(int)));
+        TEST(spmc_queue_pop(&q, &popped[0], sizeof(int)));
+    }
+
+    for(int i = 0; i < count; i++)
+        TEST(spmc_queue_push_st(&q, &i, sizeof(int)));
+
+    //half must take the bigger half and respect max_count
+    isize remaining = count;
+    int next = 0;
+    if(remaining > 0)
+    {
+        isize half = spmc_queue_pop_half(&q, popped, 256, sizeof(int));
+        isize expected = (remaining + 1)/2 < 256 ? (remaining + 1)/2 : 256;
+        TEST(half == expected);
+        for(isize i = 0; i < half; i++)
+            TEST(popped[i] == next++);
+        remaining -= half;
+    }
+
+    //pop the rest in odd sized batches
+    while(remaining > 0)
+    {
+        isize batch = spmc_queue_pop_many(&q, popped, 7, sizeof(int));
+        TEST(batch == (remaining < 7 ? remaining : 7));
+        for(isize i = 0; i < batch; i++)
+            TEST(popped[i] == next++);
+        remaining -= batch;
+    }
+
+    TEST(next == count);
+    TEST(spmc_queue_count(&q) == 0);
+    TEST(spmc_queue_pop_many(&q, popped, 256, sizeof(int)) == 0);
+    TEST(spmc_queue_pop_many(&q, popped, 0, sizeof(int)) == 0);
+    spmc_queue_deinit(&q);
+}
+
+static void test_spmc_reclaim()
+{
+    SPMC_Queue q = {0};
+    spmc_queue_init(&q, sizeof(int), -1);
+
+    //growing retires blocks
+    for(int i = 0; i < 100000; i++)
+        TEST(spmc_queue_push_st(&q, &i, sizeof(int)));
+    TEST(spmc_queue_capacity(&q) >= 100000);
+    TEST(spmc_queue_retired_count(&q) > 0);
+
+    //there are no readers so everything can be reclaimed
+    spmc_queue_reclaim(&q);
+    TEST(spmc_queue_retired_count(&q) == 0);
+
+    for(int i = 0; i < 100000; i++)
+    {
+        int popped = 0;
+        TEST(spmc_queue_pop(&q, &popped, sizeof(int)));
+        TEST(popped == i);
+    }
+
+    //explicit shrink keeps the items
+    for(int i = 0; i < 100; i++)
+        TEST(spmc_queue_push_st(&q, &i, sizeof(int)));
+    spmc_queue_shrink(&q, 0);
+    TEST(spmc_queue_capacity(&q) == 128);
+    TEST(spmc_queue_count(&q) == 100);
+    for(int i = 0; i < 100; i++)
+    {
+        int popped = 0;
+        TEST(spmc_queue_pop(&q, &popped, sizeof(int)));
+        TEST(popped == i);
+    }
+
+    //grow again then shrink automatically under sustained low occupancy
+    spmc_queue_reserve(&q, 1 << 16);
+    spmc_queue_set_shrink(&q, 2);
+    for(int i = 0; i < 1 << 20; i++)
+    {
+        int popped = 0;
+        TEST(spmc_queue_push_st(&q, &i, sizeof(int)));
+        TEST(spmc_queue_pop(&q, &popped, sizeof(int)));
+        TEST(popped == i);
+    }
+    TEST(spmc_queue_capacity(&q) == 64);
+    TEST(spmc_queue_retired_count(&q) <= 1);
+
+    spmc_queue_deinit(&q);
+}
+
 typedef struct Test_SPMC_Buffer {
     isize* data; 
     isize count;
@@ -79,6 +180,7 @@ typedef struct Test_SPMC_Thread {
     SPMC_QUEUE_ATOMIC(isize)* finished; 
     SPMC_QUEUE_ATOMIC(isize)* run_test; 
     SPMC_Queue* queue;
+    isize steal_batch;
 
     Test_SPMC_Buffer popped;
 } Test_SPMC_Thread;
@@ -98,21 +200,37 @@ static void test_spmc_producer_consumers_thread_func(void *arg)
     while(*thread->run_test == 0); 
     
     //run for as long as we can
-    while(*thread->run_test == 1)
+    for(isize iter = 0; *thread->run_test == 1; iter++)
     {
-        isize val = 0;
-        if(spmc_queue_pop(thread->queue, &val, sizeof(isize)))
-            test_spmc_buffer_push(&thread->popped, &val, 1);
+        if(thread->steal_batch > 0)
+        {
+            isize vals[1024] = {0};
+            isize max_count = thread->steal_batch < 1024 ? thread->steal_batch : 1024;
+            isize popped = iter % 2 
+                ? spmc_queue_pop_half(thread->queue, vals, max_count, sizeof(isize))
+                : spmc_queue_pop_many(thread->queue, vals, max_count, sizeof(isize));
+            test_spmc_buffer_push(&thread->popped, vals, popped);
+        }
+        else
+        {
+            isize val = 0;
+            if(spmc_queue_pop(thread->queue, &val, sizeof(isize)))
+                test_spmc_buffer_push(&thread->popped, &val, 1);
+        }
     }
 
     atomic_fetch_add(thread->finished, 1);
 }
 
-static void test_spmc_producer_consumers(isize reserve_size, isize consumer_count, double time, double producer_pop_back_chance, double producer_pop_front_chance)
+static void test_spmc_producer_consumers(isize reserve_size, isize consumer_count, double time, double producer_pop_back_chance, double producer_pop_front_chance, isize steal_batch, isize max_burst)
 {
     SPMC_Queue queue = {0};
     spmc_queue_init(&queue, sizeof(isize), -1);
     spmc_queue_reserve(&queue, reserve_size);
+    
+    //exercise constant growing/shrinking and reclamation of blocks while consumers are reading them 
+    if(steal_batch > 0)
+        spmc_queue_set_shrink(&queue, 1);
 
     SPMC_QUEUE_ATOMIC(isize) started = 0;
     SPMC_QUEUE_ATOMIC(isize) finished = 0;
@@ -127,6 +245,7 @@ static void test_spmc_producer_consumers(isize reserve_size, isize consumer_coun
         threads[i].started = &started;
         threads[i].finished = &finished;
         threads[i].run_test = &run_test;
+        threads[i].steal_batch = steal_batch;
 
         //run the test func in separate thread in detached state
         test_spmc_launch_thread(test_spmc_producer_consumers_thread_func, &threads[i]);
@@ -143,8 +262,13 @@ static void test_spmc_producer_consumers(isize reserve_size, isize consumer_coun
         isize deadline = clock() + (isize)(time*CLOCKS_PER_SEC);
         while(clock() < deadline)
         {
-            spmc_queue_push_st(&queue, &produced_counter, sizeof(isize));
-            produced_counter += 1;
+            //bursts make the queue grow and then shrink again once the consumers catch up
+            isize burst = max_burst > 1 ? 1 + rand() % max_burst : 1;
+            for(isize k = 0; k < burst; k++)
+            {
+                spmc_queue_push_st(&queue, &produced_counter, sizeof(isize));
+                produced_counter += 1;
+            }
 
             double random = (double) rand() / RAND_MAX;
             if(random < producer_pop_back_chance)
@@ -217,13 +341,26 @@ static void test_spmc_queue(double time)
     test_spmc_sequential(100, 100);
     test_spmc_sequential(1024, 1024);
     test_spmc_sequential(1024*1024, 1024);
+
+    test_spmc_sequential_pop_many(0, 0);
+    test_spmc_sequential_pop_many(1, 0);
+    test_spmc_sequential_pop_many(10, 8);
+    test_spmc_sequential_pop_many(100, 100);
+    test_spmc_sequential_pop_many(1000, 1024);
+    test_spmc_sequential_pop_many(100000, 1024);
+    test_spmc_sequential_pop_many(64, 64);
+    test_spmc_reclaim();
     
     if(time > 0)
     {
         printf("test_spmc testing stress\n");
         enum {THREADS = 32};
         for(isize i = 1; i <= THREADS; i++) {
-            test_spmc_producer_consumers(1000, i, time/THREADS, 0.1, 0.1);
+            test_spmc_producer_consumers(1000, i, time/THREADS/3, 0.1, 0.1, 0, 1);
+            //batches up to 4 times bigger than the smallest block
+            test_spmc_producer_consumers(1000, i, time/THREADS/3, 0.1, 0.1, 1 + i*37 % 256, 1);
+            //batches bigger than the block the queue shrinks to while some thieves still see the old range
+            test_spmc_producer_consumers(64, i, time/THREADS/3, 0.1, 0.1, 1024, 4096);
         }
     }
     printf("test_spmc done!\n");
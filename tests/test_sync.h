@@ -0,0 +1,388 @@
+#pragma once
+
+#include "../sync.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef TEST
+    #define TEST(x, ...) (!(x) ? (fprintf(stderr, "TEST(" #x ") failed. " __VA_ARGS__), abort()) : (void) 0)
+#endif
+
+#define TEST_SYNC_MAX_THREADS 16
+
+typedef struct Test_Sync_Shared {
+    RW_Lock rw_lock;
+    Seq_Lock seq_lock;
+    Mutex mutex;
+    Mutex_Stats* mutex_stats;
+    Sync_Wait wait;
+
+    CHAN_ATOMIC(uint32_t) run;
+    CHAN_ATOMIC(uint32_t) readers_inside;
+    CHAN_ATOMIC(uint32_t) writers_inside;
+    CHAN_ATOMIC(uint64_t) reads;
+    CHAN_ATOMIC(uint64_t) writes;
+    CHAN_ATOMIC(isize) finished;
+
+    //protected by rw_lock
+    uint64_t a;
+    uint64_t b;
+
+    //protected by seq_lock
+    uint64_t snapshot[8];
+} Test_Sync_Shared;
+
+typedef struct Test_Sync_Thread {
+    Test_Sync_Shared* shared;
+    isize index;
+    uint32_t writer_every; //every n-th operation is write
+    uint32_t _;
+} Test_Sync_Thread;
+
+static void _test_sync_rw_lock_thread(void* context)
+{
+    Test_Sync_Thread* thread = (Test_Sync_Thread*) context;
+    Test_Sync_Shared* shared = thread->shared;
+
+    for(uint64_t i = (uint64_t) thread->index; atomic_load(&shared->run); i++)
+    {
+        if(i % thread->writer_every == 0)
+        {
+            rw_lock_writer_lock(&shared->rw_lock, shared->wait);
+            TEST(atomic_fetch_add(&shared->writers_inside, 1) == 0);
+            TEST(atomic_load(&shared->readers_inside) == 0);
+            shared->a += 1;
+            chan_pause();
+            shared->b += 1;
+            TEST(atomic_fetch_sub(&shared->writers_inside, 1) == 1);
+            rw_lock_writer_unlock(&shared->rw_lock, shared->wait);
+            atomic_fetch_add(&shared->writes, 1);
+        }
+        else
+        {
+            rw_lock_reader_lock(&shared->rw_lock, shared->wait);
+            atomic_fetch_add(&shared->readers_inside, 1);
+            TEST(atomic_load(&shared->writers_inside) == 0);
+            TEST(shared->a == shared->b);
+            atomic_fetch_sub(&shared->readers_inside, 1);
+            rw_lock_reader_unlock(&shared->rw_lock, shared->wait);
+            atomic_fetch_add(&shared->reads, 1);
+        }
+    }
+
+    atomic_fetch_add(&shared->finished, 1);
+}
+
+static void _test_sync_seq_lock_thread(void* context)
+{
+    Test_Sync_Thread* thread = (Test_Sync_Thread*) context;
+    Test_Sync_Shared* shared = thread->shared;
+
+    for(uint64_t i = (uint64_t) thread->index; atomic_load(&shared->run); i++)
+    {
+        uint64_t snapshot[8] = {0};
+        if(i % thread->writer_every == 0)
+        {
+            for(uint64_t k = 0; k < 8; k++)
+                snapshot[k] = i*(k + 1);
+            seq_lock_write(&shared->seq_lock, shared->snapshot, snapshot, sizeof snapshot, shared->wait);
+            atomic_fetch_add(&shared->writes, 1);
+        }
+        else
+        {
+            seq_lock_read(&shared->seq_lock, snapshot, shared->snapshot, sizeof snapshot, shared->wait);
+            for(uint64_t k = 0; k < 8; k++)
+                TEST(snapshot[k] == snapshot[0]*(k + 1));
+            atomic_fetch_add(&shared->reads, 1);
+        }
+    }
+
+    atomic_fetch_add(&shared->finished, 1);
+}
+
+static void _test_sync_mutex_thread(void* context)
+{
+    Test_Sync_Thread* thread = (Test_Sync_Thread*) context;
+    Test_Sync_Shared* shared = thread->shared;
+
+    for(uint64_t i = (uint64_t) thread->index; atomic_load(&shared->run); i++)
+    {
+        mutex_lock_stats(&shared->mutex, shared->mutex_stats, shared->wait);
+        TEST(atomic_fetch_add(&shared->writers_inside, 1) == 0);
+        shared->a += 1;
+        if(i % thread->writer_every == 0)
+            chan_pause();
+        shared->b += 1;
+        TEST(atomic_fetch_sub(&shared->writers_inside, 1) == 1);
+        mutex_unlock_stats(&shared->mutex, shared->mutex_stats, shared->wait);
+        atomic_fetch_add(&shared->writes, 1);
+    }
+
+    atomic_fetch_add(&shared->finished, 1);
+}
+
+static void test_sync_stress(void (*func)(void*), const char* name, isize thread_count, uint32_t writer_every, bool prefer_readers, Sync_Wait wait, double seconds)
+{
+    Test_Sync_Shared shared = {0};
+    Mutex_Stats mutex_stats = {0};
+    rw_lock_init(&shared.rw_lock, prefer_readers);
+    if(prefer_readers)
+        shared.mutex_stats = &mutex_stats;
+    shared.wait = wait;
+    shared.run = 1;
+
+    Test_Sync_Thread threads[TEST_SYNC_MAX_THREADS] = {0};
+    for(isize i = 0; i < thread_count; i++)
+    {
+        threads[i].shared = &shared;
+        threads[i].index = i;
+        threads[i].writer_every = writer_every;
+        TEST(chan_start_thread(func, &threads[i]));
+    }
+
+    chan_sleep(seconds);
+    atomic_store(&shared.run, 0);
+    while(atomic_load(&shared.finished) != thread_count)
+        chan_yield();
+
+    TEST(shared.a == shared.b);
+    TEST(shared.a == 0 || shared.a == shared.writes);
+    TEST((shared.rw_lock.state & (RW_LOCK_WRITER | RW_LOCK_READERS_MASK)) == 0);
+    TEST((shared.seq_lock.sequence & SEQ_LOCK_WRITING) == 0);
+    TEST((shared.mutex.state & (MUTEX_LOCKED | MUTEX_WAITERS)) == 0);
+    TEST(mutex_stats.lock_count == 0 || mutex_stats.lock_count == shared.writes);
+    printf("%s threads:%lli block:%i prefer_readers:%i reads:%llu writes:%llu\n",
+        name, (long long) thread_count, wait.wait != NULL, prefer_readers,
+        (unsigned long long) shared.reads, (unsigned long long) shared.writes);
+}
+
+typedef struct Test_Sync_Phases {
+    Barrier barrier;
+    Semaphore semaphore;
+    Event_Count eventcount;
+    Sync_Wait wait;
+    isize rounds;
+    isize quota;
+
+    CHAN_ATOMIC(uint32_t) items;
+    CHAN_ATOMIC(isize) arrived;
+    CHAN_ATOMIC(isize) serial;
+    CHAN_ATOMIC(isize) consumed;
+    CHAN_ATOMIC(isize) finished;
+} Test_Sync_Phases;
+
+static void _test_sync_barrier_thread(void* context)
+{
+    Test_Sync_Phases* phases = (Test_Sync_Phases*) context;
+    isize thread_count = phases->barrier.thread_count;
+    for(isize round = 0; round < phases->rounds; round++)
+    {
+        atomic_fetch_add(&phases->arrived, 1);
+        if(barrier_arrive_and_wait(&phases->barrier, phases->wait))
+            atomic_fetch_add(&phases->serial, 1);
+
+        //everyone arrived this round and nobody could have yet arrived the next one
+        TEST(atomic_load(&phases->arrived) == thread_count*(round + 1));
+        barrier_arrive_and_wait(&phases->barrier, phases->wait);
+    }
+    atomic_fetch_add(&phases->finished, 1);
+}
+
+static void _test_sync_producer_thread(void* context)
+{
+    Test_Sync_Phases* phases = (Test_Sync_Phases*) context;
+    for(isize i = 0; i < phases->quota; i++)
+    {
+        semaphore_post(&phases->semaphore, 1, phases->wait);
+        atomic_fetch_add(&phases->items, 1);
+        eventcount_notify(&phases->eventcount, phases->wait);
+    }
+    atomic_fetch_add(&phases->finished, 1);
+}
+
+static bool _test_sync_try_take(Test_Sync_Phases* phases)
+{
+    uint32_t items = atomic_load(&phases->items);
+    while(items > 0)
+        if(atomic_compare_exchange_weak(&phases->items, &items, items - 1))
+            return true;
+    return false;
+}
+
+static void _test_sync_consumer_thread(void* context)
+{
+    Test_Sync_Phases* phases = (Test_Sync_Phases*) context;
+    for(isize i = 0; i < phases->quota; i++)
+    {
+        semaphore_wait(&phases->semaphore, phases->wait);
+        for(;;) {
+            if(_test_sync_try_take(phases))
+                break;
+            uint32_t key = eventcount_prepare_wait(&phases->eventcount);
+            if(_test_sync_try_take(phases))
+            {
+                eventcount_cancel_wait(&phases->eventcount);
+                break;
+            }
+            eventcount_commit_wait(&phases->eventcount, key, phases->wait);
+        }
+        atomic_fetch_add(&phases->consumed, 1);
+    }
+    atomic_fetch_add(&phases->finished, 1);
+}
+
+static void test_sync_phases_stress(isize thread_count, isize rounds, Sync_Wait wait)
+{
+    Test_Sync_Phases phases = {0};
+    barrier_init(&phases.barrier, thread_count);
+    phases.wait = wait;
+    phases.rounds = rounds;
+    phases.quota = rounds;
+
+    for(isize i = 0; i < thread_count; i++)
+        TEST(chan_start_thread(_test_sync_barrier_thread, &phases));
+    while(atomic_load(&phases.finished) != thread_count)
+        chan_yield();
+
+    TEST(phases.serial == rounds);
+    TEST(phases.arrived == rounds*thread_count);
+    TEST(barrier_phase(&phases.barrier) == (uint32_t) rounds*2);
+
+    //consumers first so that they have a chance to go to sleep
+    phases.finished = 0;
+    for(isize i = 0; i < thread_count; i++)
+        TEST(chan_start_thread(_test_sync_consumer_thread, &phases));
+    for(isize i = 0; i < thread_count; i++)
+        TEST(chan_start_thread(_test_sync_producer_thread, &phases));
+    while(atomic_load(&phases.finished) != thread_count*2)
+        chan_yield();
+
+    TEST(phases.consumed == rounds*thread_count);
+    TEST(phases.items == 0);
+    TEST(phases.semaphore.count == 0 && phases.semaphore.waiters == 0);
+    TEST((phases.eventcount.state & EVENTCOUNT_WAITERS_MASK) == 0);
+    printf("barrier/semaphore/eventcount threads:%lli block:%i rounds:%lli\n",
+        (long long) thread_count, wait.wake != NULL, (long long) rounds);
+}
+
+static void test_sync_unit()
+{
+    RW_Lock rw = {0};
+    TEST(rw_lock_reader_try_lock(&rw));
+    TEST(rw_lock_reader_try_lock(&rw));
+    TEST(rw_lock_writer_try_lock(&rw) == false);
+    rw_lock_reader_unlock(&rw, SYNC_WAIT_BLOCK);
+    rw_lock_reader_unlock(&rw, SYNC_WAIT_BLOCK);
+    TEST(rw_lock_writer_try_lock(&rw));
+    TEST(rw_lock_reader_try_lock(&rw) == false);
+    TEST(rw_lock_writer_try_lock(&rw) == false);
+    rw_lock_writer_unlock(&rw, SYNC_WAIT_BLOCK);
+    TEST(rw.state == 0);
+
+    //waiting writer blocks readers unless we prefer readers
+    rw.state = RW_LOCK_WRITER_WAITING;
+    TEST(rw_lock_reader_try_lock(&rw) == false);
+    rw_lock_init(&rw, true);
+    rw.state |= RW_LOCK_WRITER_WAITING;
+    TEST(rw_lock_reader_try_lock(&rw));
+    rw_lock_reader_unlock(&rw, SYNC_WAIT_BLOCK);
+
+    Seq_Lock seq = {0};
+    uint32_t begin = seq_lock_read_begin(&seq, SYNC_WAIT_SPIN);
+    TEST(seq_lock_read_retry(&seq, begin) == false);
+    seq_lock_write_begin(&seq, SYNC_WAIT_SPIN);
+    TEST(seq_lock_read_retry(&seq, begin));
+    seq_lock_write_end(&seq, SYNC_WAIT_SPIN);
+    TEST(seq_lock_read_retry(&seq, begin));
+    begin = seq_lock_read_begin(&seq, SYNC_WAIT_SPIN);
+    TEST(seq_lock_read_retry(&seq, begin) == false);
+
+    Mutex mutex = {0};
+    Mutex_Stats stats = {0};
+    TEST(mutex_try_lock(&mutex));
+    TEST(mutex_is_locked(&mutex));
+    TEST(mutex_try_lock(&mutex) == false);
+    mutex_unlock(&mutex, SYNC_WAIT_BLOCK);
+    TEST(mutex_is_locked(&mutex) == false);
+    mutex_lock_stats(&mutex, &stats, SYNC_WAIT_BLOCK);
+    TEST(mutex_try_lock(&mutex) == false);
+    mutex_unlock_stats(&mutex, &stats, SYNC_WAIT_BLOCK);
+    TEST(stats.lock_count == 1 && stats.contended_count == 0 && stats.sleep_count == 0);
+    TEST(mutex.state == 0);
+
+    Latch latch = {0};
+    TEST(latch_try_wait(&latch));
+    latch_init(&latch, 3);
+    TEST(latch_count_down(&latch, 2, SYNC_WAIT_BLOCK) == false);
+    TEST(latch_try_wait(&latch) == false);
+    TEST(latch_count_down(&latch, 1, SYNC_WAIT_BLOCK));
+    TEST(latch_try_wait(&latch));
+    latch_wait(&latch, SYNC_WAIT_BLOCK);
+
+    Barrier barrier = {0};
+    barrier_init(&barrier, 1);
+    TEST(barrier_arrive_and_wait(&barrier, SYNC_WAIT_BLOCK));
+    TEST(barrier_arrive_and_wait(&barrier, SYNC_WAIT_BLOCK));
+    TEST(barrier_phase(&barrier) == 2);
+
+    Semaphore sem = {0};
+    TEST(semaphore_try_wait(&sem) == false);
+    TEST(semaphore_wait_timed(&sem, 0.001, SYNC_WAIT_BLOCK) == false);
+    semaphore_post(&sem, 2, SYNC_WAIT_BLOCK);
+    TEST(semaphore_try_wait(&sem));
+    TEST(semaphore_wait_timed(&sem, 0.001, SYNC_WAIT_BLOCK));
+    TEST(semaphore_try_wait(&sem) == false);
+
+    Event_Count ec = {0};
+    eventcount_notify(&ec, SYNC_WAIT_BLOCK);
+    TEST(ec.state == 0); //nobody waits so notify does nothing
+    uint32_t key = eventcount_prepare_wait(&ec);
+    eventcount_notify(&ec, SYNC_WAIT_BLOCK);
+    eventcount_commit_wait(&ec, key, SYNC_WAIT_BLOCK); //already notified so does not block
+    TEST(ec.state == EVENTCOUNT_EPOCH);
+    eventcount_prepare_wait(&ec);
+    eventcount_cancel_wait(&ec);
+    TEST(ec.state == EVENTCOUNT_EPOCH);
+
+    //One more binding than there are slots evicts the oldest one
+    Sync_Thread_Slots slots = {0};
+    uint64_t ids[SYNC_THREAD_SLOTS + 1] = {0};
+    int values[SYNC_THREAD_SLOTS + 1] = {0};
+    for(isize i = 0; i < SYNC_THREAD_SLOTS + 1; i++)
+    {
+        ids[i] = sync_thread_slots_make_id();
+        TEST(ids[i] != 0 && (i == 0 || ids[i] != ids[i - 1]));
+        TEST(sync_thread_slots_get(&slots, ids[i]) == NULL);
+        void* evicted = sync_thread_slots_set(&slots, ids[i], &values[i]);
+        TEST(evicted == (i < SYNC_THREAD_SLOTS ? NULL : &values[0]));
+        TEST(sync_thread_slots_get(&slots, ids[i]) == &values[i]);
+    }
+    TEST(sync_thread_slots_get(&slots, ids[0]) == NULL);
+    TEST(sync_thread_slots_remove(&slots, ids[1]) == &values[1]);
+    TEST(sync_thread_slots_remove(&slots, ids[1]) == NULL);
+    TEST(sync_thread_slots_set(&slots, ids[0], &values[0]) == NULL);
+    TEST(sync_thread_slots_get(&slots, ids[0]) == &values[0]);
+}
+
+static void test_sync(double max_time)
+{
+    test_sync_unit();
+
+    enum {CONFIGS = 12};
+    double time = max_time/CONFIGS;
+    for(isize block = 0; block < 2; block++)
+        for(isize prefer_readers = 0; prefer_readers < 2; prefer_readers++)
+        {
+            Sync_Wait wait = block ? SYNC_WAIT_BLOCK : SYNC_WAIT_SPIN;
+            isize threads = 2 + rand() % (TEST_SYNC_MAX_THREADS - 1);
+            test_sync_stress(_test_sync_rw_lock_thread, "rw_lock", threads, 10, prefer_readers, wait, time);
+            test_sync_stress(_test_sync_seq_lock_thread, "seq_lock", threads, 50, prefer_readers, wait, time);
+            //prefer_readers enables Mutex_Stats gathering for the mutex test
+            test_sync_stress(_test_sync_mutex_thread, "mutex", threads, 4, prefer_readers, wait, time);
+        }
+
+    test_sync_phases_stress(2 + rand() % (TEST_SYNC_MAX_THREADS - 1), 1000, SYNC_WAIT_YIELD);
+    test_sync_phases_stress(2 + rand() % (TEST_SYNC_MAX_THREADS - 1), 1000, SYNC_WAIT_BLOCK);
+}
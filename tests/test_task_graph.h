@@ -0,0 +1,180 @@
+#pragma once
+
+#include "../task_graph.h"
+#include "../time.h"
+#include "../random.h"
+
+typedef struct Test_Task_Graph Test_Task_Graph;
+
+typedef struct Test_Task_Graph_Task {
+    Test_Task_Graph* test;
+    isize index;
+    CHAN_ATOMIC(isize) runs;
+    isize dependencies[4];
+    isize dependency_count;
+} Test_Task_Graph_Task;
+
+typedef struct Test_Task_Graph {
+    Test_Task_Graph_Task tasks[200];
+    isize task_count;
+    isize run;
+    bool nested_parallel;
+    CHAN_ATOMIC(isize) nested_visits;
+} Test_Task_Graph;
+
+static void _test_task_graph_nested(isize begin, isize end, void* context)
+{
+    Test_Task_Graph* test = (Test_Task_Graph*) context;
+    atomic_fetch_add(&test->nested_visits, end - begin);
+}
+
+static void _test_task_graph_task(void* context)
+{
+    Test_Task_Graph_Task* task = (Test_Task_Graph_Task*) context;
+    Test_Task_Graph* test = task->test;
+
+    //All dependencies must have already finished this run
+    for(isize i = 0; i < task->dependency_count; i++)
+        TEST(atomic_load(&test->tasks[task->dependencies[i]].runs) == test->run + 1);
+    TEST(atomic_load(&task->runs) == test->run);
+
+    if(test->nested_parallel)
+        parallel_for(0, 100, 7, _test_task_graph_nested, test);
+
+    atomic_fetch_add(&task->runs, 1);
+}
+
+static void test_task_graph_unit()
+{
+    Task_Graph graph = {0};
+    task_graph_init(&graph, NULL);
+    TEST(task_graph_run(&graph, NULL));
+
+    //cycle is detected and nothing is run
+    Test_Task_Graph test = {0};
+    for(isize i = 0; i < 3; i++)
+    {
+        test.tasks[i].test = &test;
+        TEST(task_graph_add(&graph, _test_task_graph_task, &test.tasks[i]) == i);
+    }
+    task_graph_depend(&graph, 0, 1);
+    task_graph_depend(&graph, 1, 2);
+    task_graph_depend(&graph, 2, 1);
+    TEST(task_graph_build(&graph, NULL) == false);
+    TEST(task_graph_run(&graph, NULL) == false);
+    TEST(test.tasks[0].runs == 0);
+
+    task_graph_clear(&graph);
+    TEST(task_graph_run(&graph, NULL));
+    task_graph_deinit(&graph);
+}
+
+static void test_task_graph_stress(Thread_Pool* pool, isize task_count, isize runs, bool nested_parallel)
+{
+    Test_Task_Graph* test = (Test_Task_Graph*) calloc(1, sizeof *test);
+    test->task_count = task_count;
+    test->nested_parallel = nested_parallel;
+
+    Task_Graph graph = {0};
+    task_graph_init(&graph, NULL);
+    for(isize i = 0; i < task_count; i++)
+    {
+        Test_Task_Graph_Task* task = &test->tasks[i];
+        task->test = test;
+        task->index = i;
+        task_graph_add(&graph, _test_task_graph_task, task);
+
+        //Depend only on earlier tasks so there are no cycles
+        if(i > 0)
+        {
+            task->dependency_count = random_range(0, ARRAY_COUNT(task->dependencies) + 1);
+            for(isize k = 0; k < task->dependency_count; k++)
+            {
+                task->dependencies[k] = random_range(0, i);
+                task_graph_depend(&graph, task->dependencies[k], i);
+            }
+        }
+    }
+
+    TEST(task_graph_build(&graph, pool));
+    for(test->run = 0; test->run < runs; test->run++)
+    {
+        TEST(task_graph_run(&graph, pool));
+        for(isize i = 0; i < task_count; i++)
+            TEST(test->tasks[i].runs == test->run + 1);
+    }
+
+    if(nested_parallel)
+        TEST(test->nested_visits == 100*task_count*runs);
+
+    task_graph_deinit(&graph);
+    free(test);
+}
+
+typedef struct Test_Task_Graph_Fan_Out {
+    CHAN_ATOMIC(isize) running;
+    CHAN_ATOMIC(isize) max_running;
+} Test_Task_Graph_Fan_Out;
+
+static void _test_task_graph_leaf(void* context)
+{
+    Test_Task_Graph_Fan_Out* test = (Test_Task_Graph_Fan_Out*) context;
+    isize running = atomic_fetch_add(&test->running, 1) + 1;
+    for(isize max = atomic_load(&test->max_running); running > max; )
+        if(atomic_compare_exchange_weak(&test->max_running, &max, running))
+            break;
+
+    //Sleep so that the leaves overlap even when there are fewer cores than threads
+    platform_thread_sleep(0.002);
+    atomic_fetch_sub(&test->running, 1);
+}
+
+static void _test_task_graph_root(void* context)
+{
+    //Give the other participants time to run out of work and fall asleep
+    (void) context;
+    platform_thread_sleep(0.02);
+}
+
+//A single task making many tasks runnable at once must wake up more than one helper
+static void test_task_graph_fan_out()
+{
+    enum {WORKERS = 7, LEAVES = 200};
+    Thread_Pool pool = {0};
+    TEST(thread_pool_init(&pool, WORKERS) == 0);
+
+    Test_Task_Graph_Fan_Out test = {0};
+    Task_Graph graph = {0};
+    task_graph_init(&graph, NULL);
+    isize root = task_graph_add(&graph, _test_task_graph_root, NULL);
+    for(isize i = 0; i < LEAVES; i++)
+        task_graph_depend(&graph, root, task_graph_add(&graph, _test_task_graph_leaf, &test));
+
+    TEST(task_graph_run(&graph, &pool));
+    TEST(test.running == 0);
+    TEST(test.max_running > 2);
+
+    task_graph_deinit(&graph);
+    thread_pool_deinit(&pool);
+}
+
+static void test_task_graph(double max_time)
+{
+    test_task_graph_unit();
+    test_task_graph_fan_out();
+
+    Thread_Pool serial = {0};
+    TEST(thread_pool_init(&serial, 0) == 0);
+    test_task_graph_stress(&serial, 50, 5, false);
+    thread_pool_deinit(&serial);
+
+    Thread_Pool pool = {0};
+    TEST(thread_pool_init(&pool, 3) == 0);
+    double start = clock_sec();
+    for(isize iter = 0; clock_sec() - start < max_time; iter++)
+        test_task_graph_stress(&pool, random_range(1, 200), 10, iter % 4 == 0);
+    thread_pool_deinit(&pool);
+
+    //Global pool
+    test_task_graph_stress(NULL, 100, 3, true);
+}
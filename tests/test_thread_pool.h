@@ -0,0 +1,104 @@
+#pragma once
+
+#include "../thread_pool.h"
+#include "../time.h"
+#include "../random.h"
+
+typedef struct Test_Thread_Pool {
+    Thread_Pool* pool;
+    CHAN_ATOMIC(uint32_t)* visited;
+    isize inner_count;
+} Test_Thread_Pool;
+
+static void _test_thread_pool_visit(isize begin, isize end, void* context)
+{
+    Test_Thread_Pool* test = (Test_Thread_Pool*) context;
+    for(isize i = begin; i < end; i++)
+        atomic_fetch_add_explicit(&test->visited[i], 1, memory_order_relaxed);
+}
+
+static void _test_thread_pool_nested(isize begin, isize end, void* context)
+{
+    Test_Thread_Pool* test = (Test_Thread_Pool*) context;
+    for(isize i = begin; i < end; i++)
+    {
+        Test_Thread_Pool inner = *test;
+        inner.visited = test->visited + i*test->inner_count;
+        thread_pool_for(test->pool, 0, test->inner_count, 3, _test_thread_pool_visit, &inner);
+    }
+}
+
+static void _test_thread_pool_sum(isize begin, isize end, void* partial, void* context)
+{
+    (void) context;
+    TEST((uintptr_t) partial % THREAD_POOL_REDUCE_ALIGN == 0);
+    uint64_t* sum = (uint64_t*) partial;
+    for(isize i = begin; i < end; i++)
+        *sum += (uint64_t) i;
+}
+
+static void _test_thread_pool_combine(void* into, const void* partial, void* context)
+{
+    (void) context;
+    *(uint64_t*) into += *(const uint64_t*) partial;
+}
+
+static void test_thread_pool_single(Thread_Pool* pool, isize count, isize grain)
+{
+    CHAN_ATOMIC(uint32_t)* visited = (CHAN_ATOMIC(uint32_t)*) calloc((size_t) count + 1, sizeof *visited);
+    Test_Thread_Pool test = {pool, visited};
+
+    thread_pool_for(pool, 0, count, grain, _test_thread_pool_visit, &test);
+    for(isize i = 0; i < count; i++)
+        TEST(visited[i] == 1);
+    TEST(visited[count] == 0);
+
+    uint64_t sum = 0;
+    uint64_t identity = 0;
+    thread_pool_reduce(pool, 0, count, grain, &sum, &identity, sizeof sum, _test_thread_pool_sum, _test_thread_pool_combine, NULL);
+    TEST(sum == (uint64_t) count*(uint64_t) (count - 1)/2);
+
+    free(visited);
+}
+
+static void test_thread_pool_nested(Thread_Pool* pool, isize outer, isize inner)
+{
+    CHAN_ATOMIC(uint32_t)* visited = (CHAN_ATOMIC(uint32_t)*) calloc((size_t) (outer*inner), sizeof *visited);
+    Test_Thread_Pool test = {pool, visited, inner};
+    thread_pool_for(pool, 0, outer, 1, _test_thread_pool_nested, &test);
+    for(isize i = 0; i < outer*inner; i++)
+        TEST(visited[i] == 1);
+    free(visited);
+}
+
+static void test_thread_pool(double max_time)
+{
+    //Serial pool - everything runs on the calling thread
+    Thread_Pool serial = {0};
+    TEST(thread_pool_init(&serial, 0) == 0);
+    test_thread_pool_single(&serial, 1000, 0);
+    test_thread_pool_single(&serial, 0, 0);
+    test_thread_pool_nested(&serial, 10, 10);
+    thread_pool_deinit(&serial);
+
+    Thread_Pool pool = {0};
+    TEST(thread_pool_init(&pool, 3) == 0);
+    TEST(pool.thread_count == 3);
+
+    double start = clock_sec();
+    for(isize iter = 0; clock_sec() - start < max_time; iter++)
+    {
+        isize count = random_range(0, 100000);
+        isize grain = random_range(0, 1000);
+        test_thread_pool_single(&pool, count, grain);
+        test_thread_pool_nested(&pool, random_range(1, 30), random_range(1, 100));
+    }
+    thread_pool_deinit(&pool);
+
+    //Global pool
+    uint64_t sum = 0;
+    uint64_t identity = 0;
+    parallel_reduce(10, 1000, 0, &sum, &identity, sizeof sum, _test_thread_pool_sum, _test_thread_pool_combine, NULL);
+    TEST(sum == 1000*999/2 - 10*9/2);
+    TEST(thread_pool_global() == thread_pool_global());
+}
@@ -0,0 +1,338 @@
+#ifndef MODULE_THREAD_POOL
+#define MODULE_THREAD_POOL
+
+// A fixed size pool of worker threads used for data parallel loops.
+// parallel_for(begin, end, grain, func, context) splits [begin, end) into chunks of grain
+// items and calls func(chunk_begin, chunk_end, context) on them from the calling thread and
+// all idle workers. Chunks are handed out dynamically from a single atomic counter so uneven
+// work gets balanced automatically. parallel_reduce additionally gives each participating
+// thread its own partial result which is combined into the final result at the end.
+//
+// The calling thread always participates in its own loop and while waiting for the other
+// threads to finish their chunks it helps with any other loops running in the pool.
+// Thus nested parallel_for calls (from inside func) cannot deadlock. The calling thread
+// can always finish its loop alone.
+//
+// Running loops are kept in a small array protected by a mutex. The mutex is only touched
+// when a thread joins or leaves a loop, never per chunk. Idle workers sleep on an eventcount
+// so posting a loop into a pool with no sleeping workers does not enter the kernel.
+//
+// The functions without the thread_pool_ prefix use a global pool which is lazily
+// initialized with platform_thread_get_processor_count() - 1 workers (the calling thread
+// is the last one).
+
+#include "defines.h"
+#include "assert.h"
+#include "platform.h"
+#include "sync.h"
+#include <string.h>
+
+#ifndef THREAD_POOL_MAX_JOBS
+    #define THREAD_POOL_MAX_JOBS 256        //max number of loops running at once. Further loops run serially on the calling thread.
+#endif
+#define THREAD_POOL_MAX_REDUCE_SIZE 256     //max size of the parallel_reduce result in bytes.
+#define THREAD_POOL_REDUCE_ALIGN 16         //the partial result passed to the reduce and combine functions is aligned to this.
+#define THREAD_POOL_CHUNKS_PER_THREAD 8     //number of chunks per thread used when grain is not specified.
+
+typedef void (*Parallel_For_Func)(isize begin, isize end, void* context);
+typedef void (*Parallel_Reduce_Func)(isize begin, isize end, void* partial, void* context);
+typedef void (*Parallel_Combine_Func)(void* into, const void* partial, void* context);
+
+typedef struct Thread_Pool_Job {
+    CHAN_ATOMIC(isize) next_chunk;
+    isize chunk_count;
+    isize begin;
+    isize end;
+    isize grain;
+
+    Parallel_For_Func for_func;
+    Parallel_Reduce_Func reduce_func;
+    Parallel_Combine_Func combine_func;
+    void* context;
+
+    void* result;
+    const void* identity;
+    isize result_size;
+    Mutex result_lock;
+
+    uint32_t refs; //number of workers inside the job. Protected by Thread_Pool.lock
+    //If set the chunks may block waiting on each other (see task_graph.h) so the job is only
+    // picked up by idle workers and never by a thread helping while waiting for its own loop.
+    // Else the helping thread could end up waiting on itself.
+    bool no_helpers;
+} Thread_Pool_Job;
+
+typedef struct Thread_Pool {
+    Mutex lock;
+    Event_Count work;
+    CHAN_ATOMIC(uint32_t) is_closed;
+    CHAN_ATOMIC(uint32_t) threads_running;
+    isize thread_count;
+
+    //Protected by lock
+    isize job_count;
+    Thread_Pool_Job* jobs[THREAD_POOL_MAX_JOBS];
+} Thread_Pool;
+
+EXTERNAL Platform_Error thread_pool_init(Thread_Pool* pool, isize thread_count_or_negative); //if negative uses platform_thread_get_processor_count() - 1
+EXTERNAL void thread_pool_deinit(Thread_Pool* pool);
+EXTERNAL void thread_pool_for(Thread_Pool* pool, isize begin, isize end, isize grain_or_zero, Parallel_For_Func func, void* context);
+EXTERNAL void thread_pool_reduce(Thread_Pool* pool, isize begin, isize end, isize grain_or_zero, void* result, const void* identity, isize result_size, Parallel_Reduce_Func reduce, Parallel_Combine_Func combine, void* context);
+
+EXTERNAL Thread_Pool* thread_pool_global();
+EXTERNAL void parallel_for(isize begin, isize end, isize grain_or_zero, Parallel_For_Func func, void* context);
+EXTERNAL void parallel_reduce(isize begin, isize end, isize grain_or_zero, void* result, const void* identity, isize result_size, Parallel_Reduce_Func reduce, Parallel_Combine_Func combine, void* context);
+#endif
+
+#if (defined(MODULE_IMPL_ALL) || defined(MODULE_IMPL_THREAD_POOL)) && !defined(MODULE_HAS_IMPL_THREAD_POOL)
+#define MODULE_HAS_IMPL_THREAD_POOL
+
+//Finds the most recently posted job which still has chunks to give out and joins it.
+// Most recent first so that nested loops (which the older loops are waiting on) finish first.
+INTERNAL Thread_Pool_Job* _thread_pool_acquire(Thread_Pool* pool, bool helping)
+{
+    Thread_Pool_Job* out = NULL;
+    mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+    for(isize i = pool->job_count; i-- > 0; )
+    {
+        Thread_Pool_Job* job = pool->jobs[i];
+        if(atomic_load_explicit(&job->next_chunk, memory_order_relaxed) < job->chunk_count
+            && (helping == false || job->no_helpers == false))
+        {
+            job->refs += 1;
+            out = job;
+            break;
+        }
+    }
+    mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+    return out;
+}
+
+//The owner can only return once all workers left the job. It checks refs under the lock so
+// by the time it sees zero the wake below is also done and the job memory is no longer touched.
+INTERNAL void _thread_pool_release(Thread_Pool* pool, Thread_Pool_Job* job)
+{
+    mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+    ASSERT(job->refs > 0);
+    job->refs -= 1;
+    if(job->refs == 0)
+        chan_futex_wake_all(&job->refs);
+    mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+}
+
+//Runs chunks of the job until there are none left.
+INTERNAL void _thread_pool_run(Thread_Pool_Job* job)
+{
+    //Callers cast the partial result to their own type so it needs proper alignment
+    ATTRIBUTE_ALIGNED(THREAD_POOL_REDUCE_ALIGN) uint8_t partial[THREAD_POOL_MAX_REDUCE_SIZE];
+    bool has_partial = false;
+    for(;;)
+    {
+        isize chunk = atomic_fetch_add_explicit(&job->next_chunk, 1, memory_order_relaxed);
+        if(chunk >= job->chunk_count)
+            break;
+
+        isize from = job->begin + chunk*job->grain;
+        isize to = MIN(from + job->grain, job->end);
+        if(job->for_func)
+            job->for_func(from, to, job->context);
+        else
+        {
+            if(has_partial == false)
+                memcpy(partial, job->identity, (size_t) job->result_size);
+            has_partial = true;
+            job->reduce_func(from, to, partial, job->context);
+        }
+    }
+
+    if(has_partial)
+    {
+        mutex_lock(&job->result_lock, SYNC_WAIT_BLOCK);
+        job->combine_func(job->result, partial, job->context);
+        mutex_unlock(&job->result_lock, SYNC_WAIT_BLOCK);
+    }
+}
+
+INTERNAL void _thread_pool_worker(void* context)
+{
+    Thread_Pool* pool = (Thread_Pool*) context;
+    while(atomic_load_explicit(&pool->is_closed, memory_order_relaxed) == false)
+    {
+        Thread_Pool_Job* job = _thread_pool_acquire(pool, false);
+        if(job == NULL)
+        {
+            uint32_t key = eventcount_prepare_wait(&pool->work);
+            job = _thread_pool_acquire(pool, false);
+            if(job == NULL)
+            {
+                if(atomic_load_explicit(&pool->is_closed, memory_order_relaxed))
+                    eventcount_cancel_wait(&pool->work);
+                else
+                    eventcount_commit_wait(&pool->work, key, SYNC_WAIT_BLOCK);
+                continue;
+            }
+            eventcount_cancel_wait(&pool->work);
+        }
+
+        _thread_pool_run(job);
+        _thread_pool_release(pool, job);
+    }
+
+    atomic_fetch_sub(&pool->threads_running, 1);
+    chan_futex_wake_all((uint32_t*) &pool->threads_running);
+}
+
+EXTERNAL Platform_Error thread_pool_init(Thread_Pool* pool, isize thread_count_or_negative)
+{
+    memset(pool, 0, sizeof *pool);
+    isize thread_count = thread_count_or_negative;
+    if(thread_count < 0)
+        thread_count = MAX(platform_thread_get_processor_count() - 1, 0);
+
+    Platform_Error error = 0;
+    for(isize i = 0; i < thread_count; i++)
+    {
+        atomic_fetch_add(&pool->threads_running, 1);
+        error = platform_thread_launch(0, _thread_pool_worker, pool, "thread pool worker %i", (int) i);
+        if(error)
+        {
+            atomic_fetch_sub(&pool->threads_running, 1);
+            break;
+        }
+        pool->thread_count += 1;
+    }
+
+    if(error)
+        thread_pool_deinit(pool);
+    return error;
+}
+
+EXTERNAL void thread_pool_deinit(Thread_Pool* pool)
+{
+    atomic_store(&pool->is_closed, 1);
+    eventcount_notify_all(&pool->work, SYNC_WAIT_BLOCK);
+    for(;;) {
+        uint32_t running = atomic_load(&pool->threads_running);
+        if(running == 0)
+            break;
+        chan_futex_wait((uint32_t*) &pool->threads_running, running, -1);
+    }
+
+    ASSERT(pool->job_count == 0, "thread_pool_deinit with loops still running");
+    memset(pool, 0, sizeof *pool);
+}
+
+INTERNAL void _thread_pool_execute(Thread_Pool* pool, Thread_Pool_Job* job)
+{
+    isize count = job->end - job->begin;
+    if(count <= 0)
+        return;
+
+    if(job->grain <= 0)
+        job->grain = MAX(count / ((pool->thread_count + 1)*THREAD_POOL_CHUNKS_PER_THREAD), 1);
+    job->chunk_count = DIV_CEIL(count, job->grain);
+
+    //Post the job if there is anyone to help and space in the list. Else just run it here.
+    bool posted = false;
+    if(job->chunk_count > 1 && pool->thread_count > 0)
+    {
+        mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+        if(pool->job_count < THREAD_POOL_MAX_JOBS)
+        {
+            pool->jobs[pool->job_count++] = job;
+            posted = true;
+        }
+        mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+    }
+
+    if(posted)
+        eventcount_notify_all(&pool->work, SYNC_WAIT_BLOCK);
+
+    _thread_pool_run(job);
+    if(posted == false)
+        return;
+
+    //All chunks are given out. Remove the job so that nobody new joins it.
+    mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+    for(isize i = 0; i < pool->job_count; i++)
+        if(pool->jobs[i] == job)
+        {
+            memmove(pool->jobs + i, pool->jobs + i + 1, (size_t) (pool->job_count - i - 1)*sizeof(pool->jobs[0]));
+            pool->job_count -= 1;
+            break;
+        }
+    mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+
+    //Help with other jobs while waiting for the workers still inside ours.
+    for(;;)
+    {
+        mutex_lock(&pool->lock, SYNC_WAIT_BLOCK);
+        uint32_t refs = job->refs;
+        mutex_unlock(&pool->lock, SYNC_WAIT_BLOCK);
+        if(refs == 0)
+            break;
+
+        Thread_Pool_Job* other = _thread_pool_acquire(pool, true);
+        if(other)
+        {
+            _thread_pool_run(other);
+            _thread_pool_release(pool, other);
+        }
+        else
+            chan_futex_wait(&job->refs, refs, -1);
+    }
+}
+
+EXTERNAL void thread_pool_for(Thread_Pool* pool, isize begin, isize end, isize grain_or_zero, Parallel_For_Func func, void* context)
+{
+    Thread_Pool_Job job = {0};
+    job.begin = begin;
+    job.end = end;
+    job.grain = grain_or_zero;
+    job.for_func = func;
+    job.context = context;
+    _thread_pool_execute(pool, &job);
+}
+
+EXTERNAL void thread_pool_reduce(Thread_Pool* pool, isize begin, isize end, isize grain_or_zero, void* result, const void* identity, isize result_size, Parallel_Reduce_Func reduce, Parallel_Combine_Func combine, void* context)
+{
+    REQUIRE(0 <= result_size && result_size <= THREAD_POOL_MAX_REDUCE_SIZE);
+    memcpy(result, identity, (size_t) result_size);
+
+    Thread_Pool_Job job = {0};
+    job.begin = begin;
+    job.end = end;
+    job.grain = grain_or_zero;
+    job.reduce_func = reduce;
+    job.combine_func = combine;
+    job.context = context;
+    job.result = result;
+    job.identity = identity;
+    job.result_size = result_size;
+    _thread_pool_execute(pool, &job);
+}
+
+INTERNAL void _thread_pool_global_init(void* context)
+{
+    //If launching the workers fails everything simply runs on the calling thread
+    thread_pool_init((Thread_Pool*) context, -1);
+}
+
+EXTERNAL Thread_Pool* thread_pool_global()
+{
+    static Thread_Pool pool = {0};
+    static Sync_Once once = 0;
+    sync_once(&once, _thread_pool_global_init, &pool, SYNC_WAIT_BLOCK);
+    return &pool;
+}
+
+EXTERNAL void parallel_for(isize begin, isize end, isize grain_or_zero, Parallel_For_Func func, void* context)
+{
+    thread_pool_for(thread_pool_global(), begin, end, grain_or_zero, func, context);
+}
+
+EXTERNAL void parallel_reduce(isize begin, isize end, isize grain_or_zero, void* result, const void* identity, isize result_size, Parallel_Reduce_Func reduce, Parallel_Combine_Func combine, void* context)
+{
+    thread_pool_reduce(thread_pool_global(), begin, end, grain_or_zero, result, identity, result_size, reduce, combine, context);
+}
+#endif